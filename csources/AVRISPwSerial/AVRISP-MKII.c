@@ -46,14 +46,15 @@ EVENT_AVRISP_Device_ConfigurationChanged (void)
   /* Setup AVRISP Data OUT endpoint */
   ConfigSuccess &= Endpoint_ConfigureEndpoint (AVRISP_DATA_OUT_EPADDR,
                                                EP_TYPE_BULK, AVRISP_DATA_EPSIZE,
-                                               1);
+                                               AVRISP_DATA_EPBANKS);
 
   /* Setup AVRISP Data IN endpoint if it is using a physically different endpoint */
   if ((AVRISP_DATA_IN_EPADDR & ENDPOINT_EPNUM_MASK)
       != (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK))
     ConfigSuccess &= Endpoint_ConfigureEndpoint (AVRISP_DATA_IN_EPADDR,
                                                  EP_TYPE_BULK,
-                                                 AVRISP_DATA_EPSIZE, 1);
+                                                 AVRISP_DATA_EPSIZE,
+                                                 AVRISP_DATA_EPBANKS);
 
   /* Indicate endpoint configuration success or failure */
   return ConfigSuccess;
@@ -76,11 +77,28 @@ AVRISP_Task (void)
     {
       LEDs_SetAllLEDs (LEDMASK_BUSY);
 
+#ifdef SERIAL_ENABLE
+      /* Keep the serial bridge running from the USB frame interrupt while the command blocks the main loop */
+      Serial_SetBackgroundTask (true);
+#endif
+
       /* Pass off processing of the V2 Protocol command to the V2 Protocol handler */
       V2Protocol_ProcessCommand ();
 
+#ifdef SERIAL_ENABLE
+      Serial_SetBackgroundTask (false);
+#endif
+
       LEDs_SetAllLEDs (LEDMASK_USB_READY);
     }
+  else
+    {
+      /* Settings are only written back to EEPROM while no command is pending, so that a command is never held up */
+#if defined(ENABLE_HEALTH_COUNTERS)
+      Health_Task ();
+#endif
+      V2Params_WriteBackNonVolatileParamValues ();
+    }
 }
 
 
@@ -54,6 +54,9 @@
 #include "Lib/V2Protocol.h"
 #include "Config/AppConfig.h"
 
+#if defined(SERIAL_ENABLE)
+#include "USBtoSerial.h"
+#endif
 
 /* Function Prototypes: */
 void
@@ -64,10 +67,5 @@ AVRISP_Task (void);
 bool
 EVENT_AVRISP_Device_ConfigurationChanged (void);
 
-uint16_t
-CALLBACK_USB_GetDescriptor (const uint16_t wValue, const uint16_t wIndex,
-                            const void** const DescriptorAddress)
-ATTR_WARN_UNUSED_RESULT ATTR_NON_NULL_PTR_ARG (3);
-
 #endif
 
@@ -100,6 +100,12 @@ extern "C"
 
 #define LEDMASK_TX                (LEDS_TX | LEDS_ACT)
 
+/** LED mask for the library LED driver, to indicate that a standalone programming run passed. */
+#define LEDMASK_STANDALONE_PASS  (LEDS_RDY | LEDS_RX | LEDS_TX)
+
+/** LED mask for the library LED driver, to indicate that a standalone programming run failed. */
+#define LEDMASK_STANDALONE_FAIL   LEDS_ERR
+
 #define PORTF_MASK                (LEDS_NOT_RDY | LEDS_RDY | LEDS_ERR | LEDS_ACT)
 
 #define PORTB_MASK                (LEDS_RX | LEDS_TX)
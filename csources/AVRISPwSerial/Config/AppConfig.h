@@ -50,6 +50,22 @@
 
 #define ENABLE_ISP_PROTOCOL
 #define ENABLE_XPROG_PROTOCOL
+#define ENABLE_STANDALONE_MODE
+#define ENABLE_COMMAND_BATCH
+#define ENABLE_STACK_MONITOR
+#define ENABLE_PROTOCOL_TRACE
+#define ENABLE_HEALTH_COUNTERS
+//	#define ENABLE_LATENCY_PROFILE
+
+//	#define PROFILER_GPIO_PORT         PORTD
+//	#define PROFILER_GPIO_PIN          PIND
+//	#define PROFILER_GPIO_DDR          DDRD
+//	#define PROFILER_GPIO_MASK         (1 << 6)
+
+//	#define STANDALONE_BUTTON_PORT     PORTD
+//	#define STANDALONE_BUTTON_PIN      PIND
+//	#define STANDALONE_BUTTON_DDR      DDRD
+//	#define STANDALONE_BUTTON_MASK     (1 << 7)
 
 //#define VTARGET_ADC_CHANNEL        2
 //#define VTARGET_REF_VOLTS          5
@@ -41,8 +41,13 @@
  *  device characteristics, including the supported USB version, control endpoint size and the
  *  number of device configurations. The descriptor is read out by the USB host when the enumeration
  *  process begins.
+ *
+ *  The composite layout keeps the AVRISP mkII VID/PID, so Windows names its functions by interface
+ *  (\c &MI_00 for AVRISP, \c &MI_01 for the serial bridge). The signed AVRISP_mkII.inf in WindowsDriver only
+ *  matches the bare ID of builds without the bridge; the composite functions are bound by the unsigned
+ *  AVRISP_mkII_Composite.inf and AVRISP_mkII_Serial.inf.
  */
-const USB_Descriptor_Device_t PROGMEM AVRISP_DeviceDescriptor =
+const USB_Descriptor_Device_t PROGMEM DeviceDescriptor =
   {
     .Header =
       {
@@ -51,6 +56,11 @@ const USB_Descriptor_Device_t PROGMEM AVRISP_DeviceDescriptor =
       },
 
     .USBSpecification = VERSION_BCD(1, 1, 0),
+#if defined(SERIAL_ENABLE)
+    .Class = USB_CSCP_IADDeviceClass,
+    .SubClass = USB_CSCP_IADDeviceSubclass,
+    .Protocol = USB_CSCP_IADDeviceProtocol,
+#endif
 
     .Endpoint0Size = FIXED_CONTROL_ENDPOINT_SIZE,
 
@@ -70,7 +80,7 @@ const USB_Descriptor_Device_t PROGMEM AVRISP_DeviceDescriptor =
  *  and endpoints. The descriptor is read out by the USB host during the enumeration process when selecting
  *  a configuration so that the host may correctly communicate with the USB device.
  */
-const AVRISP_USB_Descriptor_Configuration_t PROGMEM AVRISP_ConfigurationDescriptor =
+const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
   {
     .Config =
       {
@@ -80,8 +90,12 @@ const AVRISP_USB_Descriptor_Configuration_t PROGMEM AVRISP_ConfigurationDescript
             .Type = DTYPE_Configuration
           },
 
-        .TotalConfigurationSize = sizeof(AVRISP_USB_Descriptor_Configuration_t),
+        .TotalConfigurationSize = sizeof(USB_Descriptor_Configuration_t),
+#if defined(SERIAL_ENABLE)
+        .TotalInterfaces = 3,
+#else
         .TotalInterfaces = 1,
+#endif
 
         .ConfigurationNumber = 1,
         .ConfigurationStrIndex = NO_DESCRIPTOR,
@@ -139,63 +153,23 @@ const AVRISP_USB_Descriptor_Configuration_t PROGMEM AVRISP_ConfigurationDescript
         .PollingIntervalMS = 0x0A
       },
 
-  };
-
-/** Device descriptor structure. This descriptor, located in FLASH memory, describes the overall
- *  device characteristics, including the supported USB version, control endpoint size and the
- *  number of device configurations. The descriptor is read out by the USB host when the enumeration
- *  process begins.
- */
-const USB_Descriptor_Device_t PROGMEM Serial_DeviceDescriptor =
-  {
-    .Header =
-      {
-        .Size = sizeof(USB_Descriptor_Device_t),
-        .Type = DTYPE_Device
-      },
-
-    .USBSpecification = VERSION_BCD(1, 1, 0),
-    .Class = CDC_CSCP_CDCClass,
-    .SubClass = CDC_CSCP_NoSpecificSubclass,
-    .Protocol = CDC_CSCP_NoSpecificProtocol,
-
-    .Endpoint0Size = FIXED_CONTROL_ENDPOINT_SIZE,
-
-    .VendorID = 0x03EB,
-    .ProductID = 0x204B,
-    .ReleaseNumber = VERSION_BCD(0, 0, 1),
-
-    .ManufacturerStrIndex = STRING_ID_Manufacturer,
-    .ProductStrIndex = STRING_ID_Product,
-    .SerialNumStrIndex = USE_INTERNAL_SERIAL,
-
-    .NumberOfConfigurations = FIXED_NUM_CONFIGURATIONS
-  };
-
-/** Configuration descriptor structure. This descriptor, located in FLASH memory, describes the usage
- *  of the device in one of its supported configurations, including information about any device interfaces
- *  and endpoints. The descriptor is read out by the USB host during the enumeration process when selecting
- *  a configuration so that the host may correctly communicate with the USB device.
- */
-const Serial_USB_Descriptor_Configuration_t PROGMEM Serial_ConfigurationDescriptor =
-  {
-    .Config =
+#if defined(SERIAL_ENABLE)
+    .CDC_IAD =
       {
         .Header =
           {
-            .Size = sizeof(USB_Descriptor_Configuration_Header_t),
-            .Type = DTYPE_Configuration
+            .Size = sizeof(USB_Descriptor_Interface_Association_t),
+            .Type = DTYPE_InterfaceAssociation
           },
 
-        .TotalConfigurationSize = sizeof(Serial_USB_Descriptor_Configuration_t),
+        .FirstInterfaceIndex = INTERFACE_ID_CDC_CCI,
         .TotalInterfaces = 2,
 
-        .ConfigurationNumber = 1,
-        .ConfigurationStrIndex = NO_DESCRIPTOR,
-
-        .ConfigAttributes = (USB_CONFIG_ATTR_RESERVED | USB_CONFIG_ATTR_SELFPOWERED),
+        .Class = CDC_CSCP_CDCClass,
+        .SubClass = CDC_CSCP_ACMSubclass,
+        .Protocol = CDC_CSCP_ATCommandProtocol,
 
-        .MaxPowerConsumption = USB_CONFIG_POWER_MA(100)
+        .IADStrIndex = STRING_ID_Console
       },
 
     .CDC_CCI_Interface =
@@ -215,7 +189,7 @@ const Serial_USB_Descriptor_Configuration_t PROGMEM Serial_ConfigurationDescript
         .SubClass = CDC_CSCP_ACMSubclass,
         .Protocol = CDC_CSCP_ATCommandProtocol,
 
-        .InterfaceStrIndex = NO_DESCRIPTOR
+        .InterfaceStrIndex = STRING_ID_Console
       },
 
     .CDC_Functional_Header =
@@ -316,51 +290,39 @@ const Serial_USB_Descriptor_Configuration_t PROGMEM Serial_ConfigurationDescript
         .EndpointSize = CDC_TXRX_EPSIZE,
         .PollingIntervalMS = 0x05
       }
+#endif
   };
 
 /** Language descriptor structure. This descriptor, located in FLASH memory, is returned when the host requests
  *  the string descriptor with index 0 (the first index). It is actually an array of 16-bit integers, which indicate
  *  via the language ID table available at USB.org what languages the device supports for its string descriptors.
  */
-const USB_Descriptor_String_t PROGMEM AVRISP_LanguageString = USB_STRING_DESCRIPTOR_ARRAY(LANGUAGE_ID_ENG);
+const USB_Descriptor_String_t PROGMEM LanguageString = USB_STRING_DESCRIPTOR_ARRAY(LANGUAGE_ID_ENG);
 
 /** Manufacturer descriptor string. This is a Unicode string containing the manufacturer's details in human readable
  *  form, and is read out upon request by the host when the appropriate string ID is requested, listed in the Device
  *  Descriptor.
  */
-const USB_Descriptor_String_t PROGMEM AVRISP_ManufacturerString = USB_STRING_DESCRIPTOR(L"ATMEL");
+const USB_Descriptor_String_t PROGMEM ManufacturerString = USB_STRING_DESCRIPTOR(L"ATMEL");
 
 /** Product descriptor string. This is a Unicode string containing the product's details in human readable form,
  *  and is read out upon request by the host when the appropriate string ID is requested, listed in the Device
  *  Descriptor.
  */
-const USB_Descriptor_String_t PROGMEM AVRISP_ProductString = USB_STRING_DESCRIPTOR(L"AVRISP mkII");
+const USB_Descriptor_String_t PROGMEM ProductString = USB_STRING_DESCRIPTOR(L"AVRISP mkII");
 
 /** Serial number string. This is a Unicode string containing the device's unique serial number, expressed as a
  *  series of uppercase hexadecimal digits.
  */
-const USB_Descriptor_String_t PROGMEM AVRISP_SerialString = USB_STRING_DESCRIPTOR(L"000200012345\0");
+const USB_Descriptor_String_t PROGMEM SerialString = USB_STRING_DESCRIPTOR(L"000200012345\0");
     // Note: Real AVRISP-MKII has the embedded NUL byte, bug in firmware?
 
-
-/** Language descriptor structure. This descriptor, located in FLASH memory, is returned when the host requests
- *  the string descriptor with index 0 (the first index). It is actually an array of 16-bit integers, which indicate
- *  via the language ID table available at USB.org what languages the device supports for its string descriptors.
- */
-const USB_Descriptor_String_t PROGMEM Serial_LanguageString = USB_STRING_DESCRIPTOR_ARRAY(LANGUAGE_ID_ENG);
-
-/** Manufacturer descriptor string. This is a Unicode string containing the manufacturer's details in human readable
- *  form, and is read out upon request by the host when the appropriate string ID is requested, listed in the Device
- *  Descriptor.
+#if defined(SERIAL_ENABLE)
+/** Serial bridge interface descriptor string. This is a Unicode string naming the CDC function of the composite
+ *  device, so that its serial port can be told apart from other adapters on the host.
  */
-const USB_Descriptor_String_t PROGMEM Serial_ManufacturerString = USB_STRING_DESCRIPTOR(L"LUFA Library");
-
-/** Product descriptor string. This is a Unicode string containing the product's details in human readable form,
- *  and is read out upon request by the host when the appropriate string ID is requested, listed in the Device
- *  Descriptor.
- */
-const USB_Descriptor_String_t PROGMEM Serial_ProductString = USB_STRING_DESCRIPTOR(L"LUFA USB-RS232 Adapter");
-
+const USB_Descriptor_String_t PROGMEM ConsoleString = USB_STRING_DESCRIPTOR(L"AVRISP mkII Target Console");
+#endif
 
 /** This function is called by the library when in device mode, and must be overridden (see library "USB Descriptors"
  *  documentation) by the application code so that the address and size of a requested descriptor can be given
@@ -369,7 +331,8 @@ const USB_Descriptor_String_t PROGMEM Serial_ProductString = USB_STRING_DESCRIPT
  *  USB host.
  */
 uint16_t
-AVRISP_GetDescriptor (const uint16_t wValue, const uint16_t wIndex, const void** const DescriptorAddress)
+CALLBACK_USB_GetDescriptor (const uint16_t wValue, const uint16_t wIndex,
+                            const void** const DescriptorAddress)
 {
   const uint8_t DescriptorType = (wValue >> 8);
   const uint8_t DescriptorNumber = (wValue & 0xFF);
@@ -380,81 +343,38 @@ AVRISP_GetDescriptor (const uint16_t wValue, const uint16_t wIndex, const void**
   switch (DescriptorType)
     {
     case DTYPE_Device:
-      Address = &AVRISP_DeviceDescriptor;
+      Address = &DeviceDescriptor;
       Size = sizeof(USB_Descriptor_Device_t);
       break;
     case DTYPE_Configuration:
-      Address = &AVRISP_ConfigurationDescriptor;
-      Size = sizeof(AVRISP_USB_Descriptor_Configuration_t);
+      Address = &ConfigurationDescriptor;
+      Size = sizeof(USB_Descriptor_Configuration_t);
       break;
     case DTYPE_String:
       switch (DescriptorNumber)
         {
         case STRING_ID_Language:
-          Address = &AVRISP_LanguageString;
-          Size = pgm_read_byte(&AVRISP_LanguageString.Header.Size);
+          Address = &LanguageString;
+          Size = pgm_read_byte(&LanguageString.Header.Size);
           break;
         case STRING_ID_Manufacturer:
-          Address = &AVRISP_ManufacturerString;
-          Size = pgm_read_byte(&AVRISP_ManufacturerString.Header.Size);
+          Address = &ManufacturerString;
+          Size = pgm_read_byte(&ManufacturerString.Header.Size);
           break;
         case STRING_ID_Product:
-          Address = &AVRISP_ProductString;
-          Size = pgm_read_byte(&AVRISP_ProductString.Header.Size);
+          Address = &ProductString;
+          Size = pgm_read_byte(&ProductString.Header.Size);
           break;
         case STRING_ID_Serial:
-          Address = &AVRISP_SerialString;
-          Size = AVRISP_SerialString.Header.Size;
+          Address = &SerialString;
+          Size = SerialString.Header.Size;
           break;
-        }
-
-      break;
-    }
-
-  *DescriptorAddress = Address;
-  return Size;
-}
-
-/** This function is called by the library when in device mode, and must be overridden (see library "USB Descriptors"
- *  documentation) by the application code so that the address and size of a requested descriptor can be given
- *  to the USB library. When the device receives a Get Descriptor request on the control endpoint, this function
- *  is called so that the descriptor details can be passed back and the appropriate descriptor sent back to the
- *  USB host.
- */
-uint16_t
-Serial_GetDescriptor (const uint16_t wValue, const uint16_t wIndex, const void** const DescriptorAddress)
-{
-  const uint8_t DescriptorType = (wValue >> 8);
-  const uint8_t DescriptorNumber = (wValue & 0xFF);
-
-  const void* Address = NULL;
-  uint16_t Size = NO_DESCRIPTOR;
-
-  switch (DescriptorType)
-    {
-    case DTYPE_Device:
-      Address = &Serial_DeviceDescriptor;
-      Size = sizeof(USB_Descriptor_Device_t);
-      break;
-    case DTYPE_Configuration:
-      Address = &Serial_ConfigurationDescriptor;
-      Size = sizeof(Serial_USB_Descriptor_Configuration_t);
-      break;
-    case DTYPE_String:
-      switch (DescriptorNumber)
-        {
-        case STRING_ID_Language:
-          Address = &Serial_LanguageString;
-          Size = pgm_read_byte(&Serial_LanguageString.Header.Size);
-          break;
-        case STRING_ID_Manufacturer:
-          Address = &Serial_ManufacturerString;
-          Size = pgm_read_byte(&Serial_ManufacturerString.Header.Size);
-          break;
-        case STRING_ID_Product:
-          Address = &Serial_ProductString;
-          Size = pgm_read_byte(&Serial_ProductString.Header.Size);
+#if defined(SERIAL_ENABLE)
+        case STRING_ID_Console:
+          Address = &ConsoleString;
+          Size = pgm_read_byte(&ConsoleString.Header.Size);
           break;
+#endif
         }
 
       break;
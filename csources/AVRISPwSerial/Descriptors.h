@@ -54,10 +54,34 @@
 /** Size in bytes of the AVRISP data endpoint. */
 #define AVRISP_DATA_EPSIZE             64
 
+/** Number of hardware banks of the AVRISP data endpoint. With two banks the USB controller
+ *  transfers one packet to or from the host while the firmware fills or drains the other.
+ */
+#define AVRISP_DATA_EPBANKS            2
+
+/** Endpoint address of the CDC device-to-host data IN endpoint. */
+#define CDC_TX_EPADDR                  (ENDPOINT_DIR_IN  | 3)
+
+/** Endpoint address of the CDC host-to-device data OUT endpoint. */
+#define CDC_RX_EPADDR                  (ENDPOINT_DIR_OUT | 4)
+
+/** Endpoint address of the CDC device-to-host notification IN endpoint. */
+#define CDC_NOTIFICATION_EPADDR        (ENDPOINT_DIR_IN  | 5)
+
+/** Size in bytes of the CDC device-to-host notification IN endpoint. */
+#define CDC_NOTIFICATION_EPSIZE        8
+
+/** Size in bytes of the CDC data IN and OUT endpoints. */
+#define CDC_TXRX_EPSIZE                16
+
 /* Type Defines: */
 /** Type define for the device configuration descriptor structure. This must be defined in the
  *  application code, as the configuration descriptor contains several sub-descriptors which
  *  vary between devices, and which describe the device's usage to the host.
+ *
+ *  When the serial bridge is enabled the device is a composite of the AVRISP interface and a CDC
+ *  function, so that the target can be programmed and its console watched without re-enumeration.
+ *  The AVRISP interface stays first and keeps endpoint 2, which is where the host software looks for it.
  */
 typedef struct
 {
@@ -68,15 +92,9 @@ typedef struct
   USB_Descriptor_Endpoint_t AVRISP_DataInEndpoint;
   USB_Descriptor_Endpoint_t AVRISP_DataOutEndpoint;
 
-} AVRISP_USB_Descriptor_Configuration_t;
-
-/** Type define for the device configuration descriptor structure. This must be defined in the
- *  application code, as the configuration descriptor contains several sub-descriptors which
- *  vary between devices, and which describe the device's usage to the host.
- */
-typedef struct
-{
-  USB_Descriptor_Configuration_Header_t Config;
+#if defined(SERIAL_ENABLE)
+  // CDC Interface Association
+  USB_Descriptor_Interface_Association_t CDC_IAD;
 
   // CDC Command Interface
   USB_Descriptor_Interface_t CDC_CCI_Interface;
@@ -89,63 +107,38 @@ typedef struct
   USB_Descriptor_Interface_t CDC_DCI_Interface;
   USB_Descriptor_Endpoint_t CDC_DataOutEndpoint;
   USB_Descriptor_Endpoint_t CDC_DataInEndpoint;
+#endif
 
-} Serial_USB_Descriptor_Configuration_t;
+} USB_Descriptor_Configuration_t;
 
 /** Enum for the device interface descriptor IDs within the device. Each interface descriptor
  *  should have a unique ID index associated with it, which can be used to refer to the
  *  interface from other descriptors.
  */
-enum AVRISP_InterfaceDescriptors_t
+enum InterfaceDescriptors_t
 {
   INTERFACE_ID_AVRISP = 0, /**< AVRISP interface descriptor ID */
-};
-
-enum Serial_InterfaceDescriptors_t
-{
-  INTERFACE_ID_CDC_CCI = 0, /**< CDC CCI interface descriptor ID */
-  INTERFACE_ID_CDC_DCI = 1, /**< CDC DCI interface descriptor ID */
+  INTERFACE_ID_CDC_CCI = 1, /**< CDC CCI interface descriptor ID */
+  INTERFACE_ID_CDC_DCI = 2, /**< CDC DCI interface descriptor ID */
 };
 
 /** Enum for the device string descriptor IDs within the device. Each string descriptor should
  *  have a unique ID index associated with it, which can be used to refer to the string from
  *  other descriptors.
  */
-enum AVRISP_StringDescriptors_t
+enum StringDescriptors_t
 {
   STRING_ID_Language = 0, /**< Supported Languages string descriptor ID (must be zero) */
   STRING_ID_Manufacturer = 1, /**< Manufacturer string ID */
   STRING_ID_Product = 2, /**< Product string ID */
   STRING_ID_Serial = 3, /**< Serial number string ID */
+  STRING_ID_Console = 4, /**< Serial bridge interface string ID */
 };
 
-
-/** Endpoint address of the CDC device-to-host notification IN endpoint. */
-#define CDC_NOTIFICATION_EPADDR        (ENDPOINT_DIR_IN  | 2)
-
-/** Endpoint address of the CDC device-to-host data IN endpoint. */
-#define CDC_TX_EPADDR                  (ENDPOINT_DIR_IN  | 3)
-
-/** Endpoint address of the CDC host-to-device data OUT endpoint. */
-#define CDC_RX_EPADDR                  (ENDPOINT_DIR_OUT | 4)
-
-/** Size in bytes of the CDC device-to-host notification IN endpoint. */
-#define CDC_NOTIFICATION_EPSIZE        8
-
-/** Size in bytes of the CDC data IN and OUT endpoints. */
-#define CDC_TXRX_EPSIZE                16
-
-
-
-
-uint16_t
-AVRISP_GetDescriptor (const uint16_t wValue, const uint16_t wIndex,
-                      const void** const DescriptorAddress)
-ATTR_WARN_UNUSED_RESULT ATTR_NON_NULL_PTR_ARG (3);
-
+/* Function Prototypes: */
 uint16_t
-Serial_GetDescriptor (const uint16_t wValue, const uint16_t wIndex,
-                      const void** const DescriptorAddress)
+CALLBACK_USB_GetDescriptor (const uint16_t wValue, const uint16_t wIndex,
+                            const void** const DescriptorAddress)
 ATTR_WARN_UNUSED_RESULT ATTR_NON_NULL_PTR_ARG (3);
 
 #endif
@@ -0,0 +1,1881 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Host-native throughput benchmark of the AVRISP firmware. The unmodified V2 protocol handlers are driven with
+ *  the command sequences avrdude issues for a full program-and-verify cycle, against simulated USB, SPI/USART
+ *  and target models, and the simulated time and bus activity of every command is reported. The process exits
+ *  with a non-zero status if any read-back or target protocol check fails, so it can be used as a regression gate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Lib/V2Protocol.h"
+
+#include "HostClock.h"
+#include "HostIO.h"
+#include "HostTarget.h"
+#include "HostUSB.h"
+
+/** Time taken by the host to start the next command after receiving a response, in microseconds. */
+#define BENCHMARK_HOST_TURNAROUND_US    500
+
+/** SCK duration parameter used for ISP programming, selecting a 2MHz hardware SPI clock. */
+#define BENCHMARK_ISP_SCK_DURATION      1
+
+/** SCK duration parameter selecting the fastest, 8MHz, hardware SPI clock. */
+#define BENCHMARK_ISP_FAST_SCK_DURATION 0
+
+/** SCK duration parameter selecting the slowest, 125KHz, hardware SPI clock, safe for a target running at 1MHz. */
+#define BENCHMARK_ISP_SLOW_SCK_DURATION 6
+
+/** \name Completion checks the host asks for on ISP writes and chip erase, as avrdude does for different devices. */
+//@{
+#define BENCHMARK_COMPLETION_READYBUSY  0 /**< RDY/BSY polling everywhere */
+#define BENCHMARK_COMPLETION_TIMED      1 /**< Fixed delays everywhere */
+#define BENCHMARK_COMPLETION_VALUE      2 /**< Value polling of writes, with a fixed chip erase delay */
+//@}
+
+/** Image bytes uploaded by each standalone image write command, so that every command fills exactly one packet. */
+#define BENCHMARK_STANDALONE_BLOCK_SIZE (AVRISP_DATA_EPSIZE - 5)
+
+/** Length of the flash segments of a standalone image, one at the bottom of flash and one at the top. */
+#define BENCHMARK_STANDALONE_APP_SIZE   320
+#define BENCHMARK_STANDALONE_BOOT_SIZE  128
+
+/** Address and length of the EEPROM segment of a standalone image, which starts part way into a page. */
+#define BENCHMARK_STANDALONE_EE_ADDRESS 0x22
+#define BENCHMARK_STANDALONE_EE_SIZE    64
+
+/** Largest block of memory read or written by a single command. */
+#define BENCHMARK_BLOCK_SIZE            256
+
+/** Size of the XPROG memory read blocks of the scenarios reading large blocks, taken from the firmware's buffer arena. */
+#define BENCHMARK_LARGE_BLOCK_SIZE      512
+
+/** Size of the bootloader at the top of a sparse flash image, in bytes. */
+#define BENCHMARK_SPARSE_BOOT_SIZE      8192
+
+/** Number of command statistics slots, one per V2 command plus one per XPROG sub-command. */
+#define BENCHMARK_COMMAND_KEYS          0x110
+
+/** Time between passes of the idle main loop writing back the non-volatile parameters, in microseconds. */
+#define BENCHMARK_IDLE_PASS_US          100
+
+/** Longest a pass of the idle main loop may take writing back the non-volatile parameters, in microseconds, short
+ *  enough for the serial bridge to keep up at 115200 baud. */
+#define BENCHMARK_IDLE_PASS_LIMIT_US    500
+
+/** Simulated time the firmware may spend on one command before the benchmark gives up on it, in cycles. */
+#define BENCHMARK_COMMAND_LIMIT         HOSTCLOCK_US_TO_CYCLES(10000000UL)
+
+/** Per-command statistics of a benchmark scenario. */
+typedef struct
+{
+  uint32_t Count;
+  uint64_t Cycles;
+  uint64_t BytesOut;
+  uint64_t BytesIn;
+} Benchmark_CommandStats_t;
+
+/** Description of a benchmark scenario. */
+typedef struct
+{
+  const char* Name;
+  const HostTarget_Profile_t* Profile;
+  bool Pipelined; /**< Enables the vendor pipelined ISP page programming extension */
+  bool Streamed; /**< Reads ISP memories back with the vendor streaming read commands */
+  bool CRCVerify; /**< Verifies memories with the vendor CRC commands instead of reading them back */
+  bool Sparse; /**< Programs a flash image of an application at the bottom and a bootloader at the top only */
+  bool SkipBlank; /**< Enables the vendor blank FLASH block elision extension */
+  bool EEPROMUpdate; /**< Reprograms the EEPROM with a slightly changed image after programming it */
+  bool SkipUnchanged; /**< Enables the vendor unchanged EEPROM byte skipping extension */
+  bool USARTSPI; /**< Carries the ISP protocol over USART1 in Master SPI mode instead of the SPI module */
+  bool FastSCK; /**< Runs the ISP protocol at the fastest SCK clock instead of the default one */
+  bool SlowSCK; /**< Runs the ISP protocol at the slowest hardware SCK clock instead of the default one */
+  bool AutoTune; /**< Enables the vendor SCK auto-tuning extension */
+  uint8_t CompletionMode; /**< Completion check the host asks for, a \c BENCHMARK_COMPLETION_* value */
+  bool AdaptiveWait; /**< Enables the vendor adaptive completion detection extension */
+  bool Standalone; /**< Uploads a standalone image and has the programmer program the target from it on its own */
+  bool Batched; /**< Sends the session setup commands in one vendor command batch */
+  bool Sequenced; /**< Reads the flash back and programs the EEPROM with vendor ISP micro-sequences */
+  bool StreamProgram; /**< Programs ISP memories with the vendor streaming program commands */
+  bool LargeBlocks; /**< Reads XPROG memories back in blocks larger than a page */
+  uint8_t Timeouts; /**< Only runs commands timing out against a target never completing a write, this many */
+  bool SingleBank; /**< Configures the AVRISP data endpoint with one bank instead of \ref AVRISP_DATA_EPBANKS */
+} Benchmark_Scenario_t;
+
+static const Benchmark_Scenario_t Benchmark_Scenarios[] =
+  {
+    { .Name = "isp-m328p", .Profile = &HostTarget_ATmega328P },
+    { .Name = "isp-m328p-pipelined", .Profile = &HostTarget_ATmega328P, .Pipelined = true },
+    { .Name = "isp-m328p-eeupdate", .Profile = &HostTarget_ATmega328P, .EEPROMUpdate = true },
+    { .Name = "isp-m328p-eeupdate-skip", .Profile = &HostTarget_ATmega328P, .EEPROMUpdate = true,
+      .SkipUnchanged = true },
+    { .Name = "isp-m328p-1mhz", .Profile = &HostTarget_ATmega328P_1MHz, .SlowSCK = true },
+    { .Name = "isp-m328p-1mhz-autotune", .Profile = &HostTarget_ATmega328P_1MHz, .SlowSCK = true,
+      .AutoTune = true },
+    /* Runs after the scenario above, and so starts from the SCK speed it cached when the whole list is run */
+    { .Name = "isp-m328p-1mhz-autotune-cached", .Profile = &HostTarget_ATmega328P_1MHz, .SlowSCK = true,
+      .AutoTune = true },
+    { .Name = "isp-m328p-timed", .Profile = &HostTarget_ATmega328P,
+      .CompletionMode = BENCHMARK_COMPLETION_TIMED },
+    { .Name = "isp-m328p-timed-adaptive", .Profile = &HostTarget_ATmega328P,
+      .CompletionMode = BENCHMARK_COMPLETION_TIMED, .AdaptiveWait = true },
+    { .Name = "isp-m328p-norb-sparse-value", .Profile = &HostTarget_ATmega328P_NoReadyBusy, .Sparse = true,
+      .CompletionMode = BENCHMARK_COMPLETION_VALUE },
+    { .Name = "isp-m328p-norb-sparse-value-adaptive", .Profile = &HostTarget_ATmega328P_NoReadyBusy,
+      .Sparse = true, .CompletionMode = BENCHMARK_COMPLETION_VALUE, .AdaptiveWait = true },
+    { .Name = "isp-m328p-never-ready", .Profile = &HostTarget_ATmega328P_NeverReady, .Timeouts = 5 },
+    { .Name = "isp-m328p-batched", .Profile = &HostTarget_ATmega328P, .Batched = true },
+    { .Name = "isp-m328p-sequence", .Profile = &HostTarget_ATmega328P, .Sequenced = true },
+    { .Name = "isp-m328p-1mhz-sequence", .Profile = &HostTarget_ATmega328P_1MHz, .SlowSCK = true,
+      .Sequenced = true },
+    { .Name = "isp-m2560", .Profile = &HostTarget_ATmega2560 },
+    { .Name = "isp-m2560-single-bank", .Profile = &HostTarget_ATmega2560, .SingleBank = true },
+    { .Name = "isp-m2560-pipelined", .Profile = &HostTarget_ATmega2560, .Pipelined = true },
+    { .Name = "isp-m2560-streamed", .Profile = &HostTarget_ATmega2560, .Streamed = true },
+    { .Name = "isp-m2560-streamed-single-bank", .Profile = &HostTarget_ATmega2560, .Streamed = true,
+      .SingleBank = true },
+    { .Name = "isp-m2560-streamprog", .Profile = &HostTarget_ATmega2560, .Streamed = true, .StreamProgram = true },
+    { .Name = "isp-m2560-mspim", .Profile = &HostTarget_ATmega2560, .USARTSPI = true },
+    { .Name = "isp-m2560-8mhz", .Profile = &HostTarget_ATmega2560, .FastSCK = true },
+    { .Name = "isp-m2560-crc", .Profile = &HostTarget_ATmega2560, .CRCVerify = true },
+    { .Name = "isp-m2560-sparse", .Profile = &HostTarget_ATmega2560, .Sparse = true },
+    { .Name = "isp-m2560-sparse-skip", .Profile = &HostTarget_ATmega2560, .Sparse = true, .SkipBlank = true },
+    { .Name = "isp-m2560-sparse-skip-streamprog", .Profile = &HostTarget_ATmega2560, .Sparse = true,
+      .SkipBlank = true, .StreamProgram = true },
+    { .Name = "pdi-x128a1", .Profile = &HostTarget_ATxmega128A1 },
+    { .Name = "pdi-x128a1-batched", .Profile = &HostTarget_ATxmega128A1, .Batched = true },
+    { .Name = "pdi-x128a1-large", .Profile = &HostTarget_ATxmega128A1, .LargeBlocks = true },
+    { .Name = "tpi-t10", .Profile = &HostTarget_ATtiny10 },
+    { .Name = "tpi-t10-crc", .Profile = &HostTarget_ATtiny10, .CRCVerify = true },
+    { .Name = "standalone-m328p", .Profile = &HostTarget_ATmega328P, .Standalone = true },
+    { .Name = "standalone-m2560", .Profile = &HostTarget_ATmega2560, .Standalone = true },
+    { .Name = "standalone-x128a1", .Profile = &HostTarget_ATxmega128A1, .Standalone = true },
+    { .Name = "standalone-t10", .Profile = &HostTarget_ATtiny10, .Standalone = true },
+  };
+
+/** Statistics of each command of the scenario being run. */
+static Benchmark_CommandStats_t Benchmark_Commands[BENCHMARK_COMMAND_KEYS];
+
+/** Images written to and read back from the simulated target. */
+static uint8_t Benchmark_FlashImage[HOSTTARGET_MAX_FLASH_SIZE];
+static uint8_t Benchmark_EEPROMImage[HOSTTARGET_MAX_EEPROM_SIZE];
+static uint8_t Benchmark_ReadBack[HOSTTARGET_MAX_FLASH_SIZE];
+
+/** Command packet of the vendor streaming program commands, which carry a whole memory image. */
+static uint8_t Benchmark_StreamCommand[16 + HOSTTARGET_MAX_FLASH_SIZE];
+
+/** Number of failed checks in the scenario being run. */
+static uint32_t Benchmark_Failures;
+
+/** Vendor command batch being built, which \ref Benchmark_Expect() adds commands to while batching is enabled. */
+static bool Benchmark_Batching;
+static uint8_t Benchmark_Batch[3 + V2PROTOCOL_BATCH_SIZE];
+static uint16_t Benchmark_BatchLength;
+static uint8_t Benchmark_BatchCommands;
+
+/** Number of EEPROM cells written by the firmware, counted by the host avr/eeprom.h implementation. */
+uint32_t HostEEPROM_ByteWrites;
+
+/** Clock cycle at which the EEPROM finishes its last write, used by the host avr/eeprom.h implementation. */
+uint64_t HostEEPROM_ReadyAt;
+
+/** Records a failed check of the scenario being run. */
+static void
+Benchmark_Fail (const char* const Message, const uint32_t Value)
+{
+  printf ("  FAIL: %s (0x%08lX)\n", Message, (unsigned long) Value);
+  Benchmark_Failures++;
+}
+
+/** Retrieves the printable name of a command statistics slot. */
+static const char*
+Benchmark_CommandName (const uint16_t Key)
+{
+  switch (Key)
+    {
+    case CMD_SIGN_ON:
+      return "SIGN_ON";
+    case CMD_SET_PARAMETER:
+      return "SET_PARAMETER";
+    case CMD_GET_PARAMETER:
+      return "GET_PARAMETER";
+    case CMD_LOAD_ADDRESS:
+      return "LOAD_ADDRESS";
+    case CMD_ENTER_PROGMODE_ISP:
+      return "ENTER_PROGMODE_ISP";
+    case CMD_LEAVE_PROGMODE_ISP:
+      return "LEAVE_PROGMODE_ISP";
+    case CMD_CHIP_ERASE_ISP:
+      return "CHIP_ERASE_ISP";
+    case CMD_PROGRAM_FLASH_ISP:
+      return "PROGRAM_FLASH_ISP";
+    case CMD_READ_FLASH_ISP:
+      return "READ_FLASH_ISP";
+    case CMD_PROGRAM_EEPROM_ISP:
+      return "PROGRAM_EEPROM_ISP";
+    case CMD_READ_EEPROM_ISP:
+      return "READ_EEPROM_ISP";
+    case CMD_READ_SIGNATURE_ISP:
+      return "READ_SIGNATURE_ISP";
+    case CMD_PROGRAM_FLUSH_ISP:
+      return "PROGRAM_FLUSH_ISP";
+    case CMD_READ_FLASH_STREAM_ISP:
+      return "READ_FLASH_STREAM_ISP";
+    case CMD_READ_EEPROM_STREAM_ISP:
+      return "READ_EEPROM_STREAM_ISP";
+    case CMD_READ_FLASH_CRC_ISP:
+      return "READ_FLASH_CRC_ISP";
+    case CMD_READ_EEPROM_CRC_ISP:
+      return "READ_EEPROM_CRC_ISP";
+    case CMD_STANDALONE_WRITE_IMAGE:
+      return "STANDALONE_WRITE_IMAGE";
+    case CMD_STANDALONE_RUN:
+      return "STANDALONE_RUN";
+    case CMD_BATCH:
+      return "BATCH";
+    case CMD_ISP_SEQUENCE:
+      return "ISP_SEQUENCE";
+    case CMD_PROG_FLASH_STREAM_ISP:
+      return "PROG_FLASH_STREAM_ISP";
+    case CMD_PROG_EEPROM_STREAM_ISP:
+      return "PROG_EEPROM_STREAM_ISP";
+    case CMD_READ_PROFILE:
+      return "READ_PROFILE";
+    case CMD_READ_TRACE:
+      return "READ_TRACE";
+    case CMD_READ_HEALTH:
+      return "READ_HEALTH";
+    case CMD_XPROG_SETMODE:
+      return "XPROG_SETMODE";
+    case CMD_XPROG:
+      return "XPROG";
+    case 0x100 | XPROG_CMD_ENTER_PROGMODE:
+      return "XPROG ENTER_PROGMODE";
+    case 0x100 | XPROG_CMD_LEAVE_PROGMODE:
+      return "XPROG LEAVE_PROGMODE";
+    case 0x100 | XPROG_CMD_ERASE:
+      return "XPROG ERASE";
+    case 0x100 | XPROG_CMD_WRITE_MEM:
+      return "XPROG WRITE_MEM";
+    case 0x100 | XPROG_CMD_READ_MEM:
+      return "XPROG READ_MEM";
+    case 0x100 | XPROG_CMD_CRC:
+      return "XPROG CRC";
+    case 0x100 | XPROG_CMD_READ_MEM_CRC:
+      return "XPROG READ_MEM_CRC";
+    case 0x100 | XPROG_CMD_SET_PARAM:
+      return "XPROG SET_PARAM";
+    default:
+      return "OTHER";
+    }
+}
+
+/** Sends a command to the firmware as the host would, and runs the firmware's AVRISP task until the complete
+ *  response has been received by the host. The simulated clock is left at the time the host is ready to send
+ *  the next command.
+ *
+ *  \param[in]  Command         Command packet to send
+ *  \param[in]  Length          Length of the command packet in bytes
+ *  \param[out] ResponseLength  Length of the response packet in bytes
+ *
+ *  \return Pointer to the response packet, valid until the next command is executed
+ */
+static const uint8_t*
+Benchmark_Execute (const uint8_t* const Command, const uint32_t Length,
+                   uint32_t* const ResponseLength)
+{
+  uint64_t StartCycles = HostClock_Cycles;
+  const uint8_t* Response;
+  uint64_t CompletedAt;
+
+  HostUSB_HostClearReceived (AVRISP_DATA_IN_EPADDR & ENDPOINT_EPNUM_MASK);
+  HostUSB_HostSend (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK, Command, Length);
+
+  for (;;)
+    {
+      Response = HostUSB_HostReceived (AVRISP_DATA_IN_EPADDR & ENDPOINT_EPNUM_MASK,
+                                       ResponseLength, &CompletedAt);
+
+      if (CompletedAt && !(HostUSB_HostSendPending (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK)))
+        break;
+
+      if ((HostClock_Cycles - StartCycles) > BENCHMARK_COMMAND_LIMIT)
+        {
+          Benchmark_Fail ("command never completed", Command[0]);
+          *ResponseLength = 0;
+          return Response;
+        }
+
+      /* Same as AVRISP_Task(), minus the LED updates */
+      Endpoint_SelectEndpoint (AVRISP_DATA_OUT_EPADDR);
+
+      if (Endpoint_IsOUTReceived ())
+        V2Protocol_ProcessCommand ();
+      else
+        HostClock_AdvanceTo (MIN(HostUSB_NextOUTReadyAt (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK),
+                                 HostClock_Cycles + HOSTCLOCK_CYCLES_PER_FRAME));
+    }
+
+  HostClock_AdvanceTo (MAX(HostClock_Cycles, CompletedAt) + HOSTCLOCK_US_TO_CYCLES(BENCHMARK_HOST_TURNAROUND_US));
+
+  uint16_t Key = Command[0];
+
+  if ((Key == CMD_XPROG) && (Length > 1))
+    Key = 0x100 | (Command[1] & 0x0F);
+
+  Benchmark_Commands[Key].Count++;
+  Benchmark_Commands[Key].Cycles += (HostClock_Cycles - StartCycles);
+  Benchmark_Commands[Key].BytesOut += Length;
+  Benchmark_Commands[Key].BytesIn += *ResponseLength;
+
+  return Response;
+}
+
+/** Executes a command and checks the status byte at the given offset of its response. While batching is enabled
+ *  the command is instead added to the vendor command batch being built, which the firmware checks the status of.
+ *
+ *  \param[in] Command       Command packet to send
+ *  \param[in] Length        Length of the command packet in bytes
+ *  \param[in] StatusOffset  Offset of the status byte in the response
+ *
+ *  \return Pointer to the response packet, valid until the next command is executed, or NULL if it was batched
+ */
+static const uint8_t*
+Benchmark_Expect (const uint8_t* const Command, const uint32_t Length,
+                  const uint8_t StatusOffset)
+{
+  if (Benchmark_Batching)
+    {
+      if ((Benchmark_BatchLength + 1 + Length) > sizeof(Benchmark_Batch))
+        {
+          Benchmark_Fail ("command batch full", Benchmark_BatchCommands);
+          return NULL;
+        }
+
+      Benchmark_Batch[Benchmark_BatchLength++] = Length;
+      memcpy (&Benchmark_Batch[Benchmark_BatchLength], Command, Length);
+      Benchmark_BatchLength += Length;
+      Benchmark_BatchCommands++;
+
+      return NULL;
+    }
+
+  uint32_t ResponseLength;
+  const uint8_t* Response = Benchmark_Execute (Command, Length, &ResponseLength);
+
+  if ((ResponseLength <= StatusOffset) || (Response[0] != Command[0])
+      || (Response[StatusOffset] != STATUS_CMD_OK))
+    {
+      Benchmark_Fail (Benchmark_CommandName (((Command[0] == CMD_XPROG) && (Length > 1)) ?
+                          (0x100 | Command[1]) : Command[0]),
+                      (ResponseLength > StatusOffset) ? Response[StatusOffset] : 0xFFFFFFFF);
+    }
+
+  return Response;
+}
+
+/** Starts building a vendor command batch, which the following commands sent through \ref Benchmark_Expect() are
+ *  added to until it is sent with \ref Benchmark_RunBatch().
+ */
+static void
+Benchmark_StartBatch (void)
+{
+  Benchmark_Batching = true;
+  Benchmark_BatchLength = 3;
+  Benchmark_BatchCommands = 0;
+}
+
+/** Sends the vendor command batch being built, and checks that every command of it was run and succeeded.
+ *
+ *  \param[out] ResponseLength  Total length of the responses of the batched commands in bytes
+ *
+ *  \return Pointer to the responses of the batched commands in order, valid until the next command is executed
+ */
+static const uint8_t*
+Benchmark_RunBatch (uint32_t* const ResponseLength)
+{
+  Benchmark_Batching = false;
+  Benchmark_Batch[0] = CMD_BATCH;
+  Benchmark_Batch[1] = (Benchmark_BatchLength - 3) >> 8;
+  Benchmark_Batch[2] = (Benchmark_BatchLength - 3) & 0xFF;
+
+  const uint8_t* Response = Benchmark_Execute (Benchmark_Batch, Benchmark_BatchLength, ResponseLength);
+
+  if ((*ResponseLength < 3) || (Response[0] != CMD_BATCH) || (Response[1] != STATUS_CMD_OK)
+      || (Response[2] != Benchmark_BatchCommands))
+    {
+      Benchmark_Fail ("BATCH", (*ResponseLength >= 3) ? Response[2] : 0xFFFFFFFF);
+      *ResponseLength = 0;
+      return Response;
+    }
+
+  *ResponseLength -= 3;
+  return &Response[3];
+}
+
+/** Checks that a vendor command batch stops at its first failing command, reporting the failure and leaving the
+ *  commands after it unrun.
+ */
+static void
+Benchmark_CheckBatchStop (void)
+{
+  static const uint8_t Batch[] =
+    { CMD_BATCH, 0, 9, 2, CMD_GET_PARAMETER, PARAM_SCK_DURATION, 3, CMD_SET_PARAMETER, 0xEE, 0x00, 1, CMD_SIGN_ON };
+  uint32_t ResponseLength;
+  const uint8_t* Response = Benchmark_Execute (Batch, sizeof(Batch), &ResponseLength);
+
+  /* The GET_PARAMETER and failed SET_PARAMETER responses follow the batch status and number of commands run */
+  if ((ResponseLength != (3 + 3 + 2)) || (Response[1] != STATUS_CMD_FAILED) || (Response[2] != 2)
+      || (Response[7] != STATUS_CMD_FAILED))
+    {
+      Benchmark_Fail ("BATCH did not stop at the failed command", ResponseLength);
+    }
+}
+
+/** Sets a V2 protocol parameter of the programmer. */
+static void
+Benchmark_SetParameter (const uint8_t ParamID, const uint8_t Value)
+{
+  uint8_t Command[] = { CMD_SET_PARAMETER, ParamID, Value };
+
+  Benchmark_Expect (Command, sizeof(Command), 1);
+}
+
+/** Reads a V2 protocol parameter of the programmer. */
+static uint8_t
+Benchmark_GetParameter (const uint8_t ParamID)
+{
+  uint8_t Command[] = { CMD_GET_PARAMETER, ParamID };
+
+  return Benchmark_Expect (Command, sizeof(Command), 1)[2];
+}
+
+/** Loads the address used by the next ISP memory command. */
+static void
+Benchmark_LoadAddress (const uint32_t Address)
+{
+  uint8_t Command[] = { CMD_LOAD_ADDRESS, Address >> 24, Address >> 16, Address >> 8, Address };
+
+  Benchmark_Expect (Command, sizeof(Command), 1);
+}
+
+/** Reads a whole ISP memory region back with one of the vendor streaming read commands.
+ *
+ *  \param[in]  V2Command          CMD_READ_FLASH_STREAM_ISP or CMD_READ_EEPROM_STREAM_ISP
+ *  \param[in]  ReadMemoryCommand  Target read command of the memory
+ *  \param[in]  Address            Byte address of the region, with bit 31 set to load the extended address
+ *  \param[out] Data               Buffer the region is read into
+ *  \param[in]  Length             Length of the region in bytes
+ */
+static void
+Benchmark_ReadStream (const uint8_t V2Command, const uint8_t ReadMemoryCommand,
+                      const uint32_t Address, uint8_t* const Data,
+                      const uint32_t Length)
+{
+  uint8_t Command[] = { V2Command,
+                        Address >> 24, Address >> 16, Address >> 8, Address,
+                        Length >> 24, Length >> 16, Length >> 8, Length,
+                        ReadMemoryCommand };
+  uint32_t ResponseLength;
+  const uint8_t* Response = Benchmark_Execute (Command, sizeof(Command), &ResponseLength);
+
+  if ((ResponseLength != (Length + 3)) || (Response[1] != STATUS_CMD_OK)
+      || (Response[Length + 2] != STATUS_CMD_OK))
+    {
+      Benchmark_Fail (Benchmark_CommandName (V2Command), ResponseLength);
+      return;
+    }
+
+  memcpy (Data, &Response[2], Length);
+}
+
+/** Computes the standard CRC-32 of an image, as returned by the vendor CRC commands. */
+static uint32_t
+Benchmark_ImageCRC (const uint8_t* const Data, const uint32_t Length)
+{
+  uint32_t CRC = 0xFFFFFFFF;
+
+  for (uint32_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+    {
+      CRC ^= Data[CurrentByte];
+
+      for (uint8_t Bit = 0; Bit < 8; Bit++)
+        CRC = (CRC >> 1) ^ ((CRC & 1) ? 0xEDB88320 : 0);
+    }
+
+  return ~CRC;
+}
+
+/** Verifies a whole ISP memory region against an image with one of the vendor CRC commands.
+ *
+ *  \param[in] V2Command          CMD_READ_FLASH_CRC_ISP or CMD_READ_EEPROM_CRC_ISP
+ *  \param[in] ReadMemoryCommand  Target read command of the memory
+ *  \param[in] Address            Byte address of the region, with bit 31 set to load the extended address
+ *  \param[in] Expected           Image the region was written with
+ *  \param[in] Length             Length of the region in bytes
+ */
+static void
+Benchmark_ReadCRC (const uint8_t V2Command, const uint8_t ReadMemoryCommand,
+                   const uint32_t Address, const uint8_t* const Expected,
+                   const uint32_t Length)
+{
+  uint8_t Command[] = { V2Command,
+                        Address >> 24, Address >> 16, Address >> 8, Address,
+                        Length >> 24, Length >> 16, Length >> 8, Length,
+                        ReadMemoryCommand };
+  const uint8_t* Response = Benchmark_Expect (Command, sizeof(Command), 1);
+
+  uint32_t ReadBackCRC = ((uint32_t) Response[2] << 24) | ((uint32_t) Response[3] << 16)
+      | ((uint32_t) Response[4] << 8) | Response[5];
+
+  if (ReadBackCRC != Benchmark_ImageCRC (Expected, Length))
+    Benchmark_Fail (Benchmark_CommandName (V2Command), ReadBackCRC);
+}
+
+/** Fills the images written to the target with reproducible pseudo-random data. Sparse flash images only hold
+ *  data in the bottom eighth (the application) and the top \ref BENCHMARK_SPARSE_BOOT_SIZE bytes (the bootloader),
+ *  and are erased in between.
+ */
+static void
+Benchmark_FillImages (const Benchmark_Scenario_t* const Scenario)
+{
+  const HostTarget_Profile_t* Profile = Scenario->Profile;
+  uint32_t Seed = 0x2545F491;
+
+  for (uint32_t CurrentByte = 0; CurrentByte < Profile->FlashSize; CurrentByte++)
+    {
+      Seed = (Seed * 1103515245UL) + 12345;
+      Benchmark_FlashImage[CurrentByte] = Seed >> 16;
+
+      if (Scenario->Sparse && (CurrentByte >= (Profile->FlashSize / 8))
+          && (CurrentByte < (Profile->FlashSize - BENCHMARK_SPARSE_BOOT_SIZE)))
+        {
+          Benchmark_FlashImage[CurrentByte] = 0xFF;
+        }
+    }
+
+  for (uint32_t CurrentByte = 0; CurrentByte < Profile->EEPROMSize; CurrentByte++)
+    {
+      Seed = (Seed * 1103515245UL) + 12345;
+      Benchmark_EEPROMImage[CurrentByte] = Seed >> 16;
+    }
+}
+
+/** Compares a memory read back through the programmer with the image written to it. */
+static void
+Benchmark_Verify (const char* const Memory, const uint8_t* const Expected,
+                  const uint8_t* const Actual, const uint32_t Length)
+{
+  for (uint32_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+    {
+      if (Expected[CurrentByte] != Actual[CurrentByte])
+        {
+          printf ("  FAIL: %s mismatch at 0x%05lX, wrote 0x%02X, read 0x%02X\n", Memory,
+                  (unsigned long) CurrentByte, Expected[CurrentByte], Actual[CurrentByte]);
+          Benchmark_Failures++;
+          return;
+        }
+    }
+}
+
+/** Reports the throughput of a memory transfer phase. */
+static void
+Benchmark_ReportPhase (const char* const Phase, const uint32_t Bytes,
+                       const uint64_t Cycles)
+{
+  double Seconds = HOSTCLOCK_CYCLES_TO_US(Cycles) / 1000000.0;
+
+  printf ("  %-22s %7lu B  %9.1f ms  %7.2f KiB/s\n", Phase, (unsigned long) Bytes,
+          Seconds * 1000.0, (Bytes / 1024.0) / Seconds);
+}
+
+/** Computes the ISP page write mode byte for the completion check the scenario's host asks for.
+ *
+ *  \param[in] Scenario  Scenario being run
+ *
+ *  \return Mode byte of the PROGRAM_FLASH_ISP and PROGRAM_EEPROM_ISP commands
+ */
+static uint8_t
+Benchmark_ISPWriteMode (const Benchmark_Scenario_t* const Scenario)
+{
+  switch (Scenario->CompletionMode)
+    {
+    case BENCHMARK_COMPLETION_TIMED:
+      return (PROG_MODE_COMMIT_PAGE_MASK | PROG_MODE_PAGED_TIMEDELAY_MASK | PROG_MODE_PAGED_WRITES_MASK);
+    case BENCHMARK_COMPLETION_VALUE:
+      return (PROG_MODE_COMMIT_PAGE_MASK | PROG_MODE_PAGED_VALUE_MASK | PROG_MODE_PAGED_WRITES_MASK);
+    default:
+      return (PROG_MODE_COMMIT_PAGE_MASK | PROG_MODE_PAGED_READYBUSY_MASK | PROG_MODE_PAGED_WRITES_MASK);
+    }
+}
+
+/** Programs a memory region of an ISP target with a single vendor streaming program command.
+ *
+ *  \param[in] Scenario             Scenario being run
+ *  \param[in] V2Command            CMD_PROG_FLASH_STREAM_ISP or CMD_PROG_EEPROM_STREAM_ISP
+ *  \param[in] Address              Byte address of the region, with bit 31 set to load the extended address
+ *  \param[in] Data                 Data to program
+ *  \param[in] Length               Length of the region in bytes
+ *  \param[in] PageSize             Target page size in bytes
+ *  \param[in] DelayMS              Page write delay in milliseconds
+ *  \param[in] ProgrammingCommands  Target load, commit and read commands of the memory
+ */
+static void
+Benchmark_ProgramStream (const Benchmark_Scenario_t* const Scenario, const uint8_t V2Command,
+                         const uint32_t Address, const uint8_t* const Data, const uint32_t Length,
+                         const uint16_t PageSize, const uint8_t DelayMS, const uint8_t ProgrammingCommands[3])
+{
+  uint8_t* Command = Benchmark_StreamCommand;
+
+  Command[0] = V2Command;
+  Command[1] = Address >> 24;
+  Command[2] = Address >> 16;
+  Command[3] = Address >> 8;
+  Command[4] = Address;
+  Command[5] = Length >> 24;
+  Command[6] = Length >> 16;
+  Command[7] = Length >> 8;
+  Command[8] = Length;
+  Command[9] = PageSize >> 8;
+  Command[10] = PageSize & 0xFF;
+  Command[11] = Benchmark_ISPWriteMode (Scenario);
+  Command[12] = DelayMS;
+  memcpy (&Command[13], ProgrammingCommands, 3);
+  Command[16] = 0xFF;
+  memcpy (&Command[17], Data, Length);
+
+  Benchmark_Expect (Command, 17 + Length, 1);
+}
+
+/** Runs an ISP micro-sequence with the vendor CMD_ISP_SEQUENCE command, and checks that it ran to its end.
+ *
+ *  \param[in]  Program         Micro-sequence program
+ *  \param[in]  ProgramLength   Length of the program in bytes
+ *  \param[in]  Data            Input data of the program
+ *  \param[in]  DataLength      Length of the input data in bytes
+ *  \param[out] Output          Buffer the bytes streamed out by the program are copied into
+ *  \param[in]  OutputLength    Number of bytes the program streams out
+ */
+static void
+Benchmark_RunSequence (const uint8_t* const Program, const uint16_t ProgramLength,
+                       const uint8_t* const Data, const uint16_t DataLength,
+                       uint8_t* const Output, const uint32_t OutputLength)
+{
+  uint8_t Command[5 + ISPSEQUENCE_PROGRAM_SIZE + BENCHMARK_BLOCK_SIZE];
+
+  Command[0] = CMD_ISP_SEQUENCE;
+  Command[1] = ProgramLength >> 8;
+  Command[2] = ProgramLength & 0xFF;
+  Command[3] = DataLength >> 8;
+  Command[4] = DataLength & 0xFF;
+  memcpy (&Command[5], Program, ProgramLength);
+  memcpy (&Command[5 + ProgramLength], Data, DataLength);
+
+  uint32_t ResponseLength;
+  const uint8_t* Response = Benchmark_Execute (Command, 5 + ProgramLength + DataLength, &ResponseLength);
+
+  if ((ResponseLength != (OutputLength + 3)) || (Response[1] != STATUS_CMD_OK)
+      || (Response[ResponseLength - 1] != STATUS_CMD_OK))
+    {
+      Benchmark_Fail ("ISP_SEQUENCE response", ResponseLength);
+      return;
+    }
+
+  memcpy (Output, &Response[2], OutputLength);
+}
+
+/** Reads the flash of an ISP target of up to 128KB back with a single micro-sequence, looping over every word. */
+static void
+Benchmark_SequenceReadFlash (const HostTarget_Profile_t* const Profile)
+{
+  uint16_t Words = Profile->FlashSize / 2;
+  uint8_t Program[] =
+    {
+      ISPSEQUENCE_OP_SET_ADDRESS, 0, 0, 0, 0,
+      ISPSEQUENCE_OP_LOOP, Words >> 8, Words & 0xFF,
+        ISPSEQUENCE_OP_SPI, 4, ISPSEQUENCE_SOURCE_LITERAL, 0x20, ISPSEQUENCE_SOURCE_ADDRESS_HIGH,
+          ISPSEQUENCE_SOURCE_ADDRESS_LOW, ISPSEQUENCE_SOURCE_LITERAL | ISPSEQUENCE_FLAG_OUTPUT, 0x00,
+        ISPSEQUENCE_OP_SPI, 4, ISPSEQUENCE_SOURCE_LITERAL, 0x28, ISPSEQUENCE_SOURCE_ADDRESS_HIGH,
+          ISPSEQUENCE_SOURCE_ADDRESS_LOW, ISPSEQUENCE_SOURCE_LITERAL | ISPSEQUENCE_FLAG_OUTPUT, 0x00,
+      ISPSEQUENCE_OP_NEXT, 1,
+      ISPSEQUENCE_OP_END,
+    };
+
+  Benchmark_RunSequence (Program, sizeof(Program), NULL, 0, Benchmark_ReadBack, Profile->FlashSize);
+}
+
+/** Programs the EEPROM image into an ISP target with micro-sequences of one block each, which load and commit each
+ *  page and poll the target until it is ready.
+ */
+static void
+Benchmark_SequenceWriteEEPROM (const HostTarget_Profile_t* const Profile)
+{
+  uint8_t PageSize = Profile->EEPROMPageSize;
+
+  for (uint32_t Address = 0; Address < Profile->EEPROMSize; Address += BENCHMARK_BLOCK_SIZE)
+    {
+      uint8_t Pages = MIN(Profile->EEPROMSize - Address, BENCHMARK_BLOCK_SIZE) / PageSize;
+      uint8_t Program[] =
+        {
+          ISPSEQUENCE_OP_SET_ADDRESS, Address >> 24, Address >> 16, Address >> 8, Address,
+          ISPSEQUENCE_OP_LOOP, 0, Pages,
+            ISPSEQUENCE_OP_LOOP, 0, PageSize,
+              ISPSEQUENCE_OP_SPI, 4, ISPSEQUENCE_SOURCE_LITERAL, 0xC1, ISPSEQUENCE_SOURCE_LITERAL, 0x00,
+                ISPSEQUENCE_SOURCE_ADDRESS_LOW, ISPSEQUENCE_SOURCE_DATA,
+            ISPSEQUENCE_OP_NEXT, 1,
+            ISPSEQUENCE_OP_ADD_ADDRESS, (-PageSize >> 8) & 0xFF, -PageSize & 0xFF,
+            ISPSEQUENCE_OP_SPI, 4, ISPSEQUENCE_SOURCE_LITERAL, 0xC2, ISPSEQUENCE_SOURCE_ADDRESS_HIGH,
+              ISPSEQUENCE_SOURCE_ADDRESS_LOW, ISPSEQUENCE_SOURCE_LITERAL, 0x00,
+            ISPSEQUENCE_OP_POLL, 0x01, 0x00, 20,
+              4, ISPSEQUENCE_SOURCE_LITERAL, 0xF0, ISPSEQUENCE_SOURCE_LITERAL, 0x00, ISPSEQUENCE_SOURCE_LITERAL, 0x00,
+              ISPSEQUENCE_SOURCE_LITERAL | ISPSEQUENCE_FLAG_CAPTURE, 0x00,
+          ISPSEQUENCE_OP_NEXT, PageSize,
+          ISPSEQUENCE_OP_END,
+        };
+
+      Benchmark_RunSequence (Program, sizeof(Program), &Benchmark_EEPROMImage[Address], Pages * PageSize,
+                             NULL, 0);
+    }
+}
+
+/** Programs the EEPROM image into an ISP target page by page, as avrdude does. */
+static void
+Benchmark_ProgramEEPROM (const Benchmark_Scenario_t* const Scenario)
+{
+  const HostTarget_Profile_t* Profile = Scenario->Profile;
+  uint8_t Command[10 + BENCHMARK_BLOCK_SIZE];
+
+  if (Scenario->Sequenced)
+    {
+      Benchmark_SequenceWriteEEPROM (Profile);
+      return;
+    }
+
+  if (Scenario->StreamProgram)
+    {
+      static const uint8_t ProgrammingCommands[] = { 0xC1, 0xC2, 0xA0 };
+
+      Benchmark_ProgramStream (Scenario, CMD_PROG_EEPROM_STREAM_ISP, 0, Benchmark_EEPROMImage, Profile->EEPROMSize,
+                               Profile->EEPROMPageSize, 20, ProgrammingCommands);
+      return;
+    }
+
+  for (uint32_t Address = 0; Address < Profile->EEPROMSize; Address += Profile->EEPROMPageSize)
+    {
+      uint16_t Length = Profile->EEPROMPageSize;
+
+      Benchmark_LoadAddress (Address);
+
+      Command[0] = CMD_PROGRAM_EEPROM_ISP;
+      Command[1] = Length >> 8;
+      Command[2] = Length & 0xFF;
+      Command[3] = Benchmark_ISPWriteMode (Scenario);
+      Command[4] = 20;
+      Command[5] = 0xC1;
+      Command[6] = 0xC2;
+      Command[7] = 0xA0;
+      Command[8] = 0xFF;
+      Command[9] = 0xFF;
+      memcpy (&Command[10], &Benchmark_EEPROMImage[Address], Length);
+
+      Benchmark_Expect (Command, 10 + Length, 1);
+    }
+
+  if (Scenario->Pipelined)
+    {
+      Command[0] = CMD_PROGRAM_FLUSH_ISP;
+      Benchmark_Expect (Command, 1, 1);
+    }
+}
+
+/** Runs the avrdude ISP sequence: sign-on, enter programming mode, signature, chip erase, flash program and
+ *  verify, EEPROM program and verify, leave programming mode.
+ */
+static void
+Benchmark_RunISP (const Benchmark_Scenario_t* const Scenario)
+{
+  const HostTarget_Profile_t* Profile = Scenario->Profile;
+  uint8_t Command[10 + BENCHMARK_BLOCK_SIZE];
+  const uint8_t* Response;
+  uint32_t ResponseLength;
+  uint64_t PhaseStart;
+
+  if (Scenario->Batched)
+    Benchmark_StartBatch ();
+
+  Command[0] = CMD_SIGN_ON;
+  Benchmark_Expect (Command, 1, 1);
+
+  if (Scenario->FastSCK)
+    Benchmark_SetParameter (PARAM_SCK_DURATION, BENCHMARK_ISP_FAST_SCK_DURATION);
+  else if (Scenario->SlowSCK)
+    Benchmark_SetParameter (PARAM_SCK_DURATION, BENCHMARK_ISP_SLOW_SCK_DURATION);
+  else
+    Benchmark_SetParameter (PARAM_SCK_DURATION, BENCHMARK_ISP_SCK_DURATION);
+
+  if (Scenario->AutoTune)
+    Benchmark_SetParameter (PARAM_ISP_SCK_AUTOTUNE, 1);
+
+  if (Scenario->AdaptiveWait)
+    Benchmark_SetParameter (PARAM_ISP_ADAPTIVE_WAIT, 1);
+
+  if (Scenario->Pipelined)
+    Benchmark_SetParameter (PARAM_PROG_PIPELINE, 1);
+
+  if (Scenario->SkipBlank)
+    Benchmark_SetParameter (PARAM_PROG_SKIP_BLANK, 1);
+
+  if (Scenario->SkipUnchanged)
+    Benchmark_SetParameter (PARAM_PROG_SKIP_UNCHANGED, 1);
+
+  if (Scenario->USARTSPI)
+    Benchmark_SetParameter (PARAM_ISP_USART_SPI, 1);
+
+  static const uint8_t EnterProgmode[] =
+    { CMD_ENTER_PROGMODE_ISP, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00 };
+  Benchmark_Expect (EnterProgmode, sizeof(EnterProgmode), 1);
+
+  if (Scenario->AutoTune)
+    {
+      uint8_t TunedDuration = Benchmark_GetParameter (PARAM_ISP_SCK_TUNED);
+
+      printf ("  tuned SCK duration %u\n", TunedDuration);
+
+      if (TunedDuration == ISP_SCK_NOT_TUNED)
+        Benchmark_Fail ("SCK speed not tuned", TunedDuration);
+    }
+
+  for (uint8_t SignatureByte = 0; SignatureByte < 3; SignatureByte++)
+    {
+      uint8_t ReadSignature[] = { CMD_READ_SIGNATURE_ISP, 4, 0x30, 0x00, SignatureByte, 0x00 };
+      Response = Benchmark_Expect (ReadSignature, sizeof(ReadSignature), 1);
+
+      if (Response && (Response[2] != Profile->Signature[SignatureByte]))
+        Benchmark_Fail ("signature mismatch", Response[2]);
+    }
+
+  if (Scenario->Batched)
+    {
+      /* The responses to the signature reads, of four bytes each, close the batch response */
+      Response = Benchmark_RunBatch (&ResponseLength);
+
+      for (uint8_t SignatureByte = 0; (ResponseLength >= 12) && (SignatureByte < 3); SignatureByte++)
+        {
+          uint8_t ResponseByte = Response[ResponseLength - 12 + (4 * SignatureByte) + 2];
+
+          if (ResponseByte != Profile->Signature[SignatureByte])
+            Benchmark_Fail ("signature mismatch", ResponseByte);
+        }
+    }
+
+  uint8_t ChipErase[] = { CMD_CHIP_ERASE_ISP, 9, (Scenario->CompletionMode == BENCHMARK_COMPLETION_READYBUSY),
+                          0xAC, 0x80, 0x00, 0x00 };
+  Benchmark_Expect (ChipErase, sizeof(ChipErase), 1);
+
+  /* Flash is written one page per command, each preceded by its word address, as avrdude does */
+  uint32_t ExtendedAddressFlag = (Profile->FlashSize > 0x20000UL) ? (1UL << 31) : 0;
+
+  PhaseStart = HostClock_Cycles;
+
+  for (uint32_t Address = 0; !(Scenario->StreamProgram) && (Address < Profile->FlashSize);
+      Address += Profile->FlashPageSize)
+    {
+      uint16_t Length = Profile->FlashPageSize;
+
+      Benchmark_LoadAddress (ExtendedAddressFlag | (Address >> 1));
+
+      Command[0] = CMD_PROGRAM_FLASH_ISP;
+      Command[1] = Length >> 8;
+      Command[2] = Length & 0xFF;
+      Command[3] = Benchmark_ISPWriteMode (Scenario);
+      Command[4] = 10;
+      Command[5] = 0x40;
+      Command[6] = 0x4C;
+      Command[7] = 0x20;
+      Command[8] = 0xFF;
+      Command[9] = 0xFF;
+      memcpy (&Command[10], &Benchmark_FlashImage[Address], Length);
+
+      Benchmark_Expect (Command, 10 + Length, 1);
+    }
+
+  if (Scenario->StreamProgram)
+    {
+      static const uint8_t ProgrammingCommands[] = { 0x40, 0x4C, 0x20 };
+
+      Benchmark_ProgramStream (Scenario, CMD_PROG_FLASH_STREAM_ISP, ExtendedAddressFlag, Benchmark_FlashImage,
+                               Profile->FlashSize, Profile->FlashPageSize, 10, ProgrammingCommands);
+    }
+
+  if (Scenario->Pipelined)
+    {
+      Command[0] = CMD_PROGRAM_FLUSH_ISP;
+      Benchmark_Expect (Command, 1, 1);
+    }
+
+  Benchmark_ReportPhase ("flash program", Profile->FlashSize, HostClock_Cycles - PhaseStart);
+
+  PhaseStart = HostClock_Cycles;
+
+  if (Scenario->CRCVerify)
+    {
+      Benchmark_ReadCRC (CMD_READ_FLASH_CRC_ISP, 0x20, ExtendedAddressFlag,
+                         Benchmark_FlashImage, Profile->FlashSize);
+    }
+  else if (Scenario->Sequenced)
+    {
+      Benchmark_SequenceReadFlash (Profile);
+    }
+  else if (Scenario->Streamed)
+    {
+      Benchmark_ReadStream (CMD_READ_FLASH_STREAM_ISP, 0x20, ExtendedAddressFlag,
+                            Benchmark_ReadBack, Profile->FlashSize);
+    }
+  else
+    {
+      for (uint32_t Address = 0; Address < Profile->FlashSize; Address += BENCHMARK_BLOCK_SIZE)
+        {
+          uint8_t ReadFlash[] = { CMD_READ_FLASH_ISP, BENCHMARK_BLOCK_SIZE >> 8, BENCHMARK_BLOCK_SIZE & 0xFF, 0x20 };
+
+          Benchmark_LoadAddress (ExtendedAddressFlag | (Address >> 1));
+          Response = Benchmark_Execute (ReadFlash, sizeof(ReadFlash), &ResponseLength);
+
+          if ((ResponseLength != (BENCHMARK_BLOCK_SIZE + 3)) || (Response[1] != STATUS_CMD_OK))
+            {
+              Benchmark_Fail ("READ_FLASH_ISP response", ResponseLength);
+              break;
+            }
+
+          memcpy (&Benchmark_ReadBack[Address], &Response[2], BENCHMARK_BLOCK_SIZE);
+        }
+    }
+
+  if (Scenario->CRCVerify)
+    {
+      Benchmark_ReportPhase ("flash CRC", Profile->FlashSize, HostClock_Cycles - PhaseStart);
+    }
+  else
+    {
+      Benchmark_ReportPhase ("flash read", Profile->FlashSize, HostClock_Cycles - PhaseStart);
+      Benchmark_Verify ("flash", Benchmark_FlashImage, Benchmark_ReadBack, Profile->FlashSize);
+    }
+
+  PhaseStart = HostClock_Cycles;
+
+  Benchmark_ProgramEEPROM (Scenario);
+  Benchmark_ReportPhase ("EEPROM program", Profile->EEPROMSize, HostClock_Cycles - PhaseStart);
+
+  if (Scenario->EEPROMUpdate)
+    {
+      /* Bytes already erased were left unchanged by the first pass over the erased EEPROM */
+      uint16_t ExpectedUnchanged = 0;
+
+      for (uint32_t Address = 0; Address < Profile->EEPROMSize; Address++)
+        {
+          if (Benchmark_EEPROMImage[Address] == 0xFF)
+            ExpectedUnchanged++;
+        }
+
+      /* Change one byte in sixteen, as a calibration table update would */
+      for (uint32_t Address = 0; Address < Profile->EEPROMSize; Address++)
+        {
+          if (Address % 16)
+            ExpectedUnchanged++;
+          else
+            Benchmark_EEPROMImage[Address] ^= 0x5A;
+        }
+
+      PhaseStart = HostClock_Cycles;
+      Benchmark_ProgramEEPROM (Scenario);
+      Benchmark_ReportPhase ("EEPROM update", Profile->EEPROMSize, HostClock_Cycles - PhaseStart);
+
+      if (Scenario->SkipUnchanged)
+        {
+          uint16_t UnchangedBytes = ((uint16_t) Benchmark_GetParameter (PARAM_PROG_UNCHANGED_HIGH) << 8)
+              | Benchmark_GetParameter (PARAM_PROG_UNCHANGED_LOW);
+
+          if (UnchangedBytes != ExpectedUnchanged)
+            Benchmark_Fail ("unchanged EEPROM byte count", UnchangedBytes);
+        }
+    }
+
+  PhaseStart = HostClock_Cycles;
+
+  if (Scenario->CRCVerify)
+    {
+      Benchmark_ReadCRC (CMD_READ_EEPROM_CRC_ISP, 0xA0, 0, Benchmark_EEPROMImage,
+                         Profile->EEPROMSize);
+    }
+  else if (Scenario->Streamed)
+    {
+      Benchmark_ReadStream (CMD_READ_EEPROM_STREAM_ISP, 0xA0, 0, Benchmark_ReadBack,
+                            Profile->EEPROMSize);
+    }
+  else
+    {
+      for (uint32_t Address = 0; Address < Profile->EEPROMSize; Address += BENCHMARK_BLOCK_SIZE)
+        {
+          uint8_t ReadEEPROM[] = { CMD_READ_EEPROM_ISP, BENCHMARK_BLOCK_SIZE >> 8, BENCHMARK_BLOCK_SIZE & 0xFF, 0xA0 };
+
+          Benchmark_LoadAddress (Address);
+          Response = Benchmark_Execute (ReadEEPROM, sizeof(ReadEEPROM), &ResponseLength);
+
+          if ((ResponseLength != (BENCHMARK_BLOCK_SIZE + 3)) || (Response[1] != STATUS_CMD_OK))
+            {
+              Benchmark_Fail ("READ_EEPROM_ISP response", ResponseLength);
+              break;
+            }
+
+          memcpy (&Benchmark_ReadBack[Address], &Response[2], BENCHMARK_BLOCK_SIZE);
+        }
+    }
+
+  if (Scenario->CRCVerify)
+    {
+      Benchmark_ReportPhase ("EEPROM CRC", Profile->EEPROMSize, HostClock_Cycles - PhaseStart);
+    }
+  else
+    {
+      Benchmark_ReportPhase ("EEPROM read", Profile->EEPROMSize, HostClock_Cycles - PhaseStart);
+      Benchmark_Verify ("EEPROM", Benchmark_EEPROMImage, Benchmark_ReadBack, Profile->EEPROMSize);
+    }
+
+  static const uint8_t LeaveProgmode[] = { CMD_LEAVE_PROGMODE_ISP, 1, 1 };
+  Benchmark_Expect (LeaveProgmode, sizeof(LeaveProgmode), 1);
+
+  if (Scenario->Batched)
+    Benchmark_CheckBatchStop ();
+}
+
+/** Programs a FLASH page of a never ready target, returning the status reported for it.
+ *
+ *  \param[in] Profile  Profile of the target
+ *  \param[in] Page     Index of the page to program
+ *  \param[in] Mode     Programming mode mask of the command
+ *  \param[in] Blank    Whether the page is sent erased, rather than with the benchmark image data
+ *
+ *  \return V2 Protocol status of the command
+ */
+static uint8_t
+Benchmark_ProgramNeverReadyPage (const HostTarget_Profile_t* const Profile, const uint8_t Page, const uint8_t Mode,
+                                 const bool Blank)
+{
+  uint8_t Command[10 + BENCHMARK_BLOCK_SIZE];
+  uint32_t Address = ((uint32_t) Page * Profile->FlashPageSize);
+  uint16_t Length = Profile->FlashPageSize;
+
+  Benchmark_LoadAddress (Address >> 1);
+
+  Command[0] = CMD_PROGRAM_FLASH_ISP;
+  Command[1] = Length >> 8;
+  Command[2] = Length & 0xFF;
+  Command[3] = Mode;
+  Command[4] = 10;
+  Command[5] = 0x40;
+  Command[6] = 0x4C;
+  Command[7] = 0x20;
+  Command[8] = 0xFF;
+  Command[9] = 0xFF;
+
+  if (Blank)
+    memset (&Command[10], 0xFF, Length);
+  else
+    memcpy (&Command[10], &Benchmark_FlashImage[Address], Length);
+
+  uint32_t ResponseLength;
+  const uint8_t* Response = Benchmark_Execute (Command, 10 + Length, &ResponseLength);
+
+  return (ResponseLength < 2) ? STATUS_CMD_FAILED : Response[1];
+}
+
+/** Checks that a V2 Protocol status reports a timeout.
+ *
+ *  \param[in] What    Description of the command reporting the status
+ *  \param[in] Status  V2 Protocol status reported
+ */
+static void
+Benchmark_ExpectTimeout (const char* const What, const uint8_t Status)
+{
+  if ((Status != STATUS_CMD_TOUT) && (Status != STATUS_RDY_BSY_TOUT))
+    Benchmark_Fail (What, Status);
+}
+
+/** Runs the ISP commands which wait on the target against a target never completing a write: a page written with
+ *  RDY/BSY polling, one written with value polling, and a chip erase with RDY/BSY polling run from a command batch,
+ *  each of which must time out. Pipelined pages then must report their timeout on the next page, even if elided as
+ *  blank, and on leaving programming mode, but not to a host signing on afresh.
+ */
+static void
+Benchmark_RunTimeouts (const Benchmark_Scenario_t* const Scenario)
+{
+  const HostTarget_Profile_t* Profile = Scenario->Profile;
+  const uint8_t ReadyBusyMode = (PROG_MODE_COMMIT_PAGE_MASK | PROG_MODE_PAGED_READYBUSY_MASK
+      | PROG_MODE_PAGED_WRITES_MASK);
+  const uint8_t ValueMode = (PROG_MODE_COMMIT_PAGE_MASK | PROG_MODE_PAGED_VALUE_MASK | PROG_MODE_PAGED_WRITES_MASK);
+  uint32_t ResponseLength;
+  const uint8_t* Response;
+
+  static const uint8_t SignOn[] = { CMD_SIGN_ON };
+  static const uint8_t EnterProgmode[] =
+    { CMD_ENTER_PROGMODE_ISP, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00 };
+  static const uint8_t LeaveProgmode[] = { CMD_LEAVE_PROGMODE_ISP, 1, 1 };
+
+  Benchmark_Expect (SignOn, sizeof(SignOn), 1);
+  Benchmark_SetParameter (PARAM_SCK_DURATION, BENCHMARK_ISP_SCK_DURATION);
+  Benchmark_Expect (EnterProgmode, sizeof(EnterProgmode), 1);
+
+  Benchmark_ExpectTimeout ("RDY/BSY page write did not time out",
+                           Benchmark_ProgramNeverReadyPage (Profile, 0, ReadyBusyMode, false));
+  Benchmark_ExpectTimeout ("value polled page write did not time out",
+                           Benchmark_ProgramNeverReadyPage (Profile, 1, ValueMode, false));
+
+  /* A batch stops at its timed out command, reporting it as the first response after the batch header */
+  static const uint8_t ChipEraseBatch[] =
+    { CMD_BATCH, 0, 8, 7, CMD_CHIP_ERASE_ISP, 9, 1, 0xAC, 0x80, 0x00, 0x00 };
+  Response = Benchmark_Execute (ChipEraseBatch, sizeof(ChipEraseBatch), &ResponseLength);
+
+  if ((ResponseLength != (3 + 2)) || (Response[1] != STATUS_CMD_FAILED))
+    Benchmark_Fail ("BATCH did not stop at the timed out command", ResponseLength);
+
+  Benchmark_ExpectTimeout ("batched chip erase did not time out", Response[4]);
+
+  /* Pipelined pages are acknowledged at once, their timeout being reported by the command after them */
+  Benchmark_SetParameter (PARAM_PROG_PIPELINE, 1);
+  Benchmark_SetParameter (PARAM_PROG_SKIP_BLANK, 1);
+
+  if (Benchmark_ProgramNeverReadyPage (Profile, 2, ReadyBusyMode, false) != STATUS_CMD_OK)
+    Benchmark_Fail ("pipelined page write not acknowledged", 2);
+
+  Benchmark_ExpectTimeout ("blank page did not report the pipelined timeout",
+                           Benchmark_ProgramNeverReadyPage (Profile, 3, ReadyBusyMode, true));
+
+  if (Benchmark_ProgramNeverReadyPage (Profile, 4, ReadyBusyMode, false) != STATUS_CMD_OK)
+    Benchmark_Fail ("pipelined page write not acknowledged", 4);
+
+  Response = Benchmark_Execute (LeaveProgmode, sizeof(LeaveProgmode), &ResponseLength);
+  Benchmark_ExpectTimeout ("LEAVE_PROGMODE_ISP did not report the pipelined timeout", Response[1]);
+
+  /* A timeout left behind by a host which signs on afresh is not reported to the new one */
+  Benchmark_Expect (EnterProgmode, sizeof(EnterProgmode), 1);
+
+  if (Benchmark_ProgramNeverReadyPage (Profile, 5, ReadyBusyMode, false) != STATUS_CMD_OK)
+    Benchmark_Fail ("pipelined page write not acknowledged", 5);
+
+  Benchmark_Expect (SignOn, sizeof(SignOn), 1);
+  Benchmark_Expect (EnterProgmode, sizeof(EnterProgmode), 1);
+  Benchmark_Expect (LeaveProgmode, sizeof(LeaveProgmode), 1);
+}
+
+/** Builds an XPROG command packet with a big endian address field.
+ *
+ *  \return Length of the command packet up to and including the address field
+ */
+static uint16_t
+Benchmark_XPROGHeader (uint8_t* const Command, const uint8_t XPROGCommand,
+                       const uint8_t MemoryType, const int8_t PageMode,
+                       const uint32_t Address)
+{
+  uint16_t Length = 0;
+
+  Command[Length++] = CMD_XPROG;
+  Command[Length++] = XPROGCommand;
+  Command[Length++] = MemoryType;
+
+  if (PageMode >= 0)
+    Command[Length++] = PageMode;
+
+  Command[Length++] = Address >> 24;
+  Command[Length++] = Address >> 16;
+  Command[Length++] = Address >> 8;
+  Command[Length++] = Address;
+
+  return Length;
+}
+
+/** Writes a memory of the target through XPROG, in blocks of at most one page and \ref BENCHMARK_BLOCK_SIZE
+ *  bytes. Blocks of pages larger than that are written to the page buffer first and committed with the last.
+ */
+static void
+Benchmark_XPROGWrite (const uint8_t MemoryType, const uint32_t BaseAddress,
+                      const uint8_t* const Data, const uint32_t Size,
+                      const uint16_t PageSize, const uint8_t FirstMode,
+                      const uint8_t LastMode)
+{
+  uint8_t Command[16 + BENCHMARK_BLOCK_SIZE];
+  uint16_t BlockSize = MIN(PageSize, BENCHMARK_BLOCK_SIZE);
+
+  for (uint32_t Offset = 0; Offset < Size; Offset += BlockSize)
+    {
+      uint8_t PageMode = 0;
+
+      if (!(Offset % PageSize))
+        PageMode |= FirstMode;
+
+      if (!((Offset + BlockSize) % PageSize))
+        PageMode |= LastMode;
+
+      uint16_t Length = Benchmark_XPROGHeader (Command, XPROG_CMD_WRITE_MEM, MemoryType, PageMode,
+                                               BaseAddress + Offset);
+
+      Command[Length++] = BlockSize >> 8;
+      Command[Length++] = BlockSize & 0xFF;
+      memcpy (&Command[Length], &Data[Offset], BlockSize);
+
+      Benchmark_Expect (Command, Length + BlockSize, 2);
+    }
+}
+
+/** Reads a memory of the target through XPROG, in blocks of the given size. */
+static void
+Benchmark_XPROGRead (const uint32_t BaseAddress, uint8_t* const Data,
+                     const uint32_t Size, const uint16_t ReadBlockSize)
+{
+  uint8_t Command[16];
+
+  for (uint32_t Offset = 0; Offset < Size; Offset += ReadBlockSize)
+    {
+      uint16_t BlockSize = MIN(Size - Offset, ReadBlockSize);
+      uint16_t Length = Benchmark_XPROGHeader (Command, XPROG_CMD_READ_MEM, XPROG_MEM_TYPE_APPL, -1,
+                                               BaseAddress + Offset);
+
+      Command[Length++] = BlockSize >> 8;
+      Command[Length++] = BlockSize & 0xFF;
+
+      uint32_t ResponseLength;
+      const uint8_t* Response = Benchmark_Execute (Command, Length, &ResponseLength);
+
+      if ((ResponseLength != (BlockSize + 3)) || (Response[2] != XPROG_ERR_OK))
+        {
+          Benchmark_Fail ("XPROG READ_MEM response", ResponseLength);
+          return;
+        }
+
+      memcpy (&Data[Offset], &Response[3], BlockSize);
+    }
+}
+
+/** Runs the avrdude PDI or TPI sequence: sign-on, protocol and parameter setup, enter programming mode,
+ *  signature, chip erase, flash (and for PDI, EEPROM) program and verify, leave programming mode.
+ */
+static void
+Benchmark_RunXPROG (const Benchmark_Scenario_t* const Scenario)
+{
+  const HostTarget_Profile_t* Profile = Scenario->Profile;
+  bool IsPDI = (Profile->Interface == HOSTTARGET_INTERFACE_PDI);
+  uint32_t FlashBase = IsPDI ? 0x0800000UL : 0x4000;
+  uint32_t SignatureBase = IsPDI ? 0x1000090UL : 0x3FC0;
+  uint32_t EEPROMBase = 0x08C0000UL;
+  uint16_t ReadBlockSize = Scenario->LargeBlocks ? BENCHMARK_LARGE_BLOCK_SIZE : BENCHMARK_BLOCK_SIZE;
+  uint8_t Command[16];
+  uint8_t Signature[3];
+  uint64_t PhaseStart;
+
+  if (Scenario->Batched)
+    Benchmark_StartBatch ();
+
+  Command[0] = CMD_SIGN_ON;
+  Benchmark_Expect (Command, 1, 1);
+
+  uint8_t SetMode[] = { CMD_XPROG_SETMODE, IsPDI ? XPROG_PROTOCOL_PDI : XPROG_PROTOCOL_TPI };
+  Benchmark_Expect (SetMode, sizeof(SetMode), 1);
+
+  if (IsPDI)
+    {
+      static const uint8_t SetNVMBase[] = { CMD_XPROG, XPROG_CMD_SET_PARAM, XPROG_PARAM_NVMBASE, 0x01, 0x00, 0x01, 0xC0 };
+      static const uint8_t SetEEPageSize[] = { CMD_XPROG, XPROG_CMD_SET_PARAM, XPROG_PARAM_EEPPAGESIZE, 0x00, 32 };
+      Benchmark_Expect (SetNVMBase, sizeof(SetNVMBase), 2);
+      Benchmark_Expect (SetEEPageSize, sizeof(SetEEPageSize), 2);
+    }
+  else
+    {
+      static const uint8_t SetNVMCMD[] = { CMD_XPROG, XPROG_CMD_SET_PARAM, XPROG_PARAM_NVMCMD_REG, 0x33 };
+      static const uint8_t SetNVMCSR[] = { CMD_XPROG, XPROG_CMD_SET_PARAM, XPROG_PARAM_NVMCSR_REG, 0x32 };
+      Benchmark_Expect (SetNVMCMD, sizeof(SetNVMCMD), 2);
+      Benchmark_Expect (SetNVMCSR, sizeof(SetNVMCSR), 2);
+    }
+
+  static const uint8_t EnterProgmode[] = { CMD_XPROG, XPROG_CMD_ENTER_PROGMODE };
+  Benchmark_Expect (EnterProgmode, sizeof(EnterProgmode), 2);
+
+  if (Scenario->Batched)
+    {
+      uint16_t ReadLength = Benchmark_XPROGHeader (Command, XPROG_CMD_READ_MEM, XPROG_MEM_TYPE_APPL, -1,
+                                                   SignatureBase);
+      Command[ReadLength++] = 0;
+      Command[ReadLength++] = sizeof(Signature);
+      Benchmark_Expect (Command, ReadLength, 2);
+
+      /* The signature bytes close the batch response */
+      uint32_t ResponseLength;
+      const uint8_t* Response = Benchmark_RunBatch (&ResponseLength);
+
+      if (ResponseLength >= sizeof(Signature))
+        memcpy (Signature, &Response[ResponseLength - sizeof(Signature)], sizeof(Signature));
+    }
+  else
+    {
+      Benchmark_XPROGRead (SignatureBase, Signature, sizeof(Signature), BENCHMARK_BLOCK_SIZE);
+    }
+
+  if (memcmp (Signature, Profile->Signature, sizeof(Signature)))
+    Benchmark_Fail ("signature mismatch", Signature[2]);
+
+  uint16_t Length = Benchmark_XPROGHeader (Command, XPROG_CMD_ERASE, XPROG_ERASE_CHIP, -1, FlashBase);
+  Benchmark_Expect (Command, Length, 2);
+
+  PhaseStart = HostClock_Cycles;
+
+  if (IsPDI)
+    {
+      Benchmark_XPROGWrite (XPROG_MEM_TYPE_APPL, FlashBase, Benchmark_FlashImage, Profile->FlashSize,
+                            Profile->FlashPageSize, XPROG_PAGEMODE_ERASE, XPROG_PAGEMODE_WRITE);
+    }
+  else
+    {
+      Benchmark_XPROGWrite (XPROG_MEM_TYPE_APPL, FlashBase, Benchmark_FlashImage, Profile->FlashSize,
+                            Profile->FlashPageSize, 0, XPROG_PAGEMODE_WRITE);
+    }
+
+  Benchmark_ReportPhase ("flash program", Profile->FlashSize, HostClock_Cycles - PhaseStart);
+
+  PhaseStart = HostClock_Cycles;
+
+  if (Scenario->CRCVerify)
+    {
+      Length = Benchmark_XPROGHeader (Command, XPROG_CMD_READ_MEM_CRC, XPROG_MEM_TYPE_APPL, -1, FlashBase);
+      Command[Length++] = Profile->FlashSize >> 24;
+      Command[Length++] = Profile->FlashSize >> 16;
+      Command[Length++] = Profile->FlashSize >> 8;
+      Command[Length++] = Profile->FlashSize;
+
+      const uint8_t* Response = Benchmark_Expect (Command, Length, 2);
+      uint32_t ReadBackCRC = ((uint32_t) Response[3] << 24) | ((uint32_t) Response[4] << 16)
+          | ((uint32_t) Response[5] << 8) | Response[6];
+
+      if (ReadBackCRC != Benchmark_ImageCRC (Benchmark_FlashImage, Profile->FlashSize))
+        Benchmark_Fail ("flash CRC mismatch", ReadBackCRC);
+
+      Benchmark_ReportPhase ("flash CRC", Profile->FlashSize, HostClock_Cycles - PhaseStart);
+    }
+  else
+    {
+      Benchmark_XPROGRead (FlashBase, Benchmark_ReadBack, Profile->FlashSize, ReadBlockSize);
+      Benchmark_ReportPhase ("flash read", Profile->FlashSize, HostClock_Cycles - PhaseStart);
+      Benchmark_Verify ("flash", Benchmark_FlashImage, Benchmark_ReadBack, Profile->FlashSize);
+    }
+
+  if (IsPDI)
+    {
+      static const uint8_t ReadCRC[] = { CMD_XPROG, XPROG_CMD_CRC, XPROG_CRC_FLASH };
+      const uint8_t* Response = Benchmark_Expect (ReadCRC, sizeof(ReadCRC), 2);
+
+      uint32_t ReadBackCRC = ((uint32_t) Response[3] << 16) | Response[4] | ((uint16_t) Response[5] << 8);
+
+      if (ReadBackCRC != (Benchmark_ImageCRC (Benchmark_FlashImage, Profile->FlashSize) & 0x00FFFFFF))
+        Benchmark_Fail ("flash CRC mismatch", ReadBackCRC);
+
+      PhaseStart = HostClock_Cycles;
+      Benchmark_XPROGWrite (XPROG_MEM_TYPE_EEPROM, EEPROMBase, Benchmark_EEPROMImage,
+                            Profile->EEPROMSize, Profile->EEPROMPageSize,
+                            XPROG_PAGEMODE_ERASE, XPROG_PAGEMODE_WRITE);
+      Benchmark_ReportPhase ("EEPROM program", Profile->EEPROMSize, HostClock_Cycles - PhaseStart);
+
+      PhaseStart = HostClock_Cycles;
+      Benchmark_XPROGRead (EEPROMBase, Benchmark_ReadBack, Profile->EEPROMSize, ReadBlockSize);
+      Benchmark_ReportPhase ("EEPROM read", Profile->EEPROMSize, HostClock_Cycles - PhaseStart);
+      Benchmark_Verify ("EEPROM", Benchmark_EEPROMImage, Benchmark_ReadBack, Profile->EEPROMSize);
+    }
+
+  static const uint8_t LeaveProgmode[] = { CMD_XPROG, XPROG_CMD_LEAVE_PROGMODE };
+  Benchmark_Expect (LeaveProgmode, sizeof(LeaveProgmode), 2);
+
+  if (Scenario->Batched)
+    Benchmark_CheckBatchStop ();
+}
+
+/** Appends a segment to a standalone image.
+ *
+ *  \param[in,out] Image   Standalone image, header included
+ *  \param[in,out] Length  Length of the image in bytes
+ *  \param[in]     Memory  Target memory of the segment, a \c STANDALONE_MEMORY_* value
+ *  \param[in]     Address Start address of the segment in the target memory
+ *  \param[in]     Data    Data of the segment
+ *  \param[in]     Size    Length of the segment data in bytes
+ */
+static void
+Benchmark_AddStandaloneSegment (uint8_t* const Image, uint16_t* const Length,
+                                const uint8_t Memory, const uint32_t Address,
+                                const uint8_t* const Data, const uint16_t Size)
+{
+  Standalone_SegmentHeader_t Segment = { .Memory = Memory, .Address = Address, .Length = Size };
+
+  memcpy (&Image[*Length], &Segment, sizeof(Segment));
+  memcpy (&Image[*Length + sizeof(Segment)], Data, Size);
+
+  *Length += (sizeof(Segment) + Size);
+}
+
+/** Runs a standalone programming session: sign-on, upload of an image holding an application at the bottom of
+ *  flash, a bootloader at the top, an EEPROM block (except for TPI), fuses and a lock byte, and a standalone run
+ *  from it. The target memories are then checked directly against the image.
+ */
+static void
+Benchmark_RunStandalone (const Benchmark_Scenario_t* const Scenario)
+{
+  const HostTarget_Profile_t* Profile = Scenario->Profile;
+  uint8_t Image[STANDALONE_STORE_SIZE];
+  uint16_t ImageLength = sizeof(Standalone_ImageHeader_t);
+  uint8_t Command[5 + BENCHMARK_STANDALONE_BLOCK_SIZE];
+  uint32_t BootAddress = Profile->FlashSize - BENCHMARK_STANDALONE_BOOT_SIZE;
+  uint64_t PhaseStart;
+
+  Command[0] = CMD_SIGN_ON;
+  Benchmark_Expect (Command, 1, 1);
+
+  Benchmark_AddStandaloneSegment (Image, &ImageLength, STANDALONE_MEMORY_FLASH, 0, Benchmark_FlashImage,
+                                  BENCHMARK_STANDALONE_APP_SIZE);
+  Benchmark_AddStandaloneSegment (Image, &ImageLength, STANDALONE_MEMORY_FLASH, BootAddress,
+                                  &Benchmark_FlashImage[BootAddress], BENCHMARK_STANDALONE_BOOT_SIZE);
+
+  if (Profile->Interface == HOSTTARGET_INTERFACE_TPI)
+    {
+      static const uint8_t ConfigByte[] = { 0xFE };
+      Benchmark_AddStandaloneSegment (Image, &ImageLength, STANDALONE_MEMORY_FUSE, 0, ConfigByte,
+                                      sizeof(ConfigByte));
+    }
+  else
+    {
+      static const uint8_t Fuses[] = { 0xE2, 0xD9, 0xFD };
+      Benchmark_AddStandaloneSegment (Image, &ImageLength, STANDALONE_MEMORY_EEPROM, BENCHMARK_STANDALONE_EE_ADDRESS,
+                                      &Benchmark_EEPROMImage[BENCHMARK_STANDALONE_EE_ADDRESS],
+                                      BENCHMARK_STANDALONE_EE_SIZE);
+      Benchmark_AddStandaloneSegment (Image, &ImageLength, STANDALONE_MEMORY_FUSE, 0, Fuses, sizeof(Fuses));
+    }
+
+  static const uint8_t LockByte[] = { 0xFC };
+  Benchmark_AddStandaloneSegment (Image, &ImageLength, STANDALONE_MEMORY_LOCK, 0, LockByte, sizeof(LockByte));
+
+  Standalone_ImageHeader_t Header =
+    { .Magic = STANDALONE_IMAGE_MAGIC, .Length = ImageLength - sizeof(Standalone_ImageHeader_t),
+      .CRC = Benchmark_ImageCRC (&Image[sizeof(Standalone_ImageHeader_t)], ImageLength - sizeof(Standalone_ImageHeader_t)),
+      .FlashPageSize = Profile->FlashPageSize, .EEPROMPageSize = Profile->EEPROMPageSize,
+      .SCKDuration = BENCHMARK_ISP_SCK_DURATION };
+
+  if (Profile->Interface == HOSTTARGET_INTERFACE_PDI)
+    Header.Protocol = STANDALONE_PROTOCOL_PDI;
+  else if (Profile->Interface == HOSTTARGET_INTERFACE_TPI)
+    Header.Protocol = STANDALONE_PROTOCOL_TPI;
+  else
+    Header.Protocol = STANDALONE_PROTOCOL_ISP;
+
+  memcpy (Header.Signature, Profile->Signature, sizeof(Header.Signature));
+  memcpy (Image, &Header, sizeof(Header));
+
+  PhaseStart = HostClock_Cycles;
+
+  for (uint16_t Offset = 0; Offset < ImageLength; Offset += BENCHMARK_STANDALONE_BLOCK_SIZE)
+    {
+      uint16_t BlockSize = MIN(ImageLength - Offset, BENCHMARK_STANDALONE_BLOCK_SIZE);
+
+      Command[0] = CMD_STANDALONE_WRITE_IMAGE;
+      Command[1] = Offset >> 8;
+      Command[2] = Offset & 0xFF;
+      Command[3] = BlockSize >> 8;
+      Command[4] = BlockSize & 0xFF;
+      memcpy (&Command[5], &Image[Offset], BlockSize);
+
+      Benchmark_Expect (Command, 5 + BlockSize, 1);
+    }
+
+  Benchmark_ReportPhase ("image upload", ImageLength, HostClock_Cycles - PhaseStart);
+
+  PhaseStart = HostClock_Cycles;
+
+  Command[0] = CMD_STANDALONE_RUN;
+  const uint8_t* Response = Benchmark_Expect (Command, 1, 1);
+
+  if (Response[2] != STANDALONE_RESULT_PASS)
+    Benchmark_Fail ("standalone run result", Response[2]);
+
+  Benchmark_ReportPhase ("standalone run", ImageLength, HostClock_Cycles - PhaseStart);
+
+  /* Everything outside the segments must have been left erased */
+  memset (Benchmark_ReadBack, 0xFF, Profile->FlashSize);
+  memcpy (Benchmark_ReadBack, Benchmark_FlashImage, BENCHMARK_STANDALONE_APP_SIZE);
+  memcpy (&Benchmark_ReadBack[BootAddress], &Benchmark_FlashImage[BootAddress], BENCHMARK_STANDALONE_BOOT_SIZE);
+  Benchmark_Verify ("flash", Benchmark_ReadBack, HostTarget_Flash, Profile->FlashSize);
+
+  if (Profile->Interface != HOSTTARGET_INTERFACE_TPI)
+    {
+      Benchmark_Verify ("EEPROM", &Benchmark_EEPROMImage[BENCHMARK_STANDALONE_EE_ADDRESS],
+                        &HostTarget_EEPROM[BENCHMARK_STANDALONE_EE_ADDRESS], BENCHMARK_STANDALONE_EE_SIZE);
+    }
+}
+
+/** Decodes a big endian 32-bit value of a response. */
+static uint32_t
+Benchmark_Read32BE (const uint8_t* const Data)
+{
+  return ((uint32_t) Data[0] << 24) | ((uint32_t) Data[1] << 16) | ((uint32_t) Data[2] << 8) | Data[3];
+}
+
+/** Reads back the firmware's latency profile of every command of the scenario, and reports the time they spent in
+ *  each phase as measured by the firmware itself.
+ */
+static void
+Benchmark_ReportProfile (void)
+{
+  printf ("  %-22s %7s %10s %10s %10s %10s %10s %10s\n", "profile ms", "count", "max", "process", "usb out",
+          "usb in", "poll", "delay");
+
+  for (uint8_t Slot = 0; Slot < PROFILER_COMMAND_SLOTS; Slot++)
+    {
+      uint8_t Command[] = { CMD_READ_PROFILE, Slot };
+      uint32_t ResponseLength;
+      const uint8_t* Response = Benchmark_Execute (Command, sizeof(Command), &ResponseLength);
+
+      if ((ResponseLength < 2) || (Response[1] != STATUS_CMD_OK))
+        {
+          Benchmark_Fail ("READ_PROFILE status", (ResponseLength < 2) ? 0 : Response[1]);
+          return;
+        }
+
+      if ((ResponseLength < (6 + (4 * (1 + PROFILER_PHASES)) + (2 * PROFILER_HISTOGRAM_BUCKETS))) || !(Response[3]))
+        break;
+
+      double MSPerTick = Response[2] / 1000.0;
+      uint16_t Count = ((uint16_t) Response[4] << 8) | Response[5];
+      const uint8_t* Histogram = &Response[10];
+      const uint8_t* PhaseTicks = &Histogram[2 * PROFILER_HISTOGRAM_BUCKETS];
+      uint32_t HistogramCount = 0;
+
+      printf ("  %-22s %7u %10.1f", Benchmark_CommandName (Response[3]), Count,
+              Benchmark_Read32BE (&Response[6]) * MSPerTick);
+
+      for (uint8_t Bucket = 0; Bucket < PROFILER_HISTOGRAM_BUCKETS; Bucket++)
+        HistogramCount += ((uint16_t) Histogram[2 * Bucket] << 8) | Histogram[(2 * Bucket) + 1];
+
+      for (uint8_t Phase = 0; Phase < PROFILER_PHASES; Phase++)
+        printf (" %10.1f", Benchmark_Read32BE (&PhaseTicks[4 * Phase]) * MSPerTick);
+
+      printf ("\n");
+
+      if (HistogramCount != Count)
+        Benchmark_Fail ("profile histogram does not add up to the command count", Response[3]);
+    }
+}
+
+/** Reads back and clears the protocol trace of the scenario, checking it against the commands issued, and reports
+ *  the slowest command traced.
+ */
+static void
+Benchmark_CheckTrace (void)
+{
+  uint32_t CommandsIssued = 0;
+
+  for (uint16_t Key = 0; Key < BENCHMARK_COMMAND_KEYS; Key++)
+    CommandsIssued += Benchmark_Commands[Key].Count;
+
+  uint8_t Command[] = { CMD_READ_TRACE, TRACE_READ_CLEAR };
+  uint32_t ResponseLength;
+  const uint8_t* Response = Benchmark_Execute (Command, sizeof(Command), &ResponseLength);
+
+  if ((ResponseLength < 5) || (Response[1] != STATUS_CMD_OK))
+    {
+      Benchmark_Fail ("READ_TRACE status", (ResponseLength < 2) ? 0 : Response[1]);
+      return;
+    }
+
+  uint8_t RecordCount = Response[2];
+  uint16_t Sequence = ((uint16_t) Response[3] << 8) | Response[4];
+
+  if ((RecordCount != MIN(CommandsIssued, TRACE_RECORDS)) || (Sequence != (CommandsIssued & 0xFFFF))
+      || (ResponseLength != (5 + (RecordCount * sizeof(Trace_Record_t)))))
+    {
+      Benchmark_Fail ("trace does not match the commands issued", RecordCount);
+      return;
+    }
+
+  Trace_Record_t Slowest = { .Duration = 0 };
+  uint16_t PreviousTimestamp = 0;
+
+  for (uint8_t RecordIndex = 0; RecordIndex < RecordCount; RecordIndex++)
+    {
+      Trace_Record_t Record;
+      memcpy (&Record, &Response[5 + (RecordIndex * sizeof(Trace_Record_t))], sizeof(Trace_Record_t));
+
+      /* Timestamps wrap every 67s or so of simulated time, so only a step back of under half the range is out of
+       * order */
+      if (RecordIndex && ((int16_t) (Record.Timestamp - PreviousTimestamp) < 0))
+        Benchmark_Fail ("trace records out of order", RecordIndex);
+
+      if (Record.Duration >= Slowest.Duration)
+        Slowest = Record;
+
+      PreviousTimestamp = Record.Timestamp;
+    }
+
+  uint16_t SlowestKey = Slowest.Command;
+
+  if (SlowestKey == CMD_XPROG)
+    SlowestKey = 0x100 | (Slowest.SubCommand & 0x0F);
+
+  printf ("  trace %u of %u records; slowest %s 0x%02X at 0x%08lX, %u B, status 0x%02X, %.2f ms\n",
+          RecordCount, Sequence, Benchmark_CommandName (SlowestKey), Slowest.SubCommand,
+          (unsigned long) Slowest.Address, Slowest.Length, Slowest.Status,
+          (Slowest.Duration << TRACE_DURATION_SHIFT) * TIMEBASE_US_PER_TICK / 1000.0);
+}
+
+/** Reads back the health counters of the scenario, checking that a session was entered without synchronization
+ *  failures, and with only the timeouts the scenario expects.
+ *
+ *  \param[in] Scenario  Scenario run
+ */
+static void
+Benchmark_CheckHealth (const Benchmark_Scenario_t* const Scenario)
+{
+  uint8_t Command[] = { CMD_READ_HEALTH };
+  uint32_t ResponseLength;
+  const uint8_t* Response = Benchmark_Execute (Command, sizeof(Command), &ResponseLength);
+
+  if ((ResponseLength != (3 + (4 * HEALTH_COUNTERS))) || (Response[1] != STATUS_CMD_OK)
+      || (Response[2] != HEALTH_COUNTERS))
+    {
+      Benchmark_Fail ("READ_HEALTH response", (ResponseLength < 2) ? 0 : Response[1]);
+      return;
+    }
+
+  uint32_t Counters[HEALTH_COUNTERS];
+
+  for (uint8_t Counter = 0; Counter < HEALTH_COUNTERS; Counter++)
+    Counters[Counter] = Benchmark_Read32BE (&Response[3 + (4 * Counter)]);
+
+  printf ("  health %lu sessions, %lu pages written, %lu B read, %lu timeouts, %lu sync failures, %lu s busy\n",
+          (unsigned long) Counters[HEALTH_SESSIONS], (unsigned long) Counters[HEALTH_PAGES_WRITTEN],
+          (unsigned long) Counters[HEALTH_BYTES_READ], (unsigned long) Counters[HEALTH_TIMEOUTS],
+          (unsigned long) Counters[HEALTH_SYNC_FAILURES], (unsigned long) Counters[HEALTH_BUSY_SECONDS]);
+
+  if (!(Counters[HEALTH_SESSIONS]))
+    Benchmark_Fail ("no session counted", 0);
+
+  if (Counters[HEALTH_TIMEOUTS] != Scenario->Timeouts)
+    Benchmark_Fail ("timeouts counted", Counters[HEALTH_TIMEOUTS]);
+
+  if (Counters[HEALTH_SYNC_FAILURES])
+    Benchmark_Fail ("synchronization failures counted", Counters[HEALTH_SYNC_FAILURES]);
+}
+
+/** Runs the idle main loop for long enough to commit the non-volatile parameter values, and to write every byte of
+ *  the journal record.
+ *
+ *  \return Longest time taken by a pass writing back the parameter values, in cycles
+ */
+static uint64_t
+Benchmark_RunIdle (void)
+{
+  uint64_t IdleEnd = HostClock_Cycles
+      + HOSTCLOCK_US_TO_CYCLES((NV_PARAMS_COMMIT_DELAY_MS * 1000UL)
+                               + (2 * sizeof(NonVolatileRecord_t) * HOSTEEPROM_WRITE_US));
+  uint64_t LongestPass = 0;
+
+  while (HostClock_Cycles < IdleEnd)
+    {
+      uint64_t PassStart = HostClock_Cycles;
+
+      V2Params_WriteBackNonVolatileParamValues ();
+      LongestPass = MAX(LongestPass, HostClock_Cycles - PassStart);
+
+      HostClock_Advance (HOSTCLOCK_US_TO_CYCLES(BENCHMARK_IDLE_PASS_US));
+    }
+
+  return LongestPass;
+}
+
+/** Writes back the non-volatile parameter values left by the scenario as the idle main loop would, checking that no
+ *  pass of the loop waits on the EEPROM, that values set again unchanged are not committed again, and that the
+ *  committed values load back.
+ */
+static void
+Benchmark_CheckWriteBack (void)
+{
+  uint8_t ResetPolarity = V2Params_GetParameterValue (PARAM_RESET_POLARITY);
+  uint8_t SCKDuration = V2Params_GetParameterValue (PARAM_SCK_DURATION);
+  uint32_t WritesBefore = HostEEPROM_ByteWrites;
+
+  uint64_t LongestPass = Benchmark_RunIdle ();
+
+  if (LongestPass > HOSTCLOCK_US_TO_CYCLES(BENCHMARK_IDLE_PASS_LIMIT_US))
+    Benchmark_Fail ("write-back held up the main loop, us", (uint32_t) HOSTCLOCK_CYCLES_TO_US(LongestPass));
+
+  uint32_t CommitWrites = (HostEEPROM_ByteWrites - WritesBefore);
+
+  V2Params_SetParameterValue (PARAM_SCK_DURATION, SCKDuration);
+  Benchmark_RunIdle ();
+
+  if (HostEEPROM_ByteWrites != (WritesBefore + CommitWrites))
+    Benchmark_Fail ("unchanged parameters committed again", HostEEPROM_ByteWrites - WritesBefore - CommitWrites);
+
+  V2Params_LoadNonVolatileParamValues ();
+
+  if ((V2Params_GetParameterValue (PARAM_RESET_POLARITY) != ResetPolarity)
+      || (V2Params_GetParameterValue (PARAM_SCK_DURATION) != SCKDuration))
+    Benchmark_Fail ("committed parameters did not load back", SCKDuration);
+
+  printf ("  parameter write-back %lu EEPROM cell writes, longest idle pass %.1f us\n", (unsigned long) CommitWrites,
+          HOSTCLOCK_CYCLES_TO_US(LongestPass));
+}
+
+/** Runs a benchmark scenario from power-up of the programmer and target, and reports its statistics.
+ *
+ *  \return Boolean \c true if every check of the scenario passed
+ */
+static bool
+Benchmark_Run (const Benchmark_Scenario_t* const Scenario)
+{
+  memset (Benchmark_Commands, 0x00, sizeof(Benchmark_Commands));
+  Benchmark_Failures = 0;
+  HostEEPROM_ByteWrites = 0;
+  HostEEPROM_ReadyAt = 0;
+
+  HostClock_Reset ();
+  HostIO_Reset ();
+  HostUSB_Reset ();
+  HostTarget_Select (Scenario->Profile);
+  Benchmark_FillImages (Scenario);
+
+  /* Same as EVENT_AVRISP_Device_ConfigurationChanged() and the firmware's startup */
+  uint8_t Banks = (Scenario->SingleBank) ? 1 : AVRISP_DATA_EPBANKS;
+
+  Endpoint_ConfigureEndpoint (AVRISP_DATA_OUT_EPADDR, EP_TYPE_BULK, AVRISP_DATA_EPSIZE, Banks);
+
+  if ((AVRISP_DATA_IN_EPADDR & ENDPOINT_EPNUM_MASK) != (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK))
+    Endpoint_ConfigureEndpoint (AVRISP_DATA_IN_EPADDR, EP_TYPE_BULK, AVRISP_DATA_EPSIZE, Banks);
+
+  Timebase_Init ();
+  V2Protocol_Init ();
+  sei ();
+
+  printf ("%s (%s)\n", Scenario->Name, Scenario->Profile->Name);
+
+  if (Scenario->Timeouts)
+    Benchmark_RunTimeouts (Scenario);
+  else if (Scenario->Standalone)
+    Benchmark_RunStandalone (Scenario);
+  else if (Scenario->Profile->Interface == HOSTTARGET_INTERFACE_ISP)
+    Benchmark_RunISP (Scenario);
+  else
+    Benchmark_RunXPROG (Scenario);
+
+  printf ("  %-22s %7s %12s %10s %9s %9s\n", "command", "count", "total ms", "avg us", "out B", "in B");
+
+  for (uint16_t Key = 0; Key < BENCHMARK_COMMAND_KEYS; Key++)
+    {
+      Benchmark_CommandStats_t* Stats = &Benchmark_Commands[Key];
+
+      if (!(Stats->Count))
+        continue;
+
+      printf ("  %-22s %7lu %12.1f %10.1f %9llu %9llu\n", Benchmark_CommandName (Key),
+              (unsigned long) Stats->Count, HOSTCLOCK_CYCLES_TO_US(Stats->Cycles) / 1000.0,
+              HOSTCLOCK_CYCLES_TO_US(Stats->Cycles) / Stats->Count,
+              (unsigned long long) Stats->BytesOut, (unsigned long long) Stats->BytesIn);
+    }
+
+  printf ("  total %.1f ms; SPI %llu B; USART %llu/%llu B tx/rx, %llu line turnarounds; "
+          "USB %llu/%llu packets out/in, %llu endpoint turnarounds; EEPROM %lu cell writes\n",
+          HOSTCLOCK_CYCLES_TO_US(HostClock_Cycles) / 1000.0,
+          (unsigned long long) HostIO_Stats.SPIBytes,
+          (unsigned long long) HostIO_Stats.USARTTxBytes,
+          (unsigned long long) HostIO_Stats.USARTRxBytes,
+          (unsigned long long) HostIO_Stats.LineTurnarounds,
+          (unsigned long long) HostIO_Stats.OUTPackets,
+          (unsigned long long) HostIO_Stats.INPackets,
+          (unsigned long long) HostIO_Stats.EndpointTurnarounds,
+          (unsigned long) HostEEPROM_ByteWrites);
+
+  Benchmark_ReportProfile ();
+  Benchmark_CheckTrace ();
+  Benchmark_CheckHealth (Scenario);
+  Benchmark_CheckWriteBack ();
+
+  if (HostIO_Stats.INPacketsLost)
+    Benchmark_Fail ("IN packets lost on endpoint turnaround", HostIO_Stats.INPacketsLost);
+
+  if (HostIO_Stats.EndpointOverruns)
+    Benchmark_Fail ("endpoint bank overruns", HostIO_Stats.EndpointOverruns);
+
+  if (HostIO_Stats.TargetViolations)
+    Benchmark_Fail ("target instructions sent while busy", HostIO_Stats.TargetViolations);
+
+  printf ("  %s\n\n", Benchmark_Failures ? "FAILED" : "passed");
+
+  return !(Benchmark_Failures);
+}
+
+/** Runs every benchmark scenario, or only those whose names are given on the command line. */
+int
+main (int argc, char* argv[])
+{
+  bool AllPassed = true;
+  bool AnyRun = false;
+
+  for (uint8_t ScenarioIndex = 0;
+      ScenarioIndex < (sizeof(Benchmark_Scenarios) / sizeof(Benchmark_Scenarios[0])); ScenarioIndex++)
+    {
+      const Benchmark_Scenario_t* Scenario = &Benchmark_Scenarios[ScenarioIndex];
+      bool Selected = (argc < 2);
+
+      for (int Arg = 1; Arg < argc; Arg++)
+        {
+          if (!(strcmp (argv[Arg], Scenario->Name)))
+            Selected = true;
+        }
+
+      if (!(Selected))
+        continue;
+
+      AnyRun = true;
+      AllPassed &= Benchmark_Run (Scenario);
+    }
+
+  if (!(AnyRun))
+    {
+      fprintf (stderr, "No such scenario\n");
+      return EXIT_FAILURE;
+    }
+
+  return AllPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,201 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Simulated CPU clock of the host-native build. Time only passes when the firmware waits on something
+ *  (a bus transfer, a delay, a polled register or an endpoint bank), which makes the simulated time of a
+ *  command the sum of its bus and wait times rather than of its instruction count.
+ *
+ *  The 16-bit Timer 3 is modelled in the modes the firmware uses, so that its interrupts - and with them the
+ *  command timeout - run against the simulated time.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "HostClock.h"
+
+/** Interrupt handlers of the modelled timer, resolved to \c NULL when the firmware does not define them. */
+void HostISR_TIMER3_OVF (void) __attribute__((weak));
+void HostISR_TIMER3_COMPA (void) __attribute__((weak));
+
+/** Current simulated time, in CPU cycles since the start of the run. */
+uint64_t HostClock_Cycles;
+
+/** Flag to indicate that an interrupt handler is running, during which register polling does not advance time. */
+bool HostClock_InISR;
+
+/** Flag to indicate that Timer 3 is clocked, and the simulated time of its next interrupt event if so. */
+static bool HostClock_Timer3Running;
+static uint64_t HostClock_Timer3NextEvent;
+
+/** Timer 3 clock prescalers, indexed by the clock select bits; external clocks are not modelled. */
+static const uint16_t HostClock_Timer3Prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+/** Resets the simulated time and the timer state. */
+void
+HostClock_Reset (void)
+{
+  HostClock_Cycles = 0;
+  HostClock_InISR = false;
+  HostClock_Timer3Running = false;
+}
+
+/** Computes the number of CPU cycles between two interrupt events of Timer 3, from its current configuration.
+ *
+ *  \return CPU cycles per timer period, or 0 if the timer is stopped or in an unmodelled mode
+ */
+static uint64_t
+HostClock_Timer3Period (void)
+{
+  uint16_t Prescaler = HostClock_Timer3Prescalers[TCCR3B & 0x07];
+  uint8_t WaveformMode = (TCCR3A & 0x03) | ((TCCR3B >> 1) & 0x0C);
+  uint32_t Counts;
+
+  switch (WaveformMode)
+    {
+    case 0:
+      Counts = 0x10000;
+      break;
+    case 1:
+    case 2:
+    case 3:
+      /* Phase correct PWM, 8/9/10 bit - counts up to TOP and back down again */
+      Counts = 2 * ((0x100UL << (WaveformMode - 1)) - 1);
+      break;
+    case 4:
+      Counts = (uint32_t) OCR3A + 1;
+      break;
+    case 5:
+    case 6:
+    case 7:
+      Counts = (0x100UL << (WaveformMode - 5));
+      break;
+    case 14:
+      Counts = (uint32_t) ICR3 + 1;
+      break;
+    case 15:
+      Counts = (uint32_t) OCR3A + 1;
+      break;
+    default:
+      Counts = 0;
+      break;
+    }
+
+  return (uint64_t) Counts * Prescaler;
+}
+
+/** Fires the enabled Timer 3 interrupt for the event that has just occurred. */
+static void
+HostClock_Timer3Event (void)
+{
+  bool IsCTC = ((TCCR3B & (1 << WGM32)) && !(TCCR3B & (1 << WGM33)));
+
+  if (!(HostIO_InterruptsEnabled))
+    return;
+
+  HostClock_InISR = true;
+
+  if (IsCTC && (TIMSK3 & (1 << OCIE3A)) && HostISR_TIMER3_COMPA)
+    HostISR_TIMER3_COMPA ();
+  else if (!IsCTC && (TIMSK3 & (1 << TOIE3)) && HostISR_TIMER3_OVF)
+    HostISR_TIMER3_OVF ();
+
+  HostClock_InISR = false;
+}
+
+/** Starts or stops the Timer 3 model to follow any change of its clock select bits made by the firmware. */
+static void
+HostClock_SyncTimer3 (void)
+{
+  uint64_t Period = HostClock_Timer3Period ();
+
+  if (!(Period))
+    {
+      HostClock_Timer3Running = false;
+    }
+  else if (!(HostClock_Timer3Running))
+    {
+      HostClock_Timer3Running = true;
+      HostClock_Timer3NextEvent = HostClock_Cycles + Period;
+    }
+}
+
+/** Computes the current count of Timer 3, from the simulated time left until its next interrupt event. Only the
+ *  count up to the event of the modes the firmware uses is modelled.
+ *
+ *  \return Current timer count, or zero if the timer is stopped
+ */
+uint16_t
+HostClock_Timer3Count (void)
+{
+  uint64_t Period = HostClock_Timer3Period ();
+
+  if (!(HostClock_Timer3Running) || !(Period) || (HostClock_Timer3NextEvent < HostClock_Cycles))
+    return 0;
+
+  return (Period - (HostClock_Timer3NextEvent - HostClock_Cycles)) / HostClock_Timer3Prescalers[TCCR3B & 0x07];
+}
+
+/** Advances the simulated time to the given absolute cycle count, firing timer interrupts on the way.
+ *
+ *  \param[in] Cycle  Simulated time to advance to; times in the past are ignored
+ */
+void
+HostClock_AdvanceTo (const uint64_t Cycle)
+{
+  if (HostClock_InISR)
+    return;
+
+  HostClock_SyncTimer3 ();
+
+  while (HostClock_Timer3Running && (HostClock_Timer3NextEvent <= Cycle))
+    {
+      HostClock_Cycles = HostClock_Timer3NextEvent;
+      HostClock_Timer3Event ();
+
+      HostClock_Timer3Running = false;
+      HostClock_SyncTimer3 ();
+    }
+
+  if (Cycle > HostClock_Cycles)
+    HostClock_Cycles = Cycle;
+}
+
+/** Advances the simulated time by the given number of CPU cycles.
+ *
+ *  \param[in] Cycles  Number of CPU cycles to let pass
+ */
+void
+HostClock_Advance (const uint64_t Cycles)
+{
+  HostClock_AdvanceTo (HostClock_Cycles + Cycles);
+}
@@ -0,0 +1,67 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for HostClock.c.
+ */
+
+#ifndef _HOST_CLOCK_
+#define _HOST_CLOCK_
+
+/* Includes: */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Macros: */
+/** Converts a duration in microseconds into simulated CPU cycles. */
+#define HOSTCLOCK_US_TO_CYCLES(us)      ((uint64_t)(us) * (F_CPU / 1000000UL))
+
+/** Converts a number of simulated CPU cycles into microseconds. */
+#define HOSTCLOCK_CYCLES_TO_US(Cycles)  ((double)(Cycles) / (F_CPU / 1000000UL))
+
+/** CPU cycles per USB full-speed frame. */
+#define HOSTCLOCK_CYCLES_PER_FRAME      (F_CPU / 1000UL)
+
+/* External Variables: */
+extern uint64_t HostClock_Cycles;
+extern bool HostClock_InISR;
+
+/* Function Prototypes: */
+void
+HostClock_Reset (void);
+void
+HostClock_Advance (const uint64_t Cycles);
+void
+HostClock_AdvanceTo (const uint64_t Cycle);
+uint16_t
+HostClock_Timer3Count (void);
+
+#endif
@@ -0,0 +1,425 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Simulated I/O register file of the host-native build, and the glue between the firmware's peripheral
+ *  accesses and the simulated target.
+ */
+
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "HostClock.h"
+#include "HostTarget.h"
+
+#define HOSTIO_DEFINE_8(Name)     volatile uint8_t Name;
+#define HOSTIO_DEFINE_16(Name)    volatile uint16_t Name;
+HOSTIO_REGISTERS_8(HOSTIO_DEFINE_8)
+HOSTIO_REGISTERS_16(HOSTIO_DEFINE_16)
+
+/** Global interrupt enable flag, the I bit of the simulated SREG. */
+bool HostIO_InterruptsEnabled;
+
+/** Bus and USB activity counters, accumulated over the whole run. */
+HostIO_Stats_t HostIO_Stats;
+
+/** Backing storage of the accessor registers. */
+static volatile uint8_t HostIO_GPIOR1;
+static volatile uint16_t HostIO_TCNT3;
+static volatile uint8_t HostIO_PIND;
+static volatile uint8_t HostIO_UCSR1A;
+static volatile uint8_t HostIO_UDR1;
+
+/** Flag to indicate that the firmware was handed \c UDR1 while transmitting, so its content is a byte to send. */
+static bool HostIO_USARTWritePending;
+
+/** Flag to indicate whether the USART transmitter was enabled at the last USART register access. */
+static bool HostIO_USARTWasSending;
+
+/** Depth of the modelled receive FIFO of the USART in Master SPI mode, deeper than the hardware's so that an overrun
+ *  by the firmware is caught as a target violation rather than lost silently.
+ */
+#define HOSTIO_MSPIM_FIFO_DEPTH   4
+
+/** Bytes received by the USART in Master SPI mode, with the time their last bit has been shifted in. */
+static struct
+{
+  uint8_t Data;
+  uint64_t ReadyAt;
+} HostIO_MSPIMFIFO[HOSTIO_MSPIM_FIFO_DEPTH];
+
+/** Number of bytes held in \ref HostIO_MSPIMFIFO. */
+static uint8_t HostIO_MSPIMFIFOCount;
+
+/** Time the last byte queued on the USART in Master SPI mode has been completely shifted out. */
+static uint64_t HostIO_MSPIMBusyUntil;
+
+/** Time the firmware wrote the pending byte to \c UDR1 in Master SPI mode. */
+static uint64_t HostIO_MSPIMWriteAt;
+
+/** Flag to indicate that the last \c UCSR1A read reported a received byte, so the next \c UDR1 access is its read.
+ *  In Master SPI mode both directions are enabled at once, and a register access alone does not tell a read from a
+ *  write; the firmware reads \c UDR1 only after having seen \c RXC1 set.
+ */
+static bool HostIO_MSPIMReadNext;
+
+/** Backing storage of \c SPDR, holding the byte written by the firmware until it is read back. */
+static volatile uint8_t HostIO_SPDR;
+
+/** Flag to indicate that the firmware has written \c SPDR, so the next access is the read of the received byte.
+ *  Unpolled transfers always write the register and then read it back once the byte time has passed.
+ */
+static bool HostIO_SPDRWritten;
+
+/** Time the firmware wrote the pending byte to \c SPDR. */
+static uint64_t HostIO_SPDRWriteAt;
+
+/** Resets all registers and counters to their power-on state. */
+void
+HostIO_Reset (void)
+{
+#define HOSTIO_RESET(Name)        Name = 0;
+  HOSTIO_REGISTERS_8(HOSTIO_RESET)
+  HOSTIO_REGISTERS_16(HOSTIO_RESET)
+#undef HOSTIO_RESET
+
+  HostIO_GPIOR1 = 0;
+  HostIO_TCNT3 = 0;
+  HostIO_PIND = 0;
+  HostIO_UCSR1A = 0;
+  HostIO_UDR1 = 0;
+  HostIO_USARTWritePending = false;
+  HostIO_USARTWasSending = false;
+  HostIO_MSPIMFIFOCount = 0;
+  HostIO_MSPIMBusyUntil = 0;
+  HostIO_MSPIMWriteAt = 0;
+  HostIO_MSPIMReadNext = false;
+  HostIO_SPDR = 0;
+  HostIO_SPDRWritten = false;
+  HostIO_SPDRWriteAt = 0;
+  HostIO_InterruptsEnabled = false;
+
+  memset (&HostIO_Stats, 0x00, sizeof(HostIO_Stats));
+}
+
+/** Charges the cost of one busy-wait iteration polling a register, unless called from an interrupt handler. */
+static void
+HostIO_Poll (void)
+{
+  HostClock_Advance (HOSTIO_POLL_CYCLES);
+}
+
+/** Accessor for \c GPIOR1, which holds the command timeout counter. Every busy-wait loop of the firmware tests
+ *  it, so each access lets a little time pass for the timeout timer to make progress.
+ */
+volatile uint8_t*
+HostIO_AccessGPIOR1 (void)
+{
+  HostIO_Poll ();
+  return &HostIO_GPIOR1;
+}
+
+/** Accessor for \c TCNT3, which the timebase reads for its sub-millisecond resolution. The count is derived from
+ *  the simulated time of the Timer 3 model; reading it lets no time pass, as it is not polled on its own.
+ */
+volatile uint16_t*
+HostIO_AccessTCNT3 (void)
+{
+  HostIO_TCNT3 = HostClock_Timer3Count ();
+  return &HostIO_TCNT3;
+}
+
+/** Accessor for \c PIND. The USART XCK clock on PD5 runs freely while the USART is in synchronous mode, which
+ *  is modelled by toggling the pin on every read, one read per half XCK period.
+ */
+volatile uint8_t*
+HostIO_AccessPIND (void)
+{
+  HostIO_Poll ();
+
+  if (UCSR1C & (1 << UMSEL10))
+    HostIO_PIND = (PORTD & ~(1 << 5)) | (~HostIO_PIND & (1 << 5));
+  else
+    HostIO_PIND = PORTD;
+
+  return &HostIO_PIND;
+}
+
+/** Number of CPU cycles taken by one bit at the configured synchronous USART baud rate. */
+static uint32_t
+HostIO_USARTBitCycles (void)
+{
+  return 2 * ((uint32_t) UBRR1 + 1);
+}
+
+/** Number of CPU cycles taken by one USART frame at the configured synchronous baud rate. */
+static uint32_t
+HostIO_USARTFrameCycles (void)
+{
+  return HOSTTARGET_BITS_IN_USART_FRAME * HostIO_USARTBitCycles ();
+}
+
+/** Hands a byte written to \c UDR1 over to the target once the firmware has moved on to its next access. */
+static void
+HostIO_FlushUSARTWrite (void)
+{
+  if (!(HostIO_USARTWritePending))
+    return;
+
+  HostIO_USARTWritePending = false;
+
+  HostClock_Advance (HostIO_USARTFrameCycles ());
+  HostIO_Stats.USARTTxBytes++;
+
+  HostTarget_USARTReceive (HostIO_UDR1);
+}
+
+/** Indicates if the USART is configured as a Master SPI, rather than as the PDI/TPI synchronous USART. */
+static bool
+HostIO_IsMSPIM (void)
+{
+  return ((UCSR1C & ((1 << UMSEL11) | (1 << UMSEL10))) == ((1 << UMSEL11) | (1 << UMSEL10)));
+}
+
+/** Number of CPU cycles taken to shift one byte out in Master SPI mode. */
+static uint32_t
+HostIO_MSPIMByteCycles (void)
+{
+  return 8 * 2 * ((uint32_t) UBRR1 + 1);
+}
+
+/** Shifts the byte written to \c UDR1 in Master SPI mode out to the target, once the byte before it has been sent,
+ *  and queues the byte the target answers with in the receive FIFO.
+ */
+static void
+HostIO_FlushMSPIMWrite (void)
+{
+  if (!(HostIO_USARTWritePending))
+    return;
+
+  HostIO_USARTWritePending = false;
+
+  uint64_t Start = (HostIO_MSPIMBusyUntil > HostIO_MSPIMWriteAt) ? HostIO_MSPIMBusyUntil : HostIO_MSPIMWriteAt;
+  HostIO_MSPIMBusyUntil = Start + HostIO_MSPIMByteCycles ();
+  HostIO_Stats.SPIBytes++;
+
+  uint8_t Received = HostTarget_SPITransfer (HostIO_UDR1, HostIO_MSPIMByteCycles ());
+
+  if (HostIO_MSPIMFIFOCount == HOSTIO_MSPIM_FIFO_DEPTH)
+    {
+      HostIO_Stats.TargetViolations++;
+      return;
+    }
+
+  HostIO_MSPIMFIFO[HostIO_MSPIMFIFOCount].Data = Received;
+  HostIO_MSPIMFIFO[HostIO_MSPIMFIFOCount].ReadyAt = HostIO_MSPIMBusyUntil;
+  HostIO_MSPIMFIFOCount++;
+}
+
+/** Status flags of the USART in Master SPI mode. The transmit buffer is free once at most one byte is left to shift
+ *  out, and a byte is received once its last bit has been shifted in.
+ */
+static uint8_t
+HostIO_MSPIMStatus (void)
+{
+  uint8_t Status = 0;
+
+  HostIO_FlushMSPIMWrite ();
+
+  if (HostIO_MSPIMBusyUntil <= HostClock_Cycles + HostIO_MSPIMByteCycles ())
+    Status |= (1 << UDRE1);
+
+  if (HostIO_MSPIMBusyUntil <= HostClock_Cycles)
+    Status |= (1 << TXC1);
+
+  if (HostIO_MSPIMFIFOCount && (HostIO_MSPIMFIFO[0].ReadyAt <= HostClock_Cycles))
+    Status |= (1 << RXC1);
+
+  HostIO_MSPIMReadNext = ((Status & (1 << RXC1)) != 0);
+
+  return Status;
+}
+
+/** Accesses \c UDR1 in Master SPI mode, either taking the oldest received byte or starting a write. */
+static void
+HostIO_AccessMSPIMData (void)
+{
+  HostIO_FlushMSPIMWrite ();
+
+  if (!(HostIO_MSPIMReadNext))
+    {
+      HostIO_USARTWritePending = true;
+      HostIO_MSPIMWriteAt = HostClock_Cycles;
+      return;
+    }
+
+  HostIO_MSPIMReadNext = false;
+  HostIO_UDR1 = HostIO_MSPIMFIFO[0].Data;
+
+  HostIO_MSPIMFIFOCount--;
+  memmove (&HostIO_MSPIMFIFO[0], &HostIO_MSPIMFIFO[1], HostIO_MSPIMFIFOCount * sizeof(HostIO_MSPIMFIFO[0]));
+}
+
+/** Tracks the transmitter and receiver enables, counting turnarounds of the half-duplex data line. */
+static void
+HostIO_SyncUSARTMode (void)
+{
+  bool IsSending = ((UCSR1B & (1 << TXEN1)) != 0);
+
+  if (IsSending == HostIO_USARTWasSending)
+    return;
+
+  HostIO_USARTWasSending = IsSending;
+
+  if (UCSR1B & ((1 << TXEN1) | (1 << RXEN1)))
+    {
+      HostIO_Stats.LineTurnarounds++;
+      HostTarget_USARTTurnaround (IsSending);
+    }
+}
+
+/** Accessor for \c UCSR1A. The status flags are recomputed on every access: the transmitter is always ready, as
+ *  each frame is charged in full when it is sent, and a byte is received once the target has produced one.
+ */
+volatile uint8_t*
+HostIO_AccessUCSR1A (void)
+{
+  HostIO_Poll ();
+
+  if (HostIO_IsMSPIM ())
+    {
+      HostIO_UCSR1A = HostIO_MSPIMStatus ();
+      return &HostIO_UCSR1A;
+    }
+
+  HostIO_FlushUSARTWrite ();
+  HostIO_SyncUSARTMode ();
+
+  HostIO_UCSR1A = (1 << UDRE1) | (1 << TXC1);
+
+  if ((UCSR1B & (1 << RXEN1)) && HostTarget_USARTAvailable ())
+    HostIO_UCSR1A |= (1 << RXC1);
+
+  return &HostIO_UCSR1A;
+}
+
+/** Accessor for \c UDR1. While transmitting the access is a write, delivered to the target on the next USART
+ *  access; while receiving it is a read, which takes the next byte sent by the target.
+ */
+volatile uint8_t*
+HostIO_AccessUDR1 (void)
+{
+  if (HostIO_IsMSPIM ())
+    {
+      HostIO_AccessMSPIMData ();
+      return &HostIO_UDR1;
+    }
+
+  HostIO_FlushUSARTWrite ();
+  HostIO_SyncUSARTMode ();
+
+  if (UCSR1B & (1 << TXEN1))
+    {
+      HostIO_USARTWritePending = true;
+    }
+  else if (HostTarget_USARTAvailable ())
+    {
+      HostClock_Advance (HostIO_USARTBitCycles () * (HostTarget_USARTGuardBits () + HOSTTARGET_BITS_IN_USART_FRAME));
+      HostIO_Stats.USARTRxBytes++;
+
+      HostIO_UDR1 = HostTarget_USARTTransmit ();
+    }
+
+  return &HostIO_UDR1;
+}
+
+/** Exchanges a byte with the target over the hardware SPI bus, charging the bus time for the SCK prescaler
+ *  selected in \c SPCR and \c SPSR, plus the polling of the transfer complete flag.
+ *
+ *  \param[in] Byte  Byte to send to the target
+ *
+ *  \return Byte received from the target
+ */
+/** Computes the CPU cycles the hardware SPI bus takes to shift one byte, for the SCK prescaler selected in \c SPCR
+ *  and \c SPSR.
+ *
+ *  \return Number of CPU cycles per byte
+ */
+static uint32_t
+HostIO_SPIByteCycles (void)
+{
+  static const uint8_t DividerFromSPR[4] = { 4, 16, 64, 128 };
+
+  uint8_t Divider = DividerFromSPR[SPCR & ((1 << SPR1) | (1 << SPR0))];
+
+  if (SPSR & (1 << SPI2X))
+    Divider /= 2;
+
+  return ((uint32_t) Divider * 8);
+}
+
+uint8_t
+HostIO_SPITransfer (const uint8_t Byte)
+{
+  HostClock_Advance (HostIO_SPIByteCycles () + HOSTIO_POLL_CYCLES);
+  HostIO_Stats.SPIBytes++;
+
+  if (!(SPCR & (1 << SPE)))
+    return 0xFF;
+
+  return HostTarget_SPITransfer (Byte, HostIO_SPIByteCycles ());
+}
+
+/** Accessor for \c SPDR, written and then read back by the unpolled hardware SPI transfers. A write starts the
+ *  transfer of the byte; the following read exchanges it with the target, and counts a target violation if the
+ *  firmware has not let the byte time pass since the write.
+ */
+volatile uint8_t*
+HostIO_AccessSPDR (void)
+{
+  if (!(HostIO_SPDRWritten))
+    {
+      HostIO_SPDRWritten = true;
+      HostIO_SPDRWriteAt = HostClock_Cycles;
+      return &HostIO_SPDR;
+    }
+
+  HostIO_SPDRWritten = false;
+
+  if ((HostClock_Cycles - HostIO_SPDRWriteAt) < HostIO_SPIByteCycles ())
+    HostIO_Stats.TargetViolations++;
+
+  HostIO_Stats.SPIBytes++;
+  HostIO_SPDR = (SPCR & (1 << SPE)) ? HostTarget_SPITransfer (HostIO_SPDR, HostIO_SPIByteCycles ()) : 0xFF;
+
+  return &HostIO_SPDR;
+}
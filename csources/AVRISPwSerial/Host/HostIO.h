@@ -0,0 +1,119 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for HostIO.c.
+ *
+ *  Simulated AVR I/O register file for the host-native build. Most registers are plain variables; the few
+ *  whose accesses have side effects on the firmware's hot paths (the command timeout counter, the timebase counter,
+ *  the XCK pin and the USART data and status registers) are routed through accessor functions so that every access is
+ *  seen by the simulation.
+ */
+
+#ifndef _HOST_IO_
+#define _HOST_IO_
+
+/* Includes: */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Macros: */
+/** List of the plain 8-bit I/O registers of the simulated ATmega32U4. */
+#define HOSTIO_REGISTERS_8(X) \
+  X(PINB) X(DDRB) X(PORTB) X(PINC) X(DDRC) X(PORTC) X(DDRD) X(PORTD)   \
+  X(PINE) X(DDRE) X(PORTE) X(PINF) X(DDRF) X(PORTF) X(GPIOR0) X(GPIOR2) \
+  X(TCCR0A) X(TCCR0B) X(TCNT0) X(OCR0A) X(OCR0B) X(TIMSK0) X(TIFR0)    \
+  X(TCCR1A) X(TCCR1B) X(TCCR1C) X(TIMSK1) X(TIFR1)                      \
+  X(TCCR3A) X(TCCR3B) X(TCCR3C) X(TIMSK3) X(TIFR3)                      \
+  X(SPCR) X(SPSR) X(UCSR1B)       X(UCSR1C) X(UCSR1D)                 \
+  X(PCICR) X(PCIFR) X(PCMSK0) X(OSCCAL) X(MCUSR) X(CLKPR)
+
+/** List of the plain 16-bit I/O registers of the simulated ATmega32U4. */
+#define HOSTIO_REGISTERS_16(X) \
+  X(TCNT1) X(OCR1A) X(OCR1B) X(ICR1) X(OCR3A) X(OCR3B) X(ICR3) X(UBRR1)
+
+/** CPU cycles charged for each access to a polled register, approximating one iteration of a busy-wait loop. */
+#define HOSTIO_POLL_CYCLES        2
+
+/* Type Defines: */
+/** Counters of the bus and USB activity caused by the firmware, reported by the benchmark per command. */
+typedef struct
+{
+  uint64_t SPIBytes; /**< Bytes exchanged with the target over the hardware SPI bus */
+  uint64_t USARTTxBytes; /**< Bytes sent to the target over the PDI/TPI USART */
+  uint64_t USARTRxBytes; /**< Bytes received from the target over the PDI/TPI USART */
+  uint64_t LineTurnarounds; /**< Direction changes of the half-duplex PDI/TPI data line */
+  uint64_t EndpointTurnarounds; /**< Direction changes of the shared AVRISP data endpoint */
+  uint64_t OUTPackets; /**< Packets received from the host */
+  uint64_t INPackets; /**< Packets sent to the host */
+  uint64_t INPacketsLost; /**< IN packets still queued when their endpoint was turned around */
+  uint64_t EndpointOverruns; /**< Endpoint accesses beyond the end of a bank */
+  uint64_t TargetViolations; /**< Target instructions received while the target could not accept them */
+} HostIO_Stats_t;
+
+/* External Variables: */
+#define HOSTIO_DECLARE_8(Name)    extern volatile uint8_t Name;
+#define HOSTIO_DECLARE_16(Name)   extern volatile uint16_t Name;
+HOSTIO_REGISTERS_8(HOSTIO_DECLARE_8)
+HOSTIO_REGISTERS_16(HOSTIO_DECLARE_16)
+#undef HOSTIO_DECLARE_8
+#undef HOSTIO_DECLARE_16
+
+extern bool HostIO_InterruptsEnabled;
+extern HostIO_Stats_t HostIO_Stats;
+
+/* Function Prototypes: */
+void
+HostIO_Reset (void);
+volatile uint8_t*
+HostIO_AccessGPIOR1 (void);
+volatile uint16_t*
+HostIO_AccessTCNT3 (void);
+volatile uint8_t*
+HostIO_AccessPIND (void);
+volatile uint8_t*
+HostIO_AccessUCSR1A (void);
+volatile uint8_t*
+HostIO_AccessUDR1 (void);
+volatile uint8_t*
+HostIO_AccessSPDR (void);
+uint8_t
+HostIO_SPITransfer (const uint8_t Byte);
+
+/* Accessor Registers: */
+#define GPIOR1                    (*HostIO_AccessGPIOR1())
+#define TCNT3                     (*HostIO_AccessTCNT3())
+#define PIND                      (*HostIO_AccessPIND())
+#define UCSR1A                    (*HostIO_AccessUCSR1A())
+#define UDR1                      (*HostIO_AccessUDR1())
+#define SPDR                      (*HostIO_AccessSPDR())
+
+#endif
@@ -0,0 +1,1098 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Behavioural model of the programmed target for the host-native build. It decodes the serial programming,
+ *  PDI and TPI instruction streams produced by the firmware, keeps flash and EEPROM contents, and stays busy
+ *  for the programming time of each write or erase. Instructions the real device would reject or corrupt
+ *  because it is still busy are ignored and counted in \c HostIO_Stats.TargetViolations.
+ */
+
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "HostClock.h"
+#include "HostTarget.h"
+
+/** Depth of the queue of bytes sent back by the target over the PDI/TPI USART. */
+#define HOSTTARGET_RX_QUEUE_SIZE        512
+
+/** Base of the XMEGA NVM address spaces, as seen through PDI. */
+#define HOSTTARGET_PDI_FLASH_BASE       0x0800000UL
+#define HOSTTARGET_PDI_CALIB_BASE       0x08E0200UL
+#define HOSTTARGET_PDI_USERSIG_BASE     0x08E0400UL
+#define HOSTTARGET_PDI_EEPROM_BASE      0x08C0000UL
+#define HOSTTARGET_PDI_FUSE_BASE        0x08F0020UL
+#define HOSTTARGET_PDI_DATA_BASE        0x1000000UL
+
+/** XMEGA data space addresses of the device ID and of the NVM controller registers. */
+#define HOSTTARGET_PDI_DEVID_ADDR       0x0090
+#define HOSTTARGET_PDI_NVM_ADDR         0x01C0
+
+/** Size of the XMEGA user signature row, in bytes. */
+#define HOSTTARGET_PDI_USERSIG_SIZE     512
+
+/** Base addresses of the tinyAVR memories in the TPI data space. */
+#define HOSTTARGET_TPI_LOCK_ADDR        0x3F00
+#define HOSTTARGET_TPI_CONFIG_ADDR      0x3F40
+#define HOSTTARGET_TPI_CALIB_ADDR       0x3F80
+#define HOSTTARGET_TPI_SIG_ADDR         0x3FC0
+#define HOSTTARGET_TPI_FLASH_BASE       0x4000
+
+/** TPI I/O space addresses of the NVM controller registers. */
+#define HOSTTARGET_TPI_NVMCSR           0x32
+#define HOSTTARGET_TPI_NVMCMD           0x33
+
+const HostTarget_Profile_t HostTarget_ATmega328P =
+  { .Name = "ATmega328P", .Interface = HOSTTARGET_INTERFACE_ISP,
+      .Signature = { 0x1E, 0x95, 0x0F }, .FlashSize = 32768UL,
+      .FlashPageSize = 128, .EEPROMSize = 1024, .EEPROMPageSize = 4,
+      .FlashWriteUS = 4500, .EEPROMWriteUS = 3600, .ChipEraseUS = 9000,
+      .FuseWriteUS = 4500 };
+
+const HostTarget_Profile_t HostTarget_ATmega328P_1MHz =
+  { .Name = "ATmega328P at 1MHz", .Interface = HOSTTARGET_INTERFACE_ISP,
+      .Signature = { 0x1E, 0x95, 0x0F }, .FlashSize = 32768UL,
+      .FlashPageSize = 128, .EEPROMSize = 1024, .EEPROMPageSize = 4,
+      .FlashWriteUS = 4500, .EEPROMWriteUS = 3600, .ChipEraseUS = 9000,
+      .FuseWriteUS = 4500, .MaxSCKHz = 1000000UL / 4 };
+
+const HostTarget_Profile_t HostTarget_ATmega328P_NoReadyBusy =
+  { .Name = "ATmega328P without RDY/BSY", .Interface = HOSTTARGET_INTERFACE_ISP,
+      .Signature = { 0x1E, 0x95, 0x0F }, .FlashSize = 32768UL,
+      .FlashPageSize = 128, .EEPROMSize = 1024, .EEPROMPageSize = 4,
+      .FlashWriteUS = 4500, .EEPROMWriteUS = 3600, .ChipEraseUS = 9000,
+      .FuseWriteUS = 4500, .NoReadyBusy = true };
+
+const HostTarget_Profile_t HostTarget_ATmega328P_NeverReady =
+  { .Name = "ATmega328P never ready", .Interface = HOSTTARGET_INTERFACE_ISP,
+      .Signature = { 0x1E, 0x95, 0x0F }, .FlashSize = 32768UL,
+      .FlashPageSize = 128, .EEPROMSize = 1024, .EEPROMPageSize = 4,
+      .FlashWriteUS = 4500, .EEPROMWriteUS = 3600, .ChipEraseUS = 9000,
+      .FuseWriteUS = 4500, .NeverReady = true };
+
+const HostTarget_Profile_t HostTarget_ATmega2560 =
+  { .Name = "ATmega2560", .Interface = HOSTTARGET_INTERFACE_ISP,
+      .Signature = { 0x1E, 0x98, 0x01 }, .FlashSize = 262144UL,
+      .FlashPageSize = 256, .EEPROMSize = 4096, .EEPROMPageSize = 8,
+      .FlashWriteUS = 4500, .EEPROMWriteUS = 9000, .ChipEraseUS = 9000,
+      .FuseWriteUS = 4500 };
+
+const HostTarget_Profile_t HostTarget_ATxmega128A1 =
+  { .Name = "ATxmega128A1", .Interface = HOSTTARGET_INTERFACE_PDI,
+      .Signature = { 0x1E, 0x97, 0x4C }, .FlashSize = 139264UL,
+      .BootSize = 8192, .FlashPageSize = 512, .EEPROMSize = 2048,
+      .EEPROMPageSize = 32, .FlashWriteUS = 2500, .FlashEraseUS = 4000,
+      .EEPROMWriteUS = 6000, .ChipEraseUS = 40000, .FuseWriteUS = 2500 };
+
+const HostTarget_Profile_t HostTarget_ATtiny10 =
+  { .Name = "ATtiny10", .Interface = HOSTTARGET_INTERFACE_TPI,
+      .Signature = { 0x1E, 0x90, 0x03 }, .FlashSize = 1024,
+      .FlashPageSize = 16, .FlashWriteUS = 2500, .FlashEraseUS = 4000,
+      .ChipEraseUS = 9700, .FuseWriteUS = 2500 };
+
+/** Simulated target memories, sized for the largest profile. */
+uint8_t HostTarget_Flash[HOSTTARGET_MAX_FLASH_SIZE];
+uint8_t HostTarget_EEPROM[HOSTTARGET_MAX_EEPROM_SIZE];
+
+/** Currently simulated device. */
+static const HostTarget_Profile_t* HostTarget_Profile = &HostTarget_ATmega328P;
+
+/** Non-volatile configuration bytes of the simulated device. */
+static uint8_t HostTarget_Fuses[8];
+static uint8_t HostTarget_Lock;
+static uint8_t HostTarget_UserSignature[HOSTTARGET_PDI_USERSIG_SIZE];
+
+/** Volatile page buffers, with the EEPROM bytes loaded since the buffer was last committed. */
+static uint8_t HostTarget_PageBuffer[512];
+static uint8_t HostTarget_EEPROMBuffer[64];
+static bool HostTarget_EEPROMLoaded[64];
+
+/** Simulated time until which the device is busy with a write or erase, and whether that is a chip erase. */
+static uint64_t HostTarget_BusyUntil;
+static bool HostTarget_ChipErasing;
+
+/** Serial programming instruction being received, and the serial programming mode state. */
+static uint8_t HostTarget_ISPFrame[4];
+static uint8_t HostTarget_ISPFramePos;
+static uint8_t HostTarget_ISPLastByte;
+static bool HostTarget_ISPEnabled;
+static uint8_t HostTarget_ISPExtendedAddress;
+
+/** PDI/TPI instruction being received, and the PDI/TPI interface state. */
+static struct
+{
+  uint8_t Opcode;
+  uint8_t Buffer[8];
+  uint16_t BytesReceived;
+  uint16_t BytesExpected;
+  uint32_t Pointer;
+  uint32_t RepeatCount;
+  bool NVMEnabled;
+  uint8_t ResetRegister;
+  uint8_t ControlRegister;
+  uint8_t NVMCommand;
+  uint8_t NVMData[3];
+  bool GuardPending;
+} HostTarget_XPROG;
+
+/** Bytes sent back by the target over the PDI/TPI USART, not yet read by the firmware. */
+static uint8_t HostTarget_RxQueue[HOSTTARGET_RX_QUEUE_SIZE];
+static uint16_t HostTarget_RxHead;
+static uint16_t HostTarget_RxCount;
+
+/** Selects the device to simulate, and powers it up with blank memories and default fuses.
+ *
+ *  \param[in] Profile  Device to simulate
+ */
+void
+HostTarget_Select (const HostTarget_Profile_t* const Profile)
+{
+  HostTarget_Profile = Profile;
+
+  memset (HostTarget_Flash, 0xFF, sizeof(HostTarget_Flash));
+  memset (HostTarget_EEPROM, 0xFF, sizeof(HostTarget_EEPROM));
+  memset (HostTarget_UserSignature, 0xFF, sizeof(HostTarget_UserSignature));
+  memset (HostTarget_Fuses, 0xFF, sizeof(HostTarget_Fuses));
+  memset (HostTarget_PageBuffer, 0xFF, sizeof(HostTarget_PageBuffer));
+  memset (HostTarget_EEPROMLoaded, 0x00, sizeof(HostTarget_EEPROMLoaded));
+
+  HostTarget_Fuses[0] = 0x62;
+  HostTarget_Fuses[1] = 0xD9;
+  HostTarget_Lock = 0xFF;
+  HostTarget_BusyUntil = 0;
+  HostTarget_ChipErasing = false;
+
+  HostTarget_SPIReset ();
+
+  memset (&HostTarget_XPROG, 0x00, sizeof(HostTarget_XPROG));
+  HostTarget_RxHead = 0;
+  HostTarget_RxCount = 0;
+}
+
+/** Indicates whether the device is still busy with the last write or erase. */
+static bool
+HostTarget_IsBusy (void)
+{
+  return (HostClock_Cycles < HostTarget_BusyUntil);
+}
+
+/** Makes the device busy for the given time, starting now. */
+static void
+HostTarget_SetBusy (const uint16_t Microseconds)
+{
+  HostTarget_BusyUntil = HostClock_Cycles + HOSTCLOCK_US_TO_CYCLES(Microseconds);
+}
+
+/** Erases the whole flash and EEPROM memories and the lock bits, as a chip erase does. */
+static void
+HostTarget_ChipErase (void)
+{
+  memset (HostTarget_Flash, 0xFF, HostTarget_Profile->FlashSize);
+  memset (HostTarget_EEPROM, 0xFF, HostTarget_Profile->EEPROMSize);
+  HostTarget_Lock = 0xFF;
+
+  HostTarget_SetBusy (HostTarget_Profile->ChipEraseUS);
+  HostTarget_ChipErasing = true;
+}
+
+/** Writes the flash page buffer into the flash page holding the given byte address, and clears the buffer.
+ *  Without a preceding erase, programming can only clear bits.
+ *
+ *  \param[in] Address  Byte address within the flash page to write
+ *  \param[in] Erase    Boolean \c true to erase the page before writing it
+ */
+static void
+HostTarget_WriteFlashPage (uint32_t Address, const bool Erase)
+{
+  uint16_t PageSize = HostTarget_Profile->FlashPageSize;
+
+  Address = (Address % HostTarget_Profile->FlashSize) & ~((uint32_t) PageSize - 1);
+
+  for (uint16_t PageByte = 0; PageByte < PageSize; PageByte++)
+    {
+      if (Erase)
+        HostTarget_Flash[Address + PageByte] = HostTarget_PageBuffer[PageByte];
+      else
+        HostTarget_Flash[Address + PageByte] &= HostTarget_PageBuffer[PageByte];
+    }
+
+  memset (HostTarget_PageBuffer, 0xFF, sizeof(HostTarget_PageBuffer));
+  HostTarget_SetBusy (HostTarget_Profile->FlashWriteUS
+      + (Erase ? HostTarget_Profile->FlashEraseUS : 0));
+}
+
+/** Writes the loaded bytes of the EEPROM page buffer into the EEPROM page holding the given address, or erases
+ *  them, and clears the buffer.
+ *
+ *  \param[in] Address  Byte address within the EEPROM page to write
+ *  \param[in] Erase    Boolean \c true to erase the loaded bytes before writing them
+ *  \param[in] Write    Boolean \c true to write the loaded bytes after any erase
+ */
+static void
+HostTarget_WriteEEPROMPage (uint32_t Address, const bool Erase,
+                            const bool Write)
+{
+  uint16_t PageSize = HostTarget_Profile->EEPROMPageSize;
+
+  Address = (Address % HostTarget_Profile->EEPROMSize) & ~((uint32_t) PageSize - 1);
+
+  for (uint16_t PageByte = 0; PageByte < PageSize; PageByte++)
+    {
+      if (!(HostTarget_EEPROMLoaded[PageByte]))
+        continue;
+
+      if (Erase)
+        HostTarget_EEPROM[Address + PageByte] = 0xFF;
+
+      if (Write)
+        HostTarget_EEPROM[Address + PageByte] &= HostTarget_EEPROMBuffer[PageByte];
+    }
+
+  memset (HostTarget_EEPROMLoaded, 0x00, sizeof(HostTarget_EEPROMLoaded));
+  HostTarget_SetBusy (HostTarget_Profile->EEPROMWriteUS);
+}
+
+/** Resets the serial programming interface, as happens when the SPI bus is (re)initialized or released. */
+void
+HostTarget_SPIReset (void)
+{
+  HostTarget_ISPFramePos = 0;
+  HostTarget_ISPEnabled = false;
+  HostTarget_ISPExtendedAddress = 0;
+}
+
+/** Computes the byte the device shifts out while the last byte of a serial programming instruction is shifted
+ *  in, which is the read data for read instructions and an echo of the third byte otherwise.
+ */
+static uint8_t
+HostTarget_ISPReadData (void)
+{
+  const uint8_t* Frame = HostTarget_ISPFrame;
+  uint32_t WordAddress = ((uint32_t) HostTarget_ISPExtendedAddress << 16)
+      | ((uint16_t) Frame[1] << 8) | Frame[2];
+  uint16_t EEPROMAddress = (((uint16_t) Frame[1] << 8) | Frame[2])
+      % HostTarget_Profile->EEPROMSize;
+
+  switch (Frame[0])
+    {
+    case 0xF0:
+      if (HostTarget_Profile->NoReadyBusy)
+        return Frame[2];
+
+      return (HostTarget_IsBusy () || HostTarget_Profile->NeverReady) ? 0x01 : 0x00;
+    case 0x20:
+    case 0x28:
+      if (HostTarget_IsBusy () || HostTarget_Profile->NeverReady)
+        return 0xFF;
+
+      return HostTarget_Flash[((WordAddress << 1) | (Frame[0] == 0x28))
+          % HostTarget_Profile->FlashSize];
+    case 0xA0:
+      return (HostTarget_IsBusy () || HostTarget_Profile->NeverReady) ? 0xFF : HostTarget_EEPROM[EEPROMAddress];
+    case 0x30:
+      return ((Frame[2] & 0x03) < 3) ?
+          HostTarget_Profile->Signature[Frame[2] & 0x03] : 0xFF;
+    case 0x50:
+      return (Frame[1] == 0x08) ? HostTarget_Fuses[2] : HostTarget_Fuses[0];
+    case 0x58:
+      return (Frame[1] == 0x08) ? HostTarget_Fuses[1] : HostTarget_Lock;
+    case 0x38:
+      return 0xA5;
+    default:
+      return Frame[2];
+    }
+}
+
+/** Executes a complete serial programming instruction. */
+static void
+HostTarget_ISPExecute (void)
+{
+  const uint8_t* Frame = HostTarget_ISPFrame;
+  uint32_t WordAddress = ((uint32_t) HostTarget_ISPExtendedAddress << 16)
+      | ((uint16_t) Frame[1] << 8) | Frame[2];
+  uint16_t EEPROMAddress = (((uint16_t) Frame[1] << 8) | Frame[2])
+      % HostTarget_Profile->EEPROMSize;
+  uint16_t PageWords = HostTarget_Profile->FlashPageSize / 2;
+  uint16_t EEPageSize = HostTarget_Profile->EEPROMPageSize;
+
+  switch (Frame[0])
+    {
+    case 0xF0:
+    case 0x20:
+    case 0x28:
+    case 0xA0:
+    case 0x30:
+    case 0x50:
+    case 0x58:
+    case 0x38:
+      return;
+    }
+
+  if (HostTarget_IsBusy ())
+    {
+      HostIO_Stats.TargetViolations++;
+      return;
+    }
+
+  HostTarget_ChipErasing = false;
+
+  switch (Frame[0])
+    {
+    case 0xAC:
+      if (Frame[1] == 0x80)
+        HostTarget_ChipErase ();
+      else if (Frame[1] == 0xA0)
+        HostTarget_Fuses[0] = Frame[3];
+      else if (Frame[1] == 0xA8)
+        HostTarget_Fuses[1] = Frame[3];
+      else if (Frame[1] == 0xA4)
+        HostTarget_Fuses[2] = Frame[3];
+      else if (Frame[1] == 0xE0)
+        HostTarget_Lock = Frame[3];
+
+      if (Frame[1] != 0x80)
+        HostTarget_SetBusy (HostTarget_Profile->FuseWriteUS);
+      break;
+    case 0x4D:
+      HostTarget_ISPExtendedAddress = Frame[2];
+      break;
+    case 0x40:
+    case 0x48:
+      HostTarget_PageBuffer[((WordAddress % PageWords) << 1) | (Frame[0] == 0x48)] =
+          Frame[3];
+      break;
+    case 0x4C:
+      HostTarget_WriteFlashPage (WordAddress << 1, false);
+      break;
+    case 0xC0:
+      HostTarget_EEPROM[EEPROMAddress] = Frame[3];
+      HostTarget_SetBusy (HostTarget_Profile->EEPROMWriteUS);
+      break;
+    case 0xC1:
+      HostTarget_EEPROMBuffer[EEPROMAddress % EEPageSize] = Frame[3];
+      HostTarget_EEPROMLoaded[EEPROMAddress % EEPageSize] = true;
+      break;
+    case 0xC2:
+      HostTarget_WriteEEPROMPage (EEPROMAddress, true, true);
+      break;
+    }
+}
+
+/** Exchanges a byte with the device's serial programming interface. The device echoes each received byte
+ *  one byte later, and only decodes instructions after the Programming Enable instruction was recognised.
+ *  A byte clocked faster than the device's SCK limit is missed, which leaves the device out of step with the
+ *  instruction framing until it is reset and synchronized again.
+ *
+ *  \param[in] Byte        Byte shifted into the device
+ *  \param[in] ByteCycles  Programmer CPU cycles taken to shift the byte, eight SCK periods
+ *
+ *  \return Byte shifted out of the device at the same time
+ */
+uint8_t
+HostTarget_SPITransfer (const uint8_t Byte, const uint32_t ByteCycles)
+{
+  uint8_t Position = HostTarget_ISPFramePos;
+  uint8_t Response;
+
+  if (HostTarget_Profile->MaxSCKHz && ((F_CPU * 8) / ByteCycles > HostTarget_Profile->MaxSCKHz))
+    {
+      HostTarget_SPIReset ();
+      return 0xFF;
+    }
+
+  HostTarget_ISPFrame[Position] = Byte;
+
+  if (!(HostTarget_ISPEnabled))
+    {
+      bool IsEnable = ((HostTarget_ISPFrame[0] == 0xAC) && (HostTarget_ISPFrame[1] == 0x53));
+
+      Response = ((Position == 2) && IsEnable) ? 0x53 : 0x00;
+
+      if ((Position == 3) && IsEnable)
+        HostTarget_ISPEnabled = true;
+    }
+  else if (Position == 3)
+    {
+      Response = HostTarget_ISPReadData ();
+      HostTarget_ISPExecute ();
+    }
+  else
+    {
+      Response = HostTarget_ISPLastByte;
+    }
+
+  HostTarget_ISPLastByte = Byte;
+  HostTarget_ISPFramePos = (Position + 1) & 0x03;
+
+  return Response;
+}
+
+/** Queues a byte to be sent back to the programmer over the PDI/TPI USART. */
+static void
+HostTarget_Respond (const uint8_t Byte)
+{
+  if (HostTarget_RxCount == HOSTTARGET_RX_QUEUE_SIZE)
+    return;
+
+  HostTarget_RxQueue[(HostTarget_RxHead + HostTarget_RxCount++)
+      % HOSTTARGET_RX_QUEUE_SIZE] = Byte;
+}
+
+/** Reads a byte from the XMEGA memory map, in the NVM space when the NVM controller is set up to read it.
+ *
+ *  \param[in] Address  PDI address to read
+ *
+ *  \return Byte at the given address
+ */
+static uint8_t
+HostTarget_PDIRead (const uint32_t Address)
+{
+  const HostTarget_Profile_t* Profile = HostTarget_Profile;
+
+  if (Address >= HOSTTARGET_PDI_DATA_BASE)
+    {
+      uint16_t DataAddress = Address - HOSTTARGET_PDI_DATA_BASE;
+
+      if ((DataAddress >= HOSTTARGET_PDI_DEVID_ADDR) && (DataAddress < HOSTTARGET_PDI_DEVID_ADDR + 3))
+        return Profile->Signature[DataAddress - HOSTTARGET_PDI_DEVID_ADDR];
+
+      switch (DataAddress - HOSTTARGET_PDI_NVM_ADDR)
+        {
+        case 0x04:
+        case 0x05:
+        case 0x06:
+          return HostTarget_XPROG.NVMData[DataAddress - HOSTTARGET_PDI_NVM_ADDR - 0x04];
+        case 0x0A:
+          return HostTarget_XPROG.NVMCommand;
+        case 0x0F:
+          return HostTarget_IsBusy () ? ((1 << 7) | (1 << 1)) : 0x00;
+        }
+
+      return 0x00;
+    }
+
+  if ((HostTarget_XPROG.NVMCommand != 0x43) || HostTarget_IsBusy ())
+    return 0xFF;
+
+  if ((Address >= HOSTTARGET_PDI_FLASH_BASE) && (Address < HOSTTARGET_PDI_FLASH_BASE + Profile->FlashSize))
+    return HostTarget_Flash[Address - HOSTTARGET_PDI_FLASH_BASE];
+  else if ((Address >= HOSTTARGET_PDI_EEPROM_BASE) && (Address < HOSTTARGET_PDI_EEPROM_BASE + Profile->EEPROMSize))
+    return HostTarget_EEPROM[Address - HOSTTARGET_PDI_EEPROM_BASE];
+  else if ((Address >= HOSTTARGET_PDI_USERSIG_BASE) && (Address < HOSTTARGET_PDI_USERSIG_BASE + HOSTTARGET_PDI_USERSIG_SIZE))
+    return HostTarget_UserSignature[Address - HOSTTARGET_PDI_USERSIG_BASE];
+  else if ((Address >= HOSTTARGET_PDI_FUSE_BASE) && (Address < HOSTTARGET_PDI_FUSE_BASE + 7))
+    return HostTarget_Fuses[Address - HOSTTARGET_PDI_FUSE_BASE];
+  else if (Address == HOSTTARGET_PDI_FUSE_BASE + 7)
+    return HostTarget_Lock;
+
+  return 0xFF;
+}
+
+/** Computes the CRC the XMEGA NVM controller generates over the given flash range, the low 24 bits of the
+ *  IEEE 802.3 CRC-32.
+ */
+static uint32_t
+HostTarget_PDIFlashCRC (const uint32_t Start, const uint32_t Length)
+{
+  uint32_t CRC = 0xFFFFFFFF;
+
+  for (uint32_t CurrentByte = Start; CurrentByte < (Start + Length); CurrentByte++)
+    {
+      CRC ^= HostTarget_Flash[CurrentByte];
+
+      for (uint8_t Bit = 0; Bit < 8; Bit++)
+        CRC = (CRC >> 1) ^ ((CRC & 1) ? 0xEDB88320 : 0);
+    }
+
+  return ~CRC & 0x00FFFFFF;
+}
+
+/** Executes the NVM command written to the NVM controller when the CMDEX bit of its CTRLA register is set. */
+static void
+HostTarget_PDIExecuteCommand (void)
+{
+  const HostTarget_Profile_t* Profile = HostTarget_Profile;
+  uint32_t AppSize = Profile->FlashSize - Profile->BootSize;
+  uint32_t CRC;
+
+  switch (HostTarget_XPROG.NVMCommand)
+    {
+    case 0x40:
+      HostTarget_ChipErase ();
+      memset (HostTarget_UserSignature, 0xFF, sizeof(HostTarget_UserSignature));
+      return;
+    case 0x26:
+      memset (HostTarget_PageBuffer, 0xFF, sizeof(HostTarget_PageBuffer));
+      return;
+    case 0x36:
+      memset (HostTarget_EEPROMLoaded, 0x00, sizeof(HostTarget_EEPROMLoaded));
+      return;
+    case 0x30:
+      for (uint32_t Page = 0; Page < Profile->EEPROMSize; Page += Profile->EEPROMPageSize)
+        {
+          for (uint16_t PageByte = 0; PageByte < Profile->EEPROMPageSize; PageByte++)
+            {
+              if (HostTarget_EEPROMLoaded[PageByte])
+                HostTarget_EEPROM[Page + PageByte] = 0xFF;
+            }
+        }
+
+      memset (HostTarget_EEPROMLoaded, 0x00, sizeof(HostTarget_EEPROMLoaded));
+      HostTarget_SetBusy (Profile->EEPROMWriteUS);
+      return;
+    case 0x38:
+      CRC = HostTarget_PDIFlashCRC (0, AppSize);
+      break;
+    case 0x39:
+      CRC = HostTarget_PDIFlashCRC (AppSize, Profile->BootSize);
+      break;
+    case 0x78:
+      CRC = HostTarget_PDIFlashCRC (0, Profile->FlashSize);
+      break;
+    default:
+      return;
+    }
+
+  HostTarget_XPROG.NVMData[0] = CRC;
+  HostTarget_XPROG.NVMData[1] = CRC >> 8;
+  HostTarget_XPROG.NVMData[2] = CRC >> 16;
+  HostTarget_BusyUntil = HostClock_Cycles + (Profile->FlashSize / 2);
+}
+
+/** Writes a byte to the XMEGA memory map. Writes to the NVM space are interpreted according to the command
+ *  loaded into the NVM controller, as on the device.
+ *
+ *  \param[in] Address  PDI address to write
+ *  \param[in] Byte     Byte to write
+ */
+static void
+HostTarget_PDIWrite (const uint32_t Address, const uint8_t Byte)
+{
+  const HostTarget_Profile_t* Profile = HostTarget_Profile;
+  uint32_t AppSize = Profile->FlashSize - Profile->BootSize;
+
+  if (Address >= HOSTTARGET_PDI_DATA_BASE)
+    {
+      uint16_t Register = (Address - HOSTTARGET_PDI_DATA_BASE) - HOSTTARGET_PDI_NVM_ADDR;
+
+      if (Register == 0x0A)
+        {
+          HostTarget_XPROG.NVMCommand = Byte;
+        }
+      else if ((Register == 0x0B) && (Byte & 0x01))
+        {
+          if (HostTarget_IsBusy ())
+            HostIO_Stats.TargetViolations++;
+          else
+            HostTarget_PDIExecuteCommand ();
+        }
+
+      return;
+    }
+
+  uint8_t Command = HostTarget_XPROG.NVMCommand;
+  bool IsBufferLoad = ((Command == 0x23) || (Command == 0x33));
+
+  if (!(IsBufferLoad) && HostTarget_IsBusy ())
+    {
+      HostIO_Stats.TargetViolations++;
+      return;
+    }
+
+  uint32_t FlashOffset = (Address - HOSTTARGET_PDI_FLASH_BASE) % Profile->FlashSize;
+  uint32_t EEPROMOffset = (Address - HOSTTARGET_PDI_EEPROM_BASE) % Profile->EEPROMSize;
+
+  switch (Command)
+    {
+    case 0x23:
+      HostTarget_PageBuffer[FlashOffset % Profile->FlashPageSize] = Byte;
+      break;
+    case 0x33:
+      HostTarget_EEPROMBuffer[EEPROMOffset % Profile->EEPROMPageSize] = Byte;
+      HostTarget_EEPROMLoaded[EEPROMOffset % Profile->EEPROMPageSize] = true;
+      break;
+    case 0x24:
+    case 0x2C:
+    case 0x2E:
+      HostTarget_WriteFlashPage (FlashOffset, false);
+      break;
+    case 0x25:
+    case 0x2D:
+    case 0x2F:
+      HostTarget_WriteFlashPage (FlashOffset, true);
+      break;
+    case 0x22:
+    case 0x2A:
+    case 0x2B:
+      memset (HostTarget_PageBuffer, 0xFF, sizeof(HostTarget_PageBuffer));
+      HostTarget_WriteFlashPage (FlashOffset, true);
+      break;
+    case 0x20:
+      memset (HostTarget_Flash, 0xFF, AppSize);
+      HostTarget_SetBusy (Profile->ChipEraseUS);
+      break;
+    case 0x68:
+      memset (&HostTarget_Flash[AppSize], 0xFF, Profile->BootSize);
+      HostTarget_SetBusy (Profile->FlashEraseUS);
+      break;
+    case 0x32:
+      HostTarget_WriteEEPROMPage (EEPROMOffset, true, false);
+      break;
+    case 0x34:
+      HostTarget_WriteEEPROMPage (EEPROMOffset, false, true);
+      break;
+    case 0x35:
+      HostTarget_WriteEEPROMPage (EEPROMOffset, true, true);
+      break;
+    case 0x18:
+      memset (HostTarget_UserSignature, 0xFF, sizeof(HostTarget_UserSignature));
+      HostTarget_SetBusy (Profile->FlashEraseUS);
+      break;
+    case 0x1A:
+      for (uint16_t SigByte = 0; SigByte < HOSTTARGET_PDI_USERSIG_SIZE; SigByte++)
+        HostTarget_UserSignature[SigByte] &= HostTarget_PageBuffer[SigByte % Profile->FlashPageSize];
+
+      memset (HostTarget_PageBuffer, 0xFF, sizeof(HostTarget_PageBuffer));
+      HostTarget_SetBusy (Profile->FlashWriteUS);
+      break;
+    case 0x4C:
+      HostTarget_Fuses[(Address - HOSTTARGET_PDI_FUSE_BASE) & 0x07] = Byte;
+      HostTarget_SetBusy (Profile->FuseWriteUS);
+      break;
+    case 0x08:
+      HostTarget_Lock = Byte;
+      HostTarget_SetBusy (Profile->FuseWriteUS);
+      break;
+    default:
+      HostIO_Stats.TargetViolations++;
+      break;
+    }
+}
+
+/** Assembles a little endian value of the given number of bytes from the instruction buffer. */
+static uint32_t
+HostTarget_XPROGValue (const uint8_t* const Bytes, const uint8_t Size)
+{
+  uint32_t Value = 0;
+
+  for (uint8_t CurrentByte = Size; CurrentByte > 0; CurrentByte--)
+    Value = (Value << 8) | Bytes[CurrentByte - 1];
+
+  return Value;
+}
+
+/** Starts decoding a new PDI instruction, answering it straight away if it has no operands. */
+static void
+HostTarget_PDIStart (const uint8_t Opcode)
+{
+  uint8_t AddressSize = ((Opcode >> 2) & 0x03) + 1;
+  uint8_t DataSize = (Opcode & 0x03) + 1;
+
+  HostTarget_XPROG.Opcode = Opcode;
+  HostTarget_XPROG.BytesReceived = 0;
+  HostTarget_XPROG.BytesExpected = 0;
+
+  switch (Opcode & 0xE0)
+    {
+    case 0x00:
+      HostTarget_XPROG.BytesExpected = AddressSize;
+      break;
+    case 0x40:
+      HostTarget_XPROG.BytesExpected = AddressSize + DataSize;
+      break;
+    case 0x20:
+      for (uint32_t Repeat = 0; Repeat <= HostTarget_XPROG.RepeatCount; Repeat++)
+        {
+          for (uint8_t DataByte = 0; DataByte < DataSize; DataByte++)
+            {
+              if (((Opcode >> 2) & 0x03) == 2)
+                {
+                  HostTarget_Respond (HostTarget_XPROG.Pointer >> (8 * DataByte));
+                  continue;
+                }
+
+              HostTarget_Respond (HostTarget_PDIRead (HostTarget_XPROG.Pointer + DataByte));
+
+              if (((Opcode >> 2) & 0x03) == 1)
+                HostTarget_XPROG.Pointer++;
+            }
+        }
+
+      HostTarget_XPROG.RepeatCount = 0;
+      break;
+    case 0x60:
+      HostTarget_XPROG.BytesExpected = (((Opcode >> 2) & 0x03) == 2) ?
+          DataSize : (HostTarget_XPROG.RepeatCount + 1) * DataSize;
+      HostTarget_XPROG.RepeatCount = 0;
+      break;
+    case 0x80:
+      if ((Opcode & 0x0F) == 0)
+        HostTarget_Respond ((HostTarget_XPROG.NVMEnabled && !(HostTarget_ChipErasing && HostTarget_IsBusy ())) ?
+            (1 << 1) : 0x00);
+      else if ((Opcode & 0x0F) == 1)
+        HostTarget_Respond (HostTarget_XPROG.ResetRegister);
+      else
+        HostTarget_Respond (HostTarget_XPROG.ControlRegister);
+      break;
+    case 0xA0:
+      HostTarget_XPROG.BytesExpected = DataSize;
+      break;
+    case 0xC0:
+      HostTarget_XPROG.BytesExpected = 1;
+      break;
+    case 0xE0:
+      HostTarget_XPROG.BytesExpected = 8;
+      break;
+    }
+}
+
+/** Processes an operand byte of the PDI instruction being received. */
+static void
+HostTarget_PDIOperand (const uint8_t Byte)
+{
+  uint8_t Opcode = HostTarget_XPROG.Opcode;
+  uint8_t AddressSize = ((Opcode >> 2) & 0x03) + 1;
+  uint8_t DataSize = (Opcode & 0x03) + 1;
+  uint16_t Position = HostTarget_XPROG.BytesReceived++;
+
+  if (Position < sizeof(HostTarget_XPROG.Buffer))
+    HostTarget_XPROG.Buffer[Position] = Byte;
+
+  bool IsLast = (HostTarget_XPROG.BytesReceived == HostTarget_XPROG.BytesExpected);
+  uint32_t Address = HostTarget_XPROGValue (HostTarget_XPROG.Buffer, AddressSize);
+
+  switch (Opcode & 0xE0)
+    {
+    case 0x00:
+      if (IsLast)
+        {
+          for (uint8_t DataByte = 0; DataByte < DataSize; DataByte++)
+            HostTarget_Respond (HostTarget_PDIRead (Address + DataByte));
+        }
+      break;
+    case 0x40:
+      if (Position >= AddressSize)
+        HostTarget_PDIWrite (Address + (Position - AddressSize), Byte);
+      break;
+    case 0x60:
+      if (((Opcode >> 2) & 0x03) == 2)
+        {
+          if (IsLast)
+            HostTarget_XPROG.Pointer = HostTarget_XPROGValue (HostTarget_XPROG.Buffer, DataSize);
+        }
+      else
+        {
+          HostTarget_PDIWrite (HostTarget_XPROG.Pointer + (Position % DataSize), Byte);
+
+          if ((((Opcode >> 2) & 0x03) == 1) && !((Position + 1) % DataSize))
+            HostTarget_XPROG.Pointer += DataSize;
+        }
+      break;
+    case 0xA0:
+      if (IsLast)
+        HostTarget_XPROG.RepeatCount = HostTarget_XPROGValue (HostTarget_XPROG.Buffer, DataSize);
+      break;
+    case 0xC0:
+      if ((Opcode & 0x0F) == 0)
+        HostTarget_XPROG.NVMEnabled = ((Byte & (1 << 1)) != 0);
+      else if ((Opcode & 0x0F) == 1)
+        HostTarget_XPROG.ResetRegister = (Byte == 0x59) ? 0x01 : 0x00;
+      else
+        HostTarget_XPROG.ControlRegister = Byte;
+      break;
+    case 0xE0:
+      if (IsLast)
+        {
+          static const uint8_t NVMKey[8] = { 0xFF, 0x88, 0xD8, 0xCD, 0x45, 0xAB, 0x89, 0x12 };
+          HostTarget_XPROG.NVMEnabled = (memcmp (HostTarget_XPROG.Buffer, NVMKey, sizeof(NVMKey)) == 0);
+        }
+      break;
+    }
+}
+
+/** Reads a byte from the tinyAVR data space. */
+static uint8_t
+HostTarget_TPIRead (const uint16_t Address)
+{
+  const HostTarget_Profile_t* Profile = HostTarget_Profile;
+
+  if ((Address >= HOSTTARGET_TPI_FLASH_BASE) && (Address < HOSTTARGET_TPI_FLASH_BASE + Profile->FlashSize))
+    return HostTarget_Flash[Address - HOSTTARGET_TPI_FLASH_BASE];
+  else if ((Address >= HOSTTARGET_TPI_SIG_ADDR) && (Address < HOSTTARGET_TPI_SIG_ADDR + 3))
+    return Profile->Signature[Address - HOSTTARGET_TPI_SIG_ADDR];
+  else if (Address == HOSTTARGET_TPI_CONFIG_ADDR)
+    return HostTarget_Fuses[0];
+  else if (Address == HOSTTARGET_TPI_LOCK_ADDR)
+    return HostTarget_Lock;
+  else if (Address == HOSTTARGET_TPI_CALIB_ADDR)
+    return 0xA5;
+
+  return 0xFF;
+}
+
+/** Writes a byte to the tinyAVR data space, programming the non-volatile memories according to the command
+ *  loaded into the NVMCMD register.
+ */
+static void
+HostTarget_TPIWrite (const uint16_t Address, const uint8_t Byte)
+{
+  const HostTarget_Profile_t* Profile = HostTarget_Profile;
+  bool IsFlash = ((Address >= HOSTTARGET_TPI_FLASH_BASE)
+      && (Address < HOSTTARGET_TPI_FLASH_BASE + Profile->FlashSize));
+
+  if (HostTarget_IsBusy ())
+    {
+      HostIO_Stats.TargetViolations++;
+      return;
+    }
+
+  switch (HostTarget_XPROG.NVMCommand)
+    {
+    case 0x10:
+      HostTarget_ChipErase ();
+      break;
+    case 0x14:
+      if (IsFlash)
+        memset (HostTarget_Flash, 0xFF, Profile->FlashSize);
+      else if ((Address & 0xFFC0) == HOSTTARGET_TPI_CONFIG_ADDR)
+        HostTarget_Fuses[0] = 0xFF;
+
+      HostTarget_SetBusy (Profile->FlashEraseUS);
+      break;
+    case 0x1D:
+      if (!(Address & 0x01))
+        {
+          HostTarget_PageBuffer[0] = Byte;
+          break;
+        }
+
+      if (IsFlash)
+        {
+          HostTarget_Flash[(Address - HOSTTARGET_TPI_FLASH_BASE) - 1] &= HostTarget_PageBuffer[0];
+          HostTarget_Flash[Address - HOSTTARGET_TPI_FLASH_BASE] &= Byte;
+        }
+      else if (Address == HOSTTARGET_TPI_CONFIG_ADDR + 1)
+        {
+          HostTarget_Fuses[0] &= HostTarget_PageBuffer[0];
+        }
+      else if (Address == HOSTTARGET_TPI_LOCK_ADDR + 1)
+        {
+          HostTarget_Lock &= HostTarget_PageBuffer[0];
+        }
+
+      HostTarget_PageBuffer[0] = 0xFF;
+      HostTarget_SetBusy (Profile->FlashWriteUS);
+      break;
+    default:
+      break;
+    }
+}
+
+/** Starts decoding a new TPI instruction, answering it straight away if it has no operands. */
+static void
+HostTarget_TPIStart (const uint8_t Opcode)
+{
+  uint8_t IOAddress = (Opcode & 0x0F) | ((Opcode >> 1) & 0x30);
+
+  HostTarget_XPROG.Opcode = Opcode;
+  HostTarget_XPROG.BytesReceived = 0;
+  HostTarget_XPROG.BytesExpected = 0;
+
+  if ((Opcode & 0x90) == 0x10)
+    {
+      if (IOAddress == HOSTTARGET_TPI_NVMCSR)
+        HostTarget_Respond (HostTarget_IsBusy () ? (1 << 7) : 0x00);
+      else if (IOAddress == HOSTTARGET_TPI_NVMCMD)
+        HostTarget_Respond (HostTarget_XPROG.NVMCommand);
+      else
+        HostTarget_Respond (0x00);
+    }
+  else if ((Opcode & 0x90) == 0x90)
+    {
+      HostTarget_XPROG.BytesExpected = 1;
+    }
+  else if ((Opcode & 0xF0) == 0x80)
+    {
+      if ((Opcode & 0x0F) == 0x00)
+        HostTarget_Respond (HostTarget_XPROG.NVMEnabled ? (1 << 1) : 0x00);
+      else if ((Opcode & 0x0F) == 0x0F)
+        HostTarget_Respond (0x80);
+      else
+        HostTarget_Respond (HostTarget_XPROG.ControlRegister);
+    }
+  else if ((Opcode == 0x20) || (Opcode == 0x24))
+    {
+      HostTarget_Respond (HostTarget_TPIRead (HostTarget_XPROG.Pointer));
+
+      if (Opcode & 0x04)
+        HostTarget_XPROG.Pointer = (HostTarget_XPROG.Pointer + 1) & 0xFFFF;
+    }
+  else if (Opcode == 0xE0)
+    {
+      HostTarget_XPROG.BytesExpected = 8;
+    }
+  else
+    {
+      HostTarget_XPROG.BytesExpected = 1;
+    }
+}
+
+/** Processes an operand byte of the TPI instruction being received. */
+static void
+HostTarget_TPIOperand (const uint8_t Byte)
+{
+  uint8_t Opcode = HostTarget_XPROG.Opcode;
+  uint8_t IOAddress = (Opcode & 0x0F) | ((Opcode >> 1) & 0x30);
+  uint16_t Position = HostTarget_XPROG.BytesReceived++;
+
+  if (Position < sizeof(HostTarget_XPROG.Buffer))
+    HostTarget_XPROG.Buffer[Position] = Byte;
+
+  if ((Opcode & 0x90) == 0x90)
+    {
+      if (IOAddress == HOSTTARGET_TPI_NVMCMD)
+        HostTarget_XPROG.NVMCommand = Byte;
+    }
+  else if ((Opcode & 0xF0) == 0xC0)
+    {
+      if ((Opcode & 0x0F) == 0x00)
+        HostTarget_XPROG.NVMEnabled = ((Byte & (1 << 1)) != 0);
+      else
+        HostTarget_XPROG.ControlRegister = Byte;
+    }
+  else if ((Opcode & 0xFE) == 0x68)
+    {
+      if (Opcode & 0x01)
+        HostTarget_XPROG.Pointer = (HostTarget_XPROG.Pointer & 0x00FF) | ((uint16_t) Byte << 8);
+      else
+        HostTarget_XPROG.Pointer = (HostTarget_XPROG.Pointer & 0xFF00) | Byte;
+    }
+  else if ((Opcode == 0x60) || (Opcode == 0x64))
+    {
+      HostTarget_TPIWrite (HostTarget_XPROG.Pointer, Byte);
+
+      if (Opcode & 0x04)
+        HostTarget_XPROG.Pointer = (HostTarget_XPROG.Pointer + 1) & 0xFFFF;
+    }
+  else if (Opcode == 0xE0)
+    {
+      if (HostTarget_XPROG.BytesReceived == 8)
+        {
+          static const uint8_t NVMKey[8] = { 0xFF, 0x88, 0xD8, 0xCD, 0x45, 0xAB, 0x89, 0x12 };
+          HostTarget_XPROG.NVMEnabled = (memcmp (HostTarget_XPROG.Buffer, NVMKey, sizeof(NVMKey)) == 0);
+        }
+    }
+}
+
+/** Delivers a byte sent by the programmer over the PDI/TPI USART to the device's instruction decoder.
+ *
+ *  \param[in] Byte  Byte received by the device
+ */
+void
+HostTarget_USARTReceive (const uint8_t Byte)
+{
+  bool IsPDI = (HostTarget_Profile->Interface == HOSTTARGET_INTERFACE_PDI);
+
+  if (HostTarget_XPROG.BytesReceived < HostTarget_XPROG.BytesExpected)
+    {
+      if (IsPDI)
+        HostTarget_PDIOperand (Byte);
+      else
+        HostTarget_TPIOperand (Byte);
+    }
+  else
+    {
+      if (IsPDI)
+        HostTarget_PDIStart (Byte);
+      else
+        HostTarget_TPIStart (Byte);
+    }
+}
+
+/** Notifies the device of a turnaround of the half-duplex data line. When the programmer starts transmitting
+ *  again, any reply bytes it did not read are lost; when it starts receiving, the device first waits its guard
+ *  time.
+ *
+ *  \param[in] IsSending  Boolean \c true if the programmer now transmits, \c false if it now receives
+ */
+void
+HostTarget_USARTTurnaround (const bool IsSending)
+{
+  if (IsSending)
+    {
+      if (HostTarget_RxCount)
+        HostIO_Stats.TargetViolations++;
+
+      HostTarget_RxCount = 0;
+    }
+
+  HostTarget_XPROG.GuardPending = !(IsSending);
+}
+
+/** Indicates whether the device has reply bytes waiting to be read by the programmer. */
+bool
+HostTarget_USARTAvailable (void)
+{
+  return (HostTarget_RxCount != 0);
+}
+
+/** Retrieves the number of idle bits the device inserts before the next reply byte, which is its configured
+ *  guard time for the first byte after a line turnaround and zero otherwise.
+ */
+uint8_t
+HostTarget_USARTGuardBits (void)
+{
+  static const uint8_t GuardBitsFromCTRL[8] = { 128, 64, 32, 16, 8, 4, 2, 2 };
+
+  if (!(HostTarget_XPROG.GuardPending))
+    return 0;
+
+  HostTarget_XPROG.GuardPending = false;
+
+  return GuardBitsFromCTRL[HostTarget_XPROG.ControlRegister & 0x07];
+}
+
+/** Retrieves the next reply byte sent by the device to the programmer.
+ *
+ *  \return Next reply byte
+ */
+uint8_t
+HostTarget_USARTTransmit (void)
+{
+  uint8_t Byte = HostTarget_RxQueue[HostTarget_RxHead];
+
+  HostTarget_RxHead = (HostTarget_RxHead + 1) % HOSTTARGET_RX_QUEUE_SIZE;
+  HostTarget_RxCount--;
+
+  return Byte;
+}
@@ -0,0 +1,113 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for HostTarget.c.
+ */
+
+#ifndef _HOST_TARGET_
+#define _HOST_TARGET_
+
+/* Includes: */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Macros: */
+/** Total number of bits in a single PDI/TPI USART frame, including start, parity and stop bits. */
+#define HOSTTARGET_BITS_IN_USART_FRAME  12
+
+/** Size of the largest simulated flash memory, in bytes. */
+#define HOSTTARGET_MAX_FLASH_SIZE       (256UL * 1024)
+
+/** Size of the largest simulated EEPROM memory, in bytes. */
+#define HOSTTARGET_MAX_EEPROM_SIZE      4096
+
+/** Programming interfaces of the simulated target. */
+enum HostTarget_Interfaces_t
+{
+  HOSTTARGET_INTERFACE_ISP = 0, /**< Serial (SPI) programming of classic AVRs */
+  HOSTTARGET_INTERFACE_PDI = 1, /**< PDI programming of XMEGA AVRs */
+  HOSTTARGET_INTERFACE_TPI = 2, /**< TPI programming of reduced core tinyAVRs */
+};
+
+/* Type Defines: */
+/** Memory organisation and programming timings of a simulated target device. */
+typedef struct
+{
+  const char* Name;
+  uint8_t Interface; /**< Programming interface, a \c HOSTTARGET_INTERFACE_* value */
+  uint8_t Signature[3];
+  uint32_t FlashSize; /**< Total flash size in bytes, including any boot section */
+  uint32_t BootSize; /**< Size of the XMEGA boot section at the top of flash, in bytes */
+  uint16_t FlashPageSize;
+  uint16_t EEPROMSize;
+  uint16_t EEPROMPageSize;
+  uint16_t FlashWriteUS; /**< Page (ISP, PDI) or word (TPI) write time */
+  uint16_t FlashEraseUS; /**< Page or section erase time */
+  uint16_t EEPROMWriteUS; /**< Byte or page write time */
+  uint16_t ChipEraseUS;
+  uint16_t FuseWriteUS;
+  uint32_t MaxSCKHz; /**< Fastest serial programming clock the device can follow, or zero for no limit */
+  bool NoReadyBusy; /**< Device lacks the Poll RDY/BSY instruction, as older devices do */
+  bool NeverReady; /**< Device never reports a write or erase complete, polling busy and reading blank throughout */
+} HostTarget_Profile_t;
+
+/* External Variables: */
+extern const HostTarget_Profile_t HostTarget_ATmega328P;
+extern const HostTarget_Profile_t HostTarget_ATmega328P_1MHz;
+extern const HostTarget_Profile_t HostTarget_ATmega328P_NoReadyBusy;
+extern const HostTarget_Profile_t HostTarget_ATmega328P_NeverReady;
+extern const HostTarget_Profile_t HostTarget_ATmega2560;
+extern const HostTarget_Profile_t HostTarget_ATxmega128A1;
+extern const HostTarget_Profile_t HostTarget_ATtiny10;
+
+extern uint8_t HostTarget_Flash[HOSTTARGET_MAX_FLASH_SIZE];
+extern uint8_t HostTarget_EEPROM[HOSTTARGET_MAX_EEPROM_SIZE];
+
+/* Function Prototypes: */
+void
+HostTarget_Select (const HostTarget_Profile_t* const Profile);
+void
+HostTarget_SPIReset (void);
+uint8_t
+HostTarget_SPITransfer (const uint8_t Byte, const uint32_t ByteCycles);
+void
+HostTarget_USARTReceive (const uint8_t Byte);
+void
+HostTarget_USARTTurnaround (const bool IsSending);
+bool
+HostTarget_USARTAvailable (void);
+uint8_t
+HostTarget_USARTGuardBits (void);
+uint8_t
+HostTarget_USARTTransmit (void);
+
+#endif
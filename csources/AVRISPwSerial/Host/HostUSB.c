@@ -0,0 +1,479 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Simulated USB device controller of the host-native build, implementing the LUFA endpoint API used by the
+ *  protocol handlers on top of a bank-level model of the endpoints and of a host that keeps every endpoint
+ *  busy - OUT data is offered as soon as a bank is free, and IN packets are collected as soon as they are
+ *  released by the firmware.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+
+#include "HostUSB.h"
+
+/** Packet held in an endpoint bank. */
+typedef struct
+{
+  uint8_t Data[HOSTUSB_MAX_BANK_SIZE];
+  uint8_t Length;
+  uint64_t Time; /**< Time the packet arrives (OUT) or has been collected by the host (IN) */
+} HostUSB_Packet_t;
+
+/** Simulated endpoint state, along with the host side of its transfers. */
+typedef struct
+{
+  bool Configured;
+  uint8_t Direction;
+  uint8_t Banks;
+  uint16_t Size;
+
+  HostUSB_Packet_t OUTBank[HOSTUSB_MAX_BANKS]; /**< Received packets, oldest first */
+  uint8_t OUTBanksUsed;
+  uint8_t OUTReadPos;
+  uint64_t LastOUTArrival;
+
+  HostUSB_Packet_t INBank[HOSTUSB_MAX_BANKS]; /**< Released packets not yet collected, oldest first */
+  uint8_t INBanksUsed;
+  uint8_t INData[HOSTUSB_MAX_BANK_SIZE];
+  uint8_t INLength;
+  uint64_t LastINCollected;
+
+  const uint8_t* HostTxData; /**< Host transfer being sent to the OUT direction */
+  uint32_t HostTxLength;
+  uint32_t HostTxPos;
+  bool HostTxZLP;
+
+  uint8_t* HostRxData; /**< Data collected by the host from the IN direction */
+  uint32_t HostRxLength;
+  uint32_t HostRxCapacity;
+  uint64_t HostRxCompletedAt;
+} HostUSB_Endpoint_t;
+
+/** Current USB device state, always configured in the simulation. */
+volatile uint8_t USB_DeviceState = DEVICE_STATE_Configured;
+
+/** Simulated endpoints, indexed by endpoint number. */
+static HostUSB_Endpoint_t HostUSB_Endpoints[HOSTUSB_ENDPOINTS];
+
+/** Currently selected endpoint. */
+static HostUSB_Endpoint_t* HostUSB_Selected = &HostUSB_Endpoints[0];
+
+/** Resets all endpoints, discarding any pending host transfers. */
+void
+HostUSB_Reset (void)
+{
+  for (uint8_t EPNum = 0; EPNum < HOSTUSB_ENDPOINTS; EPNum++)
+    free (HostUSB_Endpoints[EPNum].HostRxData);
+
+  memset (HostUSB_Endpoints, 0x00, sizeof(HostUSB_Endpoints));
+  HostUSB_Selected = &HostUSB_Endpoints[0];
+  USB_DeviceState = DEVICE_STATE_Configured;
+}
+
+/** Retires IN packets the host has collected by now, freeing their banks. */
+static void
+HostUSB_RetireINBanks (HostUSB_Endpoint_t* const Endpoint)
+{
+  while (Endpoint->INBanksUsed && (Endpoint->INBank[0].Time <= HostClock_Cycles))
+    {
+      Endpoint->INBanksUsed--;
+      memmove (&Endpoint->INBank[0], &Endpoint->INBank[1],
+               Endpoint->INBanksUsed * sizeof(HostUSB_Packet_t));
+    }
+}
+
+/** Moves packets of the host's OUT transfer into free endpoint banks, each arriving one packet time after the
+ *  later of the previous packet and the moment its bank became free.
+ */
+static void
+HostUSB_FillOUTBanks (HostUSB_Endpoint_t* const Endpoint)
+{
+  while ((Endpoint->OUTBanksUsed < Endpoint->Banks)
+      && ((Endpoint->HostTxPos < Endpoint->HostTxLength) || Endpoint->HostTxZLP))
+    {
+      HostUSB_Packet_t* Packet = &Endpoint->OUTBank[Endpoint->OUTBanksUsed++];
+      uint32_t Remaining = Endpoint->HostTxLength - Endpoint->HostTxPos;
+
+      Packet->Length = (Remaining > Endpoint->Size) ? Endpoint->Size : Remaining;
+      memcpy (Packet->Data, &Endpoint->HostTxData[Endpoint->HostTxPos], Packet->Length);
+      Endpoint->HostTxPos += Packet->Length;
+
+      if (!(Remaining))
+        Endpoint->HostTxZLP = false;
+      else if ((Endpoint->HostTxPos == Endpoint->HostTxLength) && (Packet->Length == Endpoint->Size))
+        Endpoint->HostTxZLP = true;
+
+      uint64_t StartTime = (Endpoint->LastOUTArrival > HostClock_Cycles) ?
+          Endpoint->LastOUTArrival : HostClock_Cycles;
+
+      Packet->Time = StartTime + HOSTUSB_PACKET_CYCLES(Packet->Length);
+      Endpoint->LastOUTArrival = Packet->Time;
+
+      HostIO_Stats.OUTPackets++;
+    }
+}
+
+/** Queues a host transfer to the given endpoint number, terminated with a ZLP if it fills its last packet as
+ *  the Jungo and libusb drivers do. The data must stay valid until the transfer has been fully received.
+ *
+ *  \param[in] EndpointNumber  Endpoint number the transfer is addressed to
+ *  \param[in] Data            Transfer data
+ *  \param[in] Length          Length of the transfer in bytes
+ */
+void
+HostUSB_HostSend (const uint8_t EndpointNumber, const uint8_t* Data,
+                  const uint32_t Length)
+{
+  HostUSB_Endpoint_t* Endpoint = &HostUSB_Endpoints[EndpointNumber];
+
+  Endpoint->HostTxData = Data;
+  Endpoint->HostTxLength = Length;
+  Endpoint->HostTxPos = 0;
+  Endpoint->HostTxZLP = !(Length);
+
+  HostUSB_FillOUTBanks (Endpoint);
+}
+
+/** Indicates whether the given endpoint still has host OUT data that the firmware has not released.
+ *
+ *  \param[in] EndpointNumber  Endpoint number to check
+ *
+ *  \return Boolean \c true if OUT packets are still queued or held in banks
+ */
+bool
+HostUSB_HostSendPending (const uint8_t EndpointNumber)
+{
+  HostUSB_Endpoint_t* Endpoint = &HostUSB_Endpoints[EndpointNumber];
+
+  return (Endpoint->OUTBanksUsed || (Endpoint->HostTxPos < Endpoint->HostTxLength)
+      || Endpoint->HostTxZLP);
+}
+
+/** Retrieves the arrival time of the oldest OUT packet held by the given endpoint.
+ *
+ *  \param[in] EndpointNumber  Endpoint number to check
+ *
+ *  \return Arrival time in CPU cycles, or \c UINT64_MAX if no packet is on its way
+ */
+uint64_t
+HostUSB_NextOUTReadyAt (const uint8_t EndpointNumber)
+{
+  HostUSB_Endpoint_t* Endpoint = &HostUSB_Endpoints[EndpointNumber];
+
+  return (Endpoint->OUTBanksUsed) ? Endpoint->OUTBank[0].Time : UINT64_MAX;
+}
+
+/** Retrieves the data the host has collected from the given endpoint since it was last cleared.
+ *
+ *  \param[in]  EndpointNumber  Endpoint number to retrieve the data of
+ *  \param[out] Length          Number of bytes collected
+ *  \param[out] CompletedAt     Time the transfer was ended by a short packet, or 0 if it is still running
+ *
+ *  \return Pointer to the collected data
+ */
+const uint8_t*
+HostUSB_HostReceived (const uint8_t EndpointNumber, uint32_t* const Length,
+                      uint64_t* const CompletedAt)
+{
+  HostUSB_Endpoint_t* Endpoint = &HostUSB_Endpoints[EndpointNumber];
+
+  *Length = Endpoint->HostRxLength;
+  *CompletedAt = Endpoint->HostRxCompletedAt;
+
+  return Endpoint->HostRxData;
+}
+
+/** Discards the data the host has collected from the given endpoint, ready for the next transfer.
+ *
+ *  \param[in] EndpointNumber  Endpoint number to clear
+ */
+void
+HostUSB_HostClearReceived (const uint8_t EndpointNumber)
+{
+  HostUSB_Endpoint_t* Endpoint = &HostUSB_Endpoints[EndpointNumber];
+
+  Endpoint->HostRxLength = 0;
+  Endpoint->HostRxCompletedAt = 0;
+}
+
+bool
+Endpoint_ConfigureEndpoint (const uint8_t Address, const uint8_t Type,
+                            const uint16_t Size, const uint8_t Banks)
+{
+  HostUSB_Endpoint_t* Endpoint = &HostUSB_Endpoints[Address & ENDPOINT_EPNUM_MASK];
+
+  (void) Type;
+
+  if ((Size > HOSTUSB_MAX_BANK_SIZE) || !(Banks) || (Banks > HOSTUSB_MAX_BANKS))
+    return false;
+
+  Endpoint->Configured = true;
+  Endpoint->Direction = (Address & ENDPOINT_DIR_MASK);
+  Endpoint->Size = Size;
+  Endpoint->Banks = Banks;
+
+  return true;
+}
+
+void
+Endpoint_SelectEndpoint (const uint8_t Address)
+{
+  HostUSB_Selected = &HostUSB_Endpoints[Address & ENDPOINT_EPNUM_MASK];
+}
+
+uint8_t
+Endpoint_GetEndpointDirection (void)
+{
+  return HostUSB_Selected->Direction;
+}
+
+/** Changes the direction of the selected endpoint. Both directions share the endpoint's banks, so IN packets
+ *  the host has not yet collected when the endpoint is turned to OUT are lost.
+ */
+void
+Endpoint_SetEndpointDirection (const uint8_t DirectionMask)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  if (DirectionMask == Endpoint->Direction)
+    return;
+
+  HostIO_Stats.EndpointTurnarounds++;
+
+  if (DirectionMask == ENDPOINT_DIR_OUT)
+    {
+      HostUSB_RetireINBanks (Endpoint);
+
+      HostIO_Stats.INPacketsLost += Endpoint->INBanksUsed;
+      Endpoint->INBanksUsed = 0;
+      Endpoint->INLength = 0;
+    }
+
+  Endpoint->Direction = DirectionMask;
+}
+
+bool
+Endpoint_IsOUTReceived (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  return (Endpoint->OUTBanksUsed && (Endpoint->OUTBank[0].Time <= HostClock_Cycles));
+}
+
+bool
+Endpoint_IsINReady (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  HostUSB_RetireINBanks (Endpoint);
+
+  return (Endpoint->INBanksUsed < Endpoint->Banks);
+}
+
+/** Waits until the selected endpoint can be read or written, advancing the simulated time to the arrival of the
+ *  next OUT packet or to the collection of the oldest IN packet. As on the device, the wait gives up after
+ *  \c USB_STREAM_TIMEOUT_MS if the host has nothing to send.
+ */
+uint8_t
+Endpoint_WaitUntilReady (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  if (Endpoint->Direction == ENDPOINT_DIR_IN)
+    {
+      if (!(Endpoint_IsINReady ()))
+        HostClock_AdvanceTo (Endpoint->INBank[0].Time);
+
+      return ENDPOINT_READYWAIT_NoError;
+    }
+
+  if (!(Endpoint->OUTBanksUsed))
+    {
+      HostClock_Advance (HOSTCLOCK_US_TO_CYCLES(USB_STREAM_TIMEOUT_MS * 1000UL));
+      return ENDPOINT_READYWAIT_Timeout;
+    }
+
+  HostClock_AdvanceTo (Endpoint->OUTBank[0].Time);
+  return ENDPOINT_READYWAIT_NoError;
+}
+
+bool
+Endpoint_IsReadWriteAllowed (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  if (Endpoint->Direction == ENDPOINT_DIR_IN)
+    return (Endpoint->INLength < Endpoint->Size);
+
+  return (Endpoint_IsOUTReceived ()
+      && (Endpoint->OUTReadPos < Endpoint->OUTBank[0].Length));
+}
+
+bool
+Endpoint_IsStalled (void)
+{
+  return false;
+}
+
+uint16_t
+Endpoint_BytesInEndpoint (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  if (Endpoint->Direction == ENDPOINT_DIR_IN)
+    return Endpoint->INLength;
+
+  if (!(Endpoint_IsOUTReceived ()))
+    return 0;
+
+  return (Endpoint->OUTBank[0].Length - Endpoint->OUTReadPos);
+}
+
+uint8_t
+Endpoint_GetBusyBanks (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  HostClock_Advance (HOSTIO_POLL_CYCLES);
+
+  if (Endpoint->Direction == ENDPOINT_DIR_IN)
+    {
+      HostUSB_RetireINBanks (Endpoint);
+      return Endpoint->INBanksUsed;
+    }
+
+  return Endpoint->OUTBanksUsed;
+}
+
+/** Releases the oldest OUT bank back to the controller, letting the next host packet into it. */
+void
+Endpoint_ClearOUT (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  if (!(Endpoint_IsOUTReceived ()))
+    return;
+
+  Endpoint->OUTBanksUsed--;
+  memmove (&Endpoint->OUTBank[0], &Endpoint->OUTBank[1],
+           Endpoint->OUTBanksUsed * sizeof(HostUSB_Packet_t));
+  Endpoint->OUTReadPos = 0;
+
+  HostUSB_FillOUTBanks (Endpoint);
+}
+
+/** Hands the IN bank being filled to the host, which collects it one packet time after the later of now and the
+ *  collection of the previous packet. A short packet ends the host's transfer.
+ */
+void
+Endpoint_ClearIN (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  HostUSB_RetireINBanks (Endpoint);
+
+  if (Endpoint->INBanksUsed >= Endpoint->Banks)
+    {
+      HostIO_Stats.EndpointOverruns++;
+      return;
+    }
+
+  HostUSB_Packet_t* Packet = &Endpoint->INBank[Endpoint->INBanksUsed++];
+  uint64_t StartTime = (Endpoint->LastINCollected > HostClock_Cycles) ?
+      Endpoint->LastINCollected : HostClock_Cycles;
+
+  memcpy (Packet->Data, Endpoint->INData, Endpoint->INLength);
+  Packet->Length = Endpoint->INLength;
+  Packet->Time = StartTime + HOSTUSB_PACKET_CYCLES(Packet->Length);
+  Endpoint->LastINCollected = Packet->Time;
+  Endpoint->INLength = 0;
+
+  if ((Endpoint->HostRxLength + Packet->Length) > Endpoint->HostRxCapacity)
+    {
+      Endpoint->HostRxCapacity = (Endpoint->HostRxCapacity * 2) + HOSTUSB_MAX_BANK_SIZE;
+      Endpoint->HostRxData = realloc (Endpoint->HostRxData, Endpoint->HostRxCapacity);
+    }
+
+  memcpy (&Endpoint->HostRxData[Endpoint->HostRxLength], Packet->Data, Packet->Length);
+  Endpoint->HostRxLength += Packet->Length;
+
+  if (Packet->Length < Endpoint->Size)
+    Endpoint->HostRxCompletedAt = Packet->Time;
+
+  HostIO_Stats.INPackets++;
+}
+
+uint8_t
+Endpoint_Read_8 (void)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  if (!(Endpoint_IsReadWriteAllowed ()) || (Endpoint->Direction != ENDPOINT_DIR_OUT))
+    {
+      HostIO_Stats.EndpointOverruns++;
+      return 0;
+    }
+
+  return Endpoint->OUTBank[0].Data[Endpoint->OUTReadPos++];
+}
+
+void
+Endpoint_Write_8 (const uint8_t Data)
+{
+  HostUSB_Endpoint_t* Endpoint = HostUSB_Selected;
+
+  if (!(Endpoint_IsReadWriteAllowed ()) || (Endpoint->Direction != ENDPOINT_DIR_IN))
+    {
+      HostIO_Stats.EndpointOverruns++;
+      return;
+    }
+
+  Endpoint->INData[Endpoint->INLength++] = Data;
+}
+
+uint16_t
+USB_Device_GetFrameNumber (void)
+{
+  return (HostClock_Cycles / HOSTCLOCK_CYCLES_PER_FRAME) & 0x07FF;
+}
+
+/** Services the control endpoint. The simulated host sends no control requests, so this only charges the cost of
+ *  checking for a SETUP packet.
+ */
+void
+USB_USBTask (void)
+{
+  HostClock_Advance (HOSTUSB_TASK_CYCLES);
+}
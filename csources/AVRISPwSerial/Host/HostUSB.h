@@ -0,0 +1,78 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for HostUSB.c.
+ */
+
+#ifndef _HOST_USB_
+#define _HOST_USB_
+
+/* Includes: */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Macros: */
+/** Number of endpoint numbers modelled, including the control endpoint. */
+#define HOSTUSB_ENDPOINTS               7
+
+/** Maximum number of hardware banks per endpoint. */
+#define HOSTUSB_MAX_BANKS               2
+
+/** Largest modelled endpoint bank, in bytes. */
+#define HOSTUSB_MAX_BANK_SIZE           64
+
+/** Bus time of the token, handshake, CRC and gaps around each full-speed bulk data packet, in byte times. */
+#define HOSTUSB_PACKET_OVERHEAD_BYTES   13
+
+/** CPU cycles the full-speed bus takes to move a data packet of the given length. */
+#define HOSTUSB_PACKET_CYCLES(Length)   ((((uint32_t)(Length) + HOSTUSB_PACKET_OVERHEAD_BYTES) * 8 * (F_CPU / 1000000UL)) / 12)
+
+/** CPU cycles taken by a call of USB_USBTask() that finds no control request pending. */
+#define HOSTUSB_TASK_CYCLES             24
+
+/* Function Prototypes: */
+void
+HostUSB_Reset (void);
+void
+HostUSB_HostSend (const uint8_t EndpointNumber, const uint8_t* Data,
+                  const uint32_t Length);
+bool
+HostUSB_HostSendPending (const uint8_t EndpointNumber);
+uint64_t
+HostUSB_NextOUTReadyAt (const uint8_t EndpointNumber);
+const uint8_t*
+HostUSB_HostReceived (const uint8_t EndpointNumber, uint32_t* const Length,
+                      uint64_t* const CompletedAt);
+void
+HostUSB_HostClearReceived (const uint8_t EndpointNumber);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Stream functions of the simulated USB device controller of the host-native build. As in LUFA, they are kept apart
+ *  from the endpoint functions they are built on, so that their calls to \c Endpoint_WaitUntilReady() can be
+ *  wrapped at link time just as in the firmware.
+ */
+
+#include <LUFA/Drivers/USB/USB.h>
+
+/** Reads a stream from the selected OUT endpoint in either byte order, as the LUFA stream functions do. */
+static uint8_t
+HostUSB_ReadStream (void* const Buffer, uint16_t Length,
+                    uint16_t* const BytesProcessed, const bool BigEndian)
+{
+  uint8_t* DataStream = (uint8_t*) Buffer + (BigEndian ? (Length - 1) : 0);
+  int8_t Step = BigEndian ? -1 : 1;
+  uint16_t BytesInTransfer = 0;
+  uint8_t ErrorCode;
+
+  if ((ErrorCode = Endpoint_WaitUntilReady ()))
+    return ErrorCode;
+
+  if (BytesProcessed != NULL)
+    {
+      Length -= *BytesProcessed;
+      DataStream += Step * *BytesProcessed;
+    }
+
+  while (Length)
+    {
+      if (!(Endpoint_IsReadWriteAllowed ()))
+        {
+          Endpoint_ClearOUT ();
+
+          if (BytesProcessed != NULL)
+            {
+              *BytesProcessed += BytesInTransfer;
+              return ENDPOINT_RWSTREAM_IncompleteTransfer;
+            }
+
+          if ((ErrorCode = Endpoint_WaitUntilReady ()))
+            return ErrorCode;
+        }
+      else
+        {
+          *DataStream = Endpoint_Read_8 ();
+          DataStream += Step;
+          Length--;
+          BytesInTransfer++;
+        }
+    }
+
+  return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t
+Endpoint_Read_Stream_LE (void* const Buffer, uint16_t Length,
+                         uint16_t* const BytesProcessed)
+{
+  return HostUSB_ReadStream (Buffer, Length, BytesProcessed, false);
+}
+
+uint8_t
+Endpoint_Read_Stream_BE (void* const Buffer, uint16_t Length,
+                         uint16_t* const BytesProcessed)
+{
+  return HostUSB_ReadStream (Buffer, Length, BytesProcessed, true);
+}
+
+uint8_t
+Endpoint_Write_Stream_LE (const void* const Buffer, uint16_t Length,
+                          uint16_t* const BytesProcessed)
+{
+  const uint8_t* DataStream = (const uint8_t*) Buffer;
+  uint16_t BytesInTransfer = 0;
+  uint8_t ErrorCode;
+
+  if ((ErrorCode = Endpoint_WaitUntilReady ()))
+    return ErrorCode;
+
+  if (BytesProcessed != NULL)
+    {
+      Length -= *BytesProcessed;
+      DataStream += *BytesProcessed;
+    }
+
+  while (Length)
+    {
+      if (!(Endpoint_IsReadWriteAllowed ()))
+        {
+          Endpoint_ClearIN ();
+
+          if (BytesProcessed != NULL)
+            {
+              *BytesProcessed += BytesInTransfer;
+              return ENDPOINT_RWSTREAM_IncompleteTransfer;
+            }
+
+          if ((ErrorCode = Endpoint_WaitUntilReady ()))
+            return ErrorCode;
+        }
+      else
+        {
+          Endpoint_Write_8 (*DataStream++);
+          Length--;
+          BytesInTransfer++;
+        }
+    }
+
+  return ENDPOINT_RWSTREAM_NoError;
+}
@@ -0,0 +1,79 @@
+/* Host build stand-in for the LUFA common header: attribute macros, endian helpers, board IDs and delays. */
+
+#ifndef _HOST_LUFA_COMMON_H_
+#define _HOST_LUFA_COMMON_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "HostClock.h"
+
+#define BOARD_USER                    0
+#define BOARD_NONE                    1
+#define BOARD_XPLAIN                  2
+#define BOARD_XPLAIN_REV1             3
+
+#if !defined(BOARD)
+#define BOARD                         BOARD_USER
+#endif
+
+#define ATTR_WARN_UNUSED_RESULT       __attribute__ ((warn_unused_result))
+#define ATTR_NON_NULL_PTR_ARG(...)    __attribute__ ((nonnull (__VA_ARGS__)))
+#define ATTR_ALWAYS_INLINE            __attribute__ ((always_inline))
+#define ATTR_CONST                    __attribute__ ((const))
+#define ATTR_PURE                     __attribute__ ((pure))
+#define ATTR_NO_RETURN                __attribute__ ((noreturn))
+#define ATTR_NO_INIT
+#define ATTR_PACKED                   __attribute__ ((packed))
+#define ATTR_WEAK                     __attribute__ ((weak))
+#define ATTR_ALIAS(Func)              __attribute__ ((alias( #Func )))
+
+#define GCC_FORCE_POINTER_ACCESS(StructPtr)
+#define GCC_MEMORY_BARRIER()          __asm__ __volatile__ ("" ::: "memory")
+#define GCC_IS_COMPILE_CONST(x)       __builtin_constant_p(x)
+
+#define MIN(x, y)                     (((x) < (y)) ? (x) : (y))
+#define MAX(x, y)                     (((x) > (y)) ? (x) : (y))
+
+#define CPU_TO_LE16(x)                (x)
+#define CPU_TO_LE32(x)                (x)
+#define LE16_TO_CPU(x)                (x)
+#define LE32_TO_CPU(x)                (x)
+
+static inline uint16_t
+SwapEndian_16 (const uint16_t Word)
+{
+  return (uint16_t) ((Word >> 8) | (Word << 8));
+}
+
+static inline uint32_t
+SwapEndian_32 (const uint32_t DWord)
+{
+  return __builtin_bswap32 (DWord);
+}
+
+static inline void
+Delay_MS (uint16_t Milliseconds)
+{
+  HostClock_Advance (HOSTCLOCK_US_TO_CYCLES((uint32_t) Milliseconds * 1000));
+}
+
+static inline void
+GlobalInterruptEnable (void)
+{
+  HostIO_InterruptsEnabled = true;
+}
+
+static inline void
+GlobalInterruptDisable (void)
+{
+  HostIO_InterruptsEnabled = false;
+}
+
+
+#endif
@@ -0,0 +1,11 @@
+/* Host build stand-in for the LUFA board LED dispatch header, pulling in the real board LED driver. */
+
+#ifndef _HOST_LUFA_LEDS_H_
+#define _HOST_LUFA_LEDS_H_
+
+#include <LUFA/Common/Common.h>
+
+#define __INCLUDE_FROM_LEDS_H
+#include "Board/LEDs.h"
+
+#endif
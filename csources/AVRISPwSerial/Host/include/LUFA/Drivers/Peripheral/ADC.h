@@ -0,0 +1,12 @@
+/* Host build stand-in for the LUFA ADC driver; the simulation has no VTARGET measurement. */
+
+#ifndef _HOST_LUFA_ADC_H_
+#define _HOST_LUFA_ADC_H_
+
+#include <LUFA/Common/Common.h>
+
+#define ADC_REFERENCE_AVCC            0
+#define ADC_REFERENCE_INT2560MV       0
+#define ADC_GET_CHANNEL_MASK(Channel) (Channel)
+
+#endif
@@ -0,0 +1,82 @@
+/* Host build stand-in for the LUFA AVR8 SPI driver. The register setup matches LUFA; each transfer is handed
+ * to the simulated target and charged the bus time of the configured SCK prescaler. */
+
+#ifndef _HOST_LUFA_SPI_H_
+#define _HOST_LUFA_SPI_H_
+
+#include <LUFA/Common/Common.h>
+
+#define SPI_USE_DOUBLESPEED           (1 << SPE)
+
+#define SPI_SPEED_FCPU_DIV_2          SPI_USE_DOUBLESPEED
+#define SPI_SPEED_FCPU_DIV_4          0
+#define SPI_SPEED_FCPU_DIV_8          (SPI_USE_DOUBLESPEED | (1 << SPR0))
+#define SPI_SPEED_FCPU_DIV_16         (1 << SPR0)
+#define SPI_SPEED_FCPU_DIV_32         (SPI_USE_DOUBLESPEED | (1 << SPR1))
+#define SPI_SPEED_FCPU_DIV_64         (SPI_USE_DOUBLESPEED | (1 << SPR1) | (1 << SPR0))
+#define SPI_SPEED_FCPU_DIV_128        ((1 << SPR1) | (1 << SPR0))
+
+#define SPI_SCK_LEAD_RISING           (0 << CPOL)
+#define SPI_SCK_LEAD_FALLING          (1 << CPOL)
+#define SPI_SAMPLE_LEADING            (0 << CPHA)
+#define SPI_SAMPLE_TRAILING           (1 << CPHA)
+#define SPI_ORDER_MSB_FIRST           (0 << DORD)
+#define SPI_ORDER_LSB_FIRST           (1 << DORD)
+#define SPI_MODE_SLAVE                (0 << MSTR)
+#define SPI_MODE_MASTER               (1 << MSTR)
+
+void
+HostTarget_SPIReset (void);
+
+static inline void
+SPI_Init (const uint8_t SPIOptions)
+{
+  DDRB |= ((1 << 1) | (1 << 2));
+  DDRB &= ~(1 << 3);
+  PORTB |= ((1 << 0) | (1 << 3));
+
+  /* Only a newly enabled bus may have clocked stray bits into the target; a change of speed does not */
+  bool WasEnabled = (SPCR & (1 << SPE));
+
+  SPCR = ((1 << SPE) | SPIOptions);
+
+  if (SPIOptions & SPI_USE_DOUBLESPEED)
+    SPSR |= (1 << SPI2X);
+  else
+    SPSR &= ~(1 << SPI2X);
+
+  if (!(WasEnabled))
+    HostTarget_SPIReset ();
+}
+
+static inline void
+SPI_Disable (void)
+{
+  DDRB &= ~((1 << 1) | (1 << 2));
+  PORTB &= ~((1 << 0) | (1 << 3));
+
+  SPCR = 0;
+  SPSR = 0;
+
+  HostTarget_SPIReset ();
+}
+
+static inline uint8_t
+SPI_TransferByte (const uint8_t Byte)
+{
+  return HostIO_SPITransfer (Byte);
+}
+
+static inline void
+SPI_SendByte (const uint8_t Byte)
+{
+  HostIO_SPITransfer (Byte);
+}
+
+static inline uint8_t
+SPI_ReceiveByte (void)
+{
+  return HostIO_SPITransfer (0x00);
+}
+
+#endif
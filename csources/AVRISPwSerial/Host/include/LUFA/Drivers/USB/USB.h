@@ -0,0 +1,177 @@
+/* Host build stand-in for the LUFA USB device stack: the endpoint API used by the protocol handlers, backed by
+ * the simulated endpoint banks of HostUSB.c, and the descriptor types needed to parse the application headers. */
+
+#ifndef _HOST_LUFA_USB_H_
+#define _HOST_LUFA_USB_H_
+
+#include <LUFA/Common/Common.h>
+
+#include "HostUSB.h"
+
+#define USB_STREAM_TIMEOUT_MS         100
+
+#define ENDPOINT_DIR_MASK             0x80
+#define ENDPOINT_DIR_OUT              0x00
+#define ENDPOINT_DIR_IN               0x80
+#define ENDPOINT_EPNUM_MASK           0x0F
+
+#define EP_TYPE_CONTROL               0x00
+#define EP_TYPE_ISOCHRONOUS           0x01
+#define EP_TYPE_BULK                  0x02
+#define EP_TYPE_INTERRUPT             0x03
+
+enum USB_Device_States_t
+{
+  DEVICE_STATE_Unattached = 0,
+  DEVICE_STATE_Powered = 1,
+  DEVICE_STATE_Default = 2,
+  DEVICE_STATE_Addressed = 3,
+  DEVICE_STATE_Configured = 4,
+  DEVICE_STATE_Suspended = 5,
+};
+
+enum Endpoint_WaitUntilReady_ErrorCodes_t
+{
+  ENDPOINT_READYWAIT_NoError = 0,
+  ENDPOINT_READYWAIT_EndpointStalled = 1,
+  ENDPOINT_READYWAIT_DeviceDisconnected = 2,
+  ENDPOINT_READYWAIT_BusSuspended = 3,
+  ENDPOINT_READYWAIT_Timeout = 4,
+};
+
+enum Endpoint_Stream_RW_ErrorCodes_t
+{
+  ENDPOINT_RWSTREAM_NoError = 0,
+  ENDPOINT_RWSTREAM_EndpointStalled = 1,
+  ENDPOINT_RWSTREAM_DeviceDisconnected = 2,
+  ENDPOINT_RWSTREAM_BusSuspended = 3,
+  ENDPOINT_RWSTREAM_Timeout = 4,
+  ENDPOINT_RWSTREAM_IncompleteTransfer = 5,
+};
+
+typedef struct { uint8_t Size; uint8_t Type; } USB_Descriptor_Header_t;
+typedef struct { USB_Descriptor_Header_t Header; } USB_Descriptor_Configuration_Header_t;
+typedef struct { USB_Descriptor_Header_t Header; } USB_Descriptor_Interface_t;
+typedef struct { USB_Descriptor_Header_t Header; } USB_Descriptor_Endpoint_t;
+typedef struct { USB_Descriptor_Header_t Header; } USB_Descriptor_Interface_Association_t;
+typedef struct { USB_Descriptor_Header_t Header; } USB_CDC_Descriptor_FunctionalHeader_t;
+typedef struct { USB_Descriptor_Header_t Header; } USB_CDC_Descriptor_FunctionalACM_t;
+typedef struct { USB_Descriptor_Header_t Header; } USB_CDC_Descriptor_FunctionalUnion_t;
+
+extern volatile uint8_t USB_DeviceState;
+
+bool
+Endpoint_ConfigureEndpoint (const uint8_t Address, const uint8_t Type,
+                            const uint16_t Size, const uint8_t Banks);
+void
+Endpoint_SelectEndpoint (const uint8_t Address);
+uint8_t
+Endpoint_GetEndpointDirection (void);
+void
+Endpoint_SetEndpointDirection (const uint8_t DirectionMask);
+uint8_t
+Endpoint_WaitUntilReady (void);
+bool
+Endpoint_IsOUTReceived (void);
+bool
+Endpoint_IsINReady (void);
+bool
+Endpoint_IsReadWriteAllowed (void);
+bool
+Endpoint_IsStalled (void);
+uint16_t
+Endpoint_BytesInEndpoint (void);
+uint8_t
+Endpoint_GetBusyBanks (void);
+void
+Endpoint_ClearOUT (void);
+void
+Endpoint_ClearIN (void);
+uint8_t
+Endpoint_Read_8 (void);
+void
+Endpoint_Write_8 (const uint8_t Data);
+uint16_t
+USB_Device_GetFrameNumber (void);
+void
+USB_USBTask (void);
+uint8_t
+Endpoint_Read_Stream_LE (void* const Buffer, uint16_t Length,
+                         uint16_t* const BytesProcessed);
+uint8_t
+Endpoint_Read_Stream_BE (void* const Buffer, uint16_t Length,
+                         uint16_t* const BytesProcessed);
+uint8_t
+Endpoint_Write_Stream_LE (const void* const Buffer, uint16_t Length,
+                          uint16_t* const BytesProcessed);
+
+static inline void
+Endpoint_Discard_8 (void)
+{
+  (void) Endpoint_Read_8 ();
+}
+
+static inline void
+Endpoint_Discard_16 (void)
+{
+  Endpoint_Discard_8 ();
+  Endpoint_Discard_8 ();
+}
+
+static inline uint16_t
+Endpoint_Read_16_BE (void)
+{
+  uint16_t Value = (uint16_t) Endpoint_Read_8 () << 8;
+  return Value | Endpoint_Read_8 ();
+}
+
+static inline uint16_t
+Endpoint_Read_16_LE (void)
+{
+  uint16_t Value = Endpoint_Read_8 ();
+  return Value | ((uint16_t) Endpoint_Read_8 () << 8);
+}
+
+static inline uint32_t
+Endpoint_Read_32_BE (void)
+{
+  uint32_t Value = (uint32_t) Endpoint_Read_16_BE () << 16;
+  return Value | Endpoint_Read_16_BE ();
+}
+
+static inline uint32_t
+Endpoint_Read_32_LE (void)
+{
+  uint32_t Value = Endpoint_Read_16_LE ();
+  return Value | ((uint32_t) Endpoint_Read_16_LE () << 16);
+}
+
+static inline void
+Endpoint_Write_16_LE (const uint16_t Data)
+{
+  Endpoint_Write_8 (Data & 0xFF);
+  Endpoint_Write_8 (Data >> 8);
+}
+
+static inline void
+Endpoint_Write_16_BE (const uint16_t Data)
+{
+  Endpoint_Write_8 (Data >> 8);
+  Endpoint_Write_8 (Data & 0xFF);
+}
+
+static inline void
+Endpoint_Write_32_BE (const uint32_t Data)
+{
+  Endpoint_Write_16_BE (Data >> 16);
+  Endpoint_Write_16_BE (Data & 0xFFFF);
+}
+
+static inline void
+Endpoint_Write_32_LE (const uint32_t Data)
+{
+  Endpoint_Write_16_LE (Data & 0xFFFF);
+  Endpoint_Write_16_LE (Data >> 16);
+}
+
+#endif
@@ -0,0 +1,91 @@
+/* Host build stand-in for <avr/eeprom.h>. EEMEM variables live in host memory; every byte actually changed
+ * by an update or write is counted so that EEPROM wear can be measured, and keeps the EEPROM busy for the time
+ * a write takes, a write started while it is busy waiting for the previous one as avr-libc does. */
+
+#ifndef _HOST_AVR_EEPROM_H_
+#define _HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "HostClock.h"
+
+#define EEMEM
+
+/* Time taken by the EEPROM to erase and write a byte */
+#define HOSTEEPROM_WRITE_US  3400
+
+extern uint32_t HostEEPROM_ByteWrites;
+extern uint64_t HostEEPROM_ReadyAt;
+
+static inline bool
+eeprom_is_ready (void)
+{
+  return (HostClock_Cycles >= HostEEPROM_ReadyAt);
+}
+
+static inline uint8_t
+eeprom_read_byte (const uint8_t* Address)
+{
+  return *Address;
+}
+
+static inline uint16_t
+eeprom_read_word (const uint16_t* Address)
+{
+  return *Address;
+}
+
+static inline uint32_t
+eeprom_read_dword (const uint32_t* Address)
+{
+  return *Address;
+}
+
+static inline void
+eeprom_read_block (void* Dest, const void* Source, size_t Length)
+{
+  memcpy (Dest, Source, Length);
+}
+
+static inline void
+eeprom_write_byte (uint8_t* Address, uint8_t Value)
+{
+  if (!(eeprom_is_ready ()))
+    HostClock_AdvanceTo (HostEEPROM_ReadyAt);
+
+  *Address = Value;
+  HostEEPROM_ByteWrites++;
+  HostEEPROM_ReadyAt = HostClock_Cycles + HOSTCLOCK_US_TO_CYCLES(HOSTEEPROM_WRITE_US);
+}
+
+static inline void
+eeprom_update_byte (uint8_t* Address, uint8_t Value)
+{
+  if (*Address != Value)
+    eeprom_write_byte (Address, Value);
+}
+
+static inline void
+eeprom_update_word (uint16_t* Address, uint16_t Value)
+{
+  eeprom_update_byte ((uint8_t*) Address, Value & 0xFF);
+  eeprom_update_byte ((uint8_t*) Address + 1, Value >> 8);
+}
+
+static inline void
+eeprom_update_dword (uint32_t* Address, uint32_t Value)
+{
+  eeprom_update_word ((uint16_t*) Address, Value & 0xFFFF);
+  eeprom_update_word ((uint16_t*) Address + 1, Value >> 16);
+}
+
+static inline void
+eeprom_update_block (const void* Source, void* Dest, size_t Length)
+{
+  for (size_t i = 0; i < Length; i++)
+    eeprom_update_byte ((uint8_t*) Dest + i, ((const uint8_t*) Source)[i]);
+}
+
+#endif
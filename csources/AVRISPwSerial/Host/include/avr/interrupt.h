@@ -0,0 +1,26 @@
+/* Host build stand-in for <avr/interrupt.h>. Interrupt handlers become weak-referenced functions that the
+ * simulated clock calls when their source fires; see HostClock.c. */
+
+#ifndef _HOST_AVR_INTERRUPT_H_
+#define _HOST_AVR_INTERRUPT_H_
+
+#include "HostIO.h"
+
+#define ISR(Vector, ...)     void Vector (void)
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+
+#define TIMER0_COMPA_vect    HostISR_TIMER0_COMPA
+#define TIMER0_OVF_vect      HostISR_TIMER0_OVF
+#define TIMER1_COMPA_vect    HostISR_TIMER1_COMPA
+#define TIMER1_OVF_vect      HostISR_TIMER1_OVF
+#define TIMER3_COMPA_vect    HostISR_TIMER3_COMPA
+#define TIMER3_OVF_vect      HostISR_TIMER3_OVF
+#define PCINT0_vect          HostISR_PCINT0
+#define USART1_RX_vect       HostISR_USART1_RX
+
+#define sei()                do { HostIO_InterruptsEnabled = true; } while (0)
+#define cli()                do { HostIO_InterruptsEnabled = false; } while (0)
+
+#endif
@@ -0,0 +1,115 @@
+/* Host build stand-in for <avr/io.h>, mapping the ATmega32U4 registers onto the simulated I/O register file. */
+
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#include "HostIO.h"
+
+#define _BV(bit)      (1 << (bit))
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define COM0A1 7
+#define COM0A0 6
+#define COM0B1 5
+#define COM0B0 4
+#define WGM01  1
+#define WGM00  0
+#define WGM02  3
+#define CS02   2
+#define CS01   1
+#define CS00   0
+#define OCIE0B 2
+#define OCIE0A 1
+#define TOIE0  0
+
+#define WGM11  1
+#define WGM10  0
+#define WGM13  4
+#define WGM12  3
+#define CS12   2
+#define CS11   1
+#define CS10   0
+#define OCIE1A 1
+#define TOIE1  0
+#define ICF1   5
+#define OCF1C  3
+#define OCF1B  2
+#define OCF1A  1
+#define TOV1   0
+
+#define WGM31  1
+#define WGM30  0
+#define WGM33  4
+#define WGM32  3
+#define CS32   2
+#define CS31   1
+#define CS30   0
+#define OCIE3A 1
+#define TOIE3  0
+#define OCF3A  1
+#define TOV3   0
+
+#define SPIE   7
+#define SPE    6
+#define DORD   5
+#define MSTR   4
+#define CPOL   3
+#define CPHA   2
+#define SPR1   1
+#define SPR0   0
+#define SPIF   7
+#define WCOL   6
+#define SPI2X  0
+
+#define RXC1   7
+#define TXC1   6
+#define UDRE1  5
+#define FE1    4
+#define DOR1   3
+#define UPE1   2
+#define U2X1   1
+#define MPCM1  0
+#define RXCIE1 7
+#define TXCIE1 6
+#define UDRIE1 5
+#define RXEN1  4
+#define TXEN1  3
+#define UCSZ12 2
+#define UMSEL11 7
+#define UMSEL10 6
+#define UPM11  5
+#define UPM10  4
+#define USBS1  3
+#define UCSZ11 2
+#define UCSZ10 1
+#define UCPOL1 0
+
+#define PCIE0  0
+#define PCINT0 0
+#define PCINT1 1
+#define PCINT2 2
+#define PCINT3 3
+#define PCINT4 4
+#define PCINT5 5
+#define PCINT6 6
+#define PCINT7 7
+
+#endif
@@ -0,0 +1,20 @@
+/* Host build stand-in for <avr/pgmspace.h>; program memory is ordinary memory on the host. */
+
+#ifndef _HOST_AVR_PGMSPACE_H_
+#define _HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(String)                   (String)
+
+#define pgm_read_byte(Address)         (*(const uint8_t*)(Address))
+#define pgm_read_word(Address)         (*(const uint16_t*)(Address))
+#define pgm_read_dword(Address)        (*(const uint32_t*)(Address))
+#define pgm_read_ptr(Address)          (*(void* const*)(Address))
+
+#define memcpy_P(Dest, Source, Length) memcpy((Dest), (Source), (Length))
+#define strlen_P(String)               strlen(String)
+
+#endif
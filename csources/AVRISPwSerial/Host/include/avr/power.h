@@ -0,0 +1,9 @@
+/* Host build stand-in for <avr/power.h>; the simulated CPU always runs at F_CPU. */
+
+#ifndef _HOST_AVR_POWER_H_
+#define _HOST_AVR_POWER_H_
+
+#define clock_div_1          0
+#define clock_prescale_set(Div) do { (void)(Div); } while (0)
+
+#endif
@@ -0,0 +1,14 @@
+/* Host build stand-in for <avr/wdt.h>; the simulation has no watchdog. */
+
+#ifndef _HOST_AVR_WDT_H_
+#define _HOST_AVR_WDT_H_
+
+#define WDTO_15MS            0
+#define WDTO_250MS           4
+#define WDTO_1S              6
+
+#define wdt_reset()          do { } while (0)
+#define wdt_disable()        do { } while (0)
+#define wdt_enable(Timeout)  do { (void)(Timeout); } while (0)
+
+#endif
@@ -0,0 +1,28 @@
+/* Host build stand-in for <util/atomic.h>, operating on the simulated global interrupt flag. */
+
+#ifndef _HOST_UTIL_ATOMIC_H_
+#define _HOST_UTIL_ATOMIC_H_
+
+#include <stdbool.h>
+
+#include "HostIO.h"
+
+static inline bool
+HostAtomic_Enter (const bool Enable)
+{
+  bool PreviousState = HostIO_InterruptsEnabled;
+  HostIO_InterruptsEnabled = Enable;
+  return PreviousState;
+}
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define NONATOMIC_RESTORESTATE
+#define NONATOMIC_FORCEOFF
+
+#define ATOMIC_BLOCK(Type)    for (bool __Saved = HostAtomic_Enter (false), __Todo = true; __Todo; \
+                                   __Todo = false, HostIO_InterruptsEnabled = __Saved)
+#define NONATOMIC_BLOCK(Type) for (bool __Saved = HostAtomic_Enter (true), __Todo = true; __Todo; \
+                                   __Todo = false, HostIO_InterruptsEnabled = __Saved)
+
+#endif
@@ -0,0 +1,13 @@
+/* Host build stand-in for <util/delay.h>; delays advance the simulated clock. */
+
+#ifndef _HOST_UTIL_DELAY_H_
+#define _HOST_UTIL_DELAY_H_
+
+#include "HostClock.h"
+
+#define _delay_us(Microseconds)  HostClock_Advance (HOSTCLOCK_US_TO_CYCLES(Microseconds))
+#define _delay_ms(Milliseconds)  HostClock_Advance (HOSTCLOCK_US_TO_CYCLES((Milliseconds) * 1000))
+
+#define __builtin_avr_delay_cycles(Cycles)  HostClock_Advance (Cycles)
+
+#endif
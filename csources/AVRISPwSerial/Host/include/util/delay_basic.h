@@ -0,0 +1,13 @@
+/* Host build stand-in for <util/delay_basic.h>; delay loops advance the simulated clock. */
+
+#ifndef _HOST_UTIL_DELAY_BASIC_H_
+#define _HOST_UTIL_DELAY_BASIC_H_
+
+#include <stdint.h>
+
+#include "HostClock.h"
+
+#define _delay_loop_1(Count)  HostClock_Advance ((Count) ? ((uint64_t)(Count) * 3) : (256 * 3))
+#define _delay_loop_2(Count)  HostClock_Advance ((Count) ? ((uint64_t)(Count) * 4) : (65536 * 4))
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Buffer arena shared by the protocol command handlers. Rather than each handler placing its page or transfer
+ *  buffer on the stack, buffers are taken from a single statically allocated block, so that the largest buffers are
+ *  accounted for at link time and the RAM of the handlers not running is reused by the one that is. Buffers are taken
+ *  in order and given back together, by releasing the arena to a mark taken before them; the dispatcher releases
+ *  the buffers of each command once it has been processed.
+ */
+
+#include "BufferArena.h"
+
+/** Memory the buffers are taken from. */
+static uint8_t BufferArena_Memory[BUFFER_ARENA_SIZE];
+
+/** Number of bytes at the start of the arena taken by the buffers in use. */
+static uint16_t BufferArena_Used;
+
+/** Takes a buffer from the arena, which stays valid until the arena is released to a mark taken before it.
+ *
+ *  \param[in] Size  Size of the buffer in bytes
+ *
+ *  \return Pointer to the buffer, or NULL if the arena has fewer than \c Size bytes left
+ */
+void*
+BufferArena_Alloc (const uint16_t Size)
+{
+  if (Size > BufferArena_Available ())
+    return NULL;
+
+  void* Buffer = &BufferArena_Memory[BufferArena_Used];
+  BufferArena_Used += Size;
+
+  return Buffer;
+}
+
+/** Retrieves the size of the largest buffer that can currently be taken from the arena.
+ *
+ *  \return Number of free bytes in the arena
+ */
+uint16_t
+BufferArena_Available (void)
+{
+  return (sizeof(BufferArena_Memory) - BufferArena_Used);
+}
+
+/** Marks the current use of the arena, so that the buffers taken after the mark can later be given back together.
+ *
+ *  \return Mark to pass to \ref BufferArena_Release()
+ */
+uint16_t
+BufferArena_Mark (void)
+{
+  return BufferArena_Used;
+}
+
+/** Gives back all buffers taken from the arena since the given mark was taken.
+ *
+ *  \param[in] Mark  Mark returned by \ref BufferArena_Mark()
+ */
+void
+BufferArena_Release (const uint16_t Mark)
+{
+  BufferArena_Used = Mark;
+}
@@ -0,0 +1,69 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for BufferArena.c.
+ */
+
+#ifndef _BUFFER_ARENA_
+#define _BUFFER_ARENA_
+
+/* Includes: */
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Config/AppConfig.h"
+
+/* Macros: */
+#if !defined(BUFFER_ARENA_SIZE) || defined(__DOXYGEN__)
+/** Size of the buffer arena in bytes, the SRAM left over once the static variables, the serial ring buffers and a
+ *  stack reserve for the deepest handler call chain have been accounted for. Can be overridden in AppConfig.h.
+ */
+#define BUFFER_ARENA_SIZE      768
+#endif
+
+#if (BUFFER_ARENA_SIZE < 256)
+#error The buffer arena must hold at least the 256 byte page buffer of the standard V2 programming commands.
+#endif
+
+/* Function Prototypes: */
+void*
+BufferArena_Alloc (const uint16_t Size);
+uint16_t
+BufferArena_Available (void);
+uint16_t
+BufferArena_Mark (void);
+void
+BufferArena_Release (const uint16_t Mark);
+
+#endif
+
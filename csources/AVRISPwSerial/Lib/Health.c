@@ -0,0 +1,163 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Health counters of the programmer, counting its programming sessions, the pages it wrote and bytes it read, the
+ *  commands which timed out, the targets it failed to synchronize with and the time it spent busy, so that units
+ *  wearing out or fixtures going bad can be spotted from their counters before they slow down a production line. The
+ *  host reads them back with the vendor CMD_READ_HEALTH command.
+ *
+ *  The counters are kept in RAM while commands are processed, and handed over to the non-volatile parameter values
+ *  by \ref Health_Task() from the main loop outside of a programming session, at most every
+ *  \ref HEALTH_SAVE_INTERVAL_MS, to be written back to the EEPROM journal with them while the programmer is idle.
+ *  A command is thus never held up by EEPROM writes, and the EEPROM is not worn out by them. Counts made since the
+ *  last save are lost if the programmer is powered off.
+ */
+
+#define  INCLUDE_FROM_HEALTH_C
+#include "Health.h"
+#include "V2Protocol.h"
+
+#if defined(ENABLE_HEALTH_COUNTERS) || defined(__DOXYGEN__)
+
+/** Health counters, as last saved plus the counts made since. */
+uint32_t Health_Counters[HEALTH_COUNTERS];
+
+/** Flag to indicate that the health counters have changed since they were last saved. */
+bool Health_CountersChanged;
+
+/** Time at which the command being processed started. */
+static Timebase_Time_t Health_CommandStart;
+
+/** Time spent busy processing commands which is not yet a whole second, and so not yet counted. */
+static Timebase_Time_t Health_BusyTicks;
+
+/** Earliest time at which the health counters may be saved to EEPROM again. */
+static Timebase_Time_t Health_NextSave;
+
+/** Initializes the health counters from the values last saved, once the non-volatile parameter values are loaded. */
+void
+Health_Init (void)
+{
+  V2Params_LoadHealthCounters (Health_Counters);
+
+  Health_CountersChanged = false;
+  Health_BusyTicks = 0;
+  Health_NextSave = Timebase_Deadline (TIMEBASE_MS(HEALTH_SAVE_INTERVAL_MS));
+}
+
+/** Starts timing a command received from the host, towards the busy time of the programmer. */
+void
+Health_BeginCommand (void)
+{
+  Health_CommandStart = Timebase_Now ();
+}
+
+/** Ends the command being processed, once it has been run, counting it towards the busy time of the programmer and
+ *  as a timeout if it returned a timeout status. The commands of a command batch are counted as they are run.
+ *
+ *  \param[in] V2Command  Command byte of the command processed
+ *  \param[in] Status     Status returned to the host for the command
+ */
+void
+Health_EndCommand (const uint8_t V2Command, const uint8_t Status)
+{
+  Health_CountStatus (V2Command, Status);
+
+  Health_BusyTicks += (Timebase_Now () - Health_CommandStart);
+
+  while (Health_BusyTicks >= TIMEBASE_MS(1000))
+    {
+      Health_BusyTicks -= TIMEBASE_MS(1000);
+      Health_Count (HEALTH_BUSY_SECONDS, 1);
+    }
+}
+
+/** Counts a command as a timeout if the status it returned is one. The status returned is checked rather than the
+ *  command timeout itself, as the handlers restart the timeout once they have given up waiting on the target.
+ *
+ *  \param[in] V2Command  Command byte of the command run
+ *  \param[in] Status     Status returned for the command, the XPROG status of an XPROG command
+ */
+void
+Health_CountStatus (const uint8_t V2Command, const uint8_t Status)
+{
+  bool TimedOut;
+
+  if (V2Command == CMD_XPROG)
+    TimedOut = (Status == XPROG_ERR_TIMEOUT);
+  else
+    TimedOut = ((Status == STATUS_CMD_TOUT) || (Status == STATUS_RDY_BSY_TOUT));
+
+  if (TimedOut)
+    Health_Count (HEALTH_TIMEOUTS, 1);
+}
+
+/** Saves the health counters to the non-volatile parameter values if they have changed, and if the save interval has
+ *  passed since the last save. To be called from the main loop while no command from the host is pending. The save interval restarts while
+ *  the counters are unchanged, so the first counts made after an idle spell are saved an interval later.
+ */
+void
+Health_Task (void)
+{
+  if (!(Health_CountersChanged))
+    {
+      Health_NextSave = Timebase_Deadline (TIMEBASE_MS(HEALTH_SAVE_INTERVAL_MS));
+      return;
+    }
+
+  if (TargetInProgMode || !(Timebase_HasExpired (Health_NextSave)))
+    return;
+
+  V2Params_SaveHealthCounters (Health_Counters);
+
+  Health_CountersChanged = false;
+  Health_NextSave = Timebase_Deadline (TIMEBASE_MS(HEALTH_SAVE_INTERVAL_MS));
+}
+
+/** Handler for the vendor CMD_READ_HEALTH command, returning the number of health counters followed by each
+ *  counter in the order of \ref Health_Counters_t, big endian. Counts not yet saved to EEPROM are included.
+ */
+void
+Health_ReadCommand (void)
+{
+  V2Protocol_BeginResponse ();
+  V2Protocol_Write_8 (CMD_READ_HEALTH);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_Write_8 (HEALTH_COUNTERS);
+
+  for (uint8_t Counter = 0; Counter < HEALTH_COUNTERS; Counter++)
+    V2Protocol_Write_32_BE (Health_Counters[Counter]);
+
+  V2Protocol_EndResponse ();
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for Health.c.
+ */
+
+#ifndef _HEALTH_
+#define _HEALTH_
+
+/* Includes: */
+#include <avr/io.h>
+#include <stdbool.h>
+
+#include <LUFA/Common/Common.h>
+
+#include "Timebase.h"
+#include "V2ProtocolConstants.h"
+#include "Config/AppConfig.h"
+
+/* Macros: */
+#if !defined(HEALTH_SAVE_INTERVAL_MS) || defined(__DOXYGEN__)
+/** Shortest time between two saves of the health counters to EEPROM, in milliseconds. Can be overridden in
+ *  AppConfig.h.
+ */
+#define HEALTH_SAVE_INTERVAL_MS    (5UL * 60 * 1000)
+#endif
+
+/* Enums: */
+/** Health counters of the programmer, in the order they are returned to the host. */
+enum Health_Counters_t
+{
+  HEALTH_SESSIONS = 0, /**< Programming sessions entered successfully */
+  HEALTH_PAGES_WRITTEN = 1, /**< Memory pages committed to targets */
+  HEALTH_BYTES_READ = 2, /**< Target memory bytes read for the host, including those of memory CRCs */
+  HEALTH_TIMEOUTS = 3, /**< Commands which ran out of time, reporting a timeout status */
+  HEALTH_SYNC_FAILURES = 4, /**< ISP sessions failing to synchronize with the target */
+  HEALTH_BUSY_SECONDS = 5, /**< Time spent processing commands from the host, in seconds */
+  HEALTH_COUNTERS = 6, /**< Number of health counters */
+};
+
+/* External Variables: */
+#if defined(ENABLE_HEALTH_COUNTERS)
+extern uint32_t Health_Counters[HEALTH_COUNTERS];
+extern bool Health_CountersChanged;
+#endif
+
+/* Function Prototypes: */
+#if defined(ENABLE_HEALTH_COUNTERS)
+void
+Health_Init (void);
+void
+Health_BeginCommand (void);
+void
+Health_EndCommand (const uint8_t V2Command, const uint8_t Status);
+void
+Health_CountStatus (const uint8_t V2Command, const uint8_t Status);
+void
+Health_Task (void);
+void
+Health_ReadCommand (void);
+#endif
+
+/* Inline Functions: */
+/** Adds to a health counter. The counter is only kept in RAM, being saved later by \c Health_Task().
+ *
+ *  \param[in] Counter  Counter to add to, a \ref Health_Counters_t value
+ *  \param[in] Amount   Amount to add
+ */
+static inline void Health_Count(const uint8_t Counter, const uint32_t Amount) ATTR_ALWAYS_INLINE;
+static inline void
+Health_Count (const uint8_t Counter, const uint32_t Amount)
+{
+#if defined(ENABLE_HEALTH_COUNTERS)
+  Health_Counters[Counter] += Amount;
+  Health_CountersChanged = true;
+#endif
+}
+
+#endif
+
@@ -35,6 +35,7 @@
  *  ISP Protocol handler, to process V2 Protocol wrapped ISP commands used in Atmel programmer devices.
  */
 
+#define  INCLUDE_FROM_ISPPROTOCOL_C
 #include "ISPProtocol.h"
 
 #if defined(ENABLE_ISP_PROTOCOL) || defined(__DOXYGEN__)
@@ -45,6 +46,27 @@ static volatile uint16_t ISPProtocol_HalfCyclesRemaining;
 /** Target device response I/O pin toggles remaining for successful OSCCAL calibration */
 static volatile uint8_t ISPProtocol_ResponseTogglesRemaining;
 
+/** Completion check of the last page committed in pipelined programming mode, run before the target is next used */
+static struct
+{
+  bool Pending;
+  uint8_t ProgrammingMode;
+  uint16_t PollAddress;
+  uint8_t PollValue;
+  uint8_t DelayMS;
+  uint8_t ReadMemCommand;
+  Timebase_Time_t IssuedAt;
+} ISPProtocol_DeferredCommit;
+
+/** First failed completion status of the deferred page commits not yet reported to the host */
+static uint8_t ISPProtocol_DeferredStatus = STATUS_CMD_OK;
+
+/** Set while bytes have been loaded into the target's FLASH page buffer that have not yet been committed */
+static bool ISPProtocol_FlashPageLoaded;
+
+/** Set while bytes have been loaded into the target's EEPROM page buffer that have not yet been committed */
+static bool ISPProtocol_EEPROMPageLoaded;
+
 /** ISR to toggle MOSI pin when TIMER1 overflows */
 ISR(TIMER1_OVF_vect, ISR_BLOCK)
 {
@@ -64,343 +86,1417 @@ ISR(PCINT0_vect, ISR_BLOCK)
 void
 ISPProtocol_EnterISPMode (void)
 {
-  struct
-  {
-    uint8_t TimeoutMS;
-    uint8_t PinStabDelayMS;
-    uint8_t ExecutionDelayMS;
-    uint8_t SynchLoops;
-    uint8_t ByteDelay;
-    uint8_t PollValue;
-    uint8_t PollIndex;
-    uint8_t EnterProgBytes[4];
-  } Enter_ISP_Params;
+  ISPProtocol_EnterParams_t Enter_ISP_Params;
 
-  Endpoint_Read_Stream_LE (&Enter_ISP_Params, sizeof(Enter_ISP_Params), NULL);
+  V2Protocol_ReadParams (&Enter_ISP_Params, sizeof(Enter_ISP_Params));
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
-
-  uint8_t ResponseStatus = STATUS_CMD_FAILED;
+  V2Protocol_BeginResponse ();
 
   CurrentAddress = 0;
 
+  /* Commit failures of an earlier session were either reported when it was left, or belong to a host now gone */
+  ISPProtocol_DiscardDeferredStatus ();
+
+  /* Each session starts at the host's speed, a tuned speed only being applied once the target is identified */
+  V2Params_SetParameterValue (PARAM_ISP_SCK_TUNED, ISP_SCK_NOT_TUNED);
+  ISPTarget_ResetCompletionTiming ();
+
   /* Perform execution delay, initialize SPI bus */
   ISPProtocol_DelayMS (Enter_ISP_Params.ExecutionDelayMS);
+  TargetInProgMode = true;
   ISPTarget_EnableTargetISP ();
 
   ISPTarget_ChangeTargetResetLine (true);
   ISPProtocol_DelayMS (Enter_ISP_Params.PinStabDelayMS);
 
+  uint8_t ResponseStatus = ISPProtocol_SynchroniseTarget (
+      &Enter_ISP_Params, Enter_ISP_Params.SynchLoops);
+
+  if (ResponseStatus != STATUS_CMD_OK)
+    Health_Count (HEALTH_SYNC_FAILURES, 1);
+
+  /* Auto-tuning works on the AVRStudio SCK duration scale, and is skipped if the host gave an explicit period */
+  if ((ResponseStatus == STATUS_CMD_OK)
+      && V2Params_GetParameterValue (PARAM_ISP_SCK_AUTOTUNE)
+      && !(V2Params_GetParameterValue (PARAM_ISP_SCK_PERIOD_LOW))
+      && !(V2Params_GetParameterValue (PARAM_ISP_SCK_PERIOD_HIGH)))
+    {
+      ResponseStatus = ISPProtocol_TuneSCK (&Enter_ISP_Params);
+    }
+
+  if (ResponseStatus == STATUS_CMD_OK)
+    Health_Count (HEALTH_SESSIONS, 1);
+
+  V2Protocol_Write_8 (CMD_ENTER_PROGMODE_ISP);
+  V2Protocol_Write_8 (ResponseStatus);
+  V2Protocol_EndResponse ();
+}
+
+/** Attempts to synchronize with the target by sending the Programming Enable instruction, pulsing the target's
+ *  reset line between attempts, until the target sends back the expected response or the attempts run out. Also
+ *  used by standalone runs, which pass the parameters avrdude would.
+ *
+ *  \param[in] Params    Parameters of the CMD_ENTER_PROGMODE_ISP command
+ *  \param[in] Attempts  Maximum number of attempts to make
+ *
+ *  \return V2 Protocol status \ref STATUS_CMD_OK if the target responded, \ref STATUS_CMD_FAILED otherwise
+ */
+uint8_t
+ISPProtocol_SynchroniseTarget (const ISPProtocol_EnterParams_t* const Params,
+                               uint8_t Attempts)
+{
   /* Continuously attempt to synchronize with the target until either the number of attempts specified
    * by the host has exceeded, or the the device sends back the expected response values */
-  while (Enter_ISP_Params.SynchLoops-- && TimeoutTicksRemaining)
+  while (Attempts-- && TimeoutTicksRemaining)
     {
       uint8_t ResponseBytes[4];
 
       for (uint8_t RByte = 0; RByte < sizeof(ResponseBytes); RByte++)
         {
-          ISPProtocol_DelayMS (Enter_ISP_Params.ByteDelay);
+          ISPProtocol_DelayMS (Params->ByteDelay);
           ResponseBytes[RByte] = ISPTarget_TransferByte (
-              Enter_ISP_Params.EnterProgBytes[RByte]);
+              Params->EnterProgBytes[RByte]);
         }
 
       /* Check if polling disabled, or if the polled value matches the expected value */
-      if (!(Enter_ISP_Params.PollIndex)
-          || (ResponseBytes[Enter_ISP_Params.PollIndex - 1]
-              == Enter_ISP_Params.PollValue))
+      if (!(Params->PollIndex)
+          || (ResponseBytes[Params->PollIndex - 1] == Params->PollValue))
         {
-          ResponseStatus = STATUS_CMD_OK;
-          break;
+          return STATUS_CMD_OK;
         }
       else
         {
           ISPTarget_ChangeTargetResetLine (false);
-          ISPProtocol_DelayMS (Enter_ISP_Params.PinStabDelayMS);
+          ISPProtocol_DelayMS (Params->PinStabDelayMS);
           ISPTarget_ChangeTargetResetLine (true);
-          ISPProtocol_DelayMS (Enter_ISP_Params.PinStabDelayMS);
+          ISPProtocol_DelayMS (Params->PinStabDelayMS);
+        }
+    }
+
+  return STATUS_CMD_FAILED;
+}
+
+/** Finds the fastest SCK speed the synchronized target can be programmed at, and switches to it. Starting from the
+ *  host's speed, or the speed cached in EEPROM for the target's signature if faster, each faster step of the
+ *  AVRStudio SCK duration scale is checked by repeatedly reading back the signature and the start of FLASH. The
+ *  speed settles one step below the first that fails, where the target is synchronized again, and is cached.
+ *
+ *  \param[in] Params  Parameters of the CMD_ENTER_PROGMODE_ISP command
+ *
+ *  \return V2 Protocol status \ref STATUS_CMD_OK if the target is synchronized, \ref STATUS_CMD_FAILED otherwise
+ */
+static uint8_t
+ISPProtocol_TuneSCK (const ISPProtocol_EnterParams_t* const Params)
+{
+  uint8_t Reference[3 + ISP_SCK_TUNE_FLASH_BYTES];
+  uint8_t WorkingDuration = V2Params_GetParameterValue (PARAM_SCK_DURATION);
+
+  /* Reads at the host's speed are trusted, and are what the faster speeds are checked against */
+  ISPProtocol_ReadTuneReference (Reference);
+
+  uint8_t CachedDuration = ISPProtocol_FindCachedSCK (Reference);
+  bool SpeedFailed = false;
+
+  /* A cached speed is known to be the fastest that worked, so it is only checked once rather than stepped past */
+  if (CachedDuration < WorkingDuration)
+    {
+      if (ISPProtocol_VerifySCK (CachedDuration, Reference))
+        WorkingDuration = CachedDuration;
+      else
+        SpeedFailed = true;
+    }
+  else if (CachedDuration != WorkingDuration)
+    {
+      while (!(SpeedFailed) && WorkingDuration)
+        {
+          if (ISPProtocol_VerifySCK (WorkingDuration - 1, Reference))
+            WorkingDuration--;
+          else
+            SpeedFailed = true;
+        }
+    }
+
+  V2Params_SetParameterValue (PARAM_ISP_SCK_TUNED, WorkingDuration);
+  ISPTarget_EnableTargetISP ();
+
+  /* A failed speed may have left the target out of step with the instruction framing, so it is reset and
+   * synchronized again at the last speed that worked */
+  if (SpeedFailed)
+    {
+      TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+      ISPTarget_ChangeTargetResetLine (false);
+      ISPProtocol_DelayMS (Params->PinStabDelayMS);
+      ISPTarget_ChangeTargetResetLine (true);
+      ISPProtocol_DelayMS (Params->PinStabDelayMS);
+
+      if (ISPProtocol_SynchroniseTarget (Params, ISP_SCK_TUNE_RESYNC_ATTEMPTS)
+          != STATUS_CMD_OK)
+        return STATUS_CMD_FAILED;
+    }
+
+  ISPProtocol_CacheSCK (Reference, WorkingDuration);
+  return STATUS_CMD_OK;
+}
+
+/** Reads the target's signature followed by the first bytes of its FLASH memory, for checking SCK speeds against.
+ *
+ *  \param[out] Reference  Buffer of 3 + \ref ISP_SCK_TUNE_FLASH_BYTES bytes for the data read
+ */
+static void
+ISPProtocol_ReadTuneReference (uint8_t* Reference)
+{
+  for (uint8_t SignatureByte = 0; SignatureByte < 3; SignatureByte++)
+    {
+      ISPTarget_SendByte (0x30);
+      ISPTarget_SendByte (0x00);
+      ISPTarget_SendByte (SignatureByte);
+      *(Reference++) = ISPTarget_ReceiveByte ();
+    }
+
+  for (uint8_t FlashByte = 0; FlashByte < ISP_SCK_TUNE_FLASH_BYTES; FlashByte++)
+    {
+      ISPTarget_SendByte ((FlashByte & 0x01) ? 0x28 : 0x20);
+      ISPTarget_SendByte (0x00);
+      ISPTarget_SendByte (FlashByte >> 1);
+      *(Reference++) = ISPTarget_ReceiveByte ();
+    }
+}
+
+/** Switches to the given SCK speed, and checks that the target can be read reliably at it.
+ *
+ *  \param[in] SCKDuration  AVRStudio SCK duration value of the speed to check
+ *  \param[in] Reference    Data read by \ref ISPProtocol_ReadTuneReference() at a working speed
+ *
+ *  \return Boolean \c true if every read matched the reference data
+ */
+static bool
+ISPProtocol_VerifySCK (const uint8_t SCKDuration, const uint8_t* Reference)
+{
+  uint8_t ReadBack[3 + ISP_SCK_TUNE_FLASH_BYTES];
+
+  V2Params_SetParameterValue (PARAM_ISP_SCK_TUNED, SCKDuration);
+  ISPTarget_EnableTargetISP ();
+
+  for (uint8_t Pass = 0; Pass < ISP_SCK_TUNE_VERIFY_PASSES; Pass++)
+    {
+      TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+      ISPProtocol_ReadTuneReference (ReadBack);
+
+      if (memcmp (ReadBack, Reference, sizeof(ReadBack)))
+        return false;
+    }
+
+  return true;
+}
+
+/** Cache of the SCK speeds tuned for the most recently seen target signatures, replaced round robin. */
+static ISPProtocol_SCKCacheEntry_t EEMEM ISPProtocol_SCKCache[ISP_SCK_CACHE_ENTRIES];
+
+/** Index of the cache entry to be replaced next. */
+static uint8_t EEMEM ISPProtocol_SCKCacheNext;
+
+/** Looks up the SCK speed cached for a target signature.
+ *
+ *  \param[in] Signature  Signature of the target
+ *
+ *  \return Cached AVRStudio SCK duration value, or \ref ISP_SCK_NOT_TUNED if the signature is not cached
+ */
+static uint8_t
+ISPProtocol_FindCachedSCK (const uint8_t* Signature)
+{
+  for (uint8_t Entry = 0; Entry < ISP_SCK_CACHE_ENTRIES; Entry++)
+    {
+      ISPProtocol_SCKCacheEntry_t CacheEntry;
+
+      eeprom_read_block (&CacheEntry, &ISPProtocol_SCKCache[Entry],
+                         sizeof(CacheEntry));
+
+      if (!(memcmp (CacheEntry.Signature, Signature,
+                    sizeof(CacheEntry.Signature))))
+        return CacheEntry.SCKDuration;
+    }
+
+  return ISP_SCK_NOT_TUNED;
+}
+
+/** Caches the SCK speed tuned for a target signature, replacing the oldest entry if the signature is not yet cached.
+ *  EEPROM cells are only written if their content changes.
+ *
+ *  \param[in] Signature    Signature of the target
+ *  \param[in] SCKDuration  Tuned AVRStudio SCK duration value
+ */
+static void
+ISPProtocol_CacheSCK (const uint8_t* Signature, const uint8_t SCKDuration)
+{
+  uint8_t Entry;
+
+  for (Entry = 0; Entry < ISP_SCK_CACHE_ENTRIES; Entry++)
+    {
+      uint8_t CachedSignature[3];
+
+      eeprom_read_block (CachedSignature, ISPProtocol_SCKCache[Entry].Signature,
+                         sizeof(CachedSignature));
+
+      if (!(memcmp (CachedSignature, Signature, sizeof(CachedSignature))))
+        break;
+    }
+
+  if (Entry == ISP_SCK_CACHE_ENTRIES)
+    {
+      Entry = (eeprom_read_byte (&ISPProtocol_SCKCacheNext) % ISP_SCK_CACHE_ENTRIES);
+      eeprom_update_byte (&ISPProtocol_SCKCacheNext, (Entry + 1) % ISP_SCK_CACHE_ENTRIES);
+    }
+
+  ISPProtocol_SCKCacheEntry_t CacheEntry;
+
+  memcpy (CacheEntry.Signature, Signature, sizeof(CacheEntry.Signature));
+  CacheEntry.SCKDuration = SCKDuration;
+
+  eeprom_update_block (&CacheEntry, &ISPProtocol_SCKCache[Entry],
+                       sizeof(CacheEntry));
+}
+
+/** Handler for the CMD_LEAVE_ISP command, which releases the target from programming mode. */
+void
+ISPProtocol_LeaveISPMode (void)
+{
+  struct
+  {
+    uint8_t PreDelayMS;
+    uint8_t PostDelayMS;
+  } Leave_ISP_Params;
+
+  V2Protocol_ReadParams (&Leave_ISP_Params, sizeof(Leave_ISP_Params));
+
+  V2Protocol_BeginResponse ();
+
+  /* A session may end without a flush, so the last pipelined page must complete and any failure be reported here */
+  uint8_t ResponseStatus = ISPProtocol_TakeDeferredStatus ();
+
+  /* Perform pre-exit delay, release the target /RESET, disable the SPI bus and perform the post-exit delay */
+  ISPProtocol_DelayMS (Leave_ISP_Params.PreDelayMS);
+  ISPTarget_ChangeTargetResetLine (false);
+  ISPTarget_DisableTargetISP ();
+  TargetInProgMode = false;
+  ISPProtocol_DelayMS (Leave_ISP_Params.PostDelayMS);
+
+  V2Protocol_Write_8 (CMD_LEAVE_PROGMODE_ISP);
+  V2Protocol_Write_8 (ResponseStatus);
+  V2Protocol_EndResponse ();
+}
+
+/** Handler for the CMD_PROGRAM_FLASH_ISP and CMD_PROGRAM_EEPROM_ISP commands, writing out bytes,
+ *  words or pages of data to the attached device.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
+void
+ISPProtocol_ProgramMemory (uint8_t V2Command)
+{
+  struct
+  {
+    uint16_t BytesToWrite;
+    uint8_t ProgrammingMode;
+    uint8_t DelayMS;
+    uint8_t ProgrammingCommands[3];
+    uint8_t PollValue1;
+    uint8_t PollValue2;
+  } Write_Memory_Params;
+
+  Endpoint_Read_Stream_LE (&Write_Memory_Params, sizeof(Write_Memory_Params),
+                           NULL);
+  Write_Memory_Params.BytesToWrite = SwapEndian_16 (
+      Write_Memory_Params.BytesToWrite);
+  Trace_SetRange (CurrentAddress, Write_Memory_Params.BytesToWrite);
+
+  // Note, the Jungo driver has a very short ACK timeout period, need to buffer the whole page and ACK the packet as
+  // fast as possible to prevent it from aborting
+  uint8_t* ProgData = BufferArena_Alloc (Write_Memory_Params.BytesToWrite);
+
+  if (!(ProgData))
+    {
+      Endpoint_ClearOUT ();
+      Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+      Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+      V2Protocol_Write_8 (V2Command);
+      V2Protocol_Write_8 (STATUS_CMD_FAILED);
+      Endpoint_ClearIN ();
+      return;
+    }
+
+  Endpoint_Read_Stream_LE (ProgData, Write_Memory_Params.BytesToWrite, NULL);
+
+  // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+  // to catch this and discard it before continuing on with packet processing to prevent communication issues
+  if ((sizeof(uint8_t) + sizeof(Write_Memory_Params)
+      + Write_Memory_Params.BytesToWrite) % AVRISP_DATA_EPSIZE == 0)
+    {
+      Endpoint_ClearOUT ();
+      Endpoint_WaitUntilReady ();
+    }
+
+  Endpoint_ClearOUT ();
+  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+  /* The previous page may still be committing if pipelined, finish it before loading the next one */
+  uint8_t PreviousPageStatus = ISPProtocol_TakeDeferredStatus ();
+
+  /* Erased FLASH blocks need not be sent to the target at all if blank elision is enabled - ISP programming can
+   * only clear FLASH bits, so loading and committing erased words would leave the target's memory unchanged */
+  if ((V2Command == CMD_PROGRAM_FLASH_ISP) && !(ISPProtocol_FlashPageLoaded)
+      && V2Params_GetParameterValue (PARAM_PROG_SKIP_BLANK)
+      && ISPProtocol_IsErasedBlock (ProgData,
+                                    Write_Memory_Params.BytesToWrite))
+    {
+      uint32_t NextAddress = CurrentAddress
+          + (Write_Memory_Params.BytesToWrite >> 1);
+
+      /* Check to see if the FLASH address has crossed the extended address boundary */
+      if ((NextAddress & 0xFFFF0000) != (CurrentAddress & 0xFFFF0000))
+        MustLoadExtendedAddress = true;
+
+      CurrentAddress = NextAddress;
+
+      V2Protocol_Write_8 (V2Command);
+      V2Protocol_Write_8 (PreviousPageStatus);
+      Endpoint_ClearIN ();
+      return;
+    }
+
+  uint8_t ProgrammingStatus = STATUS_CMD_OK;
+  uint8_t PollValue =
+      (V2Command == CMD_PROGRAM_FLASH_ISP) ?
+          Write_Memory_Params.PollValue1 : Write_Memory_Params.PollValue2;
+  uint16_t PollAddress = 0;
+  uint8_t* NextWriteByte = ProgData;
+  uint16_t PageStartAddress = (CurrentAddress & 0xFFFF);
+  bool SkipUnchanged = ((V2Command == CMD_PROGRAM_EEPROM_ISP)
+      && V2Params_GetParameterValue (PARAM_PROG_SKIP_UNCHANGED));
+  uint16_t UnchangedBytes = 0;
+
+  /* Page loads without unchanged byte elision need no decision per byte, and are passed to a loop specialised for
+   * the memory type and SPI speed, after the poll address has been found from the page data up front */
+  if ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK)
+      && !(SkipUnchanged))
+    {
+      bool IsFlash = (V2Command == CMD_PROGRAM_FLASH_ISP);
+
+      PollAddress = ISPProtocol_FindPollAddress (
+          IsFlash, ProgData,
+          Write_Memory_Params.BytesToWrite, PageStartAddress, PollValue,
+          &Write_Memory_Params.ProgrammingCommands[2]);
+      ISPProtocol_LoadPage (IsFlash, Write_Memory_Params.ProgrammingCommands[0],
+                            ProgData,
+                            Write_Memory_Params.BytesToWrite);
+    }
+  else
+    {
+      for (uint16_t CurrentByte = 0;
+          CurrentByte < Write_Memory_Params.BytesToWrite; CurrentByte++)
+        {
+          uint8_t ByteToWrite = *(NextWriteByte++);
+          uint8_t ProgrammingMode = Write_Memory_Params.ProgrammingMode;
+
+          /* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
+          if (MustLoadExtendedAddress)
+            {
+              ISPTarget_LoadExtendedAddress ();
+              MustLoadExtendedAddress = false;
+            }
+
+          /* EEPROM bytes already holding the new value need not be written - in page mode only loaded bytes of the
+           * page are altered by the target, so unchanged bytes are simply left out of the page buffer */
+          if (SkipUnchanged)
+            {
+              ISPTarget_SendByte (Write_Memory_Params.ProgrammingCommands[2]);
+              ISPTarget_SendByte (CurrentAddress >> 8);
+              ISPTarget_SendByte (CurrentAddress & 0xFF);
+
+              if (ISPTarget_ReceiveByte () == ByteToWrite)
+                {
+                  UnchangedBytes++;
+                  CurrentAddress++;
+                  continue;
+                }
+            }
+
+          ISPTarget_SendByte (Write_Memory_Params.ProgrammingCommands[0]);
+          ISPTarget_SendByte (CurrentAddress >> 8);
+          ISPTarget_SendByte (CurrentAddress & 0xFF);
+          ISPTarget_SendByte (ByteToWrite);
+
+          /* AVR FLASH addressing requires us to modify the write command based on if we are writing a high
+           * or low byte at the current word address */
+          if (V2Command == CMD_PROGRAM_FLASH_ISP)
+            Write_Memory_Params.ProgrammingCommands[0] ^= READ_WRITE_HIGH_BYTE_MASK;
+
+          /* Check to see if we have a valid polling address */
+          if (!(PollAddress) && (ByteToWrite != PollValue))
+            {
+              if ((CurrentByte & 0x01) && (V2Command == CMD_PROGRAM_FLASH_ISP))
+                Write_Memory_Params.ProgrammingCommands[2] |=
+                    READ_WRITE_HIGH_BYTE_MASK;
+              else
+                Write_Memory_Params.ProgrammingCommands[2] &=
+                    ~READ_WRITE_HIGH_BYTE_MASK;
+
+              PollAddress = (CurrentAddress & 0xFFFF);
+            }
+
+          /* If in word programming mode, commit the byte to the target's memory */
+          if (!(ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK))
+            {
+              /* If the current polling address is invalid, switch to timed delay write completion mode */
+              if (!(PollAddress)
+                  && !(ProgrammingMode & PROG_MODE_WORD_READYBUSY_MASK))
+                ProgrammingMode = (ProgrammingMode & ~PROG_MODE_WORD_VALUE_MASK)
+                    | PROG_MODE_WORD_TIMEDELAY_MASK;
+
+              ProgrammingStatus = ISPTarget_WaitForProgComplete (
+                  ProgrammingMode, PollAddress, PollValue,
+                  Write_Memory_Params.DelayMS,
+                  Write_Memory_Params.ProgrammingCommands[2], Timebase_Now ());
+
+              /* Abort the programming loop early if the byte/word programming failed */
+              if (ProgrammingStatus != STATUS_CMD_OK)
+                break;
+
+              /* Must reset the polling address afterwards, so it is not erroneously used for the next byte */
+              PollAddress = 0;
+            }
+
+          /* EEPROM just increments the address each byte, flash needs to increment on each word and
+           * also check to ensure that a LOAD EXTENDED ADDRESS command is issued each time the extended
+           * address boundary has been crossed during FLASH memory programming */
+          if ((CurrentByte & 0x01) || (V2Command == CMD_PROGRAM_EEPROM_ISP))
+            {
+              CurrentAddress++;
+
+              if ((V2Command == CMD_PROGRAM_FLASH_ISP)
+                  && !(CurrentAddress & 0xFFFF))
+                MustLoadExtendedAddress = true;
+            }
+        }
+    }
+
+  /* Track whether the FLASH page buffer holds loaded bytes, as an erased block may then only be elided once the
+   * page has been committed */
+  if (V2Command == CMD_PROGRAM_FLASH_ISP)
+    {
+      ISPProtocol_FlashPageLoaded = ((Write_Memory_Params.ProgrammingMode
+          & (PROG_MODE_PAGED_WRITES_MASK | PROG_MODE_COMMIT_PAGE_MASK))
+          == PROG_MODE_PAGED_WRITES_MASK);
+    }
+
+  /* Track whether the EEPROM page buffer holds loaded bytes, so that a page with no changed bytes is not committed */
+  if (V2Command == CMD_PROGRAM_EEPROM_ISP)
+    {
+      bool PageLoaded = (ISPProtocol_EEPROMPageLoaded
+          || (UnchangedBytes != Write_Memory_Params.BytesToWrite));
+
+      ISPProtocol_EEPROMPageLoaded = (PageLoaded
+          && !(Write_Memory_Params.ProgrammingMode & PROG_MODE_COMMIT_PAGE_MASK));
+
+      if (!(PageLoaded))
+        Write_Memory_Params.ProgrammingMode &= ~PROG_MODE_COMMIT_PAGE_MASK;
+
+      ISPProtocol_CountUnchangedBytes (UnchangedBytes);
+    }
+
+  /* If the current page must be committed, send the PROGRAM PAGE command to the target */
+  if (Write_Memory_Params.ProgrammingMode & PROG_MODE_COMMIT_PAGE_MASK)
+    {
+      Health_Count (HEALTH_PAGES_WRITTEN, 1);
+
+      ISPTarget_SendByte (Write_Memory_Params.ProgrammingCommands[1]);
+      ISPTarget_SendByte (PageStartAddress >> 8);
+      ISPTarget_SendByte (PageStartAddress & 0xFF);
+      ISPTarget_SendByte (0x00);
+
+      Timebase_Time_t CommitIssuedAt = Timebase_Now ();
+
+      /* Check if polling is enabled and possible, if not switch to timed delay mode */
+      if ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_VALUE_MASK)
+          && !(PollAddress))
+        {
+          Write_Memory_Params.ProgrammingMode =
+              (Write_Memory_Params.ProgrammingMode & ~PROG_MODE_PAGED_VALUE_MASK)
+                  |
+                  PROG_MODE_PAGED_TIMEDELAY_MASK;
+        }
+
+      /* In pipelined mode the host is acknowledged straight away and the page completion check is deferred
+       * until the target is next needed, so the next page is transferred over USB while this one is written */
+      if (V2Params_GetParameterValue (PARAM_PROG_PIPELINE))
+        {
+          ISPProtocol_DeferredCommit.ProgrammingMode =
+              Write_Memory_Params.ProgrammingMode;
+          ISPProtocol_DeferredCommit.PollAddress = PollAddress;
+          ISPProtocol_DeferredCommit.PollValue = PollValue;
+          ISPProtocol_DeferredCommit.DelayMS = Write_Memory_Params.DelayMS;
+          ISPProtocol_DeferredCommit.ReadMemCommand =
+              Write_Memory_Params.ProgrammingCommands[2];
+          ISPProtocol_DeferredCommit.IssuedAt = CommitIssuedAt;
+          ISPProtocol_DeferredCommit.Pending = true;
+        }
+      else
+        {
+          ProgrammingStatus = ISPTarget_WaitForProgComplete (
+              Write_Memory_Params.ProgrammingMode, PollAddress, PollValue,
+              Write_Memory_Params.DelayMS,
+              Write_Memory_Params.ProgrammingCommands[2], CommitIssuedAt);
+        }
+
+      /* Check to see if the FLASH address has crossed the extended address boundary */
+      if ((V2Command == CMD_PROGRAM_FLASH_ISP) && !(CurrentAddress & 0xFFFF))
+        MustLoadExtendedAddress = true;
+    }
+
+  /* A failure of the previously committed page takes precedence, as it was not yet reported to the host */
+  if (PreviousPageStatus != STATUS_CMD_OK)
+    ProgrammingStatus = PreviousPageStatus;
+
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (ProgrammingStatus);
+  Endpoint_ClearIN ();
+}
+
+/** Determines if a block of data to program consists only of the erased FLASH value.
+ *
+ *  \param[in] Data    Block of data to check
+ *  \param[in] Length  Length of the block in bytes
+ *
+ *  \return Boolean \c true if every byte of the block is erased
+ */
+static bool
+ISPProtocol_IsErasedBlock (const uint8_t* Data, uint16_t Length)
+{
+  while (Length--)
+    {
+      if (*(Data++) != 0xFF)
+        return false;
+    }
+
+  return true;
+}
+
+/** Finds the address of a page for polling its completion: the first byte that will read back differently from
+ *  the poll value once written, not at address zero so that the address can double as a validity flag.
+ *
+ *  \param[in]     IsFlash            Boolean \c true if the page is in FLASH memory, \c false for EEPROM memory
+ *  \param[in]     Data               Page data to be written
+ *  \param[in]     Length             Length of the page data in bytes
+ *  \param[in]     StartAddress       Low 16 bits of the target address of the first byte of the page
+ *  \param[in]     PollValue          Value read back from a byte of the page while it is being written
+ *  \param[in,out] ReadMemoryCommand  Target read command, adjusted to read the high byte for an odd FLASH byte
+ *
+ *  \return Address to poll, or zero if the page has no byte to poll
+ */
+static uint16_t
+ISPProtocol_FindPollAddress (const bool IsFlash, const uint8_t* Data,
+                             const uint16_t Length, const uint16_t StartAddress,
+                             const uint8_t PollValue,
+                             uint8_t* const ReadMemoryCommand)
+{
+  for (uint16_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+    {
+      if (Data[CurrentByte] == PollValue)
+        continue;
+
+      if ((CurrentByte & 0x01) && IsFlash)
+        *ReadMemoryCommand |= READ_WRITE_HIGH_BYTE_MASK;
+      else
+        *ReadMemoryCommand &= ~READ_WRITE_HIGH_BYTE_MASK;
+
+      uint16_t PollAddress = StartAddress
+          + (IsFlash ? (CurrentByte >> 1) : CurrentByte);
+
+      if (PollAddress)
+        return PollAddress;
+    }
+
+  return 0;
+}
+
+/** Loads a block of data into the target's FLASH or EEPROM page buffer, starting at the current address, and leaves
+ *  the current address after the last byte loaded. As with the memory reads, the SPI access is chosen once for the
+ *  whole block, FLASH pages having a loop of their own for each hardware SPI speed class.
+ *
+ *  \param[in] IsFlash      Boolean \c true to load the FLASH page buffer, \c false for the EEPROM page buffer
+ *  \param[in] LoadCommand  Target load command of the first byte
+ *  \param[in] Data         Data to load
+ *  \param[in] Length       Length of the data in bytes
+ */
+static void
+ISPProtocol_LoadPage (const bool IsFlash, const uint8_t LoadCommand,
+                      const uint8_t* Data, const uint16_t Length)
+{
+  if (IsFlash && ISPTarget_IsTimedSPIMode ())
+    ISPProtocol_LoadFlashPageTimedSPI (LoadCommand, Data, Length);
+  else if (IsFlash && (ISPTarget_SPIMode == ISP_SPI_MODE_HARDWARE))
+    ISPProtocol_LoadFlashPageHardwareSPI (LoadCommand, Data, Length);
+  else
+    ISPProtocol_LoadPageAnySPI (IsFlash, LoadCommand, Data, Length);
+}
+
+/** Loads FLASH page data over the hardware SPI bus running at F_CPU / 2, see \ref ISPProtocol_LoadPage().
+ *
+ *  \param[in] LoadCommand  Target load command of the first byte
+ *  \param[in] Data         Data to load
+ *  \param[in] Length       Length of the data in bytes
+ */
+static void
+ISPProtocol_LoadFlashPageTimedSPI (uint8_t LoadCommand, const uint8_t* Data,
+                                   const uint16_t Length)
+{
+  ISPProtocol_LoadPageKernel (ISP_KERNEL_TIMED_SPI, true, LoadCommand, Data,
+                              Length);
+}
+
+/** Loads FLASH page data over the hardware SPI bus running below F_CPU / 2, see \ref ISPProtocol_LoadPage().
+ *
+ *  \param[in] LoadCommand  Target load command of the first byte
+ *  \param[in] Data         Data to load
+ *  \param[in] Length       Length of the data in bytes
+ */
+static void
+ISPProtocol_LoadFlashPageHardwareSPI (uint8_t LoadCommand, const uint8_t* Data,
+                                      const uint16_t Length)
+{
+  ISPProtocol_LoadPageKernel (ISP_KERNEL_HARDWARE_SPI, true, LoadCommand, Data,
+                              Length);
+}
+
+/** Loads FLASH or EEPROM page data over whichever SPI driver is selected, see \ref ISPProtocol_LoadPage().
+ *
+ *  \param[in] IsFlash      Boolean \c true to load the FLASH page buffer, \c false for the EEPROM page buffer
+ *  \param[in] LoadCommand  Target load command of the first byte
+ *  \param[in] Data         Data to load
+ *  \param[in] Length       Length of the data in bytes
+ */
+static void
+ISPProtocol_LoadPageAnySPI (const bool IsFlash, uint8_t LoadCommand,
+                            const uint8_t* Data, const uint16_t Length)
+{
+  ISPProtocol_LoadPageKernel (ISP_KERNEL_ANY_SPI, IsFlash, LoadCommand, Data,
+                              Length);
+}
+
+/** Body of the page load loops, inlined into each of them with the SPI access and memory type fixed. The current
+ *  address is kept in a local copy while loading, and written back before an extended address is loaded and once
+ *  the loop ends.
+ *
+ *  \param[in] Kernel       SPI access of the loop, a value from the \ref ISPProtocol_SPIKernels_t enum
+ *  \param[in] IsFlash      Boolean \c true to load the FLASH page buffer, \c false for the EEPROM page buffer
+ *  \param[in] LoadCommand  Target load command of the first byte
+ *  \param[in] Data         Data to load
+ *  \param[in] Length       Length of the data in bytes
+ */
+static inline void
+ISPProtocol_LoadPageKernel (const uint8_t Kernel, const bool IsFlash,
+                            uint8_t LoadCommand, const uint8_t* Data,
+                            const uint16_t Length)
+{
+  uint32_t Address = CurrentAddress;
+
+  for (uint16_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+    {
+      /* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
+      if (MustLoadExtendedAddress)
+        {
+          CurrentAddress = Address;
+          ISPTarget_LoadExtendedAddress ();
+          MustLoadExtendedAddress = false;
+        }
+
+      ISPProtocol_KernelSendByte (Kernel, LoadCommand);
+      ISPProtocol_KernelSendByte (Kernel, Address >> 8);
+      ISPProtocol_KernelSendByte (Kernel, Address & 0xFF);
+      ISPProtocol_KernelSendByte (Kernel, Data[CurrentByte]);
+
+      /* FLASH loads alternate between the low and high byte of each word, moving to the next word after the high
+       * byte and loading a new extended address each time its boundary is crossed */
+      if (IsFlash)
+        {
+          LoadCommand ^= READ_WRITE_HIGH_BYTE_MASK;
+
+          if ((CurrentByte & 0x01) && !(++Address & 0xFFFF))
+            MustLoadExtendedAddress = true;
+        }
+      else
+        {
+          Address++;
         }
     }
 
-  Endpoint_Write_8 (CMD_ENTER_PROGMODE_ISP);
-  Endpoint_Write_8 (ResponseStatus);
+  CurrentAddress = Address;
+}
+
+/** Adds EEPROM bytes left unwritten because the target already held their value to the count reported to the host
+ *  through the PARAM_PROG_UNCHANGED_LOW and PARAM_PROG_UNCHANGED_HIGH parameters. The count saturates at 0xFFFF.
+ *
+ *  \param[in] UnchangedBytes  Number of unwritten bytes to add
+ */
+static void
+ISPProtocol_CountUnchangedBytes (const uint16_t UnchangedBytes)
+{
+  uint16_t Count = ((uint16_t) V2Params_GetParameterValue (PARAM_PROG_UNCHANGED_HIGH) << 8)
+      | V2Params_GetParameterValue (PARAM_PROG_UNCHANGED_LOW);
+
+  Count = (UnchangedBytes > (0xFFFF - Count)) ? 0xFFFF : (Count + UnchangedBytes);
+
+  V2Params_SetParameterValue (PARAM_PROG_UNCHANGED_HIGH, Count >> 8);
+  V2Params_SetParameterValue (PARAM_PROG_UNCHANGED_LOW, Count & 0xFF);
+}
+
+/** Handler for the vendor CMD_PROG_FLASH_STREAM_ISP and CMD_PROG_EEPROM_STREAM_ISP commands, programming a memory
+ *  region of any size in paged mode from one bulk OUT transfer. The region is given by a 32-bit byte address and
+ *  length as for the streaming read commands, followed by the target page size and the mode, delay, target commands
+ *  and poll value of CMD_PROGRAM_FLASH_ISP, and then the region data. The data is received a page at a time into the
+ *  buffer arena, each page being loaded and committed before the next is received, so that only one page is ever
+ *  buffered; the completion
+ *  of each page is waited for once the next one has arrived from the host. A single status is returned at the end.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
+void
+ISPProtocol_ProgramMemoryStream (const uint8_t V2Command)
+{
+  struct
+  {
+    uint32_t StartAddress;
+    uint32_t BytesToWrite;
+    uint16_t PageSize;
+    uint8_t ProgrammingMode;
+    uint8_t DelayMS;
+    uint8_t ProgrammingCommands[3];
+    uint8_t PollValue;
+  } Write_Stream_Params;
+
+  /* Pages are received into all of the arena left, which bounds the page size */
+  uint16_t PageBufferSize = BufferArena_Available ();
+  uint8_t* PageData = BufferArena_Alloc (PageBufferSize);
+
+  Endpoint_Read_Stream_LE (&Write_Stream_Params, sizeof(Write_Stream_Params),
+                           NULL);
+  Write_Stream_Params.StartAddress = SwapEndian_32 (
+      Write_Stream_Params.StartAddress);
+  Write_Stream_Params.BytesToWrite = SwapEndian_32 (
+      Write_Stream_Params.BytesToWrite);
+  Write_Stream_Params.PageSize = SwapEndian_16 (Write_Stream_Params.PageSize);
+  Trace_SetRange (Write_Stream_Params.StartAddress,
+                  MIN(Write_Stream_Params.BytesToWrite, UINT16_MAX));
+
+  bool IsFlash = (V2Command == CMD_PROG_FLASH_STREAM_ISP);
+  uint16_t PageSize = Write_Stream_Params.PageSize;
+  uint32_t ByteAddress = (Write_Stream_Params.StartAddress & ~(1UL << 31));
+  uint32_t BytesRemaining = Write_Stream_Params.BytesToWrite;
+
+  /* A failure of a page committed before this command takes precedence, as it was not yet reported to the host */
+  uint8_t ProgrammingStatus = ISPProtocol_TakeDeferredStatus ();
+
+  /* Pages are split on the page size boundaries of the target address, and FLASH is only ever loaded in whole words */
+  if (!(PageSize) || (PageSize > PageBufferSize) || (PageSize & (PageSize - 1))
+      || !(Write_Stream_Params.ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK)
+      || (IsFlash && ((ByteAddress | BytesRemaining) & 0x01)))
+    {
+      ProgrammingStatus = STATUS_CMD_FAILED;
+    }
+
+  ISPProtocol_SetReadAddress (IsFlash, Write_Stream_Params.StartAddress,
+                              &Write_Stream_Params.ProgrammingCommands[2]);
+
+  // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+  // to catch this and discard it before continuing on with packet processing to prevent communication issues
+  bool ExpectZLP = (((sizeof(uint8_t) + sizeof(Write_Stream_Params)
+      + Write_Stream_Params.BytesToWrite) % AVRISP_DATA_EPSIZE) == 0);
+
+  bool SkipBlank = (IsFlash && V2Params_GetParameterValue (PARAM_PROG_SKIP_BLANK));
+  uint8_t PollValue = Write_Stream_Params.PollValue;
+  bool CommitPending = false;
+  uint8_t CommitMode = 0;
+  uint16_t PollAddress = 0;
+  Timebase_Time_t CommitIssuedAt = 0;
+
+  while (BytesRemaining)
+    {
+      /* Once programming has failed the rest of the region is still received from the host, but discarded */
+      uint16_t PageLength = PageBufferSize;
+
+      if (ProgrammingStatus == STATUS_CMD_OK)
+        PageLength = PageSize - (ByteAddress & (PageSize - 1));
+
+      if (PageLength > BytesRemaining)
+        PageLength = BytesRemaining;
+
+      Endpoint_Read_Stream_LE (PageData, PageLength, NULL);
+
+      ByteAddress += PageLength;
+      BytesRemaining -= PageLength;
+
+      /* Regions may take much longer than a single command timeout - restart it on each page */
+      TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+      /* The previous page was written by the target while this one was received, check that it has completed */
+      if (CommitPending)
+        {
+          CommitPending = false;
+          ProgrammingStatus = ISPTarget_WaitForProgComplete (
+              CommitMode, PollAddress, PollValue, Write_Stream_Params.DelayMS,
+              Write_Stream_Params.ProgrammingCommands[2], CommitIssuedAt);
+        }
+
+      if (ProgrammingStatus != STATUS_CMD_OK)
+        continue;
+
+      /* Erased FLASH pages leave the target's memory unchanged, and need not be loaded or committed */
+      if (SkipBlank && ISPProtocol_IsErasedBlock (PageData, PageLength))
+        {
+          uint32_t NextAddress = CurrentAddress + (PageLength >> 1);
+
+          if ((NextAddress & 0xFFFF0000) != (CurrentAddress & 0xFFFF0000))
+            MustLoadExtendedAddress = true;
+
+          CurrentAddress = NextAddress;
+          continue;
+        }
+
+      uint16_t PageStartAddress = (CurrentAddress & 0xFFFF);
+
+      PollAddress = ISPProtocol_FindPollAddress (
+          IsFlash, PageData, PageLength, PageStartAddress, PollValue,
+          &Write_Stream_Params.ProgrammingCommands[2]);
+      ISPProtocol_LoadPage (IsFlash, Write_Stream_Params.ProgrammingCommands[0],
+                            PageData, PageLength);
+
+      ISPTarget_SendByte (Write_Stream_Params.ProgrammingCommands[1]);
+      ISPTarget_SendByte (PageStartAddress >> 8);
+      ISPTarget_SendByte (PageStartAddress & 0xFF);
+      ISPTarget_SendByte (0x00);
+
+      CommitIssuedAt = Timebase_Now ();
+      CommitMode = Write_Stream_Params.ProgrammingMode;
+      CommitPending = true;
+      Health_Count (HEALTH_PAGES_WRITTEN, 1);
+
+      /* Check if polling is enabled and possible, if not switch to timed delay mode */
+      if ((CommitMode & PROG_MODE_PAGED_VALUE_MASK) && !(PollAddress))
+        CommitMode = (CommitMode & ~PROG_MODE_PAGED_VALUE_MASK) | PROG_MODE_PAGED_TIMEDELAY_MASK;
+    }
+
+  if (CommitPending)
+    {
+      ProgrammingStatus = ISPTarget_WaitForProgComplete (
+          CommitMode, PollAddress, PollValue, Write_Stream_Params.DelayMS,
+          Write_Stream_Params.ProgrammingCommands[2], CommitIssuedAt);
+    }
+
+  /* Every page of the region has been committed, so the page buffer of the memory is left empty */
+  if (IsFlash)
+    ISPProtocol_FlashPageLoaded = false;
+  else
+    ISPProtocol_EEPROMPageLoaded = false;
+
+  if (ExpectZLP)
+    {
+      Endpoint_ClearOUT ();
+      Endpoint_WaitUntilReady ();
+    }
+
+  Endpoint_ClearOUT ();
+  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (ProgrammingStatus);
+  Endpoint_ClearIN ();
+}
+
+/** Handler for the vendor CMD_PROGRAM_FLUSH_ISP command, which completes the last page committed in pipelined
+ *  programming mode and returns the status of all deferred page commits not yet reported to the host.
+ */
+void
+ISPProtocol_FlushProgramMemory (void)
+{
+  V2Protocol_BeginResponse ();
+
+  V2Protocol_Write_8 (CMD_PROGRAM_FLUSH_ISP);
+  V2Protocol_Write_8 (ISPProtocol_TakeDeferredStatus ());
+  V2Protocol_EndResponse ();
+}
+
+/** Waits for the page committed last in pipelined programming mode to be written by the target, if one is still
+ *  outstanding. A failed completion is latched until it is reported to the host by the next program, flush or leave
+ *  programming mode command.
+ */
+void
+ISPProtocol_WaitForDeferredCommit (void)
+{
+  if (!(ISPProtocol_DeferredCommit.Pending))
+    return;
+
+  ISPProtocol_DeferredCommit.Pending = false;
+
+  uint8_t CommitStatus = ISPTarget_WaitForProgComplete (
+      ISPProtocol_DeferredCommit.ProgrammingMode,
+      ISPProtocol_DeferredCommit.PollAddress,
+      ISPProtocol_DeferredCommit.PollValue,
+      ISPProtocol_DeferredCommit.DelayMS,
+      ISPProtocol_DeferredCommit.ReadMemCommand,
+      ISPProtocol_DeferredCommit.IssuedAt);
+
+  if (ISPProtocol_DeferredStatus == STATUS_CMD_OK)
+    ISPProtocol_DeferredStatus = CommitStatus;
+}
+
+/** Clears the latched deferred commit status without reporting it, when the host it was owed to has started over.
+ *  Any outstanding deferred page commit is completed by the command dispatcher before this is called.
+ */
+void
+ISPProtocol_DiscardDeferredStatus (void)
+{
+  ISPProtocol_DeferredStatus = STATUS_CMD_OK;
+}
+
+/** Completes any outstanding deferred page commit, and retrieves and clears the latched deferred commit status.
+ *
+ *  \return V2 Protocol status of the deferred page commits since the status was last taken
+ */
+static uint8_t
+ISPProtocol_TakeDeferredStatus (void)
+{
+  ISPProtocol_WaitForDeferredCommit ();
+
+  uint8_t DeferredStatus = ISPProtocol_DeferredStatus;
+  ISPProtocol_DeferredStatus = STATUS_CMD_OK;
+
+  return DeferredStatus;
+}
+
+/** Handler for the CMD_READ_FLASH_ISP and CMD_READ_EEPROM_ISP commands, reading in bytes,
+ *  words or pages of data from the attached device.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
+void
+ISPProtocol_ReadMemory (uint8_t V2Command)
+{
+  struct
+  {
+    uint16_t BytesToRead;
+    uint8_t ReadMemoryCommand;
+  } Read_Memory_Params;
+
+  Endpoint_Read_Stream_LE (&Read_Memory_Params, sizeof(Read_Memory_Params),
+                           NULL);
+  Read_Memory_Params.BytesToRead = SwapEndian_16 (
+      Read_Memory_Params.BytesToRead);
+  Trace_SetRange (CurrentAddress, Read_Memory_Params.BytesToRead);
+  Health_Count (HEALTH_BYTES_READ, Read_Memory_Params.BytesToRead);
+
+  Endpoint_ClearOUT ();
+  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+
+  /* Read each byte from the device and write them to the packet for the host */
+  if (!(ISPProtocol_ReadMemoryToEndpoint (V2Command == CMD_READ_FLASH_ISP,
+                                          Read_Memory_Params.ReadMemoryCommand,
+                                          Read_Memory_Params.BytesToRead)))
+    return;
+
+  Endpoint_Write_8 (STATUS_CMD_OK);
+
+  bool IsEndpointFull = !(Endpoint_IsReadWriteAllowed ());
   Endpoint_ClearIN ();
+
+  /* Ensure last packet is a short packet to terminate the transfer */
+  if (IsEndpointFull)
+    {
+      Endpoint_WaitUntilReady ();
+      Endpoint_ClearIN ();
+      Endpoint_WaitUntilReady ();
+    }
 }
 
-/** Handler for the CMD_LEAVE_ISP command, which releases the target from programming mode. */
+/** Handler for the vendor CMD_READ_FLASH_STREAM_ISP and CMD_READ_EEPROM_STREAM_ISP commands, reading a memory region
+ *  of any size given by a 32-bit byte address and length, and streaming it back to the host as one bulk IN transfer.
+ *  As with CMD_LOAD_ADDRESS, bit 31 of the address requests a LOAD EXTENDED ADDRESS before the first FLASH read;
+ *  extended address boundaries within the region are then crossed without involving the host.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
 void
-ISPProtocol_LeaveISPMode (void)
+ISPProtocol_ReadMemoryStream (const uint8_t V2Command)
 {
   struct
   {
-    uint8_t PreDelayMS;
-    uint8_t PostDelayMS;
-  } Leave_ISP_Params;
+    uint32_t StartAddress;
+    uint32_t BytesToRead;
+    uint8_t ReadMemoryCommand;
+  } Read_Stream_Params;
 
-  Endpoint_Read_Stream_LE (&Leave_ISP_Params, sizeof(Leave_ISP_Params), NULL);
+  Endpoint_Read_Stream_LE (&Read_Stream_Params, sizeof(Read_Stream_Params),
+                           NULL);
+  Read_Stream_Params.StartAddress = SwapEndian_32 (
+      Read_Stream_Params.StartAddress);
+  Read_Stream_Params.BytesToRead = SwapEndian_32 (
+      Read_Stream_Params.BytesToRead);
+  Trace_SetRange (Read_Stream_Params.StartAddress,
+                  MIN(Read_Stream_Params.BytesToRead, UINT16_MAX));
+  Health_Count (HEALTH_BYTES_READ, Read_Stream_Params.BytesToRead);
 
   Endpoint_ClearOUT ();
   Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
   Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
 
-  /* Perform pre-exit delay, release the target /RESET, disable the SPI bus and perform the post-exit delay */
-  ISPProtocol_DelayMS (Leave_ISP_Params.PreDelayMS);
-  ISPTarget_ChangeTargetResetLine (false);
-  ISPTarget_DisableTargetISP ();
-  ISPProtocol_DelayMS (Leave_ISP_Params.PostDelayMS);
+  bool IsFlash = (V2Command == CMD_READ_FLASH_STREAM_ISP);
+
+  ISPProtocol_SetReadAddress (IsFlash, Read_Stream_Params.StartAddress,
+                              &Read_Stream_Params.ReadMemoryCommand);
+
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+
+  if (!(ISPProtocol_ReadMemoryToEndpoint (IsFlash,
+                                          Read_Stream_Params.ReadMemoryCommand,
+                                          Read_Stream_Params.BytesToRead)))
+    return;
 
-  Endpoint_Write_8 (CMD_LEAVE_PROGMODE_ISP);
   Endpoint_Write_8 (STATUS_CMD_OK);
+
+  bool IsEndpointFull = !(Endpoint_IsReadWriteAllowed ());
   Endpoint_ClearIN ();
+
+  /* Ensure last packet is a short packet to terminate the transfer */
+  if (IsEndpointFull)
+    {
+      Endpoint_WaitUntilReady ();
+      Endpoint_ClearIN ();
+      Endpoint_WaitUntilReady ();
+    }
 }
 
-/** Handler for the CMD_PROGRAM_FLASH_ISP and CMD_PROGRAM_EEPROM_ISP commands, writing out bytes,
- *  words or pages of data to the attached device.
+/** Handler for the vendor CMD_READ_FLASH_CRC_ISP and CMD_READ_EEPROM_CRC_ISP commands, reading a memory region
+ *  given in the same way as for the streaming read commands, but returning only the CRC-32 of its contents
+ *  (see \ref MemoryCRC_Update) instead of the data itself. The CRC is only returned with a STATUS_CMD_OK status;
+ *  a region read that times out or is cut short by the device being deconfigured reports STATUS_CMD_TOUT alone.
  *
  *  \param[in] V2Command  Issued V2 Protocol command byte from the host
  */
 void
-ISPProtocol_ProgramMemory (uint8_t V2Command)
+ISPProtocol_ReadMemoryCRC (const uint8_t V2Command)
 {
   struct
   {
-    uint16_t BytesToWrite;
-    uint8_t ProgrammingMode;
-    uint8_t DelayMS;
-    uint8_t ProgrammingCommands[3];
-    uint8_t PollValue1;
-    uint8_t PollValue2;
-    uint8_t ProgData[256]; // Note, the Jungo driver has a very short ACK timeout period, need to buffer the
-  } Write_Memory_Params; // whole page and ACK the packet as fast as possible to prevent it from aborting
-
-  Endpoint_Read_Stream_LE (
-      &Write_Memory_Params,
-      (sizeof(Write_Memory_Params) - sizeof(Write_Memory_Params.ProgData)),
-      NULL);
-  Write_Memory_Params.BytesToWrite = SwapEndian_16 (
-      Write_Memory_Params.BytesToWrite);
-
-  if (Write_Memory_Params.BytesToWrite > sizeof(Write_Memory_Params.ProgData))
-    {
-      Endpoint_ClearOUT ();
-      Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-      Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
-
-      Endpoint_Write_8 (V2Command);
-      Endpoint_Write_8 (STATUS_CMD_FAILED);
-      Endpoint_ClearIN ();
-      return;
-    }
+    uint32_t StartAddress;
+    uint32_t BytesToRead;
+    uint8_t ReadMemoryCommand;
+  } Read_CRC_Params;
 
-  Endpoint_Read_Stream_LE (&Write_Memory_Params.ProgData,
-                           Write_Memory_Params.BytesToWrite, NULL);
+  V2Protocol_ReadParams (&Read_CRC_Params, sizeof(Read_CRC_Params));
+  Read_CRC_Params.StartAddress = SwapEndian_32 (Read_CRC_Params.StartAddress);
+  Read_CRC_Params.BytesToRead = SwapEndian_32 (Read_CRC_Params.BytesToRead);
+  Trace_SetRange (Read_CRC_Params.StartAddress,
+                  MIN(Read_CRC_Params.BytesToRead, UINT16_MAX));
+  Health_Count (HEALTH_BYTES_READ, Read_CRC_Params.BytesToRead);
 
-  // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
-  // to catch this and discard it before continuing on with packet processing to prevent communication issues
-  if (((sizeof(uint8_t) + sizeof(Write_Memory_Params)
-      - sizeof(Write_Memory_Params.ProgData)) + Write_Memory_Params.BytesToWrite)
-      % AVRISP_DATA_EPSIZE == 0)
-    {
-      Endpoint_ClearOUT ();
-      Endpoint_WaitUntilReady ();
-    }
+  V2Protocol_BeginResponse ();
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  bool IsFlash = (V2Command == CMD_READ_FLASH_CRC_ISP);
+  uint8_t ResponseStatus = STATUS_CMD_OK;
+  uint32_t MemoryCRC = MEMORY_CRC_INITIAL;
 
-  uint8_t ProgrammingStatus = STATUS_CMD_OK;
-  uint8_t PollValue =
-      (V2Command == CMD_PROGRAM_FLASH_ISP) ?
-          Write_Memory_Params.PollValue1 : Write_Memory_Params.PollValue2;
-  uint16_t PollAddress = 0;
-  uint8_t* NextWriteByte = Write_Memory_Params.ProgData;
-  uint16_t PageStartAddress = (CurrentAddress & 0xFFFF);
+  ISPProtocol_SetReadAddress (IsFlash, Read_CRC_Params.StartAddress,
+                              &Read_CRC_Params.ReadMemoryCommand);
 
-  for (uint16_t CurrentByte = 0; CurrentByte < Write_Memory_Params.BytesToWrite;
-      CurrentByte++)
+  while (Read_CRC_Params.BytesToRead--)
     {
-      uint8_t ByteToWrite = *(NextWriteByte++);
-      uint8_t ProgrammingMode = Write_Memory_Params.ProgrammingMode;
+      MemoryCRC = MemoryCRC_Update (
+          MemoryCRC,
+          ISPProtocol_ReadNextByte (IsFlash, &Read_CRC_Params.ReadMemoryCommand));
 
-      /* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
-      if (MustLoadExtendedAddress)
+      /* The range size is set by the host - service USB every few hundred bytes, giving up if the command timed
+       * out or the device was deconfigured, and otherwise restart the timeout for the next run of bytes */
+      if (!(Read_CRC_Params.BytesToRead % ISP_CRC_YIELD_BYTES))
         {
-          ISPTarget_LoadExtendedAddress ();
-          MustLoadExtendedAddress = false;
-        }
-
-      ISPTarget_SendByte (Write_Memory_Params.ProgrammingCommands[0]);
-      ISPTarget_SendByte (CurrentAddress >> 8);
-      ISPTarget_SendByte (CurrentAddress & 0xFF);
-      ISPTarget_SendByte (ByteToWrite);
-
-      /* AVR FLASH addressing requires us to modify the write command based on if we are writing a high
-       * or low byte at the current word address */
-      if (V2Command == CMD_PROGRAM_FLASH_ISP)
-        Write_Memory_Params.ProgrammingCommands[0] ^= READ_WRITE_HIGH_BYTE_MASK;
+          V2Protocol_Yield ();
 
-      /* Check to see if we have a valid polling address */
-      if (!(PollAddress) && (ByteToWrite != PollValue))
-        {
-          if ((CurrentByte & 0x01) && (V2Command == CMD_PROGRAM_FLASH_ISP))
-            Write_Memory_Params.ProgrammingCommands[2] |=
-                READ_WRITE_HIGH_BYTE_MASK;
-          else
-            Write_Memory_Params.ProgrammingCommands[2] &=
-                ~READ_WRITE_HIGH_BYTE_MASK;
+          if (!(TimeoutTicksRemaining))
+            {
+              ResponseStatus = STATUS_CMD_TOUT;
+              break;
+            }
 
-          PollAddress = (CurrentAddress & 0xFFFF);
+          TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
         }
+    }
 
-      /* If in word programming mode, commit the byte to the target's memory */
-      if (!(ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK))
-        {
-          /* If the current polling address is invalid, switch to timed delay write completion mode */
-          if (!(PollAddress)
-              && !(ProgrammingMode & PROG_MODE_WORD_READYBUSY_MASK))
-            ProgrammingMode = (ProgrammingMode & ~PROG_MODE_WORD_VALUE_MASK)
-                | PROG_MODE_WORD_TIMEDELAY_MASK;
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (ResponseStatus);
 
-          ProgrammingStatus = ISPTarget_WaitForProgComplete (
-              ProgrammingMode, PollAddress, PollValue,
-              Write_Memory_Params.DelayMS,
-              Write_Memory_Params.ProgrammingCommands[2]);
+  if (ResponseStatus == STATUS_CMD_OK)
+    V2Protocol_Write_32_BE (MemoryCRC ^ MEMORY_CRC_FINAL_XOR);
 
-          /* Abort the programming loop early if the byte/word programming failed */
-          if (ProgrammingStatus != STATUS_CMD_OK)
-            break;
+  V2Protocol_EndResponse ();
+}
 
-          /* Must reset the polling address afterwards, so it is not erroneously used for the next byte */
-          PollAddress = 0;
-        }
+/** Sets the current address to the start of a memory region read by one of the vendor region read commands.
+ *  As with CMD_LOAD_ADDRESS, bit 31 of the address requests a LOAD EXTENDED ADDRESS before the first FLASH read.
+ *
+ *  \param[in]     IsFlash            Boolean \c true if the region is in FLASH memory, \c false for EEPROM memory
+ *  \param[in]     StartAddress       Byte address of the start of the region
+ *  \param[in,out] ReadMemoryCommand  Target read command, adjusted to read the high byte for an odd FLASH address
+ */
+static void
+ISPProtocol_SetReadAddress (const bool IsFlash, const uint32_t StartAddress,
+                            uint8_t* const ReadMemoryCommand)
+{
+  MustLoadExtendedAddress = (StartAddress & (1UL << 31)) ? true : false;
 
-      /* EEPROM just increments the address each byte, flash needs to increment on each word and
-       * also check to ensure that a LOAD EXTENDED ADDRESS command is issued each time the extended
-       * address boundary has been crossed during FLASH memory programming */
-      if ((CurrentByte & 0x01) || (V2Command == CMD_PROGRAM_EEPROM_ISP))
-        {
-          CurrentAddress++;
+  /* FLASH is addressed in words, with the low bit of the byte address selecting the byte within the word */
+  if (IsFlash)
+    {
+      CurrentAddress = ((StartAddress & ~(1UL << 31)) >> 1);
 
-          if ((V2Command == CMD_PROGRAM_FLASH_ISP)
-              && !(CurrentAddress & 0xFFFF))
-            MustLoadExtendedAddress = true;
-        }
+      if (StartAddress & 0x01)
+        *ReadMemoryCommand |= READ_WRITE_HIGH_BYTE_MASK;
+      else
+        *ReadMemoryCommand &= ~READ_WRITE_HIGH_BYTE_MASK;
     }
+  else
+    {
+      CurrentAddress = (StartAddress & ~(1UL << 31));
+    }
+}
 
-  /* If the current page must be committed, send the PROGRAM PAGE command to the target */
-  if (Write_Memory_Params.ProgrammingMode & PROG_MODE_COMMIT_PAGE_MASK)
+/** Reads the byte at the current address from the target's FLASH or EEPROM memory, and advances the current
+ *  address to the next byte.
+ *
+ *  \param[in]     IsFlash            Boolean \c true to read FLASH memory, \c false to read EEPROM memory
+ *  \param[in,out] ReadMemoryCommand  Target read command, toggled between the low and high byte of each FLASH word
+ *
+ *  \return Byte read from the target
+ */
+static uint8_t
+ISPProtocol_ReadNextByte (const bool IsFlash, uint8_t* const ReadMemoryCommand)
+{
+  /* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
+  if (MustLoadExtendedAddress)
     {
-      ISPTarget_SendByte (Write_Memory_Params.ProgrammingCommands[1]);
-      ISPTarget_SendByte (PageStartAddress >> 8);
-      ISPTarget_SendByte (PageStartAddress & 0xFF);
-      ISPTarget_SendByte (0x00);
+      ISPTarget_LoadExtendedAddress ();
+      MustLoadExtendedAddress = false;
+    }
 
-      /* Check if polling is enabled and possible, if not switch to timed delay mode */
-      if ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_VALUE_MASK)
-          && !(PollAddress))
-        {
-          Write_Memory_Params.ProgrammingMode =
-              (Write_Memory_Params.ProgrammingMode & ~PROG_MODE_PAGED_VALUE_MASK)
-                  |
-                  PROG_MODE_PAGED_TIMEDELAY_MASK;
-        }
+  /* Read the next byte from the desired memory space in the device */
+  ISPTarget_SendByte (*ReadMemoryCommand);
+  ISPTarget_SendByte (CurrentAddress >> 8);
+  ISPTarget_SendByte (CurrentAddress & 0xFF);
+  uint8_t ReadByte = ISPTarget_ReceiveByte ();
 
-      ProgrammingStatus = ISPTarget_WaitForProgComplete (
-          Write_Memory_Params.ProgrammingMode, PollAddress, PollValue,
-          Write_Memory_Params.DelayMS,
-          Write_Memory_Params.ProgrammingCommands[2]);
+  bool WasHighByte = (*ReadMemoryCommand & READ_WRITE_HIGH_BYTE_MASK);
 
-      /* Check to see if the FLASH address has crossed the extended address boundary */
-      if ((V2Command == CMD_PROGRAM_FLASH_ISP) && !(CurrentAddress & 0xFFFF))
+  /* AVR FLASH addressing requires us to modify the read command based on if we are reading a high
+   * or low byte at the current word address */
+  if (IsFlash)
+    *ReadMemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
+
+  /* EEPROM just increments the address each byte, flash needs to increment on each word and
+   * also check to ensure that a LOAD EXTENDED ADDRESS command is issued each time the extended
+   * address boundary has been crossed */
+  if (WasHighByte || !(IsFlash))
+    {
+      CurrentAddress++;
+
+      if (IsFlash && !(CurrentAddress & 0xFFFF))
         MustLoadExtendedAddress = true;
     }
 
-  Endpoint_Write_8 (V2Command);
-  Endpoint_Write_8 (ProgrammingStatus);
-  Endpoint_ClearIN ();
+  return ReadByte;
 }
 
-/** Handler for the CMD_READ_FLASH_ISP and CMD_READ_EEPROM_ISP commands, reading in bytes,
- *  words or pages of data from the attached device.
+/** Reads bytes from the target's FLASH or EEPROM memory starting at the current address, and writes them to the
+ *  selected IN endpoint, sending each packet to the host as it fills. The current address is left after the last
+ *  byte read.
  *
- *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ *  \param[in] IsFlash            Boolean \c true to read FLASH memory, \c false to read EEPROM memory
+ *  \param[in] ReadMemoryCommand  Target read command of the first byte, with the high byte bit set for an odd FLASH byte
+ *  \param[in] BytesToRead        Number of bytes to read
+ *
+ *  \return Boolean \c true if all bytes were read, \c false if the host stopped collecting the data
  */
-void
-ISPProtocol_ReadMemory (uint8_t V2Command)
+static bool
+ISPProtocol_ReadMemoryToEndpoint (const bool IsFlash, uint8_t ReadMemoryCommand,
+                                  uint32_t BytesToRead)
 {
-  struct
-  {
-    uint16_t BytesToRead;
-    uint8_t ReadMemoryCommand;
-  } Read_Memory_Params;
+  /* The SPI access is chosen once for the whole read, FLASH reads having a loop of their own for each hardware SPI
+   * speed class - EEPROM reads are short, and are left to the generic loop to save program space */
+  if (IsFlash && ISPTarget_IsTimedSPIMode ())
+    return ISPProtocol_ReadFlashTimedSPI (ReadMemoryCommand, BytesToRead);
+  else if (IsFlash && (ISPTarget_SPIMode == ISP_SPI_MODE_HARDWARE))
+    return ISPProtocol_ReadFlashHardwareSPI (ReadMemoryCommand, BytesToRead);
+  else
+    return ISPProtocol_ReadAnySPI (IsFlash, ReadMemoryCommand, BytesToRead);
+}
 
-  Endpoint_Read_Stream_LE (&Read_Memory_Params, sizeof(Read_Memory_Params),
-                           NULL);
-  Read_Memory_Params.BytesToRead = SwapEndian_16 (
-      Read_Memory_Params.BytesToRead);
+/** Reads FLASH memory to the selected IN endpoint over the hardware SPI bus running at F_CPU / 2, see
+ *  \ref ISPProtocol_ReadMemoryToEndpoint().
+ *
+ *  \param[in] ReadMemoryCommand  Target read command of the first byte, with the high byte bit set for an odd byte
+ *  \param[in] BytesToRead        Number of bytes to read
+ *
+ *  \return Boolean \c true if all bytes were read, \c false if the host stopped collecting the data
+ */
+static bool
+ISPProtocol_ReadFlashTimedSPI (uint8_t ReadMemoryCommand, uint32_t BytesToRead)
+{
+  return ISPProtocol_ReadKernel (ISP_KERNEL_TIMED_SPI, true, ReadMemoryCommand,
+                                 BytesToRead);
+}
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+/** Reads FLASH memory to the selected IN endpoint over the hardware SPI bus running below F_CPU / 2, see
+ *  \ref ISPProtocol_ReadMemoryToEndpoint().
+ *
+ *  \param[in] ReadMemoryCommand  Target read command of the first byte, with the high byte bit set for an odd byte
+ *  \param[in] BytesToRead        Number of bytes to read
+ *
+ *  \return Boolean \c true if all bytes were read, \c false if the host stopped collecting the data
+ */
+static bool
+ISPProtocol_ReadFlashHardwareSPI (uint8_t ReadMemoryCommand,
+                                  uint32_t BytesToRead)
+{
+  return ISPProtocol_ReadKernel (ISP_KERNEL_HARDWARE_SPI, true,
+                                 ReadMemoryCommand, BytesToRead);
+}
 
-  Endpoint_Write_8 (V2Command);
-  Endpoint_Write_8 (STATUS_CMD_OK);
+/** Reads FLASH or EEPROM memory to the selected IN endpoint over whichever SPI driver is selected, see
+ *  \ref ISPProtocol_ReadMemoryToEndpoint().
+ *
+ *  \param[in] IsFlash            Boolean \c true to read FLASH memory, \c false to read EEPROM memory
+ *  \param[in] ReadMemoryCommand  Target read command of the first byte, with the high byte bit set for an odd FLASH byte
+ *  \param[in] BytesToRead        Number of bytes to read
+ *
+ *  \return Boolean \c true if all bytes were read, \c false if the host stopped collecting the data
+ */
+static bool
+ISPProtocol_ReadAnySPI (const bool IsFlash, uint8_t ReadMemoryCommand,
+                        uint32_t BytesToRead)
+{
+  return ISPProtocol_ReadKernel (ISP_KERNEL_ANY_SPI, IsFlash, ReadMemoryCommand,
+                                 BytesToRead);
+}
 
-  /* Read each byte from the device and write them to the packet for the host */
-  for (uint16_t CurrentByte = 0; CurrentByte < Read_Memory_Params.BytesToRead;
-      CurrentByte++)
+/** Sends a byte of ISP data to the attached target through the given SPI access of a specialised loop.
+ *
+ *  \param[in] Kernel  SPI access of the calling loop, a value from the \ref ISPProtocol_SPIKernels_t enum
+ *  \param[in] Byte    Byte of data to send to the attached target
+ */
+static inline void
+ISPProtocol_KernelSendByte (const uint8_t Kernel, const uint8_t Byte)
+{
+  if (Kernel == ISP_KERNEL_TIMED_SPI)
+    ISPTarget_TransferTimedSPIByte (Byte);
+  else if (Kernel == ISP_KERNEL_HARDWARE_SPI)
+    SPI_SendByte (Byte);
+  else
+    ISPTarget_SendByte (Byte);
+}
+
+/** Receives a byte of ISP data from the attached target through the given SPI access of a specialised loop.
+ *
+ *  \param[in] Kernel  SPI access of the calling loop, a value from the \ref ISPProtocol_SPIKernels_t enum
+ *
+ *  \return Received byte of data from the attached target
+ */
+static inline uint8_t
+ISPProtocol_KernelReceiveByte (const uint8_t Kernel)
+{
+  if (Kernel == ISP_KERNEL_TIMED_SPI)
+    return ISPTarget_TransferTimedSPIByte (0x00);
+
+  if (Kernel == ISP_KERNEL_ANY_SPI)
+    return ISPTarget_ReceiveByte ();
+
+#if defined(INVERTED_ISP_MISO)
+  return ~SPI_ReceiveByte ();
+#else
+  return SPI_ReceiveByte ();
+#endif
+}
+
+/** Body of the memory read loops, inlined into each of them with the SPI access and memory type fixed so that the
+ *  per-byte work is reduced to the bus transfers and the address arithmetic. The current address is kept in a local
+ *  copy while reading, and written back before an extended address is loaded and once the loop ends.
+ *
+ *  \param[in] Kernel             SPI access of the loop, a value from the \ref ISPProtocol_SPIKernels_t enum
+ *  \param[in] IsFlash            Boolean \c true to read FLASH memory, \c false to read EEPROM memory
+ *  \param[in] ReadMemoryCommand  Target read command of the first byte, with the high byte bit set for an odd FLASH byte
+ *  \param[in] BytesToRead        Number of bytes to read
+ *
+ *  \return Boolean \c true if all bytes were read, \c false if the host stopped collecting the data
+ */
+static inline bool
+ISPProtocol_ReadKernel (const uint8_t Kernel, const bool IsFlash,
+                        uint8_t ReadMemoryCommand, uint32_t BytesToRead)
+{
+  uint32_t Address = CurrentAddress;
+  bool Completed = true;
+
+  while (BytesToRead--)
     {
       /* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
       if (MustLoadExtendedAddress)
         {
+          CurrentAddress = Address;
           ISPTarget_LoadExtendedAddress ();
           MustLoadExtendedAddress = false;
         }
 
-      /* Read the next byte from the desired memory space in the device */
-      ISPTarget_SendByte (Read_Memory_Params.ReadMemoryCommand);
-      ISPTarget_SendByte (CurrentAddress >> 8);
-      ISPTarget_SendByte (CurrentAddress & 0xFF);
-      Endpoint_Write_8 (ISPTarget_ReceiveByte ());
-
-      /* Check if the endpoint bank is currently full, if so send the packet */
-      if (!(Endpoint_IsReadWriteAllowed ()))
-        {
-          Endpoint_ClearIN ();
-          Endpoint_WaitUntilReady ();
-        }
+      ISPProtocol_KernelSendByte (Kernel, ReadMemoryCommand);
+      ISPProtocol_KernelSendByte (Kernel, Address >> 8);
+      ISPProtocol_KernelSendByte (Kernel, Address & 0xFF);
+      Endpoint_Write_8 (ISPProtocol_KernelReceiveByte (Kernel));
 
-      /* AVR FLASH addressing requires us to modify the read command based on if we are reading a high
-       * or low byte at the current word address */
-      if (V2Command == CMD_READ_FLASH_ISP)
-        Read_Memory_Params.ReadMemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
+      /* Region reads may run for longer than a single command timeout - restart it on each byte read */
+      TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
 
-      /* EEPROM just increments the address each byte, flash needs to increment on each word and
-       * also check to ensure that a LOAD EXTENDED ADDRESS command is issued each time the extended
-       * address boundary has been crossed */
-      if ((CurrentByte & 0x01) || (V2Command == CMD_READ_EEPROM_ISP))
+      /* FLASH reads alternate between the low and high byte of each word, moving to the next word after the high
+       * byte and loading a new extended address each time its boundary is crossed */
+      if (IsFlash)
         {
-          CurrentAddress++;
+          ReadMemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
 
-          if ((V2Command != CMD_READ_EEPROM_ISP) && !(CurrentAddress & 0xFFFF))
+          if (!(ReadMemoryCommand & READ_WRITE_HIGH_BYTE_MASK)
+              && !(++Address & 0xFFFF))
             MustLoadExtendedAddress = true;
         }
-    }
-
-  Endpoint_Write_8 (STATUS_CMD_OK);
+      else
+        {
+          Address++;
+        }
 
-  bool IsEndpointFull = !(Endpoint_IsReadWriteAllowed ());
-  Endpoint_ClearIN ();
+      /* Check if the endpoint bank is currently full, if so send the packet */
+      if (!(Endpoint_IsReadWriteAllowed ()))
+        {
+          Endpoint_ClearIN ();
 
-  /* Ensure last packet is a short packet to terminate the transfer */
-  if (IsEndpointFull)
-    {
-      Endpoint_WaitUntilReady ();
-      Endpoint_ClearIN ();
-      Endpoint_WaitUntilReady ();
+          if (Endpoint_WaitUntilReady () != ENDPOINT_READYWAIT_NoError)
+            {
+              Completed = false;
+              break;
+            }
+        }
     }
+
+  CurrentAddress = Address;
+  return Completed;
 }
 
 /** Handler for the CMD_CHI_ERASE_ISP command, clearing the target's FLASH memory. */
@@ -414,11 +1510,9 @@ ISPProtocol_ChipErase (void)
     uint8_t EraseCommandBytes[4];
   } Erase_Chip_Params;
 
-  Endpoint_Read_Stream_LE (&Erase_Chip_Params, sizeof(Erase_Chip_Params), NULL);
+  V2Protocol_ReadParams (&Erase_Chip_Params, sizeof(Erase_Chip_Params));
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   uint8_t ResponseStatus = STATUS_CMD_OK;
 
@@ -428,14 +1522,19 @@ ISPProtocol_ChipErase (void)
     ISPTarget_SendByte (Erase_Chip_Params.EraseCommandBytes[SByte]);
 
   /* Use appropriate command completion check as given by the host (delay or busy polling) */
+  uint8_t PreviousPhase = Profiler_EnterPhase (PROFILER_PHASE_POLL);
+
   if (!(Erase_Chip_Params.PollMethod))
-    ISPProtocol_DelayMS (Erase_Chip_Params.EraseDelayMS);
+    ISPTarget_WaitForDelay (ISP_COMPLETION_CHIP_ERASE, Timebase_Now (),
+                            Erase_Chip_Params.EraseDelayMS);
   else
     ResponseStatus = ISPTarget_WaitWhileTargetBusy ();
 
-  Endpoint_Write_8 (CMD_CHIP_ERASE_ISP);
-  Endpoint_Write_8 (ResponseStatus);
-  Endpoint_ClearIN ();
+  Profiler_EnterPhase (PreviousPhase);
+
+  V2Protocol_Write_8 (CMD_CHIP_ERASE_ISP);
+  V2Protocol_Write_8 (ResponseStatus);
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the CMD_OSCCAL command, entering RC-calibration mode as specified in AVR053 */
@@ -460,6 +1559,7 @@ ISPProtocol_Calibrate (void)
   PCMSK0 = (1 << PCINT3);
 
   /* Set up timer that fires at a rate of 65536 Hz - this will drive the MOSI toggle */
+  Timebase_ClaimTimer1 (TIMEBASE_TIMER1_CALIBRATION);
   OCR1A = ISPPROTOCOL_CALIB_TICKS - 1;
   TCCR1A = ((1 << WGM11) | (1 << WGM10));       // set for fast PWM, TOP = OCR1A
   TCCR1B = ((1 << WGM13) | (1 << WGM12) | (1 << CS10)); //  ... and no clock prescaling
@@ -483,7 +1583,7 @@ ISPProtocol_Calibrate (void)
 
       /* Disable timer and pin change interrupts */
       PCICR &= ~(1 << PCIE0);
-      TIMSK1 = 0;
+      Timebase_ReleaseTimer1 (TIMEBASE_TIMER1_CALIBRATION);
     }
 
   /* Check if device responded with a success message or if we timed out */
@@ -491,8 +1591,8 @@ ISPProtocol_Calibrate (void)
     ResponseStatus = STATUS_CMD_TOUT;
 
   /* Report back to PC via USB */
-  Endpoint_Write_8 (CMD_OSCCAL);
-  Endpoint_Write_8 (ResponseStatus);
+  V2Protocol_Write_8 (CMD_OSCCAL);
+  V2Protocol_Write_8 (ResponseStatus);
   Endpoint_ClearIN ();
 }
 
@@ -510,12 +1610,10 @@ ISPProtocol_ReadFuseLockSigOSCCAL (uint8_t V2Command)
     uint8_t ReadCommandBytes[4];
   } Read_FuseLockSigOSCCAL_Params;
 
-  Endpoint_Read_Stream_LE (&Read_FuseLockSigOSCCAL_Params,
-                           sizeof(Read_FuseLockSigOSCCAL_Params), NULL);
+  V2Protocol_ReadParams (&Read_FuseLockSigOSCCAL_Params,
+                         sizeof(Read_FuseLockSigOSCCAL_Params));
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   uint8_t ResponseBytes[4];
 
@@ -524,11 +1622,11 @@ ISPProtocol_ReadFuseLockSigOSCCAL (uint8_t V2Command)
     ResponseBytes[RByte] = ISPTarget_TransferByte (
         Read_FuseLockSigOSCCAL_Params.ReadCommandBytes[RByte]);
 
-  Endpoint_Write_8 (V2Command);
-  Endpoint_Write_8 (STATUS_CMD_OK);
-  Endpoint_Write_8 (ResponseBytes[Read_FuseLockSigOSCCAL_Params.RetByte - 1]);
-  Endpoint_Write_8 (STATUS_CMD_OK);
-  Endpoint_ClearIN ();
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_Write_8 (ResponseBytes[Read_FuseLockSigOSCCAL_Params.RetByte - 1]);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the CMD_WRITE_FUSE_ISP and CMD_WRITE_LOCK_ISP commands, writing the requested configuration
@@ -544,22 +1642,20 @@ ISPProtocol_WriteFuseLock (uint8_t V2Command)
     uint8_t WriteCommandBytes[4];
   } Write_FuseLockSig_Params;
 
-  Endpoint_Read_Stream_LE (&Write_FuseLockSig_Params,
-                           sizeof(Write_FuseLockSig_Params), NULL);
+  V2Protocol_ReadParams (&Write_FuseLockSig_Params,
+                         sizeof(Write_FuseLockSig_Params));
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   /* Send the Fuse or Lock byte program commands as given by the host to the device */
   for (uint8_t SByte = 0;
       SByte < sizeof(Write_FuseLockSig_Params.WriteCommandBytes); SByte++)
     ISPTarget_SendByte (Write_FuseLockSig_Params.WriteCommandBytes[SByte]);
 
-  Endpoint_Write_8 (V2Command);
-  Endpoint_Write_8 (STATUS_CMD_OK);
-  Endpoint_Write_8 (STATUS_CMD_OK);
-  Endpoint_ClearIN ();
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the CMD_SPI_MULTI command, writing and reading arbitrary SPI data to and from the attached device. */
@@ -571,33 +1667,49 @@ ISPProtocol_SPIMulti (void)
     uint8_t TxBytes;
     uint8_t RxBytes;
     uint8_t RxStartAddr;
-    uint8_t TxData[255];
   } SPI_Multi_Params;
 
-  Endpoint_Read_Stream_LE (
-      &SPI_Multi_Params,
-      (sizeof(SPI_Multi_Params) - sizeof(SPI_Multi_Params.TxData)), NULL);
-  Endpoint_Read_Stream_LE (&SPI_Multi_Params.TxData, SPI_Multi_Params.TxBytes,
-                           NULL);
+  Endpoint_Read_Stream_LE (&SPI_Multi_Params, sizeof(SPI_Multi_Params), NULL);
+
+  uint8_t* TxData = BufferArena_Alloc (SPI_Multi_Params.TxBytes);
+
+  if (!(TxData))
+    {
+      /* Discard all incoming data */
+      while (Endpoint_BytesInEndpoint () == AVRISP_DATA_EPSIZE)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+
+      Endpoint_ClearOUT ();
+      Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+      Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+      V2Protocol_Write_8 (CMD_SPI_MULTI);
+      V2Protocol_Write_8 (STATUS_CMD_FAILED);
+      Endpoint_ClearIN ();
+      return;
+    }
+
+  Endpoint_Read_Stream_LE (TxData, SPI_Multi_Params.TxBytes, NULL);
 
   Endpoint_ClearOUT ();
   Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
   Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
 
-  Endpoint_Write_8 (CMD_SPI_MULTI);
-  Endpoint_Write_8 (STATUS_CMD_OK);
+  V2Protocol_Write_8 (CMD_SPI_MULTI);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
 
-  uint8_t CurrTxPos = 0;
+  uint8_t CurrTxPos = MIN (SPI_Multi_Params.RxStartAddr, SPI_Multi_Params.TxBytes);
   uint8_t CurrRxPos = 0;
 
   /* Write out bytes to transmit until the start of the bytes to receive is met */
+  ISPTarget_SendBytes (TxData, CurrTxPos);
+
   while (CurrTxPos < SPI_Multi_Params.RxStartAddr)
     {
-      if (CurrTxPos < SPI_Multi_Params.TxBytes)
-        ISPTarget_SendByte (SPI_Multi_Params.TxData[CurrTxPos]);
-      else
-        ISPTarget_SendByte (0);
-
+      ISPTarget_SendByte (0);
       CurrTxPos++;
     }
 
@@ -606,7 +1718,7 @@ ISPProtocol_SPIMulti (void)
     {
       if (CurrTxPos < SPI_Multi_Params.TxBytes)
         Endpoint_Write_8 (
-            ISPTarget_TransferByte (SPI_Multi_Params.TxData[CurrTxPos++]));
+            ISPTarget_TransferByte (TxData[CurrTxPos++]));
       else
         Endpoint_Write_8 (ISPTarget_ReceiveByte ());
 
@@ -634,17 +1746,21 @@ ISPProtocol_SPIMulti (void)
     }
 }
 
-/** Blocking delay for a given number of milliseconds. This provides a simple wrapper around
- *  the avr-libc provided delay function, so that the delay function can be called with a
- *  constant value (to prevent run-time floating point operations being required).
+/** Delay for a given number of milliseconds, measured against the timebase so that time spent in interrupts
+ *  is not added to the delay. The delay is cut short if the command times out.
  *
  *  \param[in] DelayMS  Number of milliseconds to delay for
  */
 void
 ISPProtocol_DelayMS (uint8_t DelayMS)
 {
-  while (DelayMS-- && TimeoutTicksRemaining)
-    Delay_MS (1);
+  Timebase_Time_t DelayEnd = Timebase_Deadline (TIMEBASE_MS(DelayMS));
+  uint8_t PreviousPhase = Profiler_EnterPhase (PROFILER_PHASE_DELAY);
+
+  while (!(Timebase_HasExpired (DelayEnd)) && TimeoutTicksRemaining)
+    V2Protocol_Yield ();
+
+  Profiler_EnterPhase (PreviousPhase);
 }
 
 #endif
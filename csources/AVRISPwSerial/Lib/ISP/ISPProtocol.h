@@ -38,12 +38,15 @@
 
 /* Includes: */
 #include <avr/io.h>
+#include <avr/eeprom.h>
 #include <util/atomic.h>
+#include <string.h>
 #include <util/delay.h>
 
 #include <LUFA/Drivers/USB/USB.h>
 
 #include "../V2Protocol.h"
+#include "../MemoryCRC.h"
 #include "Config/AppConfig.h"
 
 /* Macros: */
@@ -62,6 +65,24 @@
  */
 #define ISPPROTOCOL_CALIB_SUCCESS_TOGGLE_NUM  8
 
+/** Value of the PARAM_ISP_SCK_TUNED parameter while no SCK speed has been tuned for the current target. */
+#define ISP_SCK_NOT_TUNED                     0xFF
+
+/** Number of times each SCK speed is checked by reading back the signature and the start of FLASH, when tuning. */
+#define ISP_SCK_TUNE_VERIFY_PASSES            4
+
+/** Number of bytes at the start of FLASH read back to check each SCK speed, when tuning. */
+#define ISP_SCK_TUNE_FLASH_BYTES              8
+
+/** Synchronisation attempts made at the last working SCK speed once a faster one has failed, when tuning. */
+#define ISP_SCK_TUNE_RESYNC_ATTEMPTS          4
+
+/** Number of target signatures whose tuned SCK speed is remembered in EEPROM. */
+#define ISP_SCK_CACHE_ENTRIES                 8
+
+/** Bytes read by a memory CRC command between yield points, each of which must complete within a command timeout. */
+#define ISP_CRC_YIELD_BYTES                   256
+
 /* Preprocessor Checks: */
 #if ((BOARD == BOARD_XPLAIN) || (BOARD == BOARD_XPLAIN_REV1))
 #undef ENABLE_ISP_PROTOCOL
@@ -84,16 +105,61 @@
 #define PROG_MODE_PAGED_READYBUSY_MASK  (1 << 6)
 #define PROG_MODE_COMMIT_PAGE_MASK      (1 << 7)
 
+/* Enums: */
+/** Enum for the SPI access of the specialised memory read and page load loops, chosen once per command. */
+enum ISPProtocol_SPIKernels_t
+{
+  ISP_KERNEL_TIMED_SPI = 0, /**< Hardware SPI at F_CPU / 2, with each byte waited out in a fixed number of cycles */
+  ISP_KERNEL_HARDWARE_SPI = 1, /**< Hardware SPI at any other speed, polling for the end of each byte */
+  ISP_KERNEL_ANY_SPI = 2, /**< Any of the SPI drivers, selected on each byte from \ref ISPTarget_SPIMode */
+};
+
+/* Type Defines: */
+/** Parameters of the CMD_ENTER_PROGMODE_ISP command, as sent by the host. */
+typedef struct
+{
+  uint8_t TimeoutMS;
+  uint8_t PinStabDelayMS;
+  uint8_t ExecutionDelayMS;
+  uint8_t SynchLoops;
+  uint8_t ByteDelay;
+  uint8_t PollValue;
+  uint8_t PollIndex;
+  uint8_t EnterProgBytes[4];
+} ISPProtocol_EnterParams_t;
+
+/** SCK speed tuned for a target, as remembered in EEPROM. */
+typedef struct
+{
+  uint8_t Signature[3];
+  uint8_t SCKDuration; /**< Fastest working AVRStudio SCK duration value */
+} ISPProtocol_SCKCacheEntry_t;
+
 /* Function Prototypes: */
 void
 ISPProtocol_EnterISPMode (void);
+uint8_t
+ISPProtocol_SynchroniseTarget (const ISPProtocol_EnterParams_t* const Params,
+                               uint8_t Attempts);
 void
 ISPProtocol_LeaveISPMode (void);
 void
 ISPProtocol_ProgramMemory (const uint8_t V2Command);
 void
+ISPProtocol_ProgramMemoryStream (const uint8_t V2Command);
+void
+ISPProtocol_FlushProgramMemory (void);
+void
+ISPProtocol_WaitForDeferredCommit (void);
+void
+ISPProtocol_DiscardDeferredStatus (void);
+void
 ISPProtocol_ReadMemory (const uint8_t V2Command);
 void
+ISPProtocol_ReadMemoryStream (const uint8_t V2Command);
+void
+ISPProtocol_ReadMemoryCRC (const uint8_t V2Command);
+void
 ISPProtocol_ChipErase (void);
 void
 ISPProtocol_Calibrate (void);
@@ -105,5 +171,36 @@ void
 ISPProtocol_SPIMulti (void);
 void
 ISPProtocol_DelayMS (uint8_t DelayMS);
+
+#if (defined(INCLUDE_FROM_ISPPROTOCOL_C) && defined(ENABLE_ISP_PROTOCOL))
+static uint8_t ISPProtocol_TuneSCK(const ISPProtocol_EnterParams_t* const Params);
+static void ISPProtocol_ReadTuneReference(uint8_t* Reference);
+static bool ISPProtocol_VerifySCK(const uint8_t SCKDuration, const uint8_t* Reference);
+static uint8_t ISPProtocol_FindCachedSCK(const uint8_t* Signature);
+static void ISPProtocol_CacheSCK(const uint8_t* Signature, const uint8_t SCKDuration);
+static uint8_t ISPProtocol_TakeDeferredStatus(void);
+static bool ISPProtocol_IsErasedBlock(const uint8_t* Data, uint16_t Length);
+static void ISPProtocol_CountUnchangedBytes(const uint16_t UnchangedBytes);
+static void ISPProtocol_SetReadAddress(const bool IsFlash, const uint32_t StartAddress, uint8_t* const ReadMemoryCommand);
+static uint8_t ISPProtocol_ReadNextByte(const bool IsFlash, uint8_t* const ReadMemoryCommand);
+static bool ISPProtocol_ReadMemoryToEndpoint(const bool IsFlash, uint8_t ReadMemoryCommand, uint32_t BytesToRead);
+static bool ISPProtocol_ReadFlashTimedSPI(uint8_t ReadMemoryCommand, uint32_t BytesToRead);
+static bool ISPProtocol_ReadFlashHardwareSPI(uint8_t ReadMemoryCommand, uint32_t BytesToRead);
+static bool ISPProtocol_ReadAnySPI(const bool IsFlash, uint8_t ReadMemoryCommand, uint32_t BytesToRead);
+static uint16_t ISPProtocol_FindPollAddress(const bool IsFlash, const uint8_t* Data, const uint16_t Length,
+                                            const uint16_t StartAddress, const uint8_t PollValue,
+                                            uint8_t* const ReadMemoryCommand);
+static void ISPProtocol_LoadPage(const bool IsFlash, const uint8_t LoadCommand, const uint8_t* Data, const uint16_t Length);
+static void ISPProtocol_LoadFlashPageTimedSPI(uint8_t LoadCommand, const uint8_t* Data, const uint16_t Length);
+static void ISPProtocol_LoadFlashPageHardwareSPI(uint8_t LoadCommand, const uint8_t* Data, const uint16_t Length);
+static void ISPProtocol_LoadPageAnySPI(const bool IsFlash, uint8_t LoadCommand, const uint8_t* Data, const uint16_t Length);
+static inline void ISPProtocol_KernelSendByte(const uint8_t Kernel, const uint8_t Byte) ATTR_ALWAYS_INLINE;
+static inline uint8_t ISPProtocol_KernelReceiveByte(const uint8_t Kernel) ATTR_ALWAYS_INLINE;
+static inline bool ISPProtocol_ReadKernel(const uint8_t Kernel, const bool IsFlash, uint8_t ReadMemoryCommand,
+                                          uint32_t BytesToRead) ATTR_ALWAYS_INLINE;
+static inline void ISPProtocol_LoadPageKernel(const uint8_t Kernel, const bool IsFlash, uint8_t LoadCommand,
+                                              const uint8_t* Data, const uint16_t Length) ATTR_ALWAYS_INLINE;
+#endif
+
 #endif
 
@@ -0,0 +1,367 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  ISP micro-sequence engine, running small programs of SPI frames, polls, delays and address loops sent by the host
+ *  with the vendor CMD_ISP_SEQUENCE command. Programming algorithms the V2 protocol has no command for, such as
+ *  those of unusual parts or vendor specific flash sequences, then run at wire speed rather than at one USB round
+ *  trip per step.
+ */
+
+#define  INCLUDE_FROM_ISPSEQUENCE_C
+#include "ISPSequence.h"
+
+#if defined(ENABLE_ISP_PROTOCOL) || defined(__DOXYGEN__)
+
+/** Handler for the vendor CMD_ISP_SEQUENCE command, running a micro-sequence on the target while in ISP programming
+ *  mode. The command holds the big endian lengths of the program and of its input data, followed by the program and
+ *  the data, both buffered in the buffer arena, so that the input data may stage several pages at once and is only
+ *  bounded by the space left in the arena. The response holds a status, then the bytes streamed out by the program
+ *  and, if the program was run, the status it ended with: STATUS_CMD_OK, STATUS_RDY_BSY_TOUT if a POLL timed out,
+ *  STATUS_CMD_TOUT if the command timed out, or STATUS_CMD_ILLEGAL_PARAM if the program was malformed.
+ */
+void
+ISPSequence_Command (void)
+{
+  uint16_t ProgramLength = Endpoint_Read_16_BE ();
+  uint16_t DataLength = Endpoint_Read_16_BE ();
+  uint8_t* Program = NULL;
+  uint8_t* Data = NULL;
+  uint8_t ResponseStatus = STATUS_CMD_OK;
+
+  if ((ProgramLength > ISPSEQUENCE_PROGRAM_SIZE)
+      || (DataLength > (BufferArena_Available () - ProgramLength)))
+    {
+      ResponseStatus = STATUS_CMD_ILLEGAL_PARAM;
+
+      /* Discard all incoming data */
+      while (Endpoint_BytesInEndpoint () == AVRISP_DATA_EPSIZE)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+    }
+  else
+    {
+      Program = BufferArena_Alloc (ProgramLength + DataLength);
+      Data = &Program[ProgramLength];
+
+      Endpoint_Read_Stream_LE (Program, ProgramLength, NULL);
+      Endpoint_Read_Stream_LE (Data, DataLength, NULL);
+
+      // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+      // to catch this and discard it before continuing on with packet processing to prevent communication issues
+      if (((sizeof(uint8_t) + (2 * sizeof(uint16_t)) + ProgramLength + DataLength) % AVRISP_DATA_EPSIZE) == 0)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+    }
+
+  Endpoint_ClearOUT ();
+  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+  if ((ResponseStatus == STATUS_CMD_OK) && !(TargetInProgMode))
+    ResponseStatus = STATUS_CMD_FAILED;
+
+  V2Protocol_Write_8 (CMD_ISP_SEQUENCE);
+  V2Protocol_Write_8 (ResponseStatus);
+
+  if (ResponseStatus == STATUS_CMD_OK)
+    {
+      ISPSequence_State_t State =
+        {
+          .Program = Program,
+          .ProgramLength = ProgramLength,
+          .Data = Data,
+          .DataLength = DataLength,
+        };
+
+      Endpoint_Write_8 (ISPSequence_Run (&State));
+    }
+
+  bool IsEndpointFull = !(Endpoint_IsReadWriteAllowed ());
+  Endpoint_ClearIN ();
+
+  /* Ensure last packet is a short packet to terminate the transfer */
+  if (IsEndpointFull)
+    {
+      Endpoint_WaitUntilReady ();
+      Endpoint_ClearIN ();
+      Endpoint_WaitUntilReady ();
+    }
+}
+
+/** Runs a micro-sequence program until its END op, a fault or a timeout.
+ *
+ *  \param[in,out] State  State of the micro-sequence to run
+ *
+ *  \return V2 Protocol status code the program ended with
+ */
+static uint8_t
+ISPSequence_Run (ISPSequence_State_t* const State)
+{
+  for (;;)
+    {
+      if (!(TimeoutTicksRemaining))
+        return STATUS_CMD_TOUT;
+
+      uint8_t Opcode = ISPSequence_Fetch (State);
+
+      switch (Opcode)
+        {
+        case ISPSEQUENCE_OP_END:
+          break;
+        case ISPSEQUENCE_OP_SPI:
+          ISPSequence_Frame (State, false);
+          break;
+        case ISPSEQUENCE_OP_POLL:
+          {
+            uint8_t PollMask = ISPSequence_Fetch (State);
+            uint8_t PollValue = ISPSequence_Fetch (State);
+            Timebase_Time_t PollEnd = Timebase_Deadline (TIMEBASE_MS(ISPSequence_Fetch (State)));
+            uint8_t FrameStart = State->ProgramCounter;
+            uint16_t FrameData = State->DataPosition;
+            uint8_t PollStatus = STATUS_CMD_OK;
+            uint8_t PreviousPhase = Profiler_EnterPhase (PROFILER_PHASE_POLL);
+
+            /* Repeat the frame, reading the same input data each time, until the captured byte matches */
+            for (;;)
+              {
+                State->ProgramCounter = FrameStart;
+                State->DataPosition = FrameData;
+                ISPSequence_Frame (State, true);
+
+                if (State->Fault || ((State->Captured & PollMask) == PollValue))
+                  break;
+
+                if (Timebase_HasExpired (PollEnd))
+                  {
+                    PollStatus = STATUS_RDY_BSY_TOUT;
+                    break;
+                  }
+
+                if (!(TimeoutTicksRemaining))
+                  {
+                    PollStatus = STATUS_CMD_TOUT;
+                    break;
+                  }
+
+                V2Protocol_Yield ();
+              }
+
+            Profiler_EnterPhase (PreviousPhase);
+
+            if (PollStatus != STATUS_CMD_OK)
+              return PollStatus;
+          }
+          break;
+        case ISPSEQUENCE_OP_SET_ADDRESS:
+          for (uint8_t AddressByte = 0; AddressByte < sizeof(State->Address); AddressByte++)
+            State->Address = ((State->Address << 8) | ISPSequence_Fetch (State));
+          break;
+        case ISPSEQUENCE_OP_ADD_ADDRESS:
+          {
+            uint16_t Increment = ((uint16_t) ISPSequence_Fetch (State) << 8);
+            Increment |= ISPSequence_Fetch (State);
+
+            State->Address += (int16_t) Increment;
+          }
+          break;
+        case ISPSEQUENCE_OP_LOOP:
+          {
+            uint16_t Iterations = ((uint16_t) ISPSequence_Fetch (State) << 8);
+            Iterations |= ISPSequence_Fetch (State);
+
+            if (!(Iterations) || (State->LoopDepth == ISPSEQUENCE_LOOP_DEPTH))
+              {
+                State->Fault = true;
+                break;
+              }
+
+            State->Loops[State->LoopDepth].Start = State->ProgramCounter;
+            State->Loops[State->LoopDepth].Remaining = Iterations;
+            State->LoopDepth++;
+          }
+          break;
+        case ISPSEQUENCE_OP_NEXT:
+          {
+            uint8_t Increment = ISPSequence_Fetch (State);
+
+            if (!(State->LoopDepth))
+              {
+                State->Fault = true;
+                break;
+              }
+
+            State->Address += Increment;
+
+            /* A loop may run for longer than a single command timeout - restart it on each iteration, leaving a
+             * POLL op or a stalled endpoint within one iteration as the only things which can time out */
+            TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+            if (--State->Loops[State->LoopDepth - 1].Remaining)
+              State->ProgramCounter = State->Loops[State->LoopDepth - 1].Start;
+            else
+              State->LoopDepth--;
+          }
+          break;
+        case ISPSEQUENCE_OP_DELAY_MS:
+          ISPProtocol_DelayMS (ISPSequence_Fetch (State));
+          break;
+        case ISPSEQUENCE_OP_DELAY_US:
+          {
+            Timebase_Time_t DelayEnd = Timebase_Deadline (TIMEBASE_US(ISPSequence_Fetch (State)));
+            uint8_t PreviousPhase = Profiler_EnterPhase (PROFILER_PHASE_DELAY);
+
+            while (!(Timebase_HasExpired (DelayEnd)))
+              ;
+
+            Profiler_EnterPhase (PreviousPhase);
+          }
+          break;
+        default:
+          State->Fault = true;
+          break;
+        }
+
+      if (State->Fault)
+        return STATUS_CMD_ILLEGAL_PARAM;
+
+      if (Opcode == ISPSEQUENCE_OP_END)
+        return STATUS_CMD_OK;
+    }
+}
+
+/** Fetches the next byte of a micro-sequence program, flagging a fault if the program has run out.
+ *
+ *  \param[in,out] State  State of the micro-sequence being run
+ *
+ *  \return Next program byte, or zero past the end of the program
+ */
+static uint8_t
+ISPSequence_Fetch (ISPSequence_State_t* const State)
+{
+  if (State->ProgramCounter >= State->ProgramLength)
+    {
+      State->Fault = true;
+      return 0;
+    }
+
+  return State->Program[State->ProgramCounter++];
+}
+
+/** Runs an SPI frame of a micro-sequence program: a byte count, then a descriptor per byte giving its source and
+ *  what to do with the byte received in return. Bytes whose received byte is not wanted are only sent.
+ *
+ *  \param[in,out] State    State of the micro-sequence being run
+ *  \param[in]     Polling  Set when the frame is repeated by a POLL op, which streams nothing out
+ */
+static void
+ISPSequence_Frame (ISPSequence_State_t* const State, const bool Polling)
+{
+  uint8_t FrameBytes = ISPSequence_Fetch (State);
+
+  while (FrameBytes-- && !(State->Fault))
+    {
+      uint8_t Descriptor = ISPSequence_Fetch (State);
+      uint8_t TxByte = 0;
+
+      switch (Descriptor & ISPSEQUENCE_SOURCE_MASK)
+        {
+        case ISPSEQUENCE_SOURCE_LITERAL:
+          TxByte = ISPSequence_Fetch (State);
+          break;
+        case ISPSEQUENCE_SOURCE_DATA:
+          if (State->DataPosition < State->DataLength)
+            TxByte = State->Data[State->DataPosition++];
+          else
+            State->Fault = true;
+          break;
+        case ISPSEQUENCE_SOURCE_ADDRESS_LOW:
+          TxByte = (State->Address & 0xFF);
+          break;
+        case ISPSEQUENCE_SOURCE_ADDRESS_HIGH:
+          TxByte = ((State->Address >> 8) & 0xFF);
+          break;
+        case ISPSEQUENCE_SOURCE_ADDRESS_EXT:
+          TxByte = ((State->Address >> 16) & 0xFF);
+          break;
+        case ISPSEQUENCE_SOURCE_CAPTURED:
+          TxByte = State->Captured;
+          break;
+        default:
+          State->Fault = true;
+          break;
+        }
+
+      if (State->Fault)
+        break;
+
+      if (!(Descriptor & (ISPSEQUENCE_FLAG_OUTPUT | ISPSEQUENCE_FLAG_CAPTURE)))
+        {
+          ISPTarget_SendByte (TxByte);
+          continue;
+        }
+
+      uint8_t RxByte = ISPTarget_TransferByte (TxByte);
+
+      if (Descriptor & ISPSEQUENCE_FLAG_CAPTURE)
+        State->Captured = RxByte;
+
+      if ((Descriptor & ISPSEQUENCE_FLAG_OUTPUT) && !(Polling))
+        ISPSequence_Output (RxByte);
+    }
+}
+
+/** Streams a byte received from the target out to the host, sending each endpoint bank as it fills.
+ *
+ *  \param[in] Byte  Byte to stream out
+ */
+static void
+ISPSequence_Output (const uint8_t Byte)
+{
+  Endpoint_Write_8 (Byte);
+
+  /* Streamed output may run for longer than a single command timeout - restart it on each byte, as the streaming
+   * reads do */
+  TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+  /* Check to see if we have filled the endpoint bank and need to send the packet */
+  if (!(Endpoint_IsReadWriteAllowed ()))
+    {
+      Endpoint_ClearIN ();
+      Endpoint_WaitUntilReady ();
+    }
+}
+
+#endif
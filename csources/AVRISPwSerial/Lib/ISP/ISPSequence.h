@@ -0,0 +1,130 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for ISPSequence.c.
+ */
+
+#ifndef _ISP_SEQUENCE_
+#define _ISP_SEQUENCE_
+
+/* Includes: */
+#include <avr/io.h>
+#include <stdbool.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+
+#include "../V2Protocol.h"
+#include "../Timebase.h"
+#include "ISPProtocol.h"
+#include "ISPTarget.h"
+#include "Config/AppConfig.h"
+
+/* Preprocessor Checks: */
+#if ((BOARD == BOARD_XPLAIN) || (BOARD == BOARD_XPLAIN_REV1))
+#undef ENABLE_ISP_PROTOCOL
+#endif
+
+/* Macros: */
+/** Largest micro-sequence program accepted by the vendor CMD_ISP_SEQUENCE command, in bytes. */
+#define ISPSEQUENCE_PROGRAM_SIZE       96
+
+/** Maximum nesting depth of micro-sequence loops. */
+#define ISPSEQUENCE_LOOP_DEPTH         2
+
+/** Mask for the byte source of an SPI frame byte descriptor. */
+#define ISPSEQUENCE_SOURCE_MASK        0xF0
+
+/** SPI frame byte descriptor flag, to stream the byte received from the target to the host. Ignored in POLL frames. */
+#define ISPSEQUENCE_FLAG_OUTPUT        (1 << 0)
+
+/** SPI frame byte descriptor flag, to keep the byte received from the target for POLL and the CAPTURED source. */
+#define ISPSEQUENCE_FLAG_CAPTURE       (1 << 1)
+
+/* Enums: */
+/** Micro-sequence opcodes, each followed by the operands given. Multi-byte operands are big endian. */
+enum ISPSequence_Opcodes_t
+{
+  ISPSEQUENCE_OP_END = 0x00, /**< Ends the sequence successfully */
+  ISPSEQUENCE_OP_SPI = 0x01, /**< Frame: byte count, then a descriptor (and literal) per byte */
+  ISPSEQUENCE_OP_POLL = 0x02, /**< Mask, value, timeout in ms, then a frame repeated until a captured byte matches */
+  ISPSEQUENCE_OP_SET_ADDRESS = 0x03, /**< 32-bit address */
+  ISPSEQUENCE_OP_ADD_ADDRESS = 0x04, /**< 16-bit signed increment added to the address */
+  ISPSEQUENCE_OP_LOOP = 0x05, /**< 16-bit non-zero iteration count, running the ops up to the matching NEXT */
+  ISPSEQUENCE_OP_NEXT = 0x06, /**< 8-bit increment added to the address at the end of each iteration */
+  ISPSEQUENCE_OP_DELAY_MS = 0x07, /**< 8-bit delay in milliseconds */
+  ISPSEQUENCE_OP_DELAY_US = 0x08, /**< 8-bit delay in microseconds */
+};
+
+/** Byte sources of an SPI frame byte descriptor, combined with \c ISPSEQUENCE_FLAG_* flags. */
+enum ISPSequence_Sources_t
+{
+  ISPSEQUENCE_SOURCE_LITERAL = 0x00, /**< Byte following the descriptor in the program */
+  ISPSEQUENCE_SOURCE_DATA = 0x10, /**< Next byte of the input data sent after the program */
+  ISPSEQUENCE_SOURCE_ADDRESS_LOW = 0x20, /**< Bits 0 to 7 of the address */
+  ISPSEQUENCE_SOURCE_ADDRESS_HIGH = 0x30, /**< Bits 8 to 15 of the address */
+  ISPSEQUENCE_SOURCE_ADDRESS_EXT = 0x40, /**< Bits 16 to 23 of the address */
+  ISPSEQUENCE_SOURCE_CAPTURED = 0x50, /**< Byte last captured from the target */
+};
+
+/* Type Defines: */
+/** State of a micro-sequence being run. */
+typedef struct
+{
+  const uint8_t* Program;
+  uint8_t ProgramLength;
+  uint8_t ProgramCounter;
+  const uint8_t* Data;
+  uint16_t DataLength;
+  uint16_t DataPosition;
+  uint32_t Address;
+  uint8_t Captured; /**< Byte last received from the target with \ref ISPSEQUENCE_FLAG_CAPTURE */
+  bool Fault; /**< Set when the program is malformed or reads past the end of the program or the input data */
+  uint8_t LoopDepth;
+  struct
+  {
+    uint8_t Start; /**< Program counter of the first op of the loop body */
+    uint16_t Remaining; /**< Iterations left, the current one included */
+  } Loops[ISPSEQUENCE_LOOP_DEPTH];
+} ISPSequence_State_t;
+
+/* Function Prototypes: */
+void
+ISPSequence_Command (void);
+
+#if (defined(INCLUDE_FROM_ISPSEQUENCE_C) && defined(ENABLE_ISP_PROTOCOL))
+static uint8_t ISPSequence_Run(ISPSequence_State_t* const State);
+static uint8_t ISPSequence_Fetch(ISPSequence_State_t* const State);
+static void ISPSequence_Frame(ISPSequence_State_t* const State, const bool Polling);
+static void ISPSequence_Output(const uint8_t Byte);
+#endif
+
+#endif
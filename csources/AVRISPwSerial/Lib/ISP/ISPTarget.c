@@ -33,159 +33,192 @@
  *  Target-related functions for the ISP Protocol decoder.
  */
 
+#define  INCLUDE_FROM_ISPTARGET_C
 #include "ISPTarget.h"
 
 #if defined(ENABLE_ISP_PROTOCOL) || defined(__DOXYGEN__)
 
-/** List of hardware SPI prescaler masks for possible AVRStudio ISP programming speeds.
+/** List of hardware SPI prescaler masks, for an SCK period of 2, 4, 8, 16, 32, 64 and 128 CPU cycles.
  *
  *  \hideinitializer
  */
-static const uint8_t SPIMaskFromSCKDuration[] PROGMEM =
+static const uint8_t SPIMaskFromPrescaler[] PROGMEM =
   {
-#if (F_CPU == 8000000)
-    SPI_SPEED_FCPU_DIV_2,    // AVRStudio =   8MHz SPI, Actual =   4MHz SPI
-    SPI_SPEED_FCPU_DIV_2,// AVRStudio =   4MHz SPI, Actual =   4MHz SPI
-    SPI_SPEED_FCPU_DIV_4,// AVRStudio =   2MHz SPI, Actual =   2MHz SPI
-    SPI_SPEED_FCPU_DIV_8,// AVRStudio =   1MHz SPI, Actual =   1MHz SPI
-    SPI_SPEED_FCPU_DIV_16,// AVRStudio = 500KHz SPI, Actual = 500KHz SPI
-    SPI_SPEED_FCPU_DIV_32,// AVRStudio = 250KHz SPI, Actual = 250KHz SPI
-    SPI_SPEED_FCPU_DIV_64,// AVRStudio = 125KHz SPI, Actual = 125KHz SPI
-#elif (F_CPU == 16000000)
-    SPI_SPEED_FCPU_DIV_2,    // AVRStudio =   8MHz SPI, Actual =   8MHz SPI
-    SPI_SPEED_FCPU_DIV_4,// AVRStudio =   4MHz SPI, Actual =   4MHz SPI
-    SPI_SPEED_FCPU_DIV_8,// AVRStudio =   2MHz SPI, Actual =   2MHz SPI
-    SPI_SPEED_FCPU_DIV_16,// AVRStudio =   1MHz SPI, Actual =   1MHz SPI
-    SPI_SPEED_FCPU_DIV_32,// AVRStudio = 500KHz SPI, Actual = 500KHz SPI
-    SPI_SPEED_FCPU_DIV_64,// AVRStudio = 250KHz SPI, Actual = 250KHz SPI
-    SPI_SPEED_FCPU_DIV_128// AVRStudio = 125KHz SPI, Actual = 125KHz SPI
-#else
-#error No SPI prescaler masks for chosen F_CPU speed.
-#endif
+    SPI_SPEED_FCPU_DIV_2,
+    SPI_SPEED_FCPU_DIV_4,
+    SPI_SPEED_FCPU_DIV_8,
+    SPI_SPEED_FCPU_DIV_16,
+    SPI_SPEED_FCPU_DIV_32,
+    SPI_SPEED_FCPU_DIV_64,
+    SPI_SPEED_FCPU_DIV_128
   };
 
-/** Lookup table to convert the slower ISP speeds into a compare value for the software SPI driver.
+/** Lookup table to convert the slower AVRStudio ISP programming speeds into a half SCK period for the software SPI
+ *  driver, in units of \ref ISP_SOFT_SPI_LOOP_CYCLES CPU cycles.
  *
  *  \hideinitializer
  */
-static const uint16_t TimerCompareFromSCKDuration[] PROGMEM =
-  { ISP_TIMER_COMP(96386), ISP_TIMER_COMP(89888), ISP_TIMER_COMP(84211),
-      ISP_TIMER_COMP(79208), ISP_TIMER_COMP(74767), ISP_TIMER_COMP(70797),
-      ISP_TIMER_COMP(67227), ISP_TIMER_COMP(64000), ISP_TIMER_COMP(61069),
-      ISP_TIMER_COMP(58395), ISP_TIMER_COMP(55945), ISP_TIMER_COMP(51613),
-      ISP_TIMER_COMP(49690), ISP_TIMER_COMP(47905), ISP_TIMER_COMP(46243),
-      ISP_TIMER_COMP(43244), ISP_TIMER_COMP(41885), ISP_TIMER_COMP(39409),
-      ISP_TIMER_COMP(38278), ISP_TIMER_COMP(36200), ISP_TIMER_COMP(34335),
-      ISP_TIMER_COMP(32654), ISP_TIMER_COMP(31129), ISP_TIMER_COMP(29740),
-      ISP_TIMER_COMP(28470), ISP_TIMER_COMP(27304), ISP_TIMER_COMP(25724),
-      ISP_TIMER_COMP(24768), ISP_TIMER_COMP(23461), ISP_TIMER_COMP(22285),
-      ISP_TIMER_COMP(21221), ISP_TIMER_COMP(20254), ISP_TIMER_COMP(19371),
-      ISP_TIMER_COMP(18562), ISP_TIMER_COMP(17583), ISP_TIMER_COMP(16914),
-      ISP_TIMER_COMP(16097), ISP_TIMER_COMP(15356), ISP_TIMER_COMP(14520),
-      ISP_TIMER_COMP(13914), ISP_TIMER_COMP(13224), ISP_TIMER_COMP(12599),
-      ISP_TIMER_COMP(12031), ISP_TIMER_COMP(11511), ISP_TIMER_COMP(10944),
-      ISP_TIMER_COMP(10431), ISP_TIMER_COMP(9963), ISP_TIMER_COMP(9468),
-      ISP_TIMER_COMP(9081), ISP_TIMER_COMP(8612), ISP_TIMER_COMP(8239),
-      ISP_TIMER_COMP(7851), ISP_TIMER_COMP(7498), ISP_TIMER_COMP(7137),
-      ISP_TIMER_COMP(6809), ISP_TIMER_COMP(6478), ISP_TIMER_COMP(6178),
-      ISP_TIMER_COMP(5879), ISP_TIMER_COMP(5607), ISP_TIMER_COMP(5359),
-      ISP_TIMER_COMP(5093), ISP_TIMER_COMP(4870), ISP_TIMER_COMP(4633),
-      ISP_TIMER_COMP(4418), ISP_TIMER_COMP(4209), ISP_TIMER_COMP(4019),
-      ISP_TIMER_COMP(3823), ISP_TIMER_COMP(3645), ISP_TIMER_COMP(3474),
-      ISP_TIMER_COMP(3310), ISP_TIMER_COMP(3161), ISP_TIMER_COMP(3011),
-      ISP_TIMER_COMP(2869), ISP_TIMER_COMP(2734), ISP_TIMER_COMP(2611),
-      ISP_TIMER_COMP(2484), ISP_TIMER_COMP(2369), ISP_TIMER_COMP(2257),
-      ISP_TIMER_COMP(2152), ISP_TIMER_COMP(2052), ISP_TIMER_COMP(1956),
-      ISP_TIMER_COMP(1866), ISP_TIMER_COMP(1779), ISP_TIMER_COMP(1695),
-      ISP_TIMER_COMP(1615), ISP_TIMER_COMP(1539), ISP_TIMER_COMP(1468),
-      ISP_TIMER_COMP(1398), ISP_TIMER_COMP(1333), ISP_TIMER_COMP(1271),
-      ISP_TIMER_COMP(1212), ISP_TIMER_COMP(1155), ISP_TIMER_COMP(1101),
-      ISP_TIMER_COMP(1049), ISP_TIMER_COMP(1000), ISP_TIMER_COMP(953),
-      ISP_TIMER_COMP(909), ISP_TIMER_COMP(866), ISP_TIMER_COMP(826),
-      ISP_TIMER_COMP(787), ISP_TIMER_COMP(750), ISP_TIMER_COMP(715),
-      ISP_TIMER_COMP(682), ISP_TIMER_COMP(650), ISP_TIMER_COMP(619),
-      ISP_TIMER_COMP(590), ISP_TIMER_COMP(563), ISP_TIMER_COMP(536),
-      ISP_TIMER_COMP(511), ISP_TIMER_COMP(487), ISP_TIMER_COMP(465),
-      ISP_TIMER_COMP(443), ISP_TIMER_COMP(422), ISP_TIMER_COMP(402),
-      ISP_TIMER_COMP(384), ISP_TIMER_COMP(366), ISP_TIMER_COMP(349),
-      ISP_TIMER_COMP(332), ISP_TIMER_COMP(317), ISP_TIMER_COMP(302),
-      ISP_TIMER_COMP(288), ISP_TIMER_COMP(274), ISP_TIMER_COMP(261),
-      ISP_TIMER_COMP(249), ISP_TIMER_COMP(238), ISP_TIMER_COMP(226),
-      ISP_TIMER_COMP(216), ISP_TIMER_COMP(206), ISP_TIMER_COMP(196),
-      ISP_TIMER_COMP(187), ISP_TIMER_COMP(178), ISP_TIMER_COMP(170),
-      ISP_TIMER_COMP(162), ISP_TIMER_COMP(154), ISP_TIMER_COMP(147),
-      ISP_TIMER_COMP(140), ISP_TIMER_COMP(134), ISP_TIMER_COMP(128),
-      ISP_TIMER_COMP(122), ISP_TIMER_COMP(116), ISP_TIMER_COMP(111),
-      ISP_TIMER_COMP(105), ISP_TIMER_COMP(100), ISP_TIMER_COMP(95.4),
-      ISP_TIMER_COMP(90.9), ISP_TIMER_COMP(86.6), ISP_TIMER_COMP(82.6),
-      ISP_TIMER_COMP(78.7), ISP_TIMER_COMP(75.0), ISP_TIMER_COMP(71.5),
-      ISP_TIMER_COMP(68.2), ISP_TIMER_COMP(65.0), ISP_TIMER_COMP(61.9),
-      ISP_TIMER_COMP(59.0), ISP_TIMER_COMP(56.3), ISP_TIMER_COMP(53.6),
-      ISP_TIMER_COMP(51.1) };
-
-/** Currently selected SPI driver, either hardware (for fast ISP speeds) or software (for slower ISP speeds). */
-bool ISPTarget_HardwareSPIMode = true;
-
-/** Software SPI data register for sending and receiving */
-static volatile uint8_t ISPTarget_SoftSPI_Data;
-
-/** Number of bits left to transfer in the software SPI driver */
-static volatile uint8_t ISPTarget_SoftSPI_BitsRemaining;
-
-/** ISR to handle software SPI transmission and reception */
-ISR(TIMER1_COMPA_vect, ISR_BLOCK)
+static const uint16_t SoftSPIHalfPeriodFromSCKDuration[] PROGMEM =
+  { ISP_SOFT_SPI_HALF_PERIOD(96386), ISP_SOFT_SPI_HALF_PERIOD(89888), ISP_SOFT_SPI_HALF_PERIOD(84211),
+      ISP_SOFT_SPI_HALF_PERIOD(79208), ISP_SOFT_SPI_HALF_PERIOD(74767), ISP_SOFT_SPI_HALF_PERIOD(70797),
+      ISP_SOFT_SPI_HALF_PERIOD(67227), ISP_SOFT_SPI_HALF_PERIOD(64000), ISP_SOFT_SPI_HALF_PERIOD(61069),
+      ISP_SOFT_SPI_HALF_PERIOD(58395), ISP_SOFT_SPI_HALF_PERIOD(55945), ISP_SOFT_SPI_HALF_PERIOD(51613),
+      ISP_SOFT_SPI_HALF_PERIOD(49690), ISP_SOFT_SPI_HALF_PERIOD(47905), ISP_SOFT_SPI_HALF_PERIOD(46243),
+      ISP_SOFT_SPI_HALF_PERIOD(43244), ISP_SOFT_SPI_HALF_PERIOD(41885), ISP_SOFT_SPI_HALF_PERIOD(39409),
+      ISP_SOFT_SPI_HALF_PERIOD(38278), ISP_SOFT_SPI_HALF_PERIOD(36200), ISP_SOFT_SPI_HALF_PERIOD(34335),
+      ISP_SOFT_SPI_HALF_PERIOD(32654), ISP_SOFT_SPI_HALF_PERIOD(31129), ISP_SOFT_SPI_HALF_PERIOD(29740),
+      ISP_SOFT_SPI_HALF_PERIOD(28470), ISP_SOFT_SPI_HALF_PERIOD(27304), ISP_SOFT_SPI_HALF_PERIOD(25724),
+      ISP_SOFT_SPI_HALF_PERIOD(24768), ISP_SOFT_SPI_HALF_PERIOD(23461), ISP_SOFT_SPI_HALF_PERIOD(22285),
+      ISP_SOFT_SPI_HALF_PERIOD(21221), ISP_SOFT_SPI_HALF_PERIOD(20254), ISP_SOFT_SPI_HALF_PERIOD(19371),
+      ISP_SOFT_SPI_HALF_PERIOD(18562), ISP_SOFT_SPI_HALF_PERIOD(17583), ISP_SOFT_SPI_HALF_PERIOD(16914),
+      ISP_SOFT_SPI_HALF_PERIOD(16097), ISP_SOFT_SPI_HALF_PERIOD(15356), ISP_SOFT_SPI_HALF_PERIOD(14520),
+      ISP_SOFT_SPI_HALF_PERIOD(13914), ISP_SOFT_SPI_HALF_PERIOD(13224), ISP_SOFT_SPI_HALF_PERIOD(12599),
+      ISP_SOFT_SPI_HALF_PERIOD(12031), ISP_SOFT_SPI_HALF_PERIOD(11511), ISP_SOFT_SPI_HALF_PERIOD(10944),
+      ISP_SOFT_SPI_HALF_PERIOD(10431), ISP_SOFT_SPI_HALF_PERIOD(9963), ISP_SOFT_SPI_HALF_PERIOD(9468),
+      ISP_SOFT_SPI_HALF_PERIOD(9081), ISP_SOFT_SPI_HALF_PERIOD(8612), ISP_SOFT_SPI_HALF_PERIOD(8239),
+      ISP_SOFT_SPI_HALF_PERIOD(7851), ISP_SOFT_SPI_HALF_PERIOD(7498), ISP_SOFT_SPI_HALF_PERIOD(7137),
+      ISP_SOFT_SPI_HALF_PERIOD(6809), ISP_SOFT_SPI_HALF_PERIOD(6478), ISP_SOFT_SPI_HALF_PERIOD(6178),
+      ISP_SOFT_SPI_HALF_PERIOD(5879), ISP_SOFT_SPI_HALF_PERIOD(5607), ISP_SOFT_SPI_HALF_PERIOD(5359),
+      ISP_SOFT_SPI_HALF_PERIOD(5093), ISP_SOFT_SPI_HALF_PERIOD(4870), ISP_SOFT_SPI_HALF_PERIOD(4633),
+      ISP_SOFT_SPI_HALF_PERIOD(4418), ISP_SOFT_SPI_HALF_PERIOD(4209), ISP_SOFT_SPI_HALF_PERIOD(4019),
+      ISP_SOFT_SPI_HALF_PERIOD(3823), ISP_SOFT_SPI_HALF_PERIOD(3645), ISP_SOFT_SPI_HALF_PERIOD(3474),
+      ISP_SOFT_SPI_HALF_PERIOD(3310), ISP_SOFT_SPI_HALF_PERIOD(3161), ISP_SOFT_SPI_HALF_PERIOD(3011),
+      ISP_SOFT_SPI_HALF_PERIOD(2869), ISP_SOFT_SPI_HALF_PERIOD(2734), ISP_SOFT_SPI_HALF_PERIOD(2611),
+      ISP_SOFT_SPI_HALF_PERIOD(2484), ISP_SOFT_SPI_HALF_PERIOD(2369), ISP_SOFT_SPI_HALF_PERIOD(2257),
+      ISP_SOFT_SPI_HALF_PERIOD(2152), ISP_SOFT_SPI_HALF_PERIOD(2052), ISP_SOFT_SPI_HALF_PERIOD(1956),
+      ISP_SOFT_SPI_HALF_PERIOD(1866), ISP_SOFT_SPI_HALF_PERIOD(1779), ISP_SOFT_SPI_HALF_PERIOD(1695),
+      ISP_SOFT_SPI_HALF_PERIOD(1615), ISP_SOFT_SPI_HALF_PERIOD(1539), ISP_SOFT_SPI_HALF_PERIOD(1468),
+      ISP_SOFT_SPI_HALF_PERIOD(1398), ISP_SOFT_SPI_HALF_PERIOD(1333), ISP_SOFT_SPI_HALF_PERIOD(1271),
+      ISP_SOFT_SPI_HALF_PERIOD(1212), ISP_SOFT_SPI_HALF_PERIOD(1155), ISP_SOFT_SPI_HALF_PERIOD(1101),
+      ISP_SOFT_SPI_HALF_PERIOD(1049), ISP_SOFT_SPI_HALF_PERIOD(1000), ISP_SOFT_SPI_HALF_PERIOD(953),
+      ISP_SOFT_SPI_HALF_PERIOD(909), ISP_SOFT_SPI_HALF_PERIOD(866), ISP_SOFT_SPI_HALF_PERIOD(826),
+      ISP_SOFT_SPI_HALF_PERIOD(787), ISP_SOFT_SPI_HALF_PERIOD(750), ISP_SOFT_SPI_HALF_PERIOD(715),
+      ISP_SOFT_SPI_HALF_PERIOD(682), ISP_SOFT_SPI_HALF_PERIOD(650), ISP_SOFT_SPI_HALF_PERIOD(619),
+      ISP_SOFT_SPI_HALF_PERIOD(590), ISP_SOFT_SPI_HALF_PERIOD(563), ISP_SOFT_SPI_HALF_PERIOD(536),
+      ISP_SOFT_SPI_HALF_PERIOD(511), ISP_SOFT_SPI_HALF_PERIOD(487), ISP_SOFT_SPI_HALF_PERIOD(465),
+      ISP_SOFT_SPI_HALF_PERIOD(443), ISP_SOFT_SPI_HALF_PERIOD(422), ISP_SOFT_SPI_HALF_PERIOD(402),
+      ISP_SOFT_SPI_HALF_PERIOD(384), ISP_SOFT_SPI_HALF_PERIOD(366), ISP_SOFT_SPI_HALF_PERIOD(349),
+      ISP_SOFT_SPI_HALF_PERIOD(332), ISP_SOFT_SPI_HALF_PERIOD(317), ISP_SOFT_SPI_HALF_PERIOD(302),
+      ISP_SOFT_SPI_HALF_PERIOD(288), ISP_SOFT_SPI_HALF_PERIOD(274), ISP_SOFT_SPI_HALF_PERIOD(261),
+      ISP_SOFT_SPI_HALF_PERIOD(249), ISP_SOFT_SPI_HALF_PERIOD(238), ISP_SOFT_SPI_HALF_PERIOD(226),
+      ISP_SOFT_SPI_HALF_PERIOD(216), ISP_SOFT_SPI_HALF_PERIOD(206), ISP_SOFT_SPI_HALF_PERIOD(196),
+      ISP_SOFT_SPI_HALF_PERIOD(187), ISP_SOFT_SPI_HALF_PERIOD(178), ISP_SOFT_SPI_HALF_PERIOD(170),
+      ISP_SOFT_SPI_HALF_PERIOD(162), ISP_SOFT_SPI_HALF_PERIOD(154), ISP_SOFT_SPI_HALF_PERIOD(147),
+      ISP_SOFT_SPI_HALF_PERIOD(140), ISP_SOFT_SPI_HALF_PERIOD(134), ISP_SOFT_SPI_HALF_PERIOD(128),
+      ISP_SOFT_SPI_HALF_PERIOD(122), ISP_SOFT_SPI_HALF_PERIOD(116), ISP_SOFT_SPI_HALF_PERIOD(111),
+      ISP_SOFT_SPI_HALF_PERIOD(105), ISP_SOFT_SPI_HALF_PERIOD(100), ISP_SOFT_SPI_HALF_PERIOD(95.4),
+      ISP_SOFT_SPI_HALF_PERIOD(90.9), ISP_SOFT_SPI_HALF_PERIOD(86.6), ISP_SOFT_SPI_HALF_PERIOD(82.6),
+      ISP_SOFT_SPI_HALF_PERIOD(78.7), ISP_SOFT_SPI_HALF_PERIOD(75.0), ISP_SOFT_SPI_HALF_PERIOD(71.5),
+      ISP_SOFT_SPI_HALF_PERIOD(68.2), ISP_SOFT_SPI_HALF_PERIOD(65.0), ISP_SOFT_SPI_HALF_PERIOD(61.9),
+      ISP_SOFT_SPI_HALF_PERIOD(59.0), ISP_SOFT_SPI_HALF_PERIOD(56.3), ISP_SOFT_SPI_HALF_PERIOD(53.6),
+      ISP_SOFT_SPI_HALF_PERIOD(51.1) };
+
+/** Currently selected SPI driver, a value from \ref ISPTarget_SPIModes_t. Hardware or USART (for fast ISP speeds)
+ *  or software (for slower ISP speeds).
+ */
+uint8_t ISPTarget_SPIMode = ISP_SPI_MODE_HARDWARE;
+
+/** Number of bytes sent by the USART SPI driver whose received bytes have not been read back yet */
+static uint8_t ISPTarget_USARTSPI_Pending;
+
+/** Delay loop iterations of each half SCK period of the software SPI driver, on top of the loop's own work */
+static uint16_t ISPTarget_SoftSPI_Delay;
+
+/** Support of the Poll RDY/BSY instruction by the current target, a value from \ref ISPTarget_ReadyBusySupport_t */
+static uint8_t ISPTarget_ReadyBusySupport;
+
+/** Number of timed waits the current target read busy throughout, while its RDY/BSY support is unknown */
+static uint8_t ISPTarget_ReadyBusyTimeouts;
+
+/** Longest value polled completion time seen for each \ref ISPTarget_CompletionKinds_t kind of operation of the
+ *  current target, in timebase ticks, or zero if none was seen yet.
+ */
+static uint16_t ISPTarget_CompletionTicks[ISP_COMPLETION_KINDS];
+
+/** Computes the requested ISP SCK period. The vendor PARAM_ISP_SCK_PERIOD_LOW and PARAM_ISP_SCK_PERIOD_HIGH
+ *  parameters give it in 1/16us steps when set, otherwise it is taken from the AVRStudio SCK duration parameter,
+ *  or the PARAM_ISP_SCK_TUNED parameter once auto-tuning has found a speed for the target.
+ *
+ *  \return SCK period in CPU cycles, rounded up so that the requested speed is never exceeded
+ */
+static uint32_t
+ISPTarget_GetSCKPeriodCycles (void)
 {
-  /* Check if rising edge (output next bit) or falling edge (read in next bit) */
-  if (!(PINB & (1 << 1)))
+  uint16_t SCKPeriod = ((uint16_t) V2Params_GetParameterValue (PARAM_ISP_SCK_PERIOD_HIGH) << 8)
+      | V2Params_GetParameterValue (PARAM_ISP_SCK_PERIOD_LOW);
+
+  if (SCKPeriod)
     {
-      if (ISPTarget_SoftSPI_Data & (1 << 7))
-        PORTB |= (1 << 2);
-      else
-        PORTB &= ~(1 << 2);
+      return (((uint32_t) SCKPeriod * (F_CPU / 1000000) + (ISP_SCK_PERIOD_STEPS_PER_US - 1))
+          / ISP_SCK_PERIOD_STEPS_PER_US);
     }
-  else
-    {
-      ISPTarget_SoftSPI_Data <<= 1;
 
-      if (!(--ISPTarget_SoftSPI_BitsRemaining))
-        {
-          TCCR1B = 0;
-          TIFR1 = (1 << OCF1A);
-        }
+  /* A speed found by auto-tuning replaces the host's for the rest of the session */
+  uint8_t SCKDuration = V2Params_GetParameterValue (PARAM_ISP_SCK_TUNED);
 
-      if (PINB & (1 << 3))
-        ISPTarget_SoftSPI_Data |= (1 << 0);
-    }
+  if (SCKDuration == ISP_SCK_NOT_TUNED)
+    SCKDuration = V2Params_GetParameterValue (PARAM_SCK_DURATION);
+
+  /* The fast AVRStudio speeds halve from 8MHz with each step; F_CPU is a multiple of 8MHz, so these are exact */
+  if (SCKDuration < ISP_HARDWARE_SCK_DURATIONS)
+    return ((F_CPU / 8000000UL) << SCKDuration);
 
-  /* Fast toggle of PORTB.1 via the PIN register (see datasheet) */
-  PINB |= (1 << 1);
+  uint8_t TableIndex = MIN (SCKDuration - ISP_HARDWARE_SCK_DURATIONS,
+                            (sizeof(SoftSPIHalfPeriodFromSCKDuration) / sizeof(SoftSPIHalfPeriodFromSCKDuration[0])) - 1);
+
+  return ((uint32_t) pgm_read_word (&SoftSPIHalfPeriodFromSCKDuration[TableIndex]) * 2 * ISP_SOFT_SPI_LOOP_CYCLES);
 }
 
-/** Initializes the appropriate SPI driver (hardware or software, depending on the selected ISP speed) ready for
- *  communication with the attached target.
+/** Initializes the appropriate SPI driver (hardware, USART or software, depending on the selected ISP speed) ready
+ *  for communication with the attached target. The driver giving the fastest SCK clock not above the requested
+ *  speed is chosen, the hardware SPI module being preferred to the software driver unless the software driver's
+ *  actual period is the shorter one.
+ *
+ *  May be called again while the target is in programming mode to change the ISP speed, in which case the ISP
+ *  lines stay driven so that the target sees no stray SCK edges.
  */
 void
 ISPTarget_EnableTargetISP (void)
 {
-  uint8_t SCKDuration = V2Params_GetParameterValue (PARAM_SCK_DURATION);
+  uint32_t PeriodCycles = ISPTarget_GetSCKPeriodCycles ();
 
-  if (SCKDuration < sizeof(SPIMaskFromSCKDuration))
+  /* Find the fastest hardware SPI prescaler that does not exceed the requested speed */
+  uint8_t Prescaler = 0;
+  while ((Prescaler < (sizeof(SPIMaskFromPrescaler) - 1))
+      && ((2UL << Prescaler) < PeriodCycles))
+    Prescaler++;
+
+  uint32_t HardwarePeriodCycles = (2UL << Prescaler);
+  uint32_t SoftwarePeriodCycles = ISP_SOFT_SPI_PERIOD_CYCLES(ISPTarget_GetSoftSPIDelay (PeriodCycles));
+
+  if (V2Params_GetParameterValue (PARAM_ISP_USART_SPI)
+      && (PeriodCycles <= ISP_USART_SPI_MAX_PERIOD_CYCLES))
+    {
+      ISPTarget_SPIMode = ISP_SPI_MODE_USART;
+
+      ISPTarget_ConfigureUSARTSPI (PeriodCycles);
+    }
+  else if ((HardwarePeriodCycles >= PeriodCycles)
+      && (HardwarePeriodCycles <= SoftwarePeriodCycles))
     {
-      ISPTarget_HardwareSPIMode = true;
+      ISPTarget_SPIMode = ISP_SPI_MODE_HARDWARE;
 
       SPI_Init (
-          pgm_read_byte( &SPIMaskFromSCKDuration[SCKDuration])
+          pgm_read_byte( &SPIMaskFromPrescaler[Prescaler])
             | SPI_ORDER_MSB_FIRST | SPI_SCK_LEAD_RISING
             | SPI_SAMPLE_LEADING | SPI_MODE_MASTER);
     }
   else
     {
-      ISPTarget_HardwareSPIMode = false;
+      ISPTarget_SPIMode = ISP_SPI_MODE_SOFTWARE;
 
+      /* Hand the ISP lines over from the SPI module, should it still be enabled at a previous speed */
+      SPCR = 0;
       DDRB |= ((1 << 1) | (1 << 2));
       PORTB |= ((1 << 0) | (1 << 3));
+      PORTB &= ~(1 << 1);
 
-      ISPTarget_ConfigureSoftwareSPI (SCKDuration);
+      ISPTarget_ConfigureSoftwareSPI (PeriodCycles);
     }
 }
 
@@ -195,18 +228,26 @@ ISPTarget_EnableTargetISP (void)
 void
 ISPTarget_DisableTargetISP (void)
 {
-  if (ISPTarget_HardwareSPIMode)
+  if (ISPTarget_SPIMode == ISP_SPI_MODE_HARDWARE)
     {
       SPI_Disable ();
     }
+  else if (ISPTarget_SPIMode == ISP_SPI_MODE_USART)
+    {
+      /* Let the queued bytes finish shifting out before the USART is turned off */
+      ISPTarget_FlushUSARTSPI ();
+
+      UCSR1B = 0;
+      UCSR1C = 0;
+
+      /* Tristate all pins */
+      DDRD &= ~((1 << 5) | (1 << 3));
+      PORTD &= ~((1 << 5) | (1 << 3) | (1 << 2));
+    }
   else
     {
       DDRB &= ~((1 << 1) | (1 << 2));
       PORTB &= ~((1 << 0) | (1 << 3));
-
-      /* Must re-enable rescue clock once software ISP has exited, as the timer for the rescue clock is
-       * re-purposed for software SPI */
-      ISPTarget_ConfigureRescueClock ();
     }
 }
 
@@ -229,23 +270,109 @@ ISPTarget_ConfigureRescueClock (void)
   TCCR0B = (1 << CS00);
 }
 
-/** Configures the AVR's timer ready to produce software SPI for the slower ISP speeds that
- *  cannot be obtained when using the AVR's hardware SPI module.
+/** Works out the delay loop count of the software SPI driver for a requested SCK period. Both halves of the period
+ *  come out at least half the requested period long, as the target only requires minimum SCK high and low times;
+ *  the low half holds more of the bit loop's work, so it is the high half that sets the count.
  *
- *  \param[in] SCKDuration  Duration of the desired software ISP SCK clock
+ *  \param[in] PeriodCycles  Requested SCK period, in CPU cycles
+ *
+ *  \return Delay loop count for each half SCK period, at least one
+ */
+static uint16_t
+ISPTarget_GetSoftSPIDelay (const uint32_t PeriodCycles)
+{
+  uint32_t HalfPeriodCycles = ((PeriodCycles + 1) / 2);
+  uint32_t Delay = 1;
+
+  if (HalfPeriodCycles > (ISP_SOFT_SPI_HIGH_OVERHEAD_CYCLES + ISP_SOFT_SPI_LOOP_CYCLES))
+    {
+      Delay = ((HalfPeriodCycles - ISP_SOFT_SPI_HIGH_OVERHEAD_CYCLES
+          + (ISP_SOFT_SPI_LOOP_CYCLES - 1)) / ISP_SOFT_SPI_LOOP_CYCLES);
+    }
+
+  return MIN (Delay, UINT16_MAX);
+}
+
+/** Configures the software SPI driver for the slower ISP speeds, and those between the hardware SPI prescalers.
+ *  SCK is generated by bit-banging the ISP header pins, with each half period timed by a delay loop whose
+ *  iteration count is worked out by \ref ISPTarget_GetSoftSPIDelay.
+ *
+ *  \param[in] PeriodCycles  Requested SCK period, in CPU cycles
  */
 void
-ISPTarget_ConfigureSoftwareSPI (const uint8_t SCKDuration)
+ISPTarget_ConfigureSoftwareSPI (const uint32_t PeriodCycles)
 {
-  /* Configure Timer 1 for software SPI using the specified SCK duration */
-  TIMSK1 = (1 << OCIE1A);
-  TCNT1 = 0;
-  OCR1A =
-      pgm_read_word(
-          &TimerCompareFromSCKDuration[SCKDuration
-              - sizeof(SPIMaskFromSCKDuration)]);
-  TCCR1A = 0;
-  TCCR1B = 0;
+  ISPTarget_SoftSPI_Delay = ISPTarget_GetSoftSPIDelay (PeriodCycles);
+}
+
+/** Shifts a single byte out to and in from the attached target via software SPI, MSB first. MOSI is set up while
+ *  SCK is low and MISO is read at the end of the high half, just before the falling edge on which the target
+ *  changes it. Interrupts may stretch either half, which the target tolerates.
+ *
+ *  The bit loop is written in assembly so that its cycle count is fixed: each delay loop of \c Delay iterations takes
+ *  exactly \ref ISP_SOFT_SPI_LOOP_CYCLES * \c Delay cycles including its set up, the high half adds
+ *  \ref ISP_SOFT_SPI_HIGH_OVERHEAD_CYCLES and the low half \ref ISP_SOFT_SPI_LOW_OVERHEAD_CYCLES, whichever value
+ *  MOSI takes. The host build, which has no AVR core to run it, uses an equivalent C loop.
+ *
+ *  \param[in] Byte  Byte of data to send to the attached target
+ *
+ *  \return Received byte of data from the attached target
+ */
+static uint8_t
+ISPTarget_ShiftSoftSPIByte (uint8_t Byte)
+{
+  uint16_t Delay = ISPTarget_SoftSPI_Delay;
+
+#if defined(__AVR__)
+  uint8_t BitsRemaining = 8;
+  uint16_t DelayCount;
+
+  __asm__ __volatile__ (
+      "1:  sbrc %[byte], 7           \n" // 5 cycles to set MOSI either way
+      "    sbi  %[port], %[mosi]     \n"
+      "    sbrs %[byte], 7           \n"
+      "    cbi  %[port], %[mosi]     \n"
+      "    movw %A[count], %A[delay] \n" // 4 * Delay cycles of SCK low
+      "2:  sbiw %A[count], 1         \n"
+      "    brne 2b                   \n"
+      "    out  %[pin], %[sck]       \n" // SCK high
+      "    lsl  %[byte]              \n"
+      "    movw %A[count], %A[delay] \n" // 4 * Delay cycles of SCK high
+      "3:  sbiw %A[count], 1         \n"
+      "    brne 3b                   \n"
+      "    sbic %[pin], %[miso]      \n" // 2 cycles to sample MISO either way
+      "    ori  %[byte], 0x01        \n"
+      "    dec  %[bits]              \n"
+      "    out  %[pin], %[sck]       \n" // SCK low
+      "    brne 1b                   \n"
+      : [byte] "+d" (Byte), [bits] "+r" (BitsRemaining), [count] "=&w" (DelayCount)
+      : [delay] "r" (Delay), [sck] "r" ((uint8_t) (1 << 1)),
+        [port] "I" (_SFR_IO_ADDR(PORTB)), [pin] "I" (_SFR_IO_ADDR(PINB)),
+        [mosi] "I" (2), [miso] "I" (3));
+#else
+  for (uint8_t BitsRemaining = 8; BitsRemaining; BitsRemaining--)
+    {
+      if (Byte & (1 << 7))
+        PORTB |= (1 << 2);
+      else
+        PORTB &= ~(1 << 2);
+
+      _delay_loop_2 (Delay);
+
+      /* Fast toggle of PORTB.1 via the PIN register (see datasheet) */
+      PINB = (1 << 1);
+      Byte <<= 1;
+
+      _delay_loop_2 (Delay);
+
+      if (PINB & (1 << 3))
+        Byte |= (1 << 0);
+
+      PINB = (1 << 1);
+    }
+#endif
+
+  return Byte;
 }
 
 /** Sends and receives a single byte of data to and from the attached target via software SPI.
@@ -257,22 +384,130 @@ ISPTarget_ConfigureSoftwareSPI (const uint8_t SCKDuration)
 uint8_t
 ISPTarget_TransferSoftSPIByte (const uint8_t Byte)
 {
-  ISPTarget_SoftSPI_Data = Byte;
-  ISPTarget_SoftSPI_BitsRemaining = 8;
+  return ISPTarget_ShiftSoftSPIByte (Byte);
+}
 
-  /* Set initial MOSI pin state according to the byte to be transferred */
-  if (ISPTarget_SoftSPI_Data & (1 << 7))
-    PORTB |= (1 << 2);
-  else
-    PORTB &= ~(1 << 2);
+/** Sends a block of data to the attached target via software SPI, discarding the received bytes.
+ *
+ *  \param[in] Data    Block of data to send to the attached target
+ *  \param[in] Length  Length of the block in bytes
+ */
+void
+ISPTarget_SendSoftSPIBytes (const uint8_t* Data, uint8_t Length)
+{
+  while (Length--)
+    ISPTarget_ShiftSoftSPIByte (*(Data++));
+}
 
-  TCNT1 = 0;
-  TCCR1B = ((1 << WGM12) | (1 << CS11));
-  while (ISPTarget_SoftSPI_BitsRemaining && TimeoutTicksRemaining)
+/** Exchanges a block of data with the attached target via software SPI, replacing each sent byte with the byte
+ *  received for it.
+ *
+ *  \param[in,out] Buffer  Block of data to send to the attached target, overwritten with the received data
+ *  \param[in]     Length  Length of the block in bytes
+ */
+void
+ISPTarget_TransferSoftSPIBytes (uint8_t* Buffer, uint8_t Length)
+{
+  while (Length--)
+    {
+      *Buffer = ISPTarget_ShiftSoftSPIByte (*Buffer);
+      Buffer++;
+    }
+}
+
+/** Configures USART1 as a Master SPI for the ISP protocol, on the XCK (SCK), TXD (MOSI) and RXD (MISO) pins of
+ *  the PDI header. Unlike the SPI module its transmitter is double buffered, so that the next byte is queued while
+ *  the current one is shifting and consecutive bytes go out without a gap on the bus.
+ *
+ *  \param[in] PeriodCycles  Requested SCK period in CPU cycles, up to \ref ISP_USART_SPI_MAX_PERIOD_CYCLES
+ */
+void
+ISPTarget_ConfigureUSARTSPI (const uint32_t PeriodCycles)
+{
+  /* Let the bytes queued at a previous speed finish shifting out before the baud rate changes */
+  if (UCSR1B)
+    ISPTarget_FlushUSARTSPI ();
+
+  ISPTarget_USARTSPI_Pending = 0;
+
+  /* Set XCK and TXD as outputs, RXD as input with pull-up */
+  DDRD |= (1 << 5) | (1 << 3);
+  DDRD &= ~(1 << 2);
+  PORTD |= (1 << 2);
+
+  /* The baud rate must be zero when the transmitter is enabled, and set afterwards (see datasheet) */
+  UBRR1 = 0;
+  UCSR1C = (1 << UMSEL11) | (1 << UMSEL10);
+  UCSR1B = (1 << RXEN1) | (1 << TXEN1);
+  /* The SCK period is 2 * (UBRR + 1) CPU cycles, rounded up to the next even count */
+  UBRR1 = (PeriodCycles > 2) ? (((PeriodCycles + 1) / 2) - 1) : 0;
+}
+
+/** Reads back and discards the bytes received for every byte sent by the USART SPI driver, which returns once all
+ *  of them have been shifted out.
+ */
+static void
+ISPTarget_FlushUSARTSPI (void)
+{
+  while (ISPTarget_USARTSPI_Pending)
+    {
+      while (!(UCSR1A & (1 << RXC1)))
+        ;
+
+      (void) UDR1;
+      ISPTarget_USARTSPI_Pending--;
+    }
+}
+
+/** Queues a byte of data to the attached target via the USART SPI driver, without waiting for it to be sent.
+ *
+ *  \param[in] Byte  Byte of data to send to the attached target
+ */
+void
+ISPTarget_SendUSARTSPIByte (const uint8_t Byte)
+{
+  /* The receive FIFO holds only two bytes, so the bytes received for the earlier sends are read back while waiting
+   * for the transmit buffer, before they can overrun it */
+  for (;;)
+    {
+      uint8_t Status = UCSR1A;
+
+      if (Status & (1 << RXC1))
+        {
+          (void) UDR1;
+          ISPTarget_USARTSPI_Pending--;
+        }
+      else if (Status & (1 << UDRE1))
+        {
+          break;
+        }
+    }
+
+  UDR1 = Byte;
+  ISPTarget_USARTSPI_Pending++;
+}
+
+/** Sends and receives a single byte of data to and from the attached target via the USART SPI driver, once the
+ *  bytes queued before it have been sent.
+ *
+ *  \param[in] Byte  Byte of data to send to the attached target
+ *
+ *  \return Received byte of data from the attached target
+ */
+uint8_t
+ISPTarget_TransferUSARTSPIByte (const uint8_t Byte)
+{
+  ISPTarget_FlushUSARTSPI ();
+
+  while (!(UCSR1A & (1 << UDRE1)))
     ;
-  TCCR1B = 0;
 
-  return ISPTarget_SoftSPI_Data;
+  UDR1 = Byte;
+
+  while (!(UCSR1A & (1 << RXC1)))
+    ;
+
+  return UDR1;
 }
 
 /** Asserts or deasserts the target's reset line, using the correct polarity as set by the host using a SET PARAM command.
@@ -313,13 +548,30 @@ ISPTarget_WaitWhileTargetBusy (void)
 {
   do
     {
-      ISPTarget_SendByte (0xF0);
-      ISPTarget_SendByte (0x00);
-      ISPTarget_SendByte (0x00);
+      V2Protocol_Yield ();
     }
-  while ((ISPTarget_ReceiveByte () & 0x01) && TimeoutTicksRemaining);
+  while (ISPTarget_IsTargetBusy () && TimeoutTicksRemaining);
+
+  if (!(TimeoutTicksRemaining))
+    return STATUS_RDY_BSY_TOUT;
+
+  /* The host only asks for RDY/BSY polling on targets that implement it */
+  ISPTarget_ReadyBusySupport = ISP_READYBUSY_SUPPORTED;
+  return STATUS_CMD_OK;
+}
+
+/** Sends a Poll RDY/BSY instruction to the target.
+ *
+ *  \return Boolean \c true if the target reported itself busy
+ */
+static bool
+ISPTarget_IsTargetBusy (void)
+{
+  ISPTarget_SendByte (0xF0);
+  ISPTarget_SendByte (0x00);
+  ISPTarget_SendByte (0x00);
 
-  return (TimeoutTicksRemaining > 0) ? STATUS_CMD_OK : STATUS_RDY_BSY_TOUT;
+  return (ISPTarget_ReceiveByte () & 0x01);
 }
 
 /** Sends a low-level LOAD EXTENDED ADDRESS command to the target, for addressing of memory beyond the
@@ -335,6 +587,96 @@ ISPTarget_LoadExtendedAddress (void)
   ISPTarget_SendByte (0x00);
 }
 
+/** Forgets what was learned of the completion of the previous target's operations, for a new programming session. */
+void
+ISPTarget_ResetCompletionTiming (void)
+{
+  ISPTarget_ReadyBusySupport = ISP_READYBUSY_UNKNOWN;
+  ISPTarget_ReadyBusyTimeouts = 0;
+  memset (ISPTarget_CompletionTicks, 0x00, sizeof(ISPTarget_CompletionTicks));
+}
+
+/** Waits for a target operation which the host asked to be timed with a fixed delay. With the vendor
+ *  PARAM_ISP_ADAPTIVE_WAIT parameter set, the target is polled with the Poll RDY/BSY instruction instead, falling
+ *  back to the longest completion time learned from value polled operations of the same kind on targets which do
+ *  not implement it. The host's delay is never exceeded.
+ *
+ *  \param[in] Kind      Kind of operation waited for, a value from \ref ISPTarget_CompletionKinds_t
+ *  \param[in] IssuedAt  Time at which the operation was issued to the target
+ *  \param[in] DelayMS   Milliseconds the host asked to wait for after the operation was issued
+ */
+void
+ISPTarget_WaitForDelay (const uint8_t Kind, const Timebase_Time_t IssuedAt,
+                        const uint8_t DelayMS)
+{
+  Timebase_Time_t DelayEnd = IssuedAt + TIMEBASE_MS(DelayMS);
+
+  if (V2Params_GetParameterValue (PARAM_ISP_ADAPTIVE_WAIT))
+    {
+      /* A target without the instruction may shift out anything, so a ready reading is only trusted once the
+       * target has been seen busy, and a target which keeps reading busy until the host's delay has passed is
+       * eventually no longer polled; a single such wait may just be a delay as short as the operation */
+      if (ISPTarget_ReadyBusySupport != ISP_READYBUSY_UNSUPPORTED)
+        {
+          bool SeenBusy = (ISPTarget_ReadyBusySupport == ISP_READYBUSY_SUPPORTED);
+
+          while (!(Timebase_HasExpired (DelayEnd)) && TimeoutTicksRemaining)
+            {
+              V2Protocol_Yield ();
+
+              if (ISPTarget_IsTargetBusy ())
+                {
+                  SeenBusy = true;
+                }
+              else if (SeenBusy)
+                {
+                  ISPTarget_ReadyBusySupport = ISP_READYBUSY_SUPPORTED;
+                  return;
+                }
+              else
+                {
+                  break;
+                }
+            }
+
+          if (Timebase_HasExpired (DelayEnd))
+            {
+              if ((ISPTarget_ReadyBusySupport == ISP_READYBUSY_UNKNOWN)
+                  && (++ISPTarget_ReadyBusyTimeouts == ISP_READYBUSY_MAX_TIMEOUTS))
+                ISPTarget_ReadyBusySupport = ISP_READYBUSY_UNSUPPORTED;
+
+              return;
+            }
+        }
+
+      Timebase_Time_t LearnedTicks = ISPTarget_CompletionTicks[Kind];
+      LearnedTicks += (LearnedTicks >> ISP_COMPLETION_MARGIN_SHIFT);
+
+      if (LearnedTicks && (LearnedTicks < TIMEBASE_MS(DelayMS)))
+        DelayEnd = IssuedAt + LearnedTicks;
+    }
+
+  while (!(Timebase_HasExpired (DelayEnd)) && TimeoutTicksRemaining)
+    V2Protocol_Yield ();
+}
+
+/** Records the completion time of a value polled operation of the target, if it is the longest of its kind yet.
+ *
+ *  \param[in] Kind      Kind of operation completed, a value from \ref ISPTarget_CompletionKinds_t
+ *  \param[in] IssuedAt  Time at which the operation was issued to the target
+ */
+static void
+ISPTarget_LearnCompletionTime (const uint8_t Kind, const Timebase_Time_t IssuedAt)
+{
+  Timebase_Time_t ElapsedTicks = Timebase_Now () - IssuedAt;
+
+  if (ElapsedTicks > UINT16_MAX)
+    ElapsedTicks = UINT16_MAX;
+
+  if (ElapsedTicks > ISPTarget_CompletionTicks[Kind])
+    ISPTarget_CompletionTicks[Kind] = ElapsedTicks;
+}
+
 /** Waits until the last issued target memory programming command has completed, via the check mode given and using
  *  the given parameters.
  *
@@ -343,6 +685,7 @@ ISPTarget_LoadExtendedAddress (void)
  *  \param[in] PollValue        Poll value to check against if polling check mode used
  *  \param[in] DelayMS          Milliseconds to delay before returning if delay check mode used
  *  \param[in] ReadMemCommand   Device low-level READ MEMORY command to send if value check mode used
+ *  \param[in] IssuedAt         Time at which the programming command was issued to the target
  *
  *  \return V2 Protocol status \ref STATUS_CMD_OK if the no timeout occurred, \ref STATUS_RDY_BSY_TOUT or
  *          \ref STATUS_CMD_TOUT otherwise
@@ -351,9 +694,14 @@ uint8_t
 ISPTarget_WaitForProgComplete (const uint8_t ProgrammingMode,
                                const uint16_t PollAddress,
                                const uint8_t PollValue, const uint8_t DelayMS,
-                               const uint8_t ReadMemCommand)
+                               const uint8_t ReadMemCommand,
+                               const Timebase_Time_t IssuedAt)
 {
   uint8_t ProgrammingStatus = STATUS_CMD_OK;
+  uint8_t Kind = ((ReadMemCommand & ISP_READ_EEPROM_MASK) ?
+      ISP_COMPLETION_EEPROM_WORD : ISP_COMPLETION_FLASH_WORD)
+      + ((ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK) ? 1 : 0);
+  uint8_t PreviousPhase = Profiler_EnterPhase (PROFILER_PHASE_POLL);
 
   /* Determine method of Programming Complete check */
   switch (ProgrammingMode
@@ -361,12 +709,14 @@ ISPTarget_WaitForProgComplete (const uint8_t ProgrammingMode,
     {
     case PROG_MODE_WORD_TIMEDELAY_MASK:
     case PROG_MODE_PAGED_TIMEDELAY_MASK:
-      ISPProtocol_DelayMS (DelayMS);
+      ISPTarget_WaitForDelay (Kind, IssuedAt, DelayMS);
       break;
     case PROG_MODE_WORD_VALUE_MASK:
     case PROG_MODE_PAGED_VALUE_MASK:
       do
         {
+          V2Protocol_Yield ();
+
           ISPTarget_SendByte (ReadMemCommand);
           ISPTarget_SendByte (PollAddress >> 8);
           ISPTarget_SendByte (PollAddress & 0xFF);
@@ -376,6 +726,8 @@ ISPTarget_WaitForProgComplete (const uint8_t ProgrammingMode,
 
       if (!(TimeoutTicksRemaining))
         ProgrammingStatus = STATUS_CMD_TOUT;
+      else if (V2Params_GetParameterValue (PARAM_ISP_ADAPTIVE_WAIT))
+        ISPTarget_LearnCompletionTime (Kind, IssuedAt);
 
       break;
     case PROG_MODE_WORD_READYBUSY_MASK:
@@ -387,6 +739,7 @@ ISPTarget_WaitForProgComplete (const uint8_t ProgrammingMode,
   /* Program complete - reset timeout */
   TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
 
+  Profiler_EnterPhase (PreviousPhase);
   return ProgrammingStatus;
 }
 
@@ -40,6 +40,7 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <util/delay.h>
+#include <util/delay_basic.h>
 
 #include <LUFA/Drivers/USB/USB.h>
 #include <LUFA/Drivers/Peripheral/SPI.h>
@@ -61,14 +62,82 @@
 /** Low level device command to issue an extended FLASH address, for devices with over 128KB of FLASH. */
 #define LOAD_EXTENDED_ADDRESS_CMD     0x4D
 
-/** Macro to convert an ISP frequency to a number of timer clock cycles for the software SPI driver. */
-#define ISP_TIMER_COMP(freq)          (((F_CPU / 8) / 2 / freq) - 1)
+/** CPU cycles taken by each iteration of the software SPI driver's delay loop. */
+#define ISP_SOFT_SPI_LOOP_CYCLES      4
+
+/** CPU cycles of the software SPI driver's SCK high half outside its delay loop: shift, sample MISO, count the bit
+ *  and toggle SCK.
+ */
+#define ISP_SOFT_SPI_HIGH_OVERHEAD_CYCLES  5
+
+/** CPU cycles of the software SPI driver's SCK low half outside its delay loop: loop back, set MOSI and toggle SCK. */
+#define ISP_SOFT_SPI_LOW_OVERHEAD_CYCLES   8
+
+/** Macro giving the SCK period produced by the software SPI driver for a delay loop count, in CPU cycles. */
+#define ISP_SOFT_SPI_PERIOD_CYCLES(delay)  ((2UL * ISP_SOFT_SPI_LOOP_CYCLES * (delay)) \
+                                             + ISP_SOFT_SPI_HIGH_OVERHEAD_CYCLES + ISP_SOFT_SPI_LOW_OVERHEAD_CYCLES)
+
+/** Macro to convert an ISP frequency to a half SCK period for the software SPI driver, in units of
+ *  \ref ISP_SOFT_SPI_LOOP_CYCLES CPU cycles, rounded up so that the given frequency is never exceeded.
+ */
+#define ISP_SOFT_SPI_HALF_PERIOD(freq)  ((uint16_t)((F_CPU / 2 / ISP_SOFT_SPI_LOOP_CYCLES) / (freq)) + 1)
+
+/** Number of AVRStudio SCK duration values for the hardware SPI speeds, 8MHz down to 125KHz. */
+#define ISP_HARDWARE_SCK_DURATIONS    7
+
+/** Steps per microsecond of the SCK period given by the vendor PARAM_ISP_SCK_PERIOD_* parameters. */
+#define ISP_SCK_PERIOD_STEPS_PER_US   16
+
+/** Longest SCK period the USART SPI driver can produce, in CPU cycles, from its 12-bit baud rate register. */
+#define ISP_USART_SPI_MAX_PERIOD_CYCLES  (2UL * 4096)
 
 /** ISP rescue clock speed in Hz, for clocking targets with incorrectly set fuses. */
 #define ISP_RESCUE_CLOCK_SPEED        4000000
 
+/** CPU cycles between writing SPDR and reading the received byte back at an F_CPU / 2 SCK: 16 cycles of shifting,
+ *  plus one for the transfer to start after the write.
+ */
+#define ISP_TIMED_SPI_BYTE_CYCLES     17
+
+/** Right shift giving the safety margin added to a learned completion time, a quarter of it. */
+#define ISP_COMPLETION_MARGIN_SHIFT   2
+
+/** Mask of the bit set in the EEPROM read instruction (0xA0) and clear in the flash ones (0x20, 0x28). */
+#define ISP_READ_EEPROM_MASK          0x80
+
+/** Number of timed waits a target of unknown RDY/BSY support may read busy throughout before it is no longer polled. */
+#define ISP_READYBUSY_MAX_TIMEOUTS    3
+
+/* Enums: */
+/** Enum for the SPI drivers which can carry the ISP protocol, selected when the target is enabled. */
+enum ISPTarget_SPIModes_t
+{
+  ISP_SPI_MODE_HARDWARE = 0, /**< Hardware SPI module on the ISP header, for the fast ISP speeds */
+  ISP_SPI_MODE_SOFTWARE = 1, /**< Bit-banged software SPI on the ISP header, for the slow ISP speeds */
+  ISP_SPI_MODE_USART = 2, /**< USART1 in Master SPI mode on the PDI header pins, for the fast ISP speeds */
+};
+
+/** Enum for the kinds of target operation whose completion times are learned separately. */
+enum ISPTarget_CompletionKinds_t
+{
+  ISP_COMPLETION_FLASH_WORD = 0, /**< Flash byte or word written in word programming mode */
+  ISP_COMPLETION_FLASH_PAGE = 1, /**< Flash page committed in page programming mode */
+  ISP_COMPLETION_EEPROM_WORD = 2, /**< EEPROM byte written in word programming mode */
+  ISP_COMPLETION_EEPROM_PAGE = 3, /**< EEPROM page committed in page programming mode */
+  ISP_COMPLETION_CHIP_ERASE = 4, /**< Chip erase */
+  ISP_COMPLETION_KINDS = 5, /**< Number of operation kinds */
+};
+
+/** Enum for what is known of the target's support of the Poll RDY/BSY instruction. */
+enum ISPTarget_ReadyBusySupport_t
+{
+  ISP_READYBUSY_UNKNOWN = 0, /**< Target not yet seen busy, so a ready reading may be an unknown instruction's echo */
+  ISP_READYBUSY_SUPPORTED = 1, /**< Target seen busy then ready, or the host polls it itself */
+  ISP_READYBUSY_UNSUPPORTED = 2, /**< Target read busy throughout several of the host's delays */
+};
+
 /* External Variables: */
-extern bool ISPTarget_HardwareSPIMode;
+extern uint8_t ISPTarget_SPIMode;
 
 /* Function Prototypes: */
 void
@@ -78,20 +147,45 @@ ISPTarget_DisableTargetISP (void);
 void
 ISPTarget_ConfigureRescueClock (void);
 void
-ISPTarget_ConfigureSoftwareSPI (const uint8_t SCKDuration);
+ISPTarget_ConfigureSoftwareSPI (const uint32_t PeriodCycles);
 uint8_t
 ISPTarget_TransferSoftSPIByte (const uint8_t Byte);
 void
+ISPTarget_SendSoftSPIBytes (const uint8_t* Data, uint8_t Length);
+void
+ISPTarget_TransferSoftSPIBytes (uint8_t* Buffer, uint8_t Length);
+void
+ISPTarget_ConfigureUSARTSPI (const uint32_t PeriodCycles);
+void
+ISPTarget_SendUSARTSPIByte (const uint8_t Byte);
+uint8_t
+ISPTarget_TransferUSARTSPIByte (const uint8_t Byte);
+void
 ISPTarget_ChangeTargetResetLine (const bool ResetTarget);
 uint8_t
 ISPTarget_WaitWhileTargetBusy (void);
 void
 ISPTarget_LoadExtendedAddress (void);
+void
+ISPTarget_ResetCompletionTiming (void);
+void
+ISPTarget_WaitForDelay (const uint8_t Kind, const Timebase_Time_t IssuedAt,
+                        const uint8_t DelayMS);
 uint8_t
 ISPTarget_WaitForProgComplete (const uint8_t ProgrammingMode,
                                const uint16_t PollAddress,
                                const uint8_t PollValue, const uint8_t DelayMS,
-                               const uint8_t ReadMemCommand);
+                               const uint8_t ReadMemCommand,
+                               const Timebase_Time_t IssuedAt);
+
+#if defined(INCLUDE_FROM_ISPTARGET_C)
+static uint32_t ISPTarget_GetSCKPeriodCycles(void);
+static uint16_t ISPTarget_GetSoftSPIDelay(const uint32_t PeriodCycles);
+static uint8_t ISPTarget_ShiftSoftSPIByte(uint8_t Byte);
+static void ISPTarget_FlushUSARTSPI(void);
+static bool ISPTarget_IsTargetBusy(void);
+static void ISPTarget_LearnCompletionTime(const uint8_t Kind, const Timebase_Time_t IssuedAt);
+#endif
 
 /* Inline Functions: */
 /** Sends a byte of ISP data to the attached target, using the appropriate SPI hardware or
@@ -102,12 +196,34 @@ ISPTarget_WaitForProgComplete (const uint8_t ProgrammingMode,
 static inline void
 ISPTarget_SendByte (const uint8_t Byte)
 {
-  if (ISPTarget_HardwareSPIMode)
+  if (ISPTarget_SPIMode == ISP_SPI_MODE_HARDWARE)
     SPI_SendByte (Byte);
+  else if (ISPTarget_SPIMode == ISP_SPI_MODE_USART)
+    ISPTarget_SendUSARTSPIByte (Byte);
   else
     ISPTarget_TransferSoftSPIByte (Byte);
 }
 
+/** Sends a block of ISP data to the attached target, using the appropriate SPI hardware or software routines
+ *  depending on the selected ISP speed. The software SPI driver sends the whole block in one call.
+ *
+ *  \param[in] Data    Block of data to send to the attached target
+ *  \param[in] Length  Length of the block in bytes
+ */
+static inline void
+ISPTarget_SendBytes (const uint8_t* Data, uint8_t Length)
+{
+  if (ISPTarget_SPIMode == ISP_SPI_MODE_SOFTWARE)
+    {
+      ISPTarget_SendSoftSPIBytes (Data, Length);
+    }
+  else
+    {
+      while (Length--)
+        ISPTarget_SendByte (*(Data++));
+    }
+}
+
 /** Receives a byte of ISP data from the attached target, using the appropriate
  *  SPI hardware or software routines depending on the selected ISP speed.
  *
@@ -118,8 +234,10 @@ ISPTarget_ReceiveByte (void)
 {
   uint8_t ReceivedByte;
 
-  if (ISPTarget_HardwareSPIMode)
+  if (ISPTarget_SPIMode == ISP_SPI_MODE_HARDWARE)
     ReceivedByte = SPI_ReceiveByte ();
+  else if (ISPTarget_SPIMode == ISP_SPI_MODE_USART)
+    ReceivedByte = ISPTarget_TransferUSARTSPIByte (0x00);
   else
     ReceivedByte = ISPTarget_TransferSoftSPIByte (0x00);
 
@@ -142,8 +260,10 @@ ISPTarget_TransferByte (const uint8_t Byte)
 {
   uint8_t ReceivedByte;
 
-  if (ISPTarget_HardwareSPIMode)
+  if (ISPTarget_SPIMode == ISP_SPI_MODE_HARDWARE)
     ReceivedByte = SPI_TransferByte (Byte);
+  else if (ISPTarget_SPIMode == ISP_SPI_MODE_USART)
+    ReceivedByte = ISPTarget_TransferUSARTSPIByte (Byte);
   else
     ReceivedByte = ISPTarget_TransferSoftSPIByte (Byte);
 
@@ -154,5 +274,42 @@ ISPTarget_TransferByte (const uint8_t Byte)
 #endif
 }
 
+/** Indicates if the hardware SPI driver is selected and runs at F_CPU / 2, where the byte time is short enough for
+ *  \ref ISPTarget_TransferTimedSPIByte() to wait it out in a fixed number of cycles.
+ *
+ *  \return Boolean \c true if the timed transfer routine can be used
+ */
+static inline bool
+ISPTarget_IsTimedSPIMode (void)
+{
+  return ((ISPTarget_SPIMode == ISP_SPI_MODE_HARDWARE)
+      && (SPSR & (1 << SPI2X)) && !(SPCR & ((1 << SPR1) | (1 << SPR0))));
+}
+
+/** Sends and receives a byte of ISP data over the hardware SPI module running at F_CPU / 2, without polling the SPIF
+ *  flag. The byte takes a fixed number of cycles to shift, so SPDR is simply read back once they have passed, and the
+ *  next byte can be written straight away.
+ *
+ *  \param[in] Byte  Byte of data to send to the attached target
+ *
+ *  \return Received byte of data from the attached target
+ */
+static inline uint8_t
+ISPTarget_TransferTimedSPIByte (const uint8_t Byte)
+{
+  SPDR = Byte;
+  __builtin_avr_delay_cycles (ISP_TIMED_SPI_BYTE_CYCLES);
+
+  /* Read SPSR before SPDR so that SPIF is cleared, and the polled SPI driver does not see a stale completion later */
+  (void) SPSR;
+  uint8_t ReceivedByte = SPDR;
+
+#if defined(INVERTED_ISP_MISO)
+  return ~ReceivedByte;
+#else
+  return ReceivedByte;
+#endif
+}
+
 #endif
 
@@ -0,0 +1,63 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Memory checksum engine, computing the standard (IEEE 802.3, reflected) CRC-32 of target memory as it is read
+ *  out, so that the host can verify a memory by comparing a single checksum against its own image.
+ */
+
+#include "MemoryCRC.h"
+
+/** Lookup table of the CRC-32 remainders of each value of a four bit nibble, small enough to live in FLASH
+ *  while still only needing two lookups per byte. */
+static const uint32_t MemoryCRCFromNibble[16] PROGMEM =
+  {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+
+/** Adds a byte to a running memory CRC, started from \ref MEMORY_CRC_INITIAL.
+ *
+ *  \param[in] CRC   Running CRC value
+ *  \param[in] Data  Byte of memory to add to the CRC
+ *
+ *  \return Updated CRC value
+ */
+uint32_t
+MemoryCRC_Update (uint32_t CRC, const uint8_t Data)
+{
+  CRC = (CRC >> 4) ^ pgm_read_dword(&MemoryCRCFromNibble[(CRC ^ Data) & 0x0F]);
+  CRC = (CRC >> 4) ^ pgm_read_dword(&MemoryCRCFromNibble[(CRC ^ (Data >> 4)) & 0x0F]);
+
+  return CRC;
+}
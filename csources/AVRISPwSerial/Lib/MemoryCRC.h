@@ -0,0 +1,55 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for MemoryCRC.c.
+ */
+
+#ifndef _MEMORY_CRC_
+#define _MEMORY_CRC_
+
+/* Includes: */
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+/* Macros: */
+/** Value a memory CRC is started from, before the first byte is added. */
+#define MEMORY_CRC_INITIAL     0xFFFFFFFFUL
+
+/** Value a finished memory CRC is XORed with before it is sent to the host. */
+#define MEMORY_CRC_FINAL_XOR   0xFFFFFFFFUL
+
+/* Function Prototypes: */
+uint32_t
+MemoryCRC_Update (uint32_t CRC, const uint8_t Data);
+
+#endif
+
@@ -0,0 +1,254 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Command latency profiler. The time taken by each command from the host is measured against the timebase and
+ *  broken down into the phases marked with \ref Profiler_EnterPhase() throughout the handlers: waiting on the USB
+ *  endpoints, waiting for the target to complete an operation, and fixed delays, the remainder being the processing
+ *  of the command and the shifting of its data to and from the target. Each command profiled gets a slot holding a
+ *  histogram of its latencies and the total time it spent in each phase, which the host reads back with the vendor
+ *  CMD_READ_PROFILE command. A spare GPIO can be toggled at every phase boundary for an external logic analyzer.
+ *
+ *  The USB endpoint waits happen inside the LUFA stream functions as well as in the handlers, so they are caught by
+ *  wrapping \c Endpoint_WaitUntilReady() at link time with the \c --wrap linker option, which the makefile adds while
+ *  the profiler is enabled.
+ */
+
+#define  INCLUDE_FROM_PROFILER_C
+#include "Profiler.h"
+#include "V2Protocol.h"
+
+#if defined(ENABLE_LATENCY_PROFILE) || defined(__DOXYGEN__)
+
+#if defined(PROFILER_GPIO_PIN)
+#define PROFILER_GPIO_TOGGLE()    (PROFILER_GPIO_PIN = PROFILER_GPIO_MASK)
+#else
+#define PROFILER_GPIO_TOGGLE()
+#endif
+
+/** Latency profiles of the commands seen so far, in the order of their first use. */
+static Profiler_CommandProfile_t Profiler_Profiles[PROFILER_COMMAND_SLOTS];
+
+/** Profile of the command being processed, or NULL while no command is profiled. */
+static Profiler_CommandProfile_t* Profiler_Current;
+
+/** Phase the command being processed is in, a \ref Profiler_Phases_t value. */
+static uint8_t Profiler_Phase;
+
+/** Times at which the command being processed started, and at which it entered its current phase. */
+static Timebase_Time_t Profiler_CommandStart;
+static Timebase_Time_t Profiler_PhaseStart;
+
+/** Initializes the profiler with every slot free, setting up the phase boundary GPIO if one is configured. */
+void
+Profiler_Init (void)
+{
+  memset (Profiler_Profiles, 0, sizeof(Profiler_Profiles));
+  Profiler_Current = NULL;
+
+#if defined(PROFILER_GPIO_PIN)
+  PROFILER_GPIO_PORT &= ~PROFILER_GPIO_MASK;
+  PROFILER_GPIO_DDR |= PROFILER_GPIO_MASK;
+#endif
+}
+
+/** Finds the profile slot of a command, taking a free one on its first use.
+ *
+ *  \param[in] V2Command  Command byte to find the profile of
+ *
+ *  \return Profile of the command, or NULL if every slot is taken by other commands
+ */
+static Profiler_CommandProfile_t*
+Profiler_FindSlot (const uint8_t V2Command)
+{
+  for (uint8_t Slot = 0; Slot < PROFILER_COMMAND_SLOTS; Slot++)
+    {
+      Profiler_CommandProfile_t* Profile = &Profiler_Profiles[Slot];
+
+      if (!(Profile->Command))
+        Profile->Command = V2Command;
+
+      if (Profile->Command == V2Command)
+        return Profile;
+    }
+
+  return NULL;
+}
+
+/** Starts profiling a command received from the host, in the processing phase.
+ *
+ *  \param[in] V2Command  Command byte of the command received
+ */
+void
+Profiler_BeginCommand (const uint8_t V2Command)
+{
+  Profiler_Current = Profiler_FindSlot (V2Command);
+  Profiler_Phase = PROFILER_PHASE_PROCESS;
+  Profiler_CommandStart = Timebase_Now ();
+  Profiler_PhaseStart = Profiler_CommandStart;
+
+  PROFILER_GPIO_TOGGLE();
+}
+
+/** Moves the command being profiled into a new phase, accounting the time spent in the phase it leaves. The phase
+ *  returned is to be entered again once the new one is over, so that phases may nest.
+ *
+ *  \param[in] Phase  Phase entered, a \ref Profiler_Phases_t value
+ *
+ *  \return Phase left
+ */
+uint8_t
+Profiler_EnterPhase (const uint8_t Phase)
+{
+  uint8_t PreviousPhase = Profiler_Phase;
+
+  if (!(Profiler_Current) || (Phase == PreviousPhase))
+    return PreviousPhase;
+
+  Timebase_Time_t Now = Timebase_Now ();
+
+  Profiler_Current->PhaseTicks[PreviousPhase] += (Now - Profiler_PhaseStart);
+  Profiler_PhaseStart = Now;
+  Profiler_Phase = Phase;
+
+  PROFILER_GPIO_TOGGLE();
+  return PreviousPhase;
+}
+
+/** Ends the profiling of the command being processed, once its response has been collected by the host, adding
+ *  its latency to the histogram of the command.
+ */
+void
+Profiler_EndCommand (void)
+{
+  Profiler_CommandProfile_t* Profile = Profiler_Current;
+
+  if (!(Profile))
+    return;
+
+  Timebase_Time_t Now = Timebase_Now ();
+  Timebase_Time_t Latency = (Now - Profiler_CommandStart);
+
+  Profile->PhaseTicks[Profiler_Phase] += (Now - Profiler_PhaseStart);
+
+  if (Latency > Profile->MaxTicks)
+    Profile->MaxTicks = Latency;
+
+  uint8_t Bucket = 0;
+  Timebase_Time_t BucketLimit = PROFILER_HISTOGRAM_BASE_TICKS;
+
+  while ((Bucket < (PROFILER_HISTOGRAM_BUCKETS - 1)) && (Latency >= BucketLimit))
+    {
+      Bucket++;
+      BucketLimit <<= 2;
+    }
+
+  if (Profile->Histogram[Bucket] != UINT16_MAX)
+    Profile->Histogram[Bucket]++;
+
+  if (Profile->Count != UINT16_MAX)
+    Profile->Count++;
+
+  Profiler_Current = NULL;
+
+  PROFILER_GPIO_TOGGLE();
+}
+
+/** Handler for the vendor CMD_READ_PROFILE command, returning the latency profile held in a slot, or clearing every
+ *  slot when given \ref PROFILER_SLOT_CLEAR_ALL. The profile is returned after the timebase resolution, with all
+ *  values big endian. A slot not yet taken is returned with a zero command byte.
+ */
+void
+Profiler_ReadCommand (void)
+{
+  uint8_t Slot = V2Protocol_Read_8 ();
+
+  V2Protocol_BeginResponse ();
+  V2Protocol_Write_8 (CMD_READ_PROFILE);
+
+  if (Slot == PROFILER_SLOT_CLEAR_ALL)
+    {
+      memset (Profiler_Profiles, 0, sizeof(Profiler_Profiles));
+      Profiler_Current = NULL;
+
+      V2Protocol_Write_8 (STATUS_CMD_OK);
+    }
+  else if (Slot >= PROFILER_COMMAND_SLOTS)
+    {
+      V2Protocol_Write_8 (STATUS_CMD_FAILED);
+    }
+  else
+    {
+      Profiler_CommandProfile_t* Profile = &Profiler_Profiles[Slot];
+
+      V2Protocol_Write_8 (STATUS_CMD_OK);
+      V2Protocol_Write_8 (TIMEBASE_US_PER_TICK);
+      V2Protocol_Write_8 (Profile->Command);
+      V2Protocol_Write_8 (Profile->Count >> 8);
+      V2Protocol_Write_8 (Profile->Count & 0xFF);
+      V2Protocol_Write_32_BE (Profile->MaxTicks);
+
+      for (uint8_t Bucket = 0; Bucket < PROFILER_HISTOGRAM_BUCKETS; Bucket++)
+        {
+          V2Protocol_Write_8 (Profile->Histogram[Bucket] >> 8);
+          V2Protocol_Write_8 (Profile->Histogram[Bucket] & 0xFF);
+        }
+
+      for (uint8_t Phase = 0; Phase < PROFILER_PHASES; Phase++)
+        V2Protocol_Write_32_BE (Profile->PhaseTicks[Phase]);
+    }
+
+  V2Protocol_EndResponse ();
+}
+
+/** LUFA's own endpoint wait, left under this name by the linker when \c Endpoint_WaitUntilReady() is wrapped. */
+uint8_t
+__real_Endpoint_WaitUntilReady (void);
+
+/** Stands in for LUFA's \c Endpoint_WaitUntilReady(), accounting the wait to the USB phase of the endpoint
+ *  direction.
+ *
+ *  \return Error code of the wait, a value from the \c Endpoint_WaitUntilReady_ErrorCodes_t enum
+ */
+uint8_t
+__wrap_Endpoint_WaitUntilReady (void)
+{
+  uint8_t PreviousPhase = Profiler_EnterPhase (
+      (Endpoint_GetEndpointDirection () == ENDPOINT_DIR_IN) ?
+          PROFILER_PHASE_USB_IN : PROFILER_PHASE_USB_OUT);
+
+  uint8_t ErrorCode = __real_Endpoint_WaitUntilReady ();
+
+  Profiler_EnterPhase (PreviousPhase);
+  return ErrorCode;
+}
+
+#endif
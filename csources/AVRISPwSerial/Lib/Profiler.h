@@ -0,0 +1,124 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for Profiler.c.
+ */
+
+#ifndef _PROFILER_
+#define _PROFILER_
+
+/* Includes: */
+#include <avr/io.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <LUFA/Common/Common.h>
+
+#include "Timebase.h"
+#include "V2ProtocolConstants.h"
+#include "Config/AppConfig.h"
+
+/* Macros: */
+#if !defined(PROFILER_COMMAND_SLOTS) || defined(__DOXYGEN__)
+/** Number of different commands profiled separately, each taking a slot on its first use. Can be overridden in
+ *  AppConfig.h.
+ */
+#define PROFILER_COMMAND_SLOTS        8
+#endif
+
+/** Number of buckets in the latency histogram of each command. */
+#define PROFILER_HISTOGRAM_BUCKETS    8
+
+/** Upper latency bound of the first histogram bucket, in timebase ticks. Each following bucket spans four times the
+ *  latencies of the one before, the last one taking all latencies beyond them.
+ */
+#define PROFILER_HISTOGRAM_BASE_TICKS TIMEBASE_US(256)
+
+/** Slot number of the vendor CMD_READ_PROFILE command which clears every slot instead of reading one. */
+#define PROFILER_SLOT_CLEAR_ALL       0xFF
+
+/* Enums: */
+/** Phases the processing time of a command is broken down into. */
+enum Profiler_Phases_t
+{
+  PROFILER_PHASE_PROCESS = 0, /**< Command processing and target data shifting */
+  PROFILER_PHASE_USB_OUT = 1, /**< Waiting for command data from the host */
+  PROFILER_PHASE_USB_IN = 2, /**< Waiting for the host to collect response data */
+  PROFILER_PHASE_POLL = 3, /**< Waiting for the target to complete an operation */
+  PROFILER_PHASE_DELAY = 4, /**< Fixed delays asked for by the host */
+  PROFILER_PHASES = 5, /**< Number of phases */
+};
+
+/* Type Defines: */
+/** Latency profile of one command. */
+typedef struct
+{
+  uint8_t Command; /**< Command byte being profiled, or zero for an unused slot */
+  uint16_t Count; /**< Number of times the command was processed, saturating at its maximum */
+  uint32_t MaxTicks;
+  uint16_t Histogram[PROFILER_HISTOGRAM_BUCKETS];
+  uint32_t PhaseTicks[PROFILER_PHASES]; /**< Total time spent in each phase, a \ref Profiler_Phases_t index */
+} Profiler_CommandProfile_t;
+
+/* Function Prototypes: */
+#if defined(ENABLE_LATENCY_PROFILE)
+void
+Profiler_Init (void);
+void
+Profiler_BeginCommand (const uint8_t V2Command);
+void
+Profiler_EndCommand (void);
+uint8_t
+Profiler_EnterPhase (const uint8_t Phase);
+void
+Profiler_ReadCommand (void);
+#endif
+
+/* Inline Functions: */
+#if !defined(ENABLE_LATENCY_PROFILE)
+/** Stands in for \ref Profiler_EnterPhase() while the profiler is left out, so that the phase boundaries marked
+ *  throughout the handlers compile away without conditionals of their own.
+ */
+static inline uint8_t Profiler_EnterPhase(const uint8_t Phase) ATTR_ALWAYS_INLINE;
+static inline uint8_t
+Profiler_EnterPhase (const uint8_t Phase)
+{
+  return Phase;
+}
+#endif
+
+#if (defined(INCLUDE_FROM_PROFILER_C) && defined(ENABLE_LATENCY_PROFILE))
+static Profiler_CommandProfile_t* Profiler_FindSlot(const uint8_t V2Command);
+#endif
+
+#endif
+
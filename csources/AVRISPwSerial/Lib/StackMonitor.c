@@ -0,0 +1,151 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Stack usage instrumentation. The free SRAM above the static variables is painted at boot, before the stack is
+ *  first used, so that the deepest point the stack has ever reached can later be found by scanning for the first
+ *  byte no longer holding the paint. The results are reported to the host through read-only vendor parameters:
+ *
+ *   - PARAM_STACK_FREE_LOW/HIGH: fewest bytes ever left free between the static variables and the stack
+ *   - PARAM_STACK_PEAK_LOW/HIGH: deepest stack use seen, in bytes
+ *   - PARAM_STACK_PEAK_CMD: command being processed when the deepest stack use was captured
+ *   - PARAM_STACK_LAST_LOW/HIGH: deepest stack use of the command processed last
+ *
+ *  The high-water values are refreshed when their low byte is read, which takes a snapshot of both bytes. The per
+ *  command values are only captured while the PARAM_STACK_CAPTURE parameter is set, as each command is then followed
+ *  by a scan of the free SRAM and a repaint of the part of it the command used.
+ */
+
+#define  INCLUDE_FROM_STACKMONITOR_C
+#include "StackMonitor.h"
+
+#if defined(ENABLE_STACK_MONITOR) || defined(__DOXYGEN__)
+
+/** Start of the free SRAM after the static variables, and end of the initial stack, as placed by the linker. */
+extern uint8_t __heap_start;
+extern uint8_t __stack;
+
+/** Deepest stack use seen so far, in bytes. */
+static uint16_t StackMonitor_PeakDepth;
+
+/** Paints the free SRAM from the end of the static variables up to the top of the stack. Run from the .init1 section
+ *  straight after reset, before the C runtime is set up, and so written without relying on any register contents.
+ */
+void
+StackMonitor_Paint (void)
+{
+  __asm__ __volatile__ (
+      "    ldi r30, lo8(__heap_start) \n"
+      "    ldi r31, hi8(__heap_start) \n"
+      "    ldi r24, %0                \n"
+      "    ldi r25, hi8(__stack)      \n"
+      "    rjmp 2f                    \n"
+      "1:  st Z+, r24                 \n"
+      "2:  cpi r30, lo8(__stack)      \n"
+      "    cpc r31, r25               \n"
+      "    brlo 1b                    \n"
+      "    breq 1b                    \n"
+      :: "M" (STACK_MONITOR_PAINT));
+}
+
+/** Finds the deepest point the stack has reached since the free SRAM was last painted.
+ *
+ *  \return Address of the lowest byte no longer holding the paint
+ */
+static uint8_t*
+StackMonitor_FindDeepest (void)
+{
+  uint8_t* Address = &__heap_start;
+
+  while ((Address < &__stack) && (*Address == STACK_MONITOR_PAINT))
+    Address++;
+
+  return Address;
+}
+
+/** Publishes a 16-bit value to the pair of parameters starting with its low byte.
+ *
+ *  \param[in] ParamIDLow  Parameter ID of the low byte, the high byte following it
+ *  \param[in] Value       Value to publish
+ */
+static void
+StackMonitor_PublishWord (const uint8_t ParamIDLow, const uint16_t Value)
+{
+  V2Params_SetParameterValue (ParamIDLow, Value & 0xFF);
+  V2Params_SetParameterValue (ParamIDLow + 1, Value >> 8);
+}
+
+/** Scans the free SRAM for the deepest point the stack has reached, and publishes the stack high-water values. */
+void
+StackMonitor_Update (void)
+{
+  uint16_t Depth = (&__stack - StackMonitor_FindDeepest ()) + 1;
+
+  if (Depth > StackMonitor_PeakDepth)
+    StackMonitor_PeakDepth = Depth;
+
+  StackMonitor_PublishWord (PARAM_STACK_FREE_LOW,
+                            (&__stack - &__heap_start + 1) - StackMonitor_PeakDepth);
+  StackMonitor_PublishWord (PARAM_STACK_PEAK_LOW, StackMonitor_PeakDepth);
+}
+
+/** Captures the deepest stack use of a command processed from the host while the PARAM_STACK_CAPTURE parameter is
+ *  set, and repaints the SRAM it used so that the next command is measured on its own.
+ *
+ *  \param[in] V2Command  Command byte of the command processed
+ */
+void
+StackMonitor_EndCommand (const uint8_t V2Command)
+{
+  if (!(V2Params_GetParameterValue (PARAM_STACK_CAPTURE)))
+    return;
+
+  uint8_t* Deepest = StackMonitor_FindDeepest ();
+  uint16_t Depth = (&__stack - Deepest) + 1;
+
+  if (Depth > StackMonitor_PeakDepth)
+    V2Params_SetParameterValue (PARAM_STACK_PEAK_CMD, V2Command);
+
+  StackMonitor_Update ();
+  StackMonitor_PublishWord (PARAM_STACK_LAST_LOW, Depth);
+
+  /* Everything below the current stack pointer is free once the command has returned; interrupts are held off while
+   * it is repainted, as an interrupt frame pushed below the stack pointer would otherwise be overwritten */
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    uint8_t* StackPointer = (uint8_t*) SP;
+
+    while (Deepest <= StackPointer)
+      *(Deepest++) = STACK_MONITOR_PAINT;
+  }
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for StackMonitor.c.
+ */
+
+#ifndef _STACK_MONITOR_
+#define _STACK_MONITOR_
+
+/* Includes: */
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <stdbool.h>
+
+#include <LUFA/Common/Common.h>
+
+#include "V2ProtocolConstants.h"
+#include "V2ProtocolParams.h"
+#include "Config/AppConfig.h"
+
+/* Preprocessor Checks: */
+#if defined(NO_STACK_MONITOR)
+#undef ENABLE_STACK_MONITOR
+#endif
+
+/* Macros: */
+/** Value the free SRAM between the static variables and the stack is painted with, so that the deepest point the
+ *  stack has reached can be found as the first byte no longer holding it.
+ */
+#define STACK_MONITOR_PAINT      0xC5
+
+/* Function Prototypes: */
+#if defined(ENABLE_STACK_MONITOR)
+void
+StackMonitor_Paint (void) ATTR_NAKED ATTR_INIT_SECTION(1);
+void
+StackMonitor_Update (void);
+void
+StackMonitor_EndCommand (const uint8_t V2Command);
+#endif
+
+#if (defined(INCLUDE_FROM_STACKMONITOR_C) && defined(ENABLE_STACK_MONITOR))
+static uint8_t* StackMonitor_FindDeepest(void);
+static void StackMonitor_PublishWord(const uint8_t ParamIDLow, const uint16_t Value);
+#endif
+
+#endif
+
@@ -0,0 +1,964 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Standalone programming mode, which programs and verifies a target from an image stored in the programmer's
+ *  EEPROM without a host. The image is uploaded once with the vendor CMD_STANDALONE_WRITE_IMAGE command, and a run
+ *  is started by resetting the programmer twice in quick succession, by an optional button or by the vendor
+ *  CMD_STANDALONE_RUN command. Targets are driven through the same ISP, PDI and TPI routines as host sessions.
+ */
+
+#define  INCLUDE_FROM_STANDALONE_C
+#include "Standalone.h"
+
+#if defined(ENABLE_STANDALONE_MODE) || defined(__DOXYGEN__)
+
+/** Store in the programmer's EEPROM holding the standalone image, a \ref Standalone_ImageHeader_t and its segments */
+static uint8_t EEMEM Standalone_Store[STANDALONE_STORE_SIZE];
+
+/** Set while a standalone run drives the target, which must then not be aborted when no host is connected */
+volatile bool Standalone_Running;
+
+/** Holds \ref STANDALONE_RESET_MAGIC across a reset of the programmer while the reset window is open */
+static uint32_t Standalone_ResetMagic ATTR_NO_INIT;
+
+/** Time at which the reset window opened by the last reset closes */
+static Timebase_Time_t Standalone_ResetWindowEnd;
+
+/** Set while the reset window is open */
+static bool Standalone_ResetWindowOpen;
+
+/** Set once a standalone run has been asked for, until the main loop starts it */
+static bool Standalone_RunRequested;
+
+#if defined(STANDALONE_BUTTON_MASK)
+/** Time at which a held button press is accepted */
+static Timebase_Time_t Standalone_ButtonAcceptAt;
+
+/** Set while the button is held down, and set once the current press has been accepted */
+static bool Standalone_ButtonHeld;
+static bool Standalone_ButtonAccepted;
+#endif
+
+#if defined(ENABLE_ISP_PROTOCOL)
+/** Extended address byte last loaded into an ISP target, for FLASH memories larger than 128KB */
+static uint8_t Standalone_ISPExtendedAddress;
+
+/** SCK speed parameters of the host session, restored once a standalone run is done with an ISP target */
+static struct
+{
+  uint8_t SCKTuned;
+  uint8_t SCKPeriodLow;
+  uint8_t SCKPeriodHigh;
+} Standalone_SavedISPParams;
+
+/** Second byte of the ISP Write Fuse instruction, indexed by fuse number (low, high, extended) */
+static const uint8_t Standalone_ISPFuseWriteCommands[] PROGMEM = { 0xA0, 0xA8, 0xA4 };
+
+/** First two bytes of the ISP Read Fuse instruction, indexed by fuse number (low, high, extended) */
+static const uint16_t Standalone_ISPFuseReadCommands[] PROGMEM = { 0x5000, 0x5808, 0x5008 };
+#endif
+
+#if defined(ENABLE_XPROG_PROTOCOL)
+/** EEPROM page size parameter of the host session, restored once a standalone run is done with a PDI target */
+static uint16_t Standalone_SavedEEPageSize;
+#endif
+
+/** Checks for a second reset of the programmer within the reset window of the first, requesting a standalone run if
+ *  there was one and opening the reset window otherwise. Power-on leaves RAM undefined, so a spurious run could only
+ *  be requested if it happened to hold the whole 32-bit magic value.
+ */
+void
+Standalone_Init (void)
+{
+  if (Standalone_ResetMagic == STANDALONE_RESET_MAGIC)
+    {
+      Standalone_ResetMagic = 0;
+      Standalone_RunRequested = true;
+    }
+  else
+    {
+      Standalone_ResetMagic = STANDALONE_RESET_MAGIC;
+      Standalone_ResetWindowEnd = Timebase_Deadline (TIMEBASE_MS(STANDALONE_RESET_WINDOW_MS));
+      Standalone_ResetWindowOpen = true;
+    }
+
+#if defined(STANDALONE_BUTTON_MASK)
+  /* The button pulls its pin low, against the internal pull-up */
+  STANDALONE_BUTTON_DDR &= ~STANDALONE_BUTTON_MASK;
+  STANDALONE_BUTTON_PORT |= STANDALONE_BUTTON_MASK;
+#endif
+}
+
+/** Task to close the reset window once it has passed, debounce the standalone button and start the standalone runs
+ *  asked for. A run asked for while a host session holds the target is held back until the session ends.
+ */
+void
+Standalone_Task (void)
+{
+  if (Standalone_ResetWindowOpen && Timebase_HasExpired (Standalone_ResetWindowEnd))
+    {
+      Standalone_ResetMagic = 0;
+      Standalone_ResetWindowOpen = false;
+    }
+
+#if defined(STANDALONE_BUTTON_MASK)
+  if (STANDALONE_BUTTON_PIN & STANDALONE_BUTTON_MASK)
+    {
+      Standalone_ButtonHeld = false;
+      Standalone_ButtonAccepted = false;
+    }
+  else if (!(Standalone_ButtonHeld))
+    {
+      Standalone_ButtonHeld = true;
+      Standalone_ButtonAcceptAt = Timebase_Deadline (TIMEBASE_MS(STANDALONE_BUTTON_DEBOUNCE_MS));
+    }
+  else if (!(Standalone_ButtonAccepted) && Timebase_HasExpired (Standalone_ButtonAcceptAt))
+    {
+      Standalone_ButtonAccepted = true;
+      Standalone_RunRequested = true;
+    }
+#endif
+
+  if (!(Standalone_RunRequested) || TargetInProgMode)
+    return;
+
+  Standalone_RunRequested = false;
+  Standalone_Run ();
+}
+
+/** Programs and verifies the attached target from the stored standalone image: the target is erased, every segment
+ *  but the lock byte is written and then read back, and the lock byte is written and read back last so that a failed
+ *  run never leaves the target locked. The outcome is shown on the LEDs.
+ *
+ *  \return Outcome of the run, a \c STANDALONE_RESULT_* value
+ */
+uint8_t
+Standalone_Run (void)
+{
+  Standalone_ImageHeader_t Header;
+
+  if (TargetInProgMode)
+    return STANDALONE_RESULT_TARGET_BUSY;
+
+  if (!(Standalone_ReadImageHeader (&Header)))
+    {
+      LEDs_SetAllLEDs (LEDMASK_STANDALONE_FAIL);
+      return STANDALONE_RESULT_NO_IMAGE;
+    }
+
+  /* A reset during the run must not start another one */
+  Standalone_ResetMagic = 0;
+  Standalone_ResetWindowOpen = false;
+
+  Standalone_Running = true;
+  TargetInProgMode = true;
+  LEDs_SetAllLEDs (LEDMASK_BUSY);
+
+  TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+  uint8_t Result = STANDALONE_RESULT_PASS;
+
+  if (!(Standalone_EnterProgMode (&Header)))
+    {
+      Result = STANDALONE_RESULT_NO_TARGET;
+    }
+  else
+    {
+      Health_Count (HEALTH_SESSIONS, 1);
+
+      uint8_t Signature[3];
+
+      if (!(Standalone_ReadSignature (&Header, Signature))
+          || memcmp (Signature, Header.Signature, sizeof(Signature)))
+        {
+          Result = STANDALONE_RESULT_WRONG_SIGNATURE;
+        }
+      else
+        {
+          TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+          if (!(Standalone_EraseChip (&Header)))
+            Result = STANDALONE_RESULT_WRITE_FAILED;
+
+          for (uint8_t Pass = STANDALONE_PASS_WRITE;
+              (Pass <= STANDALONE_PASS_VERIFY_LOCK) && (Result == STANDALONE_RESULT_PASS); Pass++)
+            Result = Standalone_ProcessSegments (&Header, Pass);
+        }
+    }
+
+  Standalone_LeaveProgMode (&Header);
+
+  TargetInProgMode = false;
+  Standalone_Running = false;
+
+  LEDs_SetAllLEDs ((Result == STANDALONE_RESULT_PASS) ? LEDMASK_STANDALONE_PASS : LEDMASK_STANDALONE_FAIL);
+  return Result;
+}
+
+/** Handler for the vendor CMD_STANDALONE_WRITE_IMAGE command, writing a block of the standalone image into the
+ *  programmer's EEPROM. The command holds the big endian offset and length of the block, followed by its data. Only
+ *  EEPROM cells whose content changes are written, so that uploading the same image again does not wear the EEPROM.
+ */
+void
+Standalone_WriteImage (void)
+{
+  uint16_t Offset = Endpoint_Read_16_BE ();
+  uint16_t Length = Endpoint_Read_16_BE ();
+  uint8_t ResponseStatus = STATUS_CMD_OK;
+
+  if ((Offset > STANDALONE_STORE_SIZE) || (Length > (STANDALONE_STORE_SIZE - Offset)))
+    {
+      ResponseStatus = STATUS_CMD_ILLEGAL_PARAM;
+
+      /* Discard all incoming data */
+      while (Endpoint_BytesInEndpoint () == AVRISP_DATA_EPSIZE)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+    }
+  else
+    {
+      // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+      // to catch this and discard it before continuing on with packet processing to prevent communication issues
+      bool ExpectZLP = (((sizeof(uint8_t) + (2 * sizeof(uint16_t)) + Length) % AVRISP_DATA_EPSIZE) == 0);
+
+      while (Length)
+        {
+          uint8_t Block[STANDALONE_CHUNK_SIZE];
+          uint8_t BlockLength = MIN(Length, sizeof(Block));
+
+          Endpoint_Read_Stream_LE (Block, BlockLength, NULL);
+          eeprom_update_block (Block, &Standalone_Store[Offset], BlockLength);
+          V2Protocol_Yield ();
+
+          Offset += BlockLength;
+          Length -= BlockLength;
+        }
+
+      if (ExpectZLP)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+    }
+
+  Endpoint_ClearOUT ();
+  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+  V2Protocol_Write_8 (CMD_STANDALONE_WRITE_IMAGE);
+  V2Protocol_Write_8 (ResponseStatus);
+  Endpoint_ClearIN ();
+}
+
+/** Handler for the vendor CMD_STANDALONE_RUN command, running the standalone programming of the target from the
+ *  stored image as if started from the programmer itself, and returning its \c STANDALONE_RESULT_* outcome.
+ */
+void
+Standalone_RunCommand (void)
+{
+  Endpoint_ClearOUT ();
+  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+
+  uint8_t Result = Standalone_Run ();
+
+  V2Protocol_Write_8 (CMD_STANDALONE_RUN);
+  V2Protocol_Write_8 ((Result == STANDALONE_RESULT_PASS) ? STATUS_CMD_OK : STATUS_CMD_FAILED);
+  V2Protocol_Write_8 (Result);
+  Endpoint_ClearIN ();
+}
+
+/** Reads the header of the stored standalone image and checks the image: its magic value, its CRC, that it is for a
+ *  protocol built into the firmware, and that its segments exactly fill it.
+ *
+ *  \param[out] Header  Header of the stored image
+ *
+ *  \return Boolean \c true if a valid image is stored
+ */
+static bool
+Standalone_ReadImageHeader (Standalone_ImageHeader_t* const Header)
+{
+  eeprom_read_block (Header, Standalone_Store, sizeof(Standalone_ImageHeader_t));
+
+  if ((Header->Magic != STANDALONE_IMAGE_MAGIC)
+      || (Header->Length > (STANDALONE_STORE_SIZE - sizeof(Standalone_ImageHeader_t))))
+    return false;
+
+  switch (Header->Protocol)
+    {
+#if defined(ENABLE_ISP_PROTOCOL)
+    case STANDALONE_PROTOCOL_ISP:
+      break;
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case STANDALONE_PROTOCOL_PDI:
+    case STANDALONE_PROTOCOL_TPI:
+      break;
+#endif
+    default:
+      return false;
+    }
+
+  uint16_t ImageEnd = sizeof(Standalone_ImageHeader_t) + Header->Length;
+  uint32_t CRC = MEMORY_CRC_INITIAL;
+
+  for (uint16_t Offset = sizeof(Standalone_ImageHeader_t); Offset < ImageEnd; Offset++)
+    CRC = MemoryCRC_Update (CRC, eeprom_read_byte (&Standalone_Store[Offset]));
+
+  if ((CRC ^ MEMORY_CRC_FINAL_XOR) != Header->CRC)
+    return false;
+
+  uint16_t Offset = sizeof(Standalone_ImageHeader_t);
+
+  while (Offset < ImageEnd)
+    {
+      Standalone_SegmentHeader_t Segment;
+
+      if ((ImageEnd - Offset) < sizeof(Segment))
+        return false;
+
+      eeprom_read_block (&Segment, &Standalone_Store[Offset], sizeof(Segment));
+      Offset += sizeof(Segment);
+
+      if ((Segment.Length > (ImageEnd - Offset))
+          || (Segment.Memory > STANDALONE_MEMORY_LOCK))
+        return false;
+
+      Offset += Segment.Length;
+    }
+
+  return true;
+}
+
+/** Makes one pass over the segments of the stored standalone image, writing or reading back either every segment but
+ *  the lock byte or only the lock byte.
+ *
+ *  \param[in] Header  Header of the stored image
+ *  \param[in] Pass    Pass to make, a \c STANDALONE_PASS_* value
+ *
+ *  \return Outcome of the pass, a \c STANDALONE_RESULT_* value
+ */
+static uint8_t
+Standalone_ProcessSegments (const Standalone_ImageHeader_t* const Header,
+                            const uint8_t Pass)
+{
+  uint16_t ImageEnd = sizeof(Standalone_ImageHeader_t) + Header->Length;
+  uint16_t Offset = sizeof(Standalone_ImageHeader_t);
+  bool IsLockPass = (Pass >= STANDALONE_PASS_WRITE_LOCK);
+
+  while (Offset < ImageEnd)
+    {
+      Standalone_SegmentHeader_t Segment;
+
+      eeprom_read_block (&Segment, &Standalone_Store[Offset], sizeof(Segment));
+      Offset += sizeof(Segment);
+
+      if ((Segment.Memory == STANDALONE_MEMORY_LOCK) == IsLockPass)
+        {
+          uint8_t Result = Standalone_ProcessSegment (Header, &Segment, Offset, Pass);
+
+          if (Result != STANDALONE_RESULT_PASS)
+            return Result;
+        }
+
+      Offset += Segment.Length;
+    }
+
+  return STANDALONE_RESULT_PASS;
+}
+
+/** Writes or reads back a segment of the stored standalone image, in chunks of at most \ref STANDALONE_CHUNK_SIZE
+ *  bytes which are split at page boundaries. A page is committed once its last chunk, or the last chunk of the
+ *  segment, has been written.
+ *
+ *  \param[in] Header      Header of the stored image
+ *  \param[in] Segment     Header of the segment
+ *  \param[in] DataOffset  Offset of the segment data in the store
+ *  \param[in] Pass        Pass being made, a \c STANDALONE_PASS_* value
+ *
+ *  \return Outcome of the segment, a \c STANDALONE_RESULT_* value
+ */
+static uint8_t
+Standalone_ProcessSegment (const Standalone_ImageHeader_t* const Header,
+                           const Standalone_SegmentHeader_t* const Segment,
+                           uint16_t DataOffset, const uint8_t Pass)
+{
+  /* TPI writes are made in words, and may pad an odd length chunk with an extra byte */
+  uint8_t Data[STANDALONE_CHUNK_SIZE + 1];
+  uint8_t ReadBack[STANDALONE_CHUNK_SIZE];
+  bool IsWritePass = ((Pass == STANDALONE_PASS_WRITE) || (Pass == STANDALONE_PASS_WRITE_LOCK));
+  uint16_t PageSize = 0;
+
+  if (Segment->Memory == STANDALONE_MEMORY_FLASH)
+    PageSize = Header->FlashPageSize;
+  else if (Segment->Memory == STANDALONE_MEMORY_EEPROM)
+    PageSize = Header->EEPROMPageSize;
+
+  uint32_t Address = Segment->Address;
+  uint16_t BytesRemaining = Segment->Length;
+
+  while (BytesRemaining)
+    {
+      uint8_t Length = MIN(BytesRemaining, STANDALONE_CHUNK_SIZE);
+      uint8_t PageMode = (STANDALONE_PAGE_START | STANDALONE_PAGE_END);
+
+      if (PageSize)
+        {
+          uint16_t PageBytesRemaining = PageSize - (Address & (PageSize - 1));
+
+          if (Length > PageBytesRemaining)
+            Length = PageBytesRemaining;
+
+          if ((PageBytesRemaining != PageSize) && (BytesRemaining != Segment->Length))
+            PageMode &= ~STANDALONE_PAGE_START;
+
+          if ((Length != PageBytesRemaining) && (Length != BytesRemaining))
+            PageMode &= ~STANDALONE_PAGE_END;
+        }
+
+      eeprom_read_block (Data, &Standalone_Store[DataOffset], Length);
+
+      /* Each chunk gets the time of a host command, as the host would have sent it as one */
+      TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+      if (IsWritePass)
+        {
+          if (!(Standalone_WriteChunk (Header, Segment->Memory, Address, Data, Length, PageMode)))
+            return STANDALONE_RESULT_WRITE_FAILED;
+        }
+      else
+        {
+          if (!(Standalone_ReadChunk (Header, Segment->Memory, Address, ReadBack, Length))
+              || memcmp (Data, ReadBack, Length))
+            return STANDALONE_RESULT_VERIFY_FAILED;
+        }
+
+      Address += Length;
+      DataOffset += Length;
+      BytesRemaining -= Length;
+    }
+
+  return STANDALONE_RESULT_PASS;
+}
+
+/** Puts the target into programming mode over the interface of the stored image, as the host would. ISP targets are
+ *  programmed at the SCK speed of the image, in place of the host session's speed.
+ *
+ *  \param[in] Header  Header of the stored image
+ *
+ *  \return Boolean \c true if the target entered programming mode
+ */
+static bool
+Standalone_EnterProgMode (const Standalone_ImageHeader_t* const Header)
+{
+  switch (Header->Protocol)
+    {
+#if defined(ENABLE_ISP_PROTOCOL)
+    case STANDALONE_PROTOCOL_ISP:
+      {
+        /* The parameters avrdude sends for every classic AVR */
+        const ISPProtocol_EnterParams_t Params =
+          { .TimeoutMS = 200, .PinStabDelayMS = 100, .ExecutionDelayMS = 25, .SynchLoops = 32,
+            .ByteDelay = 0, .PollValue = 0x53, .PollIndex = 3, .EnterProgBytes = { 0xAC, 0x53, 0x00, 0x00 } };
+
+        Standalone_SavedISPParams.SCKTuned = V2Params_GetParameterValue (PARAM_ISP_SCK_TUNED);
+        Standalone_SavedISPParams.SCKPeriodLow = V2Params_GetParameterValue (PARAM_ISP_SCK_PERIOD_LOW);
+        Standalone_SavedISPParams.SCKPeriodHigh = V2Params_GetParameterValue (PARAM_ISP_SCK_PERIOD_HIGH);
+
+        V2Params_SetParameterValue (PARAM_ISP_SCK_PERIOD_LOW, 0);
+        V2Params_SetParameterValue (PARAM_ISP_SCK_PERIOD_HIGH, 0);
+        V2Params_SetParameterValue (PARAM_ISP_SCK_TUNED, Header->SCKDuration);
+
+        Standalone_ISPExtendedAddress = 0;
+
+        ISPProtocol_DelayMS (Params.ExecutionDelayMS);
+        ISPTarget_EnableTargetISP ();
+
+        ISPTarget_ChangeTargetResetLine (true);
+        ISPProtocol_DelayMS (Params.PinStabDelayMS);
+
+        return (ISPProtocol_SynchroniseTarget (&Params, Params.SynchLoops) == STATUS_CMD_OK);
+      }
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case STANDALONE_PROTOCOL_PDI:
+      Standalone_SavedEEPageSize = XPROG_Param_EEPageSize;
+      XPROG_Param_EEPageSize = Header->EEPROMPageSize;
+
+      return XMEGANVM_EnablePDI ();
+    case STANDALONE_PROTOCOL_TPI:
+      return TINYNVM_EnableTPI ();
+#endif
+    }
+
+  return false;
+}
+
+/** Releases the target from programming mode, and restores the host session's parameters changed for the run.
+ *
+ *  \param[in] Header  Header of the stored image
+ */
+static void
+Standalone_LeaveProgMode (const Standalone_ImageHeader_t* const Header)
+{
+  switch (Header->Protocol)
+    {
+#if defined(ENABLE_ISP_PROTOCOL)
+    case STANDALONE_PROTOCOL_ISP:
+      ISPTarget_ChangeTargetResetLine (false);
+      ISPTarget_DisableTargetISP ();
+
+      V2Params_SetParameterValue (PARAM_ISP_SCK_TUNED, Standalone_SavedISPParams.SCKTuned);
+      V2Params_SetParameterValue (PARAM_ISP_SCK_PERIOD_LOW, Standalone_SavedISPParams.SCKPeriodLow);
+      V2Params_SetParameterValue (PARAM_ISP_SCK_PERIOD_HIGH, Standalone_SavedISPParams.SCKPeriodHigh);
+      break;
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case STANDALONE_PROTOCOL_PDI:
+      XMEGANVM_DisablePDI ();
+      XPROG_Param_EEPageSize = Standalone_SavedEEPageSize;
+      break;
+    case STANDALONE_PROTOCOL_TPI:
+      TINYNVM_DisableTPI ();
+      break;
+#endif
+    }
+
+#if defined(XCK_RESCUE_CLOCK_ENABLE) && defined(ENABLE_ISP_PROTOCOL)
+  /* The XPROG routines stop the rescue clock, which must be restarted once they are done with the target */
+  if (Header->Protocol != STANDALONE_PROTOCOL_ISP)
+    ISPTarget_ConfigureRescueClock ();
+#endif
+}
+
+/** Reads the three signature bytes of the target.
+ *
+ *  \param[in]  Header     Header of the stored image
+ *  \param[out] Signature  Signature of the target
+ *
+ *  \return Boolean \c true if the signature was read
+ */
+static bool
+Standalone_ReadSignature (const Standalone_ImageHeader_t* const Header,
+                          uint8_t* const Signature)
+{
+  switch (Header->Protocol)
+    {
+#if defined(ENABLE_ISP_PROTOCOL)
+    case STANDALONE_PROTOCOL_ISP:
+      for (uint8_t SignatureByte = 0; SignatureByte < 3; SignatureByte++)
+        Signature[SignatureByte] = Standalone_ISPInstruction (0x30, SignatureByte, 0x00);
+
+      return true;
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case STANDALONE_PROTOCOL_PDI:
+      return XMEGANVM_ReadMemory (STANDALONE_PDI_SIGNATURE_ADDR, Signature, 3);
+    case STANDALONE_PROTOCOL_TPI:
+      return TINYNVM_ReadMemory (STANDALONE_TPI_SIGNATURE_ADDR, Signature, 3);
+#endif
+    }
+
+  return false;
+}
+
+/** Erases the target's FLASH, and its EEPROM unless preserved by its fuses, along with its lock bits.
+ *
+ *  \param[in] Header  Header of the stored image
+ *
+ *  \return Boolean \c true if the erase completed
+ */
+static bool
+Standalone_EraseChip (const Standalone_ImageHeader_t* const Header)
+{
+  switch (Header->Protocol)
+    {
+#if defined(ENABLE_ISP_PROTOCOL)
+    case STANDALONE_PROTOCOL_ISP:
+      Standalone_ISPInstruction (0xAC, 0x8000, 0x00);
+      return (ISPTarget_WaitWhileTargetBusy () == STATUS_CMD_OK);
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case STANDALONE_PROTOCOL_PDI:
+      return XMEGANVM_EraseMemory (XMEGA_NVM_CMD_CHIPERASE, 0);
+    case STANDALONE_PROTOCOL_TPI:
+      return TINYNVM_EraseMemory (TINY_NVM_CMD_CHIPERASE, STANDALONE_TPI_FLASH_BASE);
+#endif
+    }
+
+  return false;
+}
+
+/** Writes a chunk of a segment to the target.
+ *
+ *  \param[in] Header    Header of the stored image
+ *  \param[in] Memory    Target memory of the segment, a \c STANDALONE_MEMORY_* value
+ *  \param[in] Address   Address of the chunk in the target memory
+ *  \param[in] Data      Data of the chunk, with room for one more byte
+ *  \param[in] Length    Length of the chunk in bytes
+ *  \param[in] PageMode  Mask of \ref STANDALONE_PAGE_START and \ref STANDALONE_PAGE_END
+ *
+ *  \return Boolean \c true if the chunk was written
+ */
+static bool
+Standalone_WriteChunk (const Standalone_ImageHeader_t* const Header,
+                       const uint8_t Memory, const uint32_t Address,
+                       uint8_t* const Data, const uint8_t Length,
+                       const uint8_t PageMode)
+{
+  switch (Header->Protocol)
+    {
+#if defined(ENABLE_ISP_PROTOCOL)
+    case STANDALONE_PROTOCOL_ISP:
+      return Standalone_ISPWriteChunk (Header, Memory, Address, Data, Length, PageMode);
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case STANDALONE_PROTOCOL_PDI:
+      return Standalone_PDIWriteChunk (Memory, Address, Data, Length, PageMode);
+    case STANDALONE_PROTOCOL_TPI:
+      return Standalone_TPIWriteChunk (Memory, Address, Data, Length);
+#endif
+    }
+
+  return false;
+}
+
+/** Reads a chunk of a segment back from the target.
+ *
+ *  \param[in]  Header   Header of the stored image
+ *  \param[in]  Memory   Target memory of the segment, a \c STANDALONE_MEMORY_* value
+ *  \param[in]  Address  Address of the chunk in the target memory
+ *  \param[out] Data     Buffer the chunk is read into
+ *  \param[in]  Length   Length of the chunk in bytes
+ *
+ *  \return Boolean \c true if the chunk was read
+ */
+static bool
+Standalone_ReadChunk (const Standalone_ImageHeader_t* const Header,
+                      const uint8_t Memory, const uint32_t Address,
+                      uint8_t* const Data, const uint8_t Length)
+{
+  switch (Header->Protocol)
+    {
+#if defined(ENABLE_ISP_PROTOCOL)
+    case STANDALONE_PROTOCOL_ISP:
+      return Standalone_ISPReadChunk (Memory, Address, Data, Length);
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case STANDALONE_PROTOCOL_PDI:
+      {
+        uint32_t BaseAddress = STANDALONE_PDI_FLASH_BASE;
+
+        if (Memory == STANDALONE_MEMORY_EEPROM)
+          BaseAddress = STANDALONE_PDI_EEPROM_BASE;
+        else if (Memory == STANDALONE_MEMORY_FUSE)
+          BaseAddress = STANDALONE_PDI_FUSE_BASE;
+        else if (Memory == STANDALONE_MEMORY_LOCK)
+          BaseAddress = STANDALONE_PDI_LOCK_ADDR;
+
+        return XMEGANVM_ReadMemory (BaseAddress + Address, Data, Length);
+      }
+    case STANDALONE_PROTOCOL_TPI:
+      {
+        uint16_t BaseAddress = STANDALONE_TPI_FLASH_BASE;
+
+        if (Memory == STANDALONE_MEMORY_EEPROM)
+          return false;
+        else if (Memory == STANDALONE_MEMORY_FUSE)
+          BaseAddress = STANDALONE_TPI_CONFIG_ADDR;
+        else if (Memory == STANDALONE_MEMORY_LOCK)
+          BaseAddress = STANDALONE_TPI_LOCK_ADDR;
+
+        return TINYNVM_ReadMemory (BaseAddress + Address, Data, Length);
+      }
+#endif
+    }
+
+  return false;
+}
+
+#if defined(ENABLE_ISP_PROTOCOL)
+/** Sends a four byte ISP instruction to the target.
+ *
+ *  \param[in] Command  First byte of the instruction
+ *  \param[in] Address  Second and third bytes of the instruction, big endian
+ *  \param[in] Data     Last byte of the instruction
+ *
+ *  \return Byte received from the target while the last byte was sent
+ */
+static uint8_t
+Standalone_ISPInstruction (const uint8_t Command, const uint16_t Address,
+                           const uint8_t Data)
+{
+  ISPTarget_SendByte (Command);
+  ISPTarget_SendByte (Address >> 8);
+  ISPTarget_SendByte (Address & 0xFF);
+
+  return ISPTarget_TransferByte (Data);
+}
+
+/** Loads the extended address byte of a FLASH byte address into the target, if it differs from the loaded one.
+ *
+ *  \param[in] Address  Byte address in the target's FLASH
+ */
+static void
+Standalone_ISPLoadExtendedAddress (const uint32_t Address)
+{
+  uint8_t ExtendedAddress = (Address >> 17);
+
+  if (ExtendedAddress == Standalone_ISPExtendedAddress)
+    return;
+
+  Standalone_ISPInstruction (LOAD_EXTENDED_ADDRESS_CMD, ExtendedAddress, 0x00);
+  Standalone_ISPExtendedAddress = ExtendedAddress;
+}
+
+/** Writes a chunk of a segment to an ISP target. FLASH and paged EEPROM chunks are loaded into the page buffer and
+ *  committed with the last chunk of the page; everything else is written byte by byte. Completion is detected by
+ *  RDY/BSY polling.
+ *
+ *  \param[in] Header    Header of the stored image
+ *  \param[in] Memory    Target memory of the segment, a \c STANDALONE_MEMORY_* value
+ *  \param[in] Address   Address of the chunk in the target memory
+ *  \param[in] Data      Data of the chunk
+ *  \param[in] Length    Length of the chunk in bytes
+ *  \param[in] PageMode  Mask of \ref STANDALONE_PAGE_START and \ref STANDALONE_PAGE_END
+ *
+ *  \return Boolean \c true if the chunk was written
+ */
+static bool
+Standalone_ISPWriteChunk (const Standalone_ImageHeader_t* const Header,
+                          const uint8_t Memory, const uint32_t Address,
+                          const uint8_t* const Data, const uint8_t Length,
+                          const uint8_t PageMode)
+{
+  switch (Memory)
+    {
+    case STANDALONE_MEMORY_FLASH:
+      Standalone_ISPLoadExtendedAddress (Address);
+
+      for (uint8_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+        {
+          uint32_t ByteAddress = (Address + CurrentByte);
+
+          Standalone_ISPInstruction ((ByteAddress & 0x01) ? (0x40 | READ_WRITE_HIGH_BYTE_MASK) : 0x40,
+                                     (ByteAddress >> 1), Data[CurrentByte]);
+        }
+
+      if (!(PageMode & STANDALONE_PAGE_END))
+        return true;
+
+      Health_Count (HEALTH_PAGES_WRITTEN, 1);
+      Standalone_ISPInstruction (0x4C, (Address >> 1), 0x00);
+      return (ISPTarget_WaitWhileTargetBusy () == STATUS_CMD_OK);
+    case STANDALONE_MEMORY_EEPROM:
+      if (Header->EEPROMPageSize)
+        {
+          for (uint8_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+            Standalone_ISPInstruction (0xC1, (Address + CurrentByte), Data[CurrentByte]);
+
+          if (!(PageMode & STANDALONE_PAGE_END))
+            return true;
+
+          Health_Count (HEALTH_PAGES_WRITTEN, 1);
+          Standalone_ISPInstruction (0xC2, Address, 0x00);
+          return (ISPTarget_WaitWhileTargetBusy () == STATUS_CMD_OK);
+        }
+
+      for (uint8_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+        {
+          Standalone_ISPInstruction (0xC0, (Address + CurrentByte), Data[CurrentByte]);
+
+          if (ISPTarget_WaitWhileTargetBusy () != STATUS_CMD_OK)
+            return false;
+        }
+
+      return true;
+    case STANDALONE_MEMORY_FUSE:
+      for (uint8_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+        {
+          uint32_t FuseNumber = (Address + CurrentByte);
+
+          if (FuseNumber >= sizeof(Standalone_ISPFuseWriteCommands))
+            return false;
+
+          Standalone_ISPInstruction (0xAC, (uint16_t)pgm_read_byte (&Standalone_ISPFuseWriteCommands[FuseNumber]) << 8,
+                                     Data[CurrentByte]);
+
+          if (ISPTarget_WaitWhileTargetBusy () != STATUS_CMD_OK)
+            return false;
+        }
+
+      return true;
+    case STANDALONE_MEMORY_LOCK:
+      Standalone_ISPInstruction (0xAC, 0xE000, Data[0]);
+      return (ISPTarget_WaitWhileTargetBusy () == STATUS_CMD_OK);
+    }
+
+  return false;
+}
+
+/** Reads a chunk of a segment back from an ISP target.
+ *
+ *  \param[in]  Memory   Target memory of the segment, a \c STANDALONE_MEMORY_* value
+ *  \param[in]  Address  Address of the chunk in the target memory
+ *  \param[out] Data     Buffer the chunk is read into
+ *  \param[in]  Length   Length of the chunk in bytes
+ *
+ *  \return Boolean \c true if the chunk was read
+ */
+static bool
+Standalone_ISPReadChunk (const uint8_t Memory, const uint32_t Address,
+                         uint8_t* const Data, const uint8_t Length)
+{
+  if (Memory == STANDALONE_MEMORY_FLASH)
+    Standalone_ISPLoadExtendedAddress (Address);
+
+  for (uint8_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+    {
+      uint32_t ByteAddress = (Address + CurrentByte);
+
+      switch (Memory)
+        {
+        case STANDALONE_MEMORY_FLASH:
+          Data[CurrentByte] = Standalone_ISPInstruction (
+              (ByteAddress & 0x01) ? (0x20 | READ_WRITE_HIGH_BYTE_MASK) : 0x20, (ByteAddress >> 1), 0x00);
+          break;
+        case STANDALONE_MEMORY_EEPROM:
+          Data[CurrentByte] = Standalone_ISPInstruction (0xA0, ByteAddress, 0x00);
+          break;
+        case STANDALONE_MEMORY_FUSE:
+          {
+            if (ByteAddress >= (sizeof(Standalone_ISPFuseReadCommands) / sizeof(Standalone_ISPFuseReadCommands[0])))
+              return false;
+
+            uint16_t ReadCommand = pgm_read_word (&Standalone_ISPFuseReadCommands[ByteAddress]);
+
+            Data[CurrentByte] = Standalone_ISPInstruction (ReadCommand >> 8, (ReadCommand & 0xFF) << 8, 0x00);
+            break;
+          }
+        case STANDALONE_MEMORY_LOCK:
+          Data[CurrentByte] = Standalone_ISPInstruction (0x58, 0x0000, 0x00);
+          break;
+        }
+    }
+
+  return true;
+}
+#endif
+
+#if defined(ENABLE_XPROG_PROTOCOL)
+/** Writes a chunk of a segment to a PDI target. FLASH and EEPROM chunks are loaded into the page buffer, which is
+ *  cleared by the first chunk of each page and committed with the last.
+ *
+ *  \param[in] Memory    Target memory of the segment, a \c STANDALONE_MEMORY_* value
+ *  \param[in] Address   Address of the chunk in the target memory
+ *  \param[in] Data      Data of the chunk
+ *  \param[in] Length    Length of the chunk in bytes
+ *  \param[in] PageMode  Mask of \ref STANDALONE_PAGE_START and \ref STANDALONE_PAGE_END
+ *
+ *  \return Boolean \c true if the chunk was written
+ */
+static bool
+Standalone_PDIWriteChunk (const uint8_t Memory, const uint32_t Address,
+                          const uint8_t* const Data, const uint8_t Length,
+                          const uint8_t PageMode)
+{
+  uint8_t XPROGPageMode = 0;
+
+  if (PageMode & STANDALONE_PAGE_START)
+    XPROGPageMode |= XPROG_PAGEMODE_ERASE;
+
+  if (PageMode & STANDALONE_PAGE_END)
+    XPROGPageMode |= XPROG_PAGEMODE_WRITE;
+
+  switch (Memory)
+    {
+    case STANDALONE_MEMORY_FLASH:
+      return XMEGANVM_WritePageMemory (XMEGA_NVM_CMD_LOADFLASHPAGEBUFF, XMEGA_NVM_CMD_ERASEFLASHPAGEBUFF,
+                                       XMEGA_NVM_CMD_WRITEFLASHPAGE, XPROGPageMode,
+                                       (STANDALONE_PDI_FLASH_BASE + Address), Data, Length);
+    case STANDALONE_MEMORY_EEPROM:
+      return XMEGANVM_WritePageMemory (XMEGA_NVM_CMD_LOADEEPROMPAGEBUFF, XMEGA_NVM_CMD_ERASEEEPROMPAGEBUFF,
+                                       XMEGA_NVM_CMD_ERASEWRITEEEPROMPAGE, XPROGPageMode,
+                                       (STANDALONE_PDI_EEPROM_BASE + Address), Data, Length);
+    case STANDALONE_MEMORY_FUSE:
+      for (uint8_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+        {
+          if (!(XMEGANVM_WriteByteMemory (XMEGA_NVM_CMD_WRITEFUSE,
+                                          (STANDALONE_PDI_FUSE_BASE + Address + CurrentByte),
+                                          Data[CurrentByte])))
+            return false;
+        }
+
+      return true;
+    case STANDALONE_MEMORY_LOCK:
+      return XMEGANVM_WriteByteMemory (XMEGA_NVM_CMD_WRITELOCK, STANDALONE_PDI_LOCK_ADDR, Data[0]);
+    }
+
+  return false;
+}
+
+/** Writes a chunk of a segment to a TPI target, which writes its FLASH a word at a time and has no EEPROM. The
+ *  configuration byte is erased before it is written, as chip erase leaves it alone.
+ *
+ *  \param[in] Memory   Target memory of the segment, a \c STANDALONE_MEMORY_* value
+ *  \param[in] Address  Address of the chunk in the target memory
+ *  \param[in] Data     Data of the chunk, with room for one more byte
+ *  \param[in] Length   Length of the chunk in bytes
+ *
+ *  \return Boolean \c true if the chunk was written
+ */
+static bool
+Standalone_TPIWriteChunk (const uint8_t Memory, const uint32_t Address,
+                          uint8_t* const Data, const uint8_t Length)
+{
+  switch (Memory)
+    {
+    case STANDALONE_MEMORY_FLASH:
+      return TINYNVM_WriteMemory ((STANDALONE_TPI_FLASH_BASE + Address), Data, Length);
+    case STANDALONE_MEMORY_FUSE:
+      if (!(TINYNVM_EraseMemory (TINY_NVM_CMD_SECTIONERASE, STANDALONE_TPI_CONFIG_ADDR)))
+        return false;
+
+      return TINYNVM_WriteMemory ((STANDALONE_TPI_CONFIG_ADDR + Address), Data, Length);
+    case STANDALONE_MEMORY_LOCK:
+      return TINYNVM_WriteMemory ((STANDALONE_TPI_LOCK_ADDR + Address), Data, Length);
+    }
+
+  return false;
+}
+#endif
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for Standalone.c.
+ */
+
+#ifndef _STANDALONE_
+#define _STANDALONE_
+
+/* Includes: */
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+#include <LUFA/Drivers/Board/LEDs.h>
+
+#include "V2Protocol.h"
+#include "MemoryCRC.h"
+#include "Timebase.h"
+#include "ISP/ISPTarget.h"
+#include "XPROG/XMEGANVM.h"
+#include "XPROG/TINYNVM.h"
+#include "Config/AppConfig.h"
+
+/* Macros: */
+/** Size of the store in the programmer's EEPROM holding the standalone image, header included, in bytes. */
+#define STANDALONE_STORE_SIZE          768
+
+/** Value of the first two bytes of a valid standalone image. */
+#define STANDALONE_IMAGE_MAGIC         0x5341
+
+/** Largest block of target memory written or read back at once, in bytes. */
+#define STANDALONE_CHUNK_SIZE          64
+
+/** Time after a reset of the programmer within which a second reset starts a standalone run, in milliseconds. */
+#define STANDALONE_RESET_WINDOW_MS     1000
+
+/** Value kept in uninitialised RAM across a reset while the reset window is open. */
+#define STANDALONE_RESET_MAGIC         0x53544E44UL
+
+/** Time the standalone button must be held down before a press is accepted, in milliseconds. */
+#define STANDALONE_BUTTON_DEBOUNCE_MS  50
+
+/** Chunk flag marking the first chunk written to a page, which clears the target's page buffer. */
+#define STANDALONE_PAGE_START          (1 << 0)
+
+/** Chunk flag marking the last chunk written to a page, which commits the target's page buffer. */
+#define STANDALONE_PAGE_END            (1 << 1)
+
+/** \name Addresses of the XMEGA memories in the PDI address space. */
+//@{
+#define STANDALONE_PDI_FLASH_BASE      0x0800000UL
+#define STANDALONE_PDI_EEPROM_BASE     0x08C0000UL
+#define STANDALONE_PDI_FUSE_BASE       0x08F0020UL
+#define STANDALONE_PDI_LOCK_ADDR       0x08F0027UL
+#define STANDALONE_PDI_SIGNATURE_ADDR  0x1000090UL
+//@}
+
+/** \name Addresses of the tinyAVR memories in the TPI data space. */
+//@{
+#define STANDALONE_TPI_FLASH_BASE      0x4000
+#define STANDALONE_TPI_CONFIG_ADDR     0x3F40
+#define STANDALONE_TPI_LOCK_ADDR       0x3F00
+#define STANDALONE_TPI_SIGNATURE_ADDR  0x3FC0
+//@}
+
+/* Enums: */
+/** Programming interface of the target a standalone image is intended for. */
+enum Standalone_Protocols_t
+{
+  STANDALONE_PROTOCOL_ISP = 0, /**< Serial (SPI) programming of classic AVRs */
+  STANDALONE_PROTOCOL_PDI = 1, /**< PDI programming of XMEGA AVRs */
+  STANDALONE_PROTOCOL_TPI = 2, /**< TPI programming of reduced core tinyAVRs */
+};
+
+/** Target memory a standalone image segment is written to. */
+enum Standalone_Memories_t
+{
+  STANDALONE_MEMORY_FLASH = 0, /**< FLASH, addressed in bytes */
+  STANDALONE_MEMORY_EEPROM = 1, /**< EEPROM, addressed in bytes */
+  STANDALONE_MEMORY_FUSE = 2, /**< Fuse bytes, addressed by fuse number (low, high, extended) */
+  STANDALONE_MEMORY_LOCK = 3, /**< Lock byte, always written last */
+};
+
+/** Outcome of a standalone programming run, returned by \ref Standalone_Run(). */
+enum Standalone_Results_t
+{
+  STANDALONE_RESULT_PASS = 0, /**< Every segment was written and verified */
+  STANDALONE_RESULT_NO_IMAGE = 1, /**< No valid image is stored, or it is for a protocol not built in */
+  STANDALONE_RESULT_NO_TARGET = 2, /**< The target could not be put into programming mode */
+  STANDALONE_RESULT_WRONG_SIGNATURE = 3, /**< The target's signature does not match the image */
+  STANDALONE_RESULT_WRITE_FAILED = 4, /**< The target did not complete an erase or write in time */
+  STANDALONE_RESULT_VERIFY_FAILED = 5, /**< A segment read back differently from the image */
+  STANDALONE_RESULT_TARGET_BUSY = 6, /**< A host programming session currently holds the target */
+};
+
+/** Passes made over the segments of a standalone image. */
+enum Standalone_Passes_t
+{
+  STANDALONE_PASS_WRITE = 0, /**< Writes every segment but the lock byte */
+  STANDALONE_PASS_VERIFY = 1, /**< Reads back every segment but the lock byte */
+  STANDALONE_PASS_WRITE_LOCK = 2, /**< Writes the lock byte */
+  STANDALONE_PASS_VERIFY_LOCK = 3, /**< Reads back the lock byte */
+};
+
+/* Type Defines: */
+/** Header at the start of a standalone image, all fields little endian. The header is followed by \c Length bytes
+ *  of segments, each a \ref Standalone_SegmentHeader_t followed by its data.
+ */
+typedef struct
+{
+  uint16_t Magic; /**< \ref STANDALONE_IMAGE_MAGIC */
+  uint16_t Length; /**< Length of the segments following the header, in bytes */
+  uint32_t CRC; /**< Standard CRC-32 of the segments, as computed by \ref MemoryCRC_Update() */
+  uint8_t Protocol; /**< Programming interface of the target, a \c STANDALONE_PROTOCOL_* value */
+  uint8_t Signature[3]; /**< Signature the target must have */
+  uint16_t FlashPageSize; /**< FLASH page size of the target, in bytes */
+  uint8_t EEPROMPageSize; /**< EEPROM page size of the target in bytes, or zero for byte writes */
+  uint8_t SCKDuration; /**< AVRStudio SCK duration value to program an ISP target at */
+} ATTR_PACKED Standalone_ImageHeader_t;
+
+/** Header of a segment of a standalone image. */
+typedef struct
+{
+  uint8_t Memory; /**< Target memory of the segment, a \c STANDALONE_MEMORY_* value */
+  uint32_t Address; /**< Start address of the segment in the target memory */
+  uint16_t Length; /**< Length of the segment data following the header, in bytes */
+} ATTR_PACKED Standalone_SegmentHeader_t;
+
+/* External Variables: */
+extern volatile bool Standalone_Running;
+
+/* Function Prototypes: */
+void
+Standalone_Init (void);
+void
+Standalone_Task (void);
+uint8_t
+Standalone_Run (void);
+void
+Standalone_WriteImage (void);
+void
+Standalone_RunCommand (void);
+
+#if (defined(INCLUDE_FROM_STANDALONE_C) && defined(ENABLE_STANDALONE_MODE))
+static bool Standalone_ReadImageHeader(Standalone_ImageHeader_t* const Header);
+static uint8_t Standalone_ProcessSegments(const Standalone_ImageHeader_t* const Header, const uint8_t Pass);
+static uint8_t Standalone_ProcessSegment(const Standalone_ImageHeader_t* const Header,
+                                         const Standalone_SegmentHeader_t* const Segment,
+                                         uint16_t DataOffset, const uint8_t Pass);
+static bool Standalone_EnterProgMode(const Standalone_ImageHeader_t* const Header);
+static void Standalone_LeaveProgMode(const Standalone_ImageHeader_t* const Header);
+static bool Standalone_ReadSignature(const Standalone_ImageHeader_t* const Header, uint8_t* const Signature);
+static bool Standalone_EraseChip(const Standalone_ImageHeader_t* const Header);
+static bool Standalone_WriteChunk(const Standalone_ImageHeader_t* const Header, const uint8_t Memory,
+                                  const uint32_t Address, uint8_t* const Data, const uint8_t Length,
+                                  const uint8_t PageMode);
+static bool Standalone_ReadChunk(const Standalone_ImageHeader_t* const Header, const uint8_t Memory,
+                                 const uint32_t Address, uint8_t* const Data, const uint8_t Length);
+#if defined(ENABLE_ISP_PROTOCOL)
+static uint8_t Standalone_ISPInstruction(const uint8_t Command, const uint16_t Address, const uint8_t Data);
+static void Standalone_ISPLoadExtendedAddress(const uint32_t Address);
+static bool Standalone_ISPWriteChunk(const Standalone_ImageHeader_t* const Header, const uint8_t Memory,
+                                     const uint32_t Address, const uint8_t* const Data, const uint8_t Length,
+                                     const uint8_t PageMode);
+static bool Standalone_ISPReadChunk(const uint8_t Memory, const uint32_t Address, uint8_t* const Data,
+                                    const uint8_t Length);
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+static bool Standalone_PDIWriteChunk(const uint8_t Memory, const uint32_t Address, const uint8_t* const Data,
+                                     const uint8_t Length, const uint8_t PageMode);
+static bool Standalone_TPIWriteChunk(const uint8_t Memory, const uint32_t Address, uint8_t* const Data,
+                                     const uint8_t Length);
+#endif
+#endif
+
+#endif
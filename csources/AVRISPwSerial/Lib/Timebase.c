@@ -0,0 +1,154 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Timebase service, shared by the programmer and the serial bridge. TIMER3 runs continuously as a 1ms tick with
+ *  4us resolution, from which deadlines for non-blocking delays and timeouts are measured and the command timeout
+ *  countdown is driven. Also arbitrates TIMER1, which the OSCCAL calibration reconfigures for its own use.
+ */
+
+#include "Timebase.h"
+
+/** Milliseconds elapsed since the timebase was started. */
+static volatile uint32_t Timebase_Milliseconds;
+
+/** Milliseconds remaining until the next decrement of the command timeout countdown. */
+static uint8_t Timebase_TimeoutPrescaler;
+
+/** Current user of TIMER1, as a \c TIMEBASE_TIMER1_* value. */
+static uint8_t Timebase_Timer1Owner = TIMEBASE_TIMER1_FREE;
+
+/** ISR to advance the timebase by one millisecond and drive the command timeout countdown. */
+ISR(TIMER3_COMPA_vect, ISR_NOBLOCK)
+{
+  Timebase_Milliseconds++;
+
+  if (!(--Timebase_TimeoutPrescaler))
+    {
+      Timebase_TimeoutPrescaler = TIMEBASE_TIMEOUT_TICK_MS;
+
+      if (TimeoutTicksRemaining)
+        TimeoutTicksRemaining--;
+    }
+}
+
+/** Starts the timebase. With the 1/64 prescaler TIMER3 counts in 4us steps, and clearing it on compare match
+ *  after \ref TIMEBASE_TICKS_PER_MS counts gives the millisecond tick.
+ */
+void
+Timebase_Init (void)
+{
+  Timebase_TimeoutPrescaler = TIMEBASE_TIMEOUT_TICK_MS;
+
+  TCCR3A = 0;
+  TCCR3B = 0;
+  TCNT3 = 0;
+  OCR3A = (TIMEBASE_TICKS_PER_MS - 1);
+  TIFR3 = (1 << OCF3A);
+  TIMSK3 = (1 << OCIE3A);
+  TCCR3B = ((1 << WGM32) | (1 << CS31) | (1 << CS30));
+}
+
+/** Retrieves the current time.
+ *
+ *  \return Current point in time, in timebase ticks
+ */
+Timebase_Time_t
+Timebase_Now (void)
+{
+  uint32_t Milliseconds;
+  uint8_t Counts;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      Milliseconds = Timebase_Milliseconds;
+      Counts = TCNT3;
+
+      /* The counter may have wrapped since interrupts were disabled, without the tick being counted yet */
+      if (TIFR3 & (1 << OCF3A))
+        {
+          Milliseconds++;
+          Counts = TCNT3;
+        }
+    }
+
+  return (Milliseconds * TIMEBASE_TICKS_PER_MS) + Counts;
+}
+
+/** Determines if a deadline, obtained from \ref Timebase_Deadline(), has passed.
+ *
+ *  \param[in] Deadline  Point in time to check
+ *
+ *  \return Boolean \c true if the deadline has passed, \c false otherwise
+ */
+bool
+Timebase_HasExpired (const Timebase_Time_t Deadline)
+{
+  return ((int32_t) (Timebase_Now () - Deadline) >= 0);
+}
+
+/** Claims TIMER1 for a user. If the timer was in use by someone else, it is stopped and its interrupts disabled so
+ *  that none of the previous configuration is left to interfere with the new user.
+ *
+ *  \param[in] Owner  User claiming the timer, as a \c TIMEBASE_TIMER1_* value
+ *
+ *  \return Boolean \c true if the timer changed hands and must be reconfigured, \c false if it was already owned
+ */
+bool
+Timebase_ClaimTimer1 (const uint8_t Owner)
+{
+  if (Timebase_Timer1Owner == Owner)
+    return false;
+
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TIMSK1 = 0;
+  TIFR1 = ((1 << ICF1) | (1 << OCF1C) | (1 << OCF1B) | (1 << OCF1A) | (1 << TOV1));
+
+  Timebase_Timer1Owner = Owner;
+  return true;
+}
+
+/** Releases TIMER1 after use, stopping it. Nothing is done if the timer has since been claimed by another user.
+ *
+ *  \param[in] Owner  User releasing the timer, as a \c TIMEBASE_TIMER1_* value
+ */
+void
+Timebase_ReleaseTimer1 (const uint8_t Owner)
+{
+  if (Timebase_Timer1Owner != Owner)
+    return;
+
+  TCCR1B = 0;
+  TIMSK1 = 0;
+
+  Timebase_Timer1Owner = TIMEBASE_TIMER1_FREE;
+}
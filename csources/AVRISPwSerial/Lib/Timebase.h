@@ -0,0 +1,102 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for Timebase.c.
+ */
+
+#ifndef _TIMEBASE_
+#define _TIMEBASE_
+
+/* Includes: */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdbool.h>
+
+/* Macros: */
+/** Resolution of the timebase, in microseconds per tick. */
+#define TIMEBASE_US_PER_TICK         4
+
+/** Number of timebase ticks in each millisecond. */
+#define TIMEBASE_TICKS_PER_MS        (1000 / TIMEBASE_US_PER_TICK)
+
+/** Converts a duration in milliseconds into timebase ticks. */
+#define TIMEBASE_MS(Milliseconds)    ((Timebase_Time_t)(Milliseconds) * TIMEBASE_TICKS_PER_MS)
+
+/** Converts a duration in microseconds into timebase ticks, rounding up so that the duration is never shortened. */
+#define TIMEBASE_US(Microseconds)    (((Timebase_Time_t)(Microseconds) + (TIMEBASE_US_PER_TICK - 1)) / TIMEBASE_US_PER_TICK)
+
+/** Period of the \ref TimeoutTicksRemaining countdown, in milliseconds. */
+#define TIMEBASE_TIMEOUT_TICK_MS     10
+
+/** Timeout countdown of the command being processed, decremented every \ref TIMEBASE_TIMEOUT_TICK_MS while non-zero.
+ *  Busy-wait loops poll it to abort once the command has run out of time, so it is kept in a GPIOR for speed. */
+#define TimeoutTicksRemaining        GPIOR1
+
+/** \name TIMER1 users, which must claim the timer with \ref Timebase_ClaimTimer1() before configuring it. */
+//@{
+#define TIMEBASE_TIMER1_FREE         0
+#define TIMEBASE_TIMER1_CALIBRATION  1
+//@}
+
+/* Type Defines: */
+/** Type define for a point in time or a duration, in timebase ticks. Points in time wrap around, so they may only be
+ *  compared through \ref Timebase_HasExpired(), for durations of up to half the range of the type (over two hours). */
+typedef uint32_t Timebase_Time_t;
+
+/* Function Prototypes: */
+void
+Timebase_Init (void);
+Timebase_Time_t
+Timebase_Now (void);
+bool
+Timebase_HasExpired (const Timebase_Time_t Deadline);
+bool
+Timebase_ClaimTimer1 (const uint8_t Owner);
+void
+Timebase_ReleaseTimer1 (const uint8_t Owner);
+
+/* Inline Functions: */
+/** Computes the deadline a given duration from now, for use with \ref Timebase_HasExpired().
+ *
+ *  \param[in] Duration  Duration in timebase ticks, see \ref TIMEBASE_MS() and \ref TIMEBASE_US()
+ *
+ *  \return Point in time at which the duration will have elapsed
+ */
+static inline Timebase_Time_t
+Timebase_Deadline (const Timebase_Time_t Duration)
+{
+  return Timebase_Now () + Duration;
+}
+
+#endif
+
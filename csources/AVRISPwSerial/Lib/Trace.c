@@ -0,0 +1,160 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Protocol trace. Every command from the host leaves a compact record in a small RAM ring buffer, with its start
+ *  time and duration, its sub-command, the memory range it accessed and the status it returned, so that a failed
+ *  programming session can be looked into after the fact by reading the trace back with the vendor CMD_READ_TRACE
+ *  command. Filling in a record only costs a few stores per command, so the trace can be left on in production.
+ *
+ *  A command batch leaves a single record, of the CMD_BATCH command, with the number of commands it ran as its
+ *  sub-command.
+ */
+
+#define  INCLUDE_FROM_TRACE_C
+#include "Trace.h"
+#include "V2Protocol.h"
+
+#if defined(ENABLE_PROTOCOL_TRACE) || defined(__DOXYGEN__)
+
+/** Ring buffer of the last trace records, \ref Trace_Next indexing the oldest once it has wrapped. */
+static Trace_Record_t Trace_Records[TRACE_RECORDS];
+
+/** Index of the record to be overwritten by the next command. */
+static uint8_t Trace_Next;
+
+/** Number of records held, up to \ref TRACE_RECORDS. */
+static uint8_t Trace_Count;
+
+/** Number of commands traced since the trace was last cleared, wrapping, so that the host can tell how many
+ *  records were overwritten between two reads.
+ */
+static uint16_t Trace_Sequence;
+
+/** Record of the command being processed, copied into the ring buffer once the command ends. */
+Trace_Record_t Trace_Current;
+
+/** Time at which the command being processed started. */
+static Timebase_Time_t Trace_CommandStart;
+
+/** Initializes the trace, empty. */
+void
+Trace_Init (void)
+{
+  Trace_Next = 0;
+  Trace_Count = 0;
+  Trace_Sequence = 0;
+}
+
+/** Starts the record of a command received from the host.
+ *
+ *  \param[in] V2Command  Command byte of the command received
+ *  \param[in] Address    Current memory address, recorded unless the command gives the range it accesses
+ */
+void
+Trace_BeginCommand (const uint8_t V2Command, const uint32_t Address)
+{
+  Trace_CommandStart = Timebase_Now ();
+
+  Trace_Current.Timestamp = (Trace_CommandStart >> TRACE_TIMESTAMP_SHIFT);
+  Trace_Current.Command = V2Command;
+  Trace_Current.SubCommand = 0;
+  Trace_Current.Address = Address;
+  Trace_Current.Length = 0;
+}
+
+/** Ends the record of the command being processed, once its response has been sent, storing it in the ring buffer
+ *  over the oldest record if it is full.
+ *
+ *  \param[in] Status  Status returned to the host, or \ref TRACE_STATUS_NONE if the command did not report one
+ */
+void
+Trace_EndCommand (const uint8_t Status)
+{
+  Timebase_Time_t Duration = ((Timebase_Now () - Trace_CommandStart) >> TRACE_DURATION_SHIFT);
+
+  Trace_Current.Status = Status;
+  Trace_Current.Duration = ((Duration > UINT16_MAX) ? UINT16_MAX : Duration);
+
+  Trace_Records[Trace_Next] = Trace_Current;
+
+  if (++Trace_Next == TRACE_RECORDS)
+    Trace_Next = 0;
+
+  if (Trace_Count < TRACE_RECORDS)
+    Trace_Count++;
+
+  Trace_Sequence++;
+}
+
+/** Handler for the vendor CMD_READ_TRACE command, returning the trace records held, oldest first, after their
+ *  number and the sequence number of the latest command traced, big endian. The records themselves are returned
+ *  as laid out in \ref Trace_Record_t. The trace is cleared afterwards if \ref TRACE_READ_CLEAR is set in the
+ *  command flags. The CMD_READ_TRACE command itself is traced once its response has been sent, so it is the first
+ *  record of the next read.
+ */
+void
+Trace_ReadCommand (void)
+{
+  uint8_t Flags = V2Protocol_Read_8 ();
+  uint8_t Record = ((Trace_Next + (TRACE_RECORDS - Trace_Count)) % TRACE_RECORDS);
+
+  V2Protocol_BeginResponse ();
+  V2Protocol_Write_8 (CMD_READ_TRACE);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_Write_8 (Trace_Count);
+  V2Protocol_Write_8 (Trace_Sequence >> 8);
+  V2Protocol_Write_8 (Trace_Sequence & 0xFF);
+
+  for (uint8_t RecordsSent = 0; RecordsSent < Trace_Count; RecordsSent++)
+    {
+      Endpoint_Write_Stream_LE (&Trace_Records[Record], sizeof(Trace_Record_t), NULL);
+
+      if (++Record == TRACE_RECORDS)
+        Record = 0;
+    }
+
+  if (Flags & TRACE_READ_CLEAR)
+    Trace_Init ();
+
+  bool IsEndpointFull = !(Endpoint_IsReadWriteAllowed ());
+  Endpoint_ClearIN ();
+
+  /* Ensure last packet is a short packet to terminate the transfer */
+  if (IsEndpointFull)
+    {
+      Endpoint_WaitUntilReady ();
+      Endpoint_ClearIN ();
+      Endpoint_WaitUntilReady ();
+    }
+}
+
+#endif
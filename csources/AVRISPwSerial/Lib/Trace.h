@@ -0,0 +1,130 @@
+/*
+ LUFA Library
+ Copyright (C) Dean Camera, 2019.
+
+ dean [at] fourwalledcubicle [dot] com
+ www.lufa-lib.org
+ */
+
+/*
+ Copyright 2019  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+ Permission to use, copy, modify, distribute, and sell this
+ software and its documentation for any purpose is hereby granted
+ without fee, provided that the above copyright notice appear in
+ all copies and that both that the copyright notice and this
+ permission notice and warranty disclaimer appear in supporting
+ documentation, and that the name of the author not be used in
+ advertising or publicity pertaining to distribution of the
+ software without specific, written prior permission.
+
+ The author disclaims all warranties with regard to this
+ software, including all implied warranties of merchantability
+ and fitness.  In no event shall the author be liable for any
+ special, indirect or consequential damages or any damages
+ whatsoever resulting from loss of use, data or profits, whether
+ in an action of contract, negligence or other tortious action,
+ arising out of or in connection with the use or performance of
+ this software.
+ */
+
+/** \file
+ *
+ *  Header file for Trace.c.
+ */
+
+#ifndef _TRACE_
+#define _TRACE_
+
+/* Includes: */
+#include <avr/io.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <LUFA/Common/Common.h>
+
+#include "Timebase.h"
+#include "V2ProtocolConstants.h"
+#include "Config/AppConfig.h"
+
+/* Macros: */
+#if !defined(TRACE_RECORDS) || defined(__DOXYGEN__)
+/** Number of trace records kept, the oldest being overwritten once they are all used. Can be overridden in
+ *  AppConfig.h.
+ */
+#define TRACE_RECORDS                 16
+#endif
+
+/** Right shift turning timebase ticks into the units of the trace record timestamps, of 1.024 milliseconds. */
+#define TRACE_TIMESTAMP_SHIFT         8
+
+/** Right shift turning timebase ticks into the units of the trace record durations, of 64 microseconds. */
+#define TRACE_DURATION_SHIFT          4
+
+/** Status of a trace record whose command did not report one, such as a command failing its parameter checks. */
+#define TRACE_STATUS_NONE             0xFF
+
+/** Flag of the vendor CMD_READ_TRACE command, clearing the trace once it has been read. */
+#define TRACE_READ_CLEAR              (1 << 0)
+
+/* Type Defines: */
+/** Trace record of a command received from the host, returned to the host as laid out here, little endian. */
+typedef struct
+{
+  uint16_t Timestamp; /**< Start of the command, in units of 1.024ms since startup, wrapping */
+  uint16_t Duration; /**< Time taken by the command, in units of 64us, saturating at its maximum */
+  uint8_t Command;
+  uint8_t SubCommand; /**< XPROG command of an XPROG command, or number of commands run of a command batch */
+  uint8_t Status; /**< Status returned to the host, or \ref TRACE_STATUS_NONE */
+  uint32_t Address; /**< Start address of the memory accessed, or the current address of other commands */
+  uint16_t Length; /**< Number of memory bytes accessed, or zero */
+} Trace_Record_t;
+
+/* External Variables: */
+#if defined(ENABLE_PROTOCOL_TRACE)
+extern Trace_Record_t Trace_Current;
+#endif
+
+/* Function Prototypes: */
+#if defined(ENABLE_PROTOCOL_TRACE)
+void
+Trace_Init (void);
+void
+Trace_BeginCommand (const uint8_t V2Command, const uint32_t Address);
+void
+Trace_EndCommand (const uint8_t Status);
+void
+Trace_ReadCommand (void);
+#endif
+
+/* Inline Functions: */
+/** Records the sub-command of the command being traced.
+ *
+ *  \param[in] SubCommand  Sub-command to record
+ */
+static inline void Trace_SetSubCommand(const uint8_t SubCommand) ATTR_ALWAYS_INLINE;
+static inline void
+Trace_SetSubCommand (const uint8_t SubCommand)
+{
+#if defined(ENABLE_PROTOCOL_TRACE)
+  Trace_Current.SubCommand = SubCommand;
+#endif
+}
+
+/** Records the memory range accessed by the command being traced.
+ *
+ *  \param[in] Address  Start address of the range
+ *  \param[in] Length   Length of the range in bytes
+ */
+static inline void Trace_SetRange(const uint32_t Address, const uint16_t Length) ATTR_ALWAYS_INLINE;
+static inline void
+Trace_SetRange (const uint32_t Address, const uint16_t Length)
+{
+#if defined(ENABLE_PROTOCOL_TRACE)
+  Trace_Current.Address = Address;
+  Trace_Current.Length = Length;
+#endif
+}
+
+#endif
+
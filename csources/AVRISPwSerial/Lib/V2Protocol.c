@@ -42,79 +42,45 @@ uint32_t CurrentAddress;
 /** Flag to indicate that the next read/write operation must update the device's current extended FLASH address */
 bool MustLoadExtendedAddress;
 
-///** ISR to manage timeouts whilst processing a V2Protocol command */
-//ISR(TIMER0_COMPA_vect, ISR_NOBLOCK)
-//{
-//  if (TimeoutTicksRemaining)
-//    TimeoutTicksRemaining--;
-//  else
-//    TCCR0B = 0;
-//}
-//
-//static inline
-//void initTimeoutTimer (void)
-//{
-//  /* Timeout timer initialization (~10ms period) */
-//  OCR0A = (((F_CPU / 1024) / 100) - 1);
-//  TCCR0A = (1 << WGM01);
-//  TIMSK0 = (1 << OCIE0A);
-//}
-//
-//static inline
-//void startTimeoutTimer (void)
-//{
-//  /* Reset timeout counter duration and start the timer */
-//  TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
-//  TCCR0B = ((1 << CS02) | (1 << CS00));
-//}
-//
-//static inline
-//void stopTimeoutTimer (void)
-//{
-//  /* Disable the timeout management timer */
-//  TCCR0B = 0;
-//}
-
-/** ISR to manage timeouts whilst processing a V2Protocol command */
-ISR(TIMER3_OVF_vect, ISR_NOBLOCK)
-{
-  if (TimeoutTicksRemaining)
-    TimeoutTicksRemaining--;
-  else
-    TCCR3B = 0;
-}
+/** Flag to indicate that a programming session currently drives the target /RESET line and the programming
+ *  interface pins, which the serial bridge must then leave alone.
+ */
+volatile bool TargetInProgMode;
 
-static inline
-void initTimeoutTimer (void)
-{
-  /* Timeout timer initialization (~10ms period) */
-  TCCR3A = (1 << WGM31); // FastPWM 9 bit (512)
-  TIMSK3 = (1 << TOIE3);
-}
+#if defined(ENABLE_COMMAND_BATCH)
+/** Vendor CMD_BATCH command currently being run, or NULL while commands are exchanged with the host directly. */
+static V2Protocol_Batch_t* V2Protocol_CurrentBatch;
+#endif
 
-static inline
-void startTimeoutTimer (void)
-{
-  /* Reset timeout counter duration and start the timer */
-  TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
-  TCCR3B = (1 << CS32);  // Prescaller 256
-}
+/** Number of bytes of the response to the command being processed written so far, up to past its status byte. */
+static uint8_t V2Protocol_ResponseBytes;
 
-static inline
-void stopTimeoutTimer (void)
-{
-  /* Disable the timeout management timer */
-  TCCR3B = 0;
-}
+/** Position of the status byte in the response to the command being processed. */
+static uint8_t V2Protocol_StatusPosition;
+
+/** Status returned to the host for the command being processed, or \ref TRACE_STATUS_NONE if it did not report one,
+ *  such as a command failing its parameter checks.
+ */
+static uint8_t V2Protocol_ResponseStatus;
 
 /** Initializes the hardware and software associated with the V2 protocol command handling. */
 void
 V2Protocol_Init (void)
 {
-  initTimeoutTimer();
-
   V2Params_LoadNonVolatileParamValues ();
 
+#if defined(ENABLE_LATENCY_PROFILE)
+  Profiler_Init ();
+#endif
+
+#if defined(ENABLE_PROTOCOL_TRACE)
+  Trace_Init ();
+#endif
+
+#if defined(ENABLE_HEALTH_COUNTERS)
+  Health_Init ();
+#endif
+
 #if defined(ENABLE_ISP_PROTOCOL)
   ISPTarget_ConfigureRescueClock ();
 #endif
@@ -129,7 +95,69 @@ V2Protocol_ProcessCommand (void)
 {
   uint8_t V2Command = Endpoint_Read_8 ();
 
-  startTimeoutTimer();
+  /* XPROG commands give their status after the XPROG command byte, other commands after the command byte */
+  V2Protocol_ResponseBytes = 0;
+  V2Protocol_StatusPosition = ((V2Command == CMD_XPROG) ? 2 : 1);
+  V2Protocol_ResponseStatus = TRACE_STATUS_NONE;
+
+#if defined(ENABLE_PROTOCOL_TRACE)
+  Trace_BeginCommand (V2Command, CurrentAddress);
+#endif
+#if defined(ENABLE_LATENCY_PROFILE)
+  Profiler_BeginCommand (V2Command);
+#endif
+#if defined(ENABLE_HEALTH_COUNTERS)
+  Health_BeginCommand ();
+#endif
+
+  V2Protocol_DispatchCommand (V2Command);
+
+#if defined(ENABLE_HEALTH_COUNTERS)
+  Health_EndCommand (V2Command, V2Protocol_ResponseStatus);
+#endif
+
+#if defined(ENABLE_STACK_MONITOR)
+  StackMonitor_EndCommand (V2Command);
+#endif
+
+  Endpoint_WaitUntilReady ();
+
+  /* The command ends once the host has collected the last of its response */
+  Profiler_EnterPhase (PROFILER_PHASE_USB_IN);
+  V2Protocol_FlushINBanks ();
+
+#if defined(ENABLE_LATENCY_PROFILE)
+  Profiler_EndCommand ();
+#endif
+#if defined(ENABLE_PROTOCOL_TRACE)
+  Trace_EndCommand (V2Protocol_ResponseStatus);
+#endif
+
+  Endpoint_SelectEndpoint (AVRISP_DATA_OUT_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_OUT);
+}
+
+/** Passes off the handling of a V2 Protocol command to the appropriate function, either for a command received
+ *  from the host or for one of the commands of a vendor CMD_BATCH command.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
+static void
+V2Protocol_DispatchCommand (const uint8_t V2Command)
+{
+  /* Start the command timeout countdown, which the timebase runs down while the command is processed */
+  TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+
+#if defined(ENABLE_ISP_PROTOCOL)
+  /* A page left committing by pipelined programming must complete before the target is used for anything else */
+  if ((V2Command != CMD_PROGRAM_FLASH_ISP)
+      && (V2Command != CMD_PROGRAM_EEPROM_ISP)
+      && (V2Command != CMD_LOAD_ADDRESS))
+    ISPProtocol_WaitForDeferredCommit ();
+#endif
+
+  /* Buffers the handler takes from the arena are given back once it returns, leaving those of an enclosing batch */
+  uint16_t ArenaMark = BufferArena_Mark ();
 
   switch (V2Command)
     {
@@ -157,10 +185,25 @@ V2Protocol_ProcessCommand (void)
     case CMD_PROGRAM_EEPROM_ISP:
       ISPProtocol_ProgramMemory (V2Command);
       break;
+    case CMD_PROGRAM_FLUSH_ISP:
+      ISPProtocol_FlushProgramMemory ();
+      break;
+    case CMD_PROG_FLASH_STREAM_ISP:
+    case CMD_PROG_EEPROM_STREAM_ISP:
+      ISPProtocol_ProgramMemoryStream (V2Command);
+      break;
     case CMD_READ_FLASH_ISP:
     case CMD_READ_EEPROM_ISP:
       ISPProtocol_ReadMemory (V2Command);
       break;
+    case CMD_READ_FLASH_STREAM_ISP:
+    case CMD_READ_EEPROM_STREAM_ISP:
+      ISPProtocol_ReadMemoryStream (V2Command);
+      break;
+    case CMD_READ_FLASH_CRC_ISP:
+    case CMD_READ_EEPROM_CRC_ISP:
+      ISPProtocol_ReadMemoryCRC (V2Command);
+      break;
     case CMD_CHIP_ERASE_ISP:
       ISPProtocol_ChipErase ();
       break;
@@ -180,6 +223,9 @@ V2Protocol_ProcessCommand (void)
     case CMD_SPI_MULTI:
       ISPProtocol_SPIMulti ();
       break;
+    case CMD_ISP_SEQUENCE:
+      ISPSequence_Command ();
+      break;
 #endif
 #if defined(ENABLE_XPROG_PROTOCOL)
     case CMD_XPROG_SETMODE:
@@ -188,17 +234,294 @@ V2Protocol_ProcessCommand (void)
     case CMD_XPROG:
       XPROGProtocol_Command ();
       break;
+#endif
+#if defined(ENABLE_STANDALONE_MODE)
+    case CMD_STANDALONE_WRITE_IMAGE:
+      Standalone_WriteImage ();
+      break;
+    case CMD_STANDALONE_RUN:
+      Standalone_RunCommand ();
+      break;
+#endif
+#if defined(ENABLE_COMMAND_BATCH)
+    case CMD_BATCH:
+      V2Protocol_Batch ();
+      break;
+#endif
+#if defined(ENABLE_LATENCY_PROFILE)
+    case CMD_READ_PROFILE:
+      Profiler_ReadCommand ();
+      break;
+#endif
+#if defined(ENABLE_PROTOCOL_TRACE)
+    case CMD_READ_TRACE:
+      Trace_ReadCommand ();
+      break;
+#endif
+#if defined(ENABLE_HEALTH_COUNTERS)
+    case CMD_READ_HEALTH:
+      Health_ReadCommand ();
+      break;
 #endif
     default:
       V2Protocol_UnknownCommand (V2Command);
       break;
     }
 
-  stopTimeoutTimer();
+  BufferArena_Release (ArenaMark);
+}
 
-  Endpoint_WaitUntilReady ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_OUT_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_OUT);
+/** Yield point for the handlers which wait on the target, called from their busy-wait loops. Pending USB control
+ *  requests are answered from here, so that the host does not time them out during a chip erase or a slow page
+ *  write. If the device has been deconfigured meanwhile the command timeout is forced, aborting the command, unless
+ *  a standalone run is driving the target, which needs no host.
+ */
+void
+V2Protocol_Yield (void)
+{
+  USB_USBTask ();
+
+#if defined(ENABLE_STANDALONE_MODE)
+  if (Standalone_Running)
+    return;
+#endif
+
+  if (USB_DeviceState != DEVICE_STATE_Configured)
+    TimeoutTicksRemaining = 0;
+}
+
+/** Reads the next parameter byte of the command being processed, from the AVRISP data OUT endpoint or from the
+ *  command batch being run. The command handlers read their parameters and write their responses through these
+ *  functions, so that they may be run from a vendor CMD_BATCH command as well as directly by the host.
+ *
+ *  \return Next parameter byte, or zero if a batched command has no more parameters
+ */
+uint8_t
+V2Protocol_Read_8 (void)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  V2Protocol_Batch_t* Batch = V2Protocol_CurrentBatch;
+
+  if (Batch)
+    {
+      if (!(Batch->ReadRemaining))
+        {
+          Batch->ReadOverrun = true;
+          return 0;
+        }
+
+      Batch->ReadRemaining--;
+      return *(Batch->ReadPosition++);
+    }
+#endif
+
+  return Endpoint_Read_8 ();
+}
+
+/** Reads the next two parameter bytes of the command being processed, as a big endian value.
+ *
+ *  \return Next 16-bit parameter value
+ */
+uint16_t
+V2Protocol_Read_16_BE (void)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  if (V2Protocol_CurrentBatch)
+    {
+      uint16_t Data = ((uint16_t) V2Protocol_Read_8 () << 8);
+      return (Data | V2Protocol_Read_8 ());
+    }
+#endif
+
+  return Endpoint_Read_16_BE ();
+}
+
+/** Reads the next four parameter bytes of the command being processed, as a big endian value.
+ *
+ *  \return Next 32-bit parameter value
+ */
+uint32_t
+V2Protocol_Read_32_BE (void)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  if (V2Protocol_CurrentBatch)
+    {
+      uint32_t Data = ((uint32_t) V2Protocol_Read_16_BE () << 16);
+      return (Data | V2Protocol_Read_16_BE ());
+    }
+#endif
+
+  return Endpoint_Read_32_BE ();
+}
+
+/** Reads the given number of parameter bytes of the command being processed into a buffer, in the order sent.
+ *
+ *  \param[out] Buffer  Buffer to read the parameters into
+ *  \param[in]  Length  Number of bytes to read
+ */
+void
+V2Protocol_ReadParams (void* const Buffer, const uint16_t Length)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  if (V2Protocol_CurrentBatch)
+    {
+      uint8_t* CurrentByte = (uint8_t*) Buffer;
+
+      for (uint16_t BytesRead = 0; BytesRead < Length; BytesRead++)
+        *(CurrentByte++) = V2Protocol_Read_8 ();
+
+      return;
+    }
+#endif
+
+  Endpoint_Read_Stream_LE (Buffer, Length, NULL);
+}
+
+/** Ends the reading of the parameters of the command being processed and starts its response, turning the AVRISP
+ *  data endpoint around from OUT to IN unless the command is part of a command batch.
+ */
+void
+V2Protocol_BeginResponse (void)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  if (V2Protocol_CurrentBatch)
+    return;
+#endif
+
+  Endpoint_ClearOUT ();
+  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
+  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+}
+
+/** Writes the next byte of the response to the command being processed, to the AVRISP data IN endpoint or to the
+ *  response buffer of the command batch being run.
+ *
+ *  \param[in] Data  Response byte to write
+ */
+void
+V2Protocol_Write_8 (const uint8_t Data)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  V2Protocol_Batch_t* Batch = V2Protocol_CurrentBatch;
+
+  if (Batch)
+    {
+      if (Batch->ResponseLength < sizeof(Batch->Response))
+        Batch->Response[Batch->ResponseLength++] = Data;
+      else
+        Batch->ResponseOverflow = true;
+
+      return;
+    }
+#endif
+
+  /* Pick the status out of the response header, for the trace and the health counters */
+  if (V2Protocol_ResponseBytes < V2Protocol_StatusPosition)
+    {
+      V2Protocol_ResponseBytes++;
+    }
+  else if (V2Protocol_ResponseBytes == V2Protocol_StatusPosition)
+    {
+      V2Protocol_ResponseStatus = Data;
+      V2Protocol_ResponseBytes++;
+    }
+
+  Endpoint_Write_8 (Data);
+}
+
+/** Writes the next four bytes of the response to the command being processed, as a big endian value.
+ *
+ *  \param[in] Data  32-bit response value to write
+ */
+void
+V2Protocol_Write_32_BE (const uint32_t Data)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  if (V2Protocol_CurrentBatch)
+    {
+      for (int8_t Shift = 24; Shift >= 0; Shift -= 8)
+        V2Protocol_Write_8 (Data >> Shift);
+
+      return;
+    }
+#endif
+
+  Endpoint_Write_32_BE (Data);
+}
+
+/** Writes a buffer of response bytes to the response of the command being processed, in order.
+ *
+ *  \param[in] Buffer  Buffer holding the response bytes
+ *  \param[in] Length  Number of bytes to write
+ */
+void
+V2Protocol_WriteStream (const void* const Buffer, const uint16_t Length)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  if (V2Protocol_CurrentBatch)
+    {
+      const uint8_t* CurrentByte = (const uint8_t*) Buffer;
+
+      for (uint16_t BytesWritten = 0; BytesWritten < Length; BytesWritten++)
+        V2Protocol_Write_8 (*(CurrentByte++));
+
+      return;
+    }
+#endif
+
+  Endpoint_Write_Stream_LE (Buffer, Length, NULL);
+}
+
+/** Ends the response to the command being processed, sending it to the host unless the command is part of a
+ *  command batch.
+ */
+void
+V2Protocol_EndResponse (void)
+{
+#if defined(ENABLE_COMMAND_BATCH)
+  if (V2Protocol_CurrentBatch)
+    return;
+#endif
+
+  Endpoint_ClearIN ();
+}
+
+/** Waits until every queued bank of the AVRISP data IN endpoint has been read by the host. When the data
+ *  IN and OUT endpoints share one physical double-banked endpoint, \c Endpoint_WaitUntilReady() returns as
+ *  soon as one bank is free, so the last response packet may still be pending when the endpoint direction
+ *  is turned around for the next command.
+ */
+static void
+V2Protocol_FlushINBanks (void)
+{
+#if (AVRISP_DATA_EPBANKS > 1)
+  if ((AVRISP_DATA_IN_EPADDR & ENDPOINT_EPNUM_MASK)
+      != (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK))
+    return;
+
+  if (Endpoint_GetEndpointDirection () != ENDPOINT_DIR_IN)
+    return;
+
+  uint16_t PreviousFrameNumber = USB_Device_GetFrameNumber ();
+  uint8_t TimeoutMSRem = USB_STREAM_TIMEOUT_MS;
+
+  while (Endpoint_GetBusyBanks ())
+    {
+      if ((USB_DeviceState != DEVICE_STATE_Configured)
+          || Endpoint_IsStalled ())
+        return;
+
+      uint16_t CurrentFrameNumber = USB_Device_GetFrameNumber ();
+
+      if (CurrentFrameNumber != PreviousFrameNumber)
+        {
+          PreviousFrameNumber = CurrentFrameNumber;
+
+          if (!(TimeoutMSRem--))
+            return;
+        }
+    }
+#endif
 }
 
 /** Handler for unknown V2 protocol commands. This discards all sent data and returns a
@@ -220,8 +543,8 @@ V2Protocol_UnknownCommand (const uint8_t V2Command)
   Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
   Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
 
-  Endpoint_Write_8 (V2Command);
-  Endpoint_Write_8 (STATUS_CMD_UNKNOWN);
+  V2Protocol_Write_8 (V2Command);
+  V2Protocol_Write_8 (STATUS_CMD_UNKNOWN);
   Endpoint_ClearIN ();
 }
 
@@ -229,15 +552,31 @@ V2Protocol_UnknownCommand (const uint8_t V2Command)
 static void
 V2Protocol_SignOn (void)
 {
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  /* Vendor extensions are opt-in per session, so a new host never inherits them from the previous one */
+  V2Params_SetParameterValue (PARAM_PROG_PIPELINE, 0);
+  V2Params_SetParameterValue (PARAM_PROG_SKIP_BLANK, 0);
+  V2Params_SetParameterValue (PARAM_PROG_SKIP_UNCHANGED, 0);
+  V2Params_SetParameterValue (PARAM_PROG_UNCHANGED_LOW, 0);
+  V2Params_SetParameterValue (PARAM_PROG_UNCHANGED_HIGH, 0);
+  V2Params_SetParameterValue (PARAM_ISP_USART_SPI, 0);
+  V2Params_SetParameterValue (PARAM_ISP_SCK_PERIOD_LOW, 0);
+  V2Params_SetParameterValue (PARAM_ISP_SCK_PERIOD_HIGH, 0);
+  V2Params_SetParameterValue (PARAM_ISP_SCK_AUTOTUNE, 0);
+  V2Params_SetParameterValue (PARAM_ISP_SCK_TUNED, ISP_SCK_NOT_TUNED);
+  V2Params_SetParameterValue (PARAM_ISP_ADAPTIVE_WAIT, 0);
 
-  Endpoint_Write_8 (CMD_SIGN_ON);
-  Endpoint_Write_8 (STATUS_CMD_OK);
-  Endpoint_Write_8 (sizeof(PROGRAMMER_ID) - 1);
-  Endpoint_Write_Stream_LE (PROGRAMMER_ID, (sizeof(PROGRAMMER_ID) - 1), NULL);
-  Endpoint_ClearIN ();
+#if defined(ENABLE_ISP_PROTOCOL)
+  /* Page commit failures latched for the previous host are not reported to the new one */
+  ISPProtocol_DiscardDeferredStatus ();
+#endif
+
+  V2Protocol_BeginResponse ();
+
+  V2Protocol_Write_8 (CMD_SIGN_ON);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_Write_8 (sizeof(PROGRAMMER_ID) - 1);
+  V2Protocol_WriteStream (PROGRAMMER_ID, (sizeof(PROGRAMMER_ID) - 1));
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the CMD_RESET_PROTECTION command, implemented as a dummy ACK function as
@@ -246,13 +585,11 @@ V2Protocol_SignOn (void)
 static void
 V2Protocol_ResetProtection (void)
 {
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
-  Endpoint_Write_8 (CMD_RESET_PROTECTION);
-  Endpoint_Write_8 (STATUS_CMD_OK);
-  Endpoint_ClearIN ();
+  V2Protocol_Write_8 (CMD_RESET_PROTECTION);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the CMD_SET_PARAMETER and CMD_GET_PARAMETER commands from the host, setting or
@@ -263,36 +600,40 @@ V2Protocol_ResetProtection (void)
 static void
 V2Protocol_GetSetParam (const uint8_t V2Command)
 {
-  uint8_t ParamID = Endpoint_Read_8 ();
-  uint8_t ParamValue;
+  uint8_t ParamID = V2Protocol_Read_8 ();
+  uint8_t ParamValue = 0;
 
   if (V2Command == CMD_SET_PARAMETER)
-    ParamValue = Endpoint_Read_8 ();
+    ParamValue = V2Protocol_Read_8 ();
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
-  Endpoint_Write_8 (V2Command);
+  V2Protocol_Write_8 (V2Command);
 
   uint8_t ParamPrivs = V2Params_GetParameterPrivileges (ParamID);
 
   if ((V2Command == CMD_SET_PARAMETER) && (ParamPrivs & PARAM_PRIV_WRITE))
     {
-      Endpoint_Write_8 (STATUS_CMD_OK);
+      V2Protocol_Write_8 (STATUS_CMD_OK);
       V2Params_SetParameterValue (ParamID, ParamValue);
     }
   else if ((V2Command == CMD_GET_PARAMETER) && (ParamPrivs & PARAM_PRIV_READ))
     {
-      Endpoint_Write_8 (STATUS_CMD_OK);
-      Endpoint_Write_8 (V2Params_GetParameterValue (ParamID));
+#if defined(ENABLE_STACK_MONITOR)
+      /* Reading the low byte of a stack high-water value takes a fresh snapshot of both of its bytes */
+      if ((ParamID == PARAM_STACK_FREE_LOW) || (ParamID == PARAM_STACK_PEAK_LOW))
+        StackMonitor_Update ();
+#endif
+
+      V2Protocol_Write_8 (STATUS_CMD_OK);
+      V2Protocol_Write_8 (V2Params_GetParameterValue (ParamID));
     }
   else
     {
-      Endpoint_Write_8 (STATUS_CMD_FAILED);
+      V2Protocol_Write_8 (STATUS_CMD_FAILED);
     }
 
-  Endpoint_ClearIN ();
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the CMD_LOAD_ADDRESS command, loading the given device address into a
@@ -302,17 +643,199 @@ V2Protocol_GetSetParam (const uint8_t V2Command)
 static void
 V2Protocol_LoadAddress (void)
 {
-  Endpoint_Read_Stream_BE (&CurrentAddress, sizeof(CurrentAddress), NULL);
+  CurrentAddress = V2Protocol_Read_32_BE ();
+
+  V2Protocol_BeginResponse ();
+
+  if (CurrentAddress & (1UL << 31))
+    MustLoadExtendedAddress = true;
+
+  V2Protocol_Write_8 (CMD_LOAD_ADDRESS);
+  V2Protocol_Write_8 (STATUS_CMD_OK);
+  V2Protocol_EndResponse ();
+}
+
+
+#if defined(ENABLE_COMMAND_BATCH)
+/** Determines if a command may be run from a vendor CMD_BATCH command. Only the commands whose handlers read a few
+ *  parameters and write a short response may be batched; memory writes and reads, which stream their data through
+ *  the AVRISP data endpoints, may not, nor may a batch hold another batch.
+ *
+ *  \param[in] V2Command   Command byte of the batched command
+ *  \param[in] SubCommand  First parameter byte of the batched command, the XPROG command of a CMD_XPROG command
+ *
+ *  \return Boolean \c true if the command may be batched, \c false otherwise
+ */
+static bool
+V2Protocol_IsBatchable (const uint8_t V2Command, const uint8_t SubCommand)
+{
+  switch (V2Command)
+    {
+    case CMD_SIGN_ON:
+    case CMD_SET_PARAMETER:
+    case CMD_GET_PARAMETER:
+    case CMD_LOAD_ADDRESS:
+    case CMD_RESET_PROTECTION:
+#if defined(ENABLE_ISP_PROTOCOL)
+    case CMD_ENTER_PROGMODE_ISP:
+    case CMD_LEAVE_PROGMODE_ISP:
+    case CMD_CHIP_ERASE_ISP:
+    case CMD_PROGRAM_FLUSH_ISP:
+    case CMD_READ_FLASH_CRC_ISP:
+    case CMD_READ_EEPROM_CRC_ISP:
+    case CMD_READ_FUSE_ISP:
+    case CMD_READ_LOCK_ISP:
+    case CMD_READ_SIGNATURE_ISP:
+    case CMD_READ_OSCCAL_ISP:
+    case CMD_PROGRAM_FUSE_ISP:
+    case CMD_PROGRAM_LOCK_ISP:
+#endif
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case CMD_XPROG_SETMODE:
+#endif
+      return true;
+#if defined(ENABLE_XPROG_PROTOCOL)
+    case CMD_XPROG:
+      switch (SubCommand)
+        {
+        case XPROG_CMD_ENTER_PROGMODE:
+        case XPROG_CMD_LEAVE_PROGMODE:
+        case XPROG_CMD_ERASE:
+        case XPROG_CMD_READ_MEM:
+        case XPROG_CMD_CRC:
+        case XPROG_CMD_READ_MEM_CRC:
+        case XPROG_CMD_SET_PARAM:
+          return true;
+        }
+
+      return false;
+#endif
+    default:
+      return false;
+    }
+}
+
+/** Handler for the vendor CMD_BATCH command, which runs a sequence of ordinary V2 commands sent in one OUT transfer
+ *  back to back through their usual handlers, and returns all of their responses in one IN transfer, so that the
+ *  many small commands of a session setup cost a single USB round trip. The command holds the big endian length of
+ *  the batch, followed by the batched commands each prefixed with its own length. The response holds the status of
+ *  the batch and the number of commands run, followed by their responses in order.
+ *
+ *  The batch stops at the first command which fails, or which is malformed or cannot be batched (see
+ *  \ref V2Protocol_IsBatchable()), in which case the batch status is STATUS_CMD_FAILED or STATUS_CMD_ILLEGAL_PARAM.
+ *  A response too long for the response buffer also fails the batch, and is left out.
+ */
+static void
+V2Protocol_Batch (void)
+{
+  uint8_t* Commands = BufferArena_Alloc (V2PROTOCOL_BATCH_SIZE);
+  V2Protocol_Batch_t* Batch = BufferArena_Alloc (sizeof(V2Protocol_Batch_t));
+  uint16_t BatchLength = Endpoint_Read_16_BE ();
+  uint8_t ResponseStatus = STATUS_CMD_OK;
+  uint8_t CommandsRun = 0;
+
+  if (BatchLength > V2PROTOCOL_BATCH_SIZE)
+    {
+      ResponseStatus = STATUS_CMD_ILLEGAL_PARAM;
+      BatchLength = 0;
+
+      /* Discard all incoming data */
+      while (Endpoint_BytesInEndpoint () == AVRISP_DATA_EPSIZE)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+    }
+  else
+    {
+      Endpoint_Read_Stream_LE (Commands, BatchLength, NULL);
+
+      // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+      // to catch this and discard it before continuing on with packet processing to prevent communication issues
+      if (((sizeof(uint8_t) + sizeof(uint16_t) + BatchLength) % AVRISP_DATA_EPSIZE) == 0)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+    }
 
   Endpoint_ClearOUT ();
   Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
   Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
 
-  if (CurrentAddress & (1UL << 31))
-    MustLoadExtendedAddress = true;
+  Batch->ResponseLength = 0;
+  Batch->ResponseOverflow = false;
+  V2Protocol_CurrentBatch = Batch;
+
+  uint8_t Position = 0;
+
+  while (Position < BatchLength)
+    {
+      uint8_t CommandLength = Commands[Position++];
+
+      if (!(CommandLength) || (CommandLength > (BatchLength - Position))
+          || !(V2Protocol_IsBatchable (Commands[Position],
+                                       (CommandLength > 1) ? Commands[Position + 1] : 0)))
+        {
+          ResponseStatus = STATUS_CMD_ILLEGAL_PARAM;
+          break;
+        }
 
-  Endpoint_Write_8 (CMD_LOAD_ADDRESS);
-  Endpoint_Write_8 (STATUS_CMD_OK);
+      uint8_t V2Command = Commands[Position];
+      uint8_t ResponseStart = Batch->ResponseLength;
+
+      Batch->ReadPosition = &Commands[Position + 1];
+      Batch->ReadRemaining = (CommandLength - 1);
+      Batch->ReadOverrun = false;
+      Position += CommandLength;
+
+      V2Protocol_DispatchCommand (V2Command);
+      CommandsRun++;
+
+      /* XPROG commands give their status after the XPROG command byte, other commands after the command byte */
+      uint8_t StatusPosition = (ResponseStart + ((V2Command == CMD_XPROG) ? 2 : 1));
+
+#if defined(ENABLE_HEALTH_COUNTERS)
+      if (StatusPosition < Batch->ResponseLength)
+        Health_CountStatus (V2Command, Batch->Response[StatusPosition]);
+#endif
+
+      if (Batch->ResponseOverflow)
+        {
+          Batch->ResponseLength = ResponseStart;
+          ResponseStatus = STATUS_CMD_FAILED;
+          break;
+        }
+      else if (Batch->ReadOverrun || Batch->ReadRemaining)
+        {
+          ResponseStatus = STATUS_CMD_ILLEGAL_PARAM;
+          break;
+        }
+      else if ((StatusPosition >= Batch->ResponseLength)
+          || (Batch->Response[StatusPosition] != STATUS_CMD_OK))
+        {
+          ResponseStatus = STATUS_CMD_FAILED;
+          break;
+        }
+    }
+
+  V2Protocol_CurrentBatch = NULL;
+  Trace_SetSubCommand (CommandsRun);
+
+  V2Protocol_Write_8 (CMD_BATCH);
+  V2Protocol_Write_8 (ResponseStatus);
+  V2Protocol_Write_8 (CommandsRun);
+  Endpoint_Write_Stream_LE (Batch->Response, Batch->ResponseLength, NULL);
+
+  bool IsEndpointFull = !(Endpoint_IsReadWriteAllowed ());
   Endpoint_ClearIN ();
-}
 
+  /* Ensure last packet is a short packet to terminate the transfer */
+  if (IsEndpointFull)
+    {
+      Endpoint_WaitUntilReady ();
+      Endpoint_ClearIN ();
+      Endpoint_WaitUntilReady ();
+    }
+}
+#endif
@@ -44,10 +44,18 @@
 #include <LUFA/Drivers/USB/USB.h>
 
 #include "../Descriptors.h"
+#include "Timebase.h"
 #include "V2ProtocolConstants.h"
 #include "V2ProtocolParams.h"
+#include "BufferArena.h"
+#include "Profiler.h"
 #include "ISP/ISPProtocol.h"
+#include "ISP/ISPSequence.h"
 #include "XPROG/XPROGProtocol.h"
+#include "Standalone.h"
+#include "StackMonitor.h"
+#include "Trace.h"
+#include "Health.h"
 #include "Config/AppConfig.h"
 
 /* Preprocessor Checks: */
@@ -79,28 +87,75 @@
 /** Timeout period for each issued command from the host before it is aborted (in 10ms ticks). */
 #define COMMAND_TIMEOUT_TICKS      100
 
-/** Command timeout ticks remaining counter, GPIOR for speed. */
-#define TimeoutTicksRemaining      GPIOR1
-
 /** MUX mask for the VTARGET ADC channel number. */
 #define VTARGET_ADC_CHANNEL_MASK   ADC_GET_CHANNEL_MASK(VTARGET_ADC_CHANNEL)
 
+/** Size of the vendor CMD_BATCH command buffer, holding the batched commands and, separately, their responses. Must
+ *  not exceed 255 bytes. Both buffers are taken from the buffer arena, ahead of the buffers of the batched commands.
+ */
+#define V2PROTOCOL_BATCH_SIZE      128
+
+#if (defined(ENABLE_COMMAND_BATCH) && (BUFFER_ARENA_SIZE < (4 * V2PROTOCOL_BATCH_SIZE)))
+#error The buffer arena is too small to hold a command batch along with the buffers of the batched commands.
+#endif
+
+/* Type Defines: */
+/** State of a vendor CMD_BATCH command being run, which the handlers' parameter reads and response writes are
+ *  redirected to in place of the AVRISP data endpoints.
+ */
+typedef struct
+{
+  const uint8_t* ReadPosition; /**< Next parameter byte of the command being run */
+  uint8_t ReadRemaining; /**< Parameter bytes of the command being run not yet read */
+  bool ReadOverrun; /**< Set when the command's handler read past the end of its parameters */
+  uint8_t ResponseLength; /**< Bytes of \c Response used so far */
+  bool ResponseOverflow; /**< Set when a response was cut short for lack of space in the response buffer */
+  uint8_t Response[V2PROTOCOL_BATCH_SIZE]; /**< Responses of the commands run so far, returned to the host at the end */
+} V2Protocol_Batch_t;
+
 /* External Variables: */
 extern uint32_t CurrentAddress;
 extern bool MustLoadExtendedAddress;
+extern volatile bool TargetInProgMode;
 
 /* Function Prototypes: */
 void
 V2Protocol_Init (void);
 void
 V2Protocol_ProcessCommand (void);
+void
+V2Protocol_Yield (void);
+uint8_t
+V2Protocol_Read_8 (void);
+uint16_t
+V2Protocol_Read_16_BE (void);
+uint32_t
+V2Protocol_Read_32_BE (void);
+void
+V2Protocol_ReadParams (void* const Buffer, const uint16_t Length);
+void
+V2Protocol_BeginResponse (void);
+void
+V2Protocol_Write_8 (const uint8_t Data);
+void
+V2Protocol_Write_32_BE (const uint32_t Data);
+void
+V2Protocol_WriteStream (const void* const Buffer, const uint16_t Length);
+void
+V2Protocol_EndResponse (void);
 
 #if defined(INCLUDE_FROM_V2PROTOCOL_C)
+static void V2Protocol_DispatchCommand(const uint8_t V2Command);
+static void V2Protocol_FlushINBanks(void);
 static void V2Protocol_UnknownCommand(const uint8_t V2Command);
 static void V2Protocol_SignOn(void);
 static void V2Protocol_GetSetParam(const uint8_t V2Command);
 static void V2Protocol_ResetProtection(void);
 static void V2Protocol_LoadAddress(void);
+#if defined(ENABLE_COMMAND_BATCH)
+static bool V2Protocol_IsBatchable(const uint8_t V2Command, const uint8_t SubCommand);
+static void V2Protocol_Batch(void);
+#endif
 #endif
 
 #endif
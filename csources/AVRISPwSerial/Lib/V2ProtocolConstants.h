@@ -61,6 +61,22 @@
 #define CMD_XPROG                   0x50
 #define CMD_XPROG_SETMODE           0x51
 
+/* Vendor extension commands, not part of the Atmel protocol: */
+#define CMD_PROGRAM_FLUSH_ISP       0x70
+#define CMD_READ_FLASH_STREAM_ISP   0x71
+#define CMD_READ_EEPROM_STREAM_ISP  0x72
+#define CMD_READ_FLASH_CRC_ISP      0x73
+#define CMD_READ_EEPROM_CRC_ISP     0x74
+#define CMD_STANDALONE_WRITE_IMAGE  0x75
+#define CMD_STANDALONE_RUN          0x76
+#define CMD_BATCH                   0x77
+#define CMD_ISP_SEQUENCE            0x78
+#define CMD_PROG_FLASH_STREAM_ISP   0x79
+#define CMD_PROG_EEPROM_STREAM_ISP  0x7A
+#define CMD_READ_PROFILE            0x7B
+#define CMD_READ_TRACE              0x7C
+#define CMD_READ_HEALTH             0x7D
+
 #define STATUS_CMD_OK               0x00
 #define STATUS_CMD_TOUT             0x80
 #define STATUS_RDY_BSY_TOUT         0x81
@@ -86,5 +102,26 @@
 #define PARAM_STATUS_TGT_CONN       0xA1
 #define PARAM_DISCHARGEDELAY        0xA4
 
+/* Vendor extension parameters, not part of the Atmel protocol: */
+#define PARAM_PROG_PIPELINE         0xC0
+#define PARAM_PROG_SKIP_BLANK       0xC1
+#define PARAM_PROG_SKIP_UNCHANGED   0xC2
+#define PARAM_PROG_UNCHANGED_LOW    0xC3
+#define PARAM_PROG_UNCHANGED_HIGH   0xC4
+#define PARAM_ISP_USART_SPI         0xC5
+#define PARAM_ISP_SCK_PERIOD_LOW    0xC6
+#define PARAM_ISP_SCK_PERIOD_HIGH   0xC7
+#define PARAM_ISP_SCK_AUTOTUNE      0xC8
+#define PARAM_ISP_SCK_TUNED         0xC9
+#define PARAM_ISP_ADAPTIVE_WAIT     0xCA
+#define PARAM_STACK_CAPTURE         0xCB
+#define PARAM_STACK_FREE_LOW        0xCC
+#define PARAM_STACK_FREE_HIGH       0xCD
+#define PARAM_STACK_PEAK_LOW        0xCE
+#define PARAM_STACK_PEAK_HIGH       0xCF
+#define PARAM_STACK_PEAK_CMD        0xD0
+#define PARAM_STACK_LAST_LOW        0xD1
+#define PARAM_STACK_LAST_HIGH       0xD2
+
 #endif
 
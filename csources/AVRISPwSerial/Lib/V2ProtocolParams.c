@@ -36,11 +36,27 @@
 #define  INCLUDE_FROM_V2PROTOCOL_PARAMS_C
 #include "V2ProtocolParams.h"
 
-/* Non-Volatile Parameter Values for EEPROM storage */
-static uint8_t EEMEM EEPROM_Reset_Polarity = 0x01;
+/* Non-Volatile Parameter Values for EEPROM storage, journaled with each commit going to the slot after the last */
+static NonVolatileRecord_t EEMEM EEPROM_Journal[NV_PARAMS_JOURNAL_SLOTS];
 
-/* Non-Volatile Parameter Values for EEPROM storage */
-static uint8_t EEMEM EEPROM_SCK_Duration = 0x06;
+/* Non-Volatile Parameter Values cached in RAM, written back to the EEPROM journal while the programmer is idle */
+static NonVolatileParams_t NonVolatileParams;
+
+/** Flag to indicate that the cached non-volatile parameter values have changed since they were last committed. */
+static bool NonVolatileParamsChanged;
+
+/** Time of the latest change of the cached non-volatile parameter values. */
+static Timebase_Time_t NonVolatileParamsChangedAt;
+
+/** Slot and generation of the journal record last committed or loaded. */
+static uint8_t JournalSlot;
+static uint16_t JournalGeneration;
+
+/** Journal record being committed to \ref JournalSlot, a byte at a time. */
+static NonVolatileRecord_t JournalRecord;
+
+/** Number of bytes at the end of \ref JournalRecord not yet written to the EEPROM journal. */
+static uint8_t JournalBytesPending;
 
 /* Volatile Parameter Values for RAM storage */
 static ParameterItem_t ParameterTable[] =
@@ -73,24 +89,165 @@ static ParameterItem_t ParameterTable[] =
         .ParamValue = STATUS_ISP_READY },
 
     { .ParamID = PARAM_DISCHARGEDELAY, .ParamPrivileges = PARAM_PRIV_READ
-        | PARAM_PRIV_WRITE, .ParamValue = 0x00 }, };
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_PROG_PIPELINE, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_PROG_SKIP_BLANK, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_PROG_SKIP_UNCHANGED, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_PROG_UNCHANGED_LOW, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_PROG_UNCHANGED_HIGH, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_ISP_USART_SPI, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_ISP_SCK_PERIOD_LOW, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_ISP_SCK_PERIOD_HIGH, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_ISP_SCK_AUTOTUNE, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_ISP_SCK_TUNED, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = ISP_SCK_NOT_TUNED },
+
+    { .ParamID = PARAM_ISP_ADAPTIVE_WAIT, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+#if defined(ENABLE_STACK_MONITOR)
+    { .ParamID = PARAM_STACK_CAPTURE, .ParamPrivileges = PARAM_PRIV_READ
+        | PARAM_PRIV_WRITE, .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_STACK_FREE_LOW, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_STACK_FREE_HIGH, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_STACK_PEAK_LOW, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_STACK_PEAK_HIGH, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_STACK_PEAK_CMD, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = 0x00 },
+
+    { .ParamID = PARAM_STACK_LAST_LOW, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = 0x00 },
 
-/** Loads saved non-volatile parameter values from the EEPROM into the parameter table, as needed. */
+    { .ParamID = PARAM_STACK_LAST_HIGH, .ParamPrivileges = PARAM_PRIV_READ,
+        .ParamValue = 0x00 },
+#endif
+  };
+
+/** Loads the non-volatile parameter values last committed to the EEPROM journal into their RAM cache and the
+ *  parameter table, or their defaults if none were ever committed.
+ */
 void
 V2Params_LoadNonVolatileParamValues (void)
 {
-  /* Read parameter values that are stored in non-volatile EEPROM */
-  uint8_t ResetPolarity = eeprom_read_byte (&EEPROM_Reset_Polarity);
-  uint8_t SCKDuration = eeprom_read_byte (&EEPROM_SCK_Duration);
-
-  /* Update current parameter table if the EEPROM contents was not blank */
-  if (ResetPolarity != 0xFF)
-    V2Params_GetParamFromTable (PARAM_RESET_POLARITY)->ParamValue =
-        ResetPolarity;
-
-  /* Update current parameter table if the EEPROM contents was not blank */
-  if (SCKDuration != 0xFF)
-    V2Params_GetParamFromTable (PARAM_SCK_DURATION)->ParamValue = SCKDuration;
+  NonVolatileRecord_t Record;
+  bool RecordFound = false;
+
+  /* Values used until the first commit to the journal */
+  memset (&NonVolatileParams, 0, sizeof(NonVolatileParams));
+  NonVolatileParams.ResetPolarity = 0x01;
+  NonVolatileParams.SCKDuration = 0x06;
+
+  for (uint8_t Slot = 0; Slot < NV_PARAMS_JOURNAL_SLOTS; Slot++)
+    {
+      eeprom_read_block (&Record, &EEPROM_Journal[Slot], sizeof(Record));
+
+      /* Records torn by a power loss fail their check, leaving the previous commit in effect */
+      if (Record.Check != V2Params_GetRecordCheck (&Record))
+        continue;
+
+      /* Generations wrap around, the latest being the one furthest ahead of the others */
+      if (RecordFound && ((int16_t) (Record.Generation - JournalGeneration) <= 0))
+        continue;
+
+      NonVolatileParams = Record.Params;
+      JournalSlot = Slot;
+      JournalGeneration = Record.Generation;
+      RecordFound = true;
+    }
+
+  /* The first commit goes to the first slot */
+  if (!(RecordFound))
+    {
+      JournalSlot = (NV_PARAMS_JOURNAL_SLOTS - 1);
+      JournalGeneration = 0;
+    }
+
+  NonVolatileParamsChanged = false;
+  JournalBytesPending = 0;
+
+  V2Params_GetParamFromTable (PARAM_RESET_POLARITY)->ParamValue = NonVolatileParams.ResetPolarity;
+  V2Params_GetParamFromTable (PARAM_SCK_DURATION)->ParamValue = NonVolatileParams.SCKDuration;
+}
+
+/** Commits the cached non-volatile parameter values to the next slot of the EEPROM journal, once they have been left
+ *  unchanged for \ref NV_PARAMS_COMMIT_DELAY_MS outside of a programming session. Values changed back to those last
+ *  committed are not committed again. To be called from the main loop while no command from the host is pending, so
+ *  that no command is held up by the EEPROM writes.
+ *
+ *  A record is written a byte per call, and only once the EEPROM has finished the previous byte, so that a call never
+ *  waits on the EEPROM and the main loop keeps servicing the USB interfaces through the commit.
+ */
+void
+V2Params_WriteBackNonVolatileParamValues (void)
+{
+  if (JournalBytesPending)
+    {
+      if (!(eeprom_is_ready ()))
+        return;
+
+      uint8_t Offset = (sizeof(JournalRecord) - JournalBytesPending--);
+
+      /* Only the bytes which differ from the record previously held in the slot are written */
+      eeprom_update_byte ((uint8_t*) &EEPROM_Journal[JournalSlot] + Offset, ((uint8_t*) &JournalRecord)[Offset]);
+      return;
+    }
+
+  if (!(NonVolatileParamsChanged) || TargetInProgMode
+      || !(Timebase_HasExpired (NonVolatileParamsChangedAt + TIMEBASE_MS(NV_PARAMS_COMMIT_DELAY_MS))))
+    {
+      return;
+    }
+
+  NonVolatileRecord_t Record;
+
+  NonVolatileParamsChanged = false;
+
+  eeprom_read_block (&Record, &EEPROM_Journal[JournalSlot], sizeof(Record));
+
+  if ((Record.Check == V2Params_GetRecordCheck (&Record))
+      && !(memcmp (&Record.Params, &NonVolatileParams, sizeof(NonVolatileParams))))
+    {
+      return;
+    }
+
+  if (++JournalSlot == NV_PARAMS_JOURNAL_SLOTS)
+    JournalSlot = 0;
+
+  JournalRecord.Generation = ++JournalGeneration;
+  JournalRecord.Params = NonVolatileParams;
+  JournalRecord.Check = V2Params_GetRecordCheck (&JournalRecord);
+
+  /* The record is written by the following calls, a power loss part way through leaving the previous commit in effect
+   * as the torn record fails its check */
+  JournalBytesPending = sizeof(JournalRecord);
 }
 
 /** Updates any parameter values that are sourced from hardware rather than explicitly set by the host, such as
@@ -166,13 +323,71 @@ V2Params_SetParameterValue (const uint8_t ParamID, const uint8_t Value)
 
   ParamInfo->ParamValue = Value;
 
-  /* The target RESET line polarity is a non-volatile parameter, save to EEPROM when changed */
-  if (ParamID == PARAM_RESET_POLARITY)
-    eeprom_update_byte (&EEPROM_Reset_Polarity, Value);
+  /* The target RESET line polarity is a non-volatile parameter, written back to EEPROM later when changed */
+  if ((ParamID == PARAM_RESET_POLARITY) && (NonVolatileParams.ResetPolarity != Value))
+    {
+      NonVolatileParams.ResetPolarity = Value;
+      V2Params_NonVolatileParamsChanged ();
+    }
+
+  /* The target SCK line period is a non-volatile parameter, written back to EEPROM later when changed */
+  if ((ParamID == PARAM_SCK_DURATION) && (NonVolatileParams.SCKDuration != Value))
+    {
+      NonVolatileParams.SCKDuration = Value;
+      V2Params_NonVolatileParamsChanged ();
+    }
+}
+
+#if defined(ENABLE_HEALTH_COUNTERS)
+/** Retrieves the health counters from the non-volatile parameter values, as last committed or handed over.
+ *
+ *  \param[out] Counters  Health counters to retrieve, \ref HEALTH_COUNTERS of them
+ */
+void
+V2Params_LoadHealthCounters (uint32_t* const Counters)
+{
+  memcpy (Counters, NonVolatileParams.HealthCounters, sizeof(NonVolatileParams.HealthCounters));
+}
+
+/** Hands the health counters over to the non-volatile parameter values, to be written back to EEPROM with them.
+ *
+ *  \param[in] Counters  Health counters to hand over, \ref HEALTH_COUNTERS of them
+ */
+void
+V2Params_SaveHealthCounters (const uint32_t* const Counters)
+{
+  if (!(memcmp (NonVolatileParams.HealthCounters, Counters, sizeof(NonVolatileParams.HealthCounters))))
+    return;
+
+  memcpy (NonVolatileParams.HealthCounters, Counters, sizeof(NonVolatileParams.HealthCounters));
+  V2Params_NonVolatileParamsChanged ();
+}
+#endif
+
+/** Marks the cached non-volatile parameter values as changed, restarting the delay before they are committed. */
+static void
+V2Params_NonVolatileParamsChanged (void)
+{
+  NonVolatileParamsChanged = true;
+  NonVolatileParamsChangedAt = Timebase_Now ();
+}
+
+/** Computes the check value of a journal record, over all of the record but the check value itself.
+ *
+ *  \param[in] Record  Journal record to compute the check value of
+ *
+ *  \return Check value of the record
+ */
+static uint16_t
+V2Params_GetRecordCheck (const NonVolatileRecord_t* const Record)
+{
+  const uint8_t* CurrentByte = (const uint8_t*) Record;
+  uint32_t CRC = MEMORY_CRC_INITIAL;
+
+  for (uint8_t Offset = 0; Offset < offsetof(NonVolatileRecord_t, Check); Offset++)
+    CRC = MemoryCRC_Update (CRC, *(CurrentByte++));
 
-  /* The target SCK line period is a non-volatile parameter, save to EEPROM when changed */
-  if (ParamID == PARAM_SCK_DURATION)
-    eeprom_update_byte (&EEPROM_SCK_Duration, Value);
+  return (uint16_t) (CRC ^ MEMORY_CRC_FINAL_XOR);
 }
 
 /** Retrieves a parameter entry (including ID, value and privileges) from the parameter table that matches the given
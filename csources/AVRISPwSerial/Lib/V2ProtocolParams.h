@@ -39,6 +39,8 @@
 /* Includes: */
 #include <avr/io.h>
 #include <avr/eeprom.h>
+#include <stddef.h>
+#include <string.h>
 
 #if defined(ADC)
 #include <LUFA/Drivers/Peripheral/ADC.h>
@@ -46,6 +48,8 @@
 
 #include "V2Protocol.h"
 #include "V2ProtocolConstants.h"
+#include "MemoryCRC.h"
+#include "Health.h"
 #include "ISP/ISPTarget.h"
 #include "Config/AppConfig.h"
 
@@ -59,6 +63,20 @@
 /** Total number of parameters in the parameter table */
 #define TABLE_PARAM_COUNT   (sizeof(ParameterTable) / sizeof(ParameterTable[0]))
 
+#if (!defined(NV_PARAMS_JOURNAL_SLOTS) || defined(__DOXYGEN__))
+/** Number of EEPROM slots of the non-volatile parameter journal, each commit going to the slot after the last one
+ *  so that the EEPROM wear is spread over all of them. Can be overridden in AppConfig.h.
+ */
+#define NV_PARAMS_JOURNAL_SLOTS   4
+#endif
+
+#if (!defined(NV_PARAMS_COMMIT_DELAY_MS) || defined(__DOXYGEN__))
+/** Time a change of the non-volatile parameters is held in RAM before it is committed to EEPROM, in milliseconds,
+ *  so that the changes made while a session is being set up are coalesced. Can be overridden in AppConfig.h.
+ */
+#define NV_PARAMS_COMMIT_DELAY_MS 1000
+#endif
+
 #if (!defined(FIRMWARE_VERSION_MINOR) || defined(__DOXYGEN__))
 /** Minor firmware version, reported to the host on request; must match the version
  *  the host is expecting, or it (may) reject further communications with the programmer. */
@@ -74,10 +92,32 @@ typedef struct
   uint8_t ParamValue; /**< Current parameter's value within the device */
 } ParameterItem_t;
 
+/** Type define for the settings kept in non-volatile EEPROM storage, cached in RAM. Further persistent settings of
+ *  the firmware are added here.
+ */
+typedef struct
+{
+  uint8_t ResetPolarity; /**< Value of the \ref PARAM_RESET_POLARITY parameter */
+  uint8_t SCKDuration; /**< Value of the \ref PARAM_SCK_DURATION parameter */
+#if defined(ENABLE_HEALTH_COUNTERS)
+  uint32_t HealthCounters[HEALTH_COUNTERS]; /**< Health counters, as last handed over by the health module */
+#endif
+} NonVolatileParams_t;
+
+/** Type define for a commit of the non-volatile settings to a slot of the EEPROM journal. */
+typedef struct
+{
+  uint16_t Generation; /**< Number of the commit, the valid record with the latest being the one loaded */
+  NonVolatileParams_t Params;
+  uint16_t Check; /**< Low half of the memory CRC of the rest of the record, failing for records torn by a power loss */
+} NonVolatileRecord_t;
+
 /* Function Prototypes: */
 void
 V2Params_LoadNonVolatileParamValues (void);
 void
+V2Params_WriteBackNonVolatileParamValues (void);
+void
 V2Params_UpdateParamValues (void);
 
 uint8_t
@@ -87,8 +127,17 @@ V2Params_GetParameterValue (const uint8_t ParamID);
 void
 V2Params_SetParameterValue (const uint8_t ParamID, const uint8_t Value);
 
+#if defined(ENABLE_HEALTH_COUNTERS)
+void
+V2Params_LoadHealthCounters (uint32_t* const Counters);
+void
+V2Params_SaveHealthCounters (const uint32_t* const Counters);
+#endif
+
 #if defined(INCLUDE_FROM_V2PROTOCOL_PARAMS_C)
 static ParameterItem_t* const V2Params_GetParamFromTable(const uint8_t ParamID);
+static void V2Params_NonVolatileParamsChanged(void);
+static uint16_t V2Params_GetRecordCheck(const NonVolatileRecord_t* const Record);
 #endif
 
 #endif
@@ -95,6 +95,8 @@ TINYNVM_WaitWhileNVMBusBusy (void)
       /* Check the status register read response to see if the NVM bus is enabled */
       if (StatusRegister & TPI_STATUS_NVM)
         return true;
+
+      V2Protocol_Yield ();
     }
 }
 
@@ -106,6 +108,9 @@ TINYNVM_WaitWhileNVMBusBusy (void)
 bool
 TINYNVM_WaitWhileNVMControllerBusy (void)
 {
+  bool IsReady = false;
+  uint8_t PreviousPhase = Profiler_EnterPhase (PROFILER_PHASE_POLL);
+
   /* Poll the STATUS register to check to see if NVM access has been enabled */
   for (;;)
     {
@@ -116,12 +121,20 @@ TINYNVM_WaitWhileNVMControllerBusy (void)
 
       /* We might have timed out waiting for the status register read response, check here */
       if (!(TimeoutTicksRemaining))
-        return false;
+        break;
 
       /* Check to see if the BUSY flag is still set */
       if (!(StatusRegister & (1 << 7)))
-        return true;
+        {
+          IsReady = true;
+          break;
+        }
+
+      V2Protocol_Yield ();
     }
+
+  Profiler_EnterPhase (PreviousPhase);
+  return IsReady;
 }
 
 /** Enables the physical TPI interface on the target and enables access to the internal NVM controller.
@@ -222,6 +235,9 @@ TINYNVM_WriteMemory (const uint16_t WriteAddress, uint8_t* WriteBuffer,
   if (WriteLength & 0x01)
     WriteBuffer[WriteLength++] = 0xFF;
 
+  /* TPI targets are written a word at a time, each block written by the host standing for a page */
+  Health_Count (HEALTH_PAGES_WRITTEN, 1);
+
   /* Set the NVM control register to the WORD WRITE command for memory writing */
   TINYNVM_SendWriteNVMRegister (XPROG_Param_NVMCMDRegAddr);
   XPROGTarget_SendByte (TINY_NVM_CMD_WORDWRITE);
@@ -66,6 +66,27 @@ XMEGANVM_SendNVMRegAddress (const uint8_t Register)
   XMEGANVM_SendAddress (Address);
 }
 
+/** Sends a REPEAT command to the target for the given number of accesses, with a two byte count for blocks larger
+ *  than 256 bytes.
+ *
+ *  \param[in] Count  Number of times the following command is to be run, at least one
+ */
+static void
+XMEGANVM_SendRepeat (const uint16_t Count)
+{
+  if (Count > 256)
+    {
+      XPROGTarget_SendByte (PDI_CMD_REPEAT(PDI_DATASIZE_2BYTES));
+      XPROGTarget_SendByte ((Count - 1) & 0xFF);
+      XPROGTarget_SendByte ((Count - 1) >> 8);
+    }
+  else
+    {
+      XPROGTarget_SendByte (PDI_CMD_REPEAT(PDI_DATASIZE_1BYTE));
+      XPROGTarget_SendByte (Count - 1);
+    }
+}
+
 /** Busy-waits while the NVM controller is busy performing a NVM operation, such as a FLASH page read or CRC
  *  calculation.
  *
@@ -89,6 +110,8 @@ XMEGANVM_WaitWhileNVMBusBusy (void)
       /* Check the status register read response to see if the NVM bus is enabled */
       if (StatusRegister & PDI_STATUS_NVM)
         return true;
+
+      V2Protocol_Yield ();
     }
 }
 
@@ -104,6 +127,9 @@ XMEGANVM_WaitWhileNVMControllerBusy (void)
   XPROGTarget_SendByte (PDI_CMD_ST(PDI_POINTER_DIRECT, PDI_DATASIZE_4BYTES));
   XMEGANVM_SendNVMRegAddress (XMEGA_NVM_REG_STATUS);
 
+  bool IsReady = false;
+  uint8_t PreviousPhase = Profiler_EnterPhase (PROFILER_PHASE_POLL);
+
   /* Poll the NVM STATUS register while the NVM controller is busy */
   for (;;)
     {
@@ -115,12 +141,20 @@ XMEGANVM_WaitWhileNVMControllerBusy (void)
 
       /* We might have timed out waiting for the status register read response, check here */
       if (!(TimeoutTicksRemaining))
-        return false;
+        break;
 
       /* Check to see if the BUSY flag is still set */
       if (!(StatusRegister & (1 << 7)))
-        return true;
+        {
+          IsReady = true;
+          break;
+        }
+
+      V2Protocol_Yield ();
     }
+
+  Profiler_EnterPhase (PreviousPhase);
+  return IsReady;
 }
 
 /** Enables the physical PDI interface on the target and enables access to the internal NVM controller.
@@ -255,8 +289,7 @@ XMEGANVM_ReadMemory (const uint32_t ReadAddress, uint8_t* ReadBuffer,
       XMEGANVM_SendAddress (ReadAddress);
 
       /* Send the REPEAT command with the specified number of bytes to read */
-      XPROGTarget_SendByte (PDI_CMD_REPEAT(PDI_DATASIZE_1BYTE));
-      XPROGTarget_SendByte (ReadSize - 1);
+      XMEGANVM_SendRepeat (ReadSize);
 
       /* Send a LD command with indirect access and post-increment to read out the bytes */
       XPROGTarget_SendByte (
@@ -361,8 +394,7 @@ XMEGANVM_WritePageMemory (const uint8_t WriteBuffCommand,
       XMEGANVM_SendAddress (WriteAddress);
 
       /* Send the REPEAT command with the specified number of bytes to write */
-      XPROGTarget_SendByte (PDI_CMD_REPEAT(PDI_DATASIZE_1BYTE));
-      XPROGTarget_SendByte (WriteSize - 1);
+      XMEGANVM_SendRepeat (WriteSize);
 
       /* Send a ST command with indirect access and post-increment to write the bytes */
       XPROGTarget_SendByte (
@@ -377,6 +409,8 @@ XMEGANVM_WritePageMemory (const uint8_t WriteBuffCommand,
       if (!(XMEGANVM_WaitWhileNVMControllerBusy ()))
         return false;
 
+      Health_Count (HEALTH_PAGES_WRITTEN, 1);
+
       /* Send the memory write command to the target */
       XPROGTarget_SendByte (
           PDI_CMD_STS(PDI_DATASIZE_4BYTES, PDI_DATASIZE_1BYTE));
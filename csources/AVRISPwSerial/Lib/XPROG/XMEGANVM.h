@@ -137,6 +137,7 @@ XMEGANVM_EraseMemory (const uint8_t EraseCommand, const uint32_t Address);
 #if defined(INCLUDE_FROM_XMEGANVM_C)
 static void XMEGANVM_SendNVMRegAddress(const uint8_t Register);
 static void XMEGANVM_SendAddress(const uint32_t AbsoluteAddress);
+static void XMEGANVM_SendRepeat(const uint16_t Count);
 #endif
 
 #endif
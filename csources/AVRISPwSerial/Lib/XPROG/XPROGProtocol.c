@@ -63,20 +63,17 @@ XPROGProtocol_SetMode (void)
     uint8_t Protocol;
   } SetMode_XPROG_Params;
 
-  Endpoint_Read_Stream_LE (&SetMode_XPROG_Params, sizeof(SetMode_XPROG_Params),
-                           NULL);
+  V2Protocol_ReadParams (&SetMode_XPROG_Params, sizeof(SetMode_XPROG_Params));
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   XPROG_SelectedProtocol = SetMode_XPROG_Params.Protocol;
 
-  Endpoint_Write_8 (CMD_XPROG_SETMODE);
-  Endpoint_Write_8 (
+  V2Protocol_Write_8 (CMD_XPROG_SETMODE);
+  V2Protocol_Write_8 (
       (SetMode_XPROG_Params.Protocol != XPROG_PROTOCOL_JTAG) ?
           STATUS_CMD_OK : STATUS_CMD_FAILED);
-  Endpoint_ClearIN ();
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the CMD_XPROG command, which wraps up XPROG commands in a V2 wrapper which need to be
@@ -85,7 +82,9 @@ XPROGProtocol_SetMode (void)
 void
 XPROGProtocol_Command (void)
 {
-  uint8_t XPROGCommand = Endpoint_Read_8 ();
+  uint8_t XPROGCommand = V2Protocol_Read_8 ();
+
+  Trace_SetSubCommand (XPROGCommand);
 
   switch (XPROGCommand)
     {
@@ -107,6 +106,9 @@ XPROGProtocol_Command (void)
     case XPROG_CMD_CRC:
       XPROGProtocol_ReadCRC ();
       break;
+    case XPROG_CMD_READ_MEM_CRC:
+      XPROGProtocol_ReadMemoryCRC ();
+      break;
     case XPROG_CMD_SET_PARAM:
       XPROGProtocol_SetParam ();
       break;
@@ -117,21 +119,24 @@ XPROGProtocol_Command (void)
 static void
 XPROGProtocol_EnterXPROGMode (void)
 {
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   bool NVMBusEnabled = false;
 
+  TargetInProgMode = true;
+
   if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
     NVMBusEnabled = XMEGANVM_EnablePDI ();
   else if (XPROG_SelectedProtocol == XPROG_PROTOCOL_TPI)
     NVMBusEnabled = TINYNVM_EnableTPI ();
 
-  Endpoint_Write_8 (CMD_XPROG);
-  Endpoint_Write_8 (XPROG_CMD_ENTER_PROGMODE);
-  Endpoint_Write_8 (NVMBusEnabled ? XPROG_ERR_OK : XPROG_ERR_FAILED);
-  Endpoint_ClearIN ();
+  if (NVMBusEnabled)
+    Health_Count (HEALTH_SESSIONS, 1);
+
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_ENTER_PROGMODE);
+  V2Protocol_Write_8 (NVMBusEnabled ? XPROG_ERR_OK : XPROG_ERR_FAILED);
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the XPROG LEAVE_PROGMODE command to terminate the PDI programming connection with
@@ -140,25 +145,25 @@ XPROGProtocol_EnterXPROGMode (void)
 static void
 XPROGProtocol_LeaveXPROGMode (void)
 {
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
     XMEGANVM_DisablePDI ();
   else
     TINYNVM_DisableTPI ();
 
+  TargetInProgMode = false;
+
 #if defined(XCK_RESCUE_CLOCK_ENABLE) && defined(ENABLE_ISP_PROTOCOL)
   /* If the XCK rescue clock option is enabled, we need to restart it once the
    * XPROG mode has been exited, since the XPROG protocol stops it after use. */
   ISPTarget_ConfigureRescueClock();
 #endif
 
-  Endpoint_Write_8 (CMD_XPROG);
-  Endpoint_Write_8 (XPROG_CMD_LEAVE_PROGMODE);
-  Endpoint_Write_8 (XPROG_ERR_OK);
-  Endpoint_ClearIN ();
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_LEAVE_PROGMODE);
+  V2Protocol_Write_8 (XPROG_ERR_OK);
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the XPRG ERASE command to erase a specific memory address space in the attached device. */
@@ -173,13 +178,11 @@ XPROGProtocol_Erase (void)
     uint32_t Address;
   } Erase_XPROG_Params;
 
-  Endpoint_Read_Stream_LE (&Erase_XPROG_Params, sizeof(Erase_XPROG_Params),
-                           NULL);
+  V2Protocol_ReadParams (&Erase_XPROG_Params, sizeof(Erase_XPROG_Params));
   Erase_XPROG_Params.Address = SwapEndian_32 (Erase_XPROG_Params.Address);
+  Trace_SetRange (Erase_XPROG_Params.Address, 0);
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   uint8_t EraseCommand;
 
@@ -233,10 +236,10 @@ XPROGProtocol_Erase (void)
         ReturnStatus = XPROG_ERR_TIMEOUT;
     }
 
-  Endpoint_Write_8 (CMD_XPROG);
-  Endpoint_Write_8 (XPROG_CMD_ERASE);
-  Endpoint_Write_8 (ReturnStatus);
-  Endpoint_ClearIN ();
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_ERASE);
+  V2Protocol_Write_8 (ReturnStatus);
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the XPROG WRITE_MEMORY command to write to a specific memory space within the attached device. */
@@ -251,36 +254,53 @@ XPROGProtocol_WriteMemory (void)
     uint8_t PageMode;
     uint32_t Address;
     uint16_t Length;
-    uint8_t ProgData[256];
   } WriteMemory_XPROG_Params;
 
-  Endpoint_Read_Stream_LE (
-      &WriteMemory_XPROG_Params,
-      (sizeof(WriteMemory_XPROG_Params)
-          - sizeof(WriteMemory_XPROG_Params).ProgData),
-      NULL);
+  Endpoint_Read_Stream_LE (&WriteMemory_XPROG_Params,
+                           sizeof(WriteMemory_XPROG_Params), NULL);
   WriteMemory_XPROG_Params.Address = SwapEndian_32 (
       WriteMemory_XPROG_Params.Address);
   WriteMemory_XPROG_Params.Length = SwapEndian_16 (
       WriteMemory_XPROG_Params.Length);
-  Endpoint_Read_Stream_LE (&WriteMemory_XPROG_Params.ProgData,
-                           WriteMemory_XPROG_Params.Length, NULL);
-
-  // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
-  // to catch this and discard it before continuing on with packet processing to prevent communication issues
-  if (((sizeof(uint8_t) + sizeof(WriteMemory_XPROG_Params)
-      - sizeof(WriteMemory_XPROG_Params.ProgData))
-      + WriteMemory_XPROG_Params.Length) % AVRISP_DATA_EPSIZE == 0)
+  Trace_SetRange (WriteMemory_XPROG_Params.Address, WriteMemory_XPROG_Params.Length);
+
+  /* Blocks of up to the size of the arena are accepted, so that pages larger than 256 bytes can be written whole */
+  uint8_t* ProgData = BufferArena_Alloc (WriteMemory_XPROG_Params.Length);
+
+  if (!(ProgData))
+    {
+      ReturnStatus = XPROG_ERR_FAILED;
+
+      /* Discard all incoming data */
+      while (Endpoint_BytesInEndpoint () == AVRISP_DATA_EPSIZE)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
+    }
+  else
     {
-      Endpoint_ClearOUT ();
-      Endpoint_WaitUntilReady ();
+      Endpoint_Read_Stream_LE (ProgData, WriteMemory_XPROG_Params.Length, NULL);
+
+      // The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+      // to catch this and discard it before continuing on with packet processing to prevent communication issues
+      if ((sizeof(uint8_t) + sizeof(WriteMemory_XPROG_Params)
+          + WriteMemory_XPROG_Params.Length) % AVRISP_DATA_EPSIZE == 0)
+        {
+          Endpoint_ClearOUT ();
+          Endpoint_WaitUntilReady ();
+        }
     }
 
   Endpoint_ClearOUT ();
   Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
   Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
 
-  if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
+  if (ReturnStatus != XPROG_ERR_OK)
+    {
+      /* The block was too large to be buffered, and has been discarded */
+    }
+  else if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
     {
       /* Assume FLASH page programming by default, as it is the common case */
       uint8_t WriteCommand = XMEGA_NVM_CMD_WRITEFLASHPAGE;
@@ -320,12 +340,12 @@ XPROGProtocol_WriteMemory (void)
                                          WriteCommand,
                                          WriteMemory_XPROG_Params.PageMode,
                                          WriteMemory_XPROG_Params.Address,
-                                         WriteMemory_XPROG_Params.ProgData,
+                                         ProgData,
                                          WriteMemory_XPROG_Params.Length)))
           || (!PagedMemory
               && !(XMEGANVM_WriteByteMemory (
                   WriteCommand, WriteMemory_XPROG_Params.Address,
-                  WriteMemory_XPROG_Params.ProgData[0]))))
+                  ProgData[0]))))
         {
           ReturnStatus = XPROG_ERR_TIMEOUT;
         }
@@ -334,16 +354,16 @@ XPROGProtocol_WriteMemory (void)
     {
       /* Send write command to the TPI device, indicate timeout if occurred */
       if (!(TINYNVM_WriteMemory (WriteMemory_XPROG_Params.Address,
-                                 WriteMemory_XPROG_Params.ProgData,
+                                 ProgData,
                                  WriteMemory_XPROG_Params.Length)))
         {
           ReturnStatus = XPROG_ERR_TIMEOUT;
         }
     }
 
-  Endpoint_Write_8 (CMD_XPROG);
-  Endpoint_Write_8 (XPROG_CMD_WRITE_MEM);
-  Endpoint_Write_8 (ReturnStatus);
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_WRITE_MEM);
+  V2Protocol_Write_8 (ReturnStatus);
   Endpoint_ClearIN ();
 }
 
@@ -362,20 +382,24 @@ XPROGProtocol_ReadMemory (void)
     uint16_t Length;
   } ReadMemory_XPROG_Params;
 
-  Endpoint_Read_Stream_LE (&ReadMemory_XPROG_Params,
-                           sizeof(ReadMemory_XPROG_Params), NULL);
+  V2Protocol_ReadParams (&ReadMemory_XPROG_Params,
+                         sizeof(ReadMemory_XPROG_Params));
   ReadMemory_XPROG_Params.Address = SwapEndian_32 (
       ReadMemory_XPROG_Params.Address);
   ReadMemory_XPROG_Params.Length = SwapEndian_16 (
       ReadMemory_XPROG_Params.Length);
+  Trace_SetRange (ReadMemory_XPROG_Params.Address, ReadMemory_XPROG_Params.Length);
+  Health_Count (HEALTH_BYTES_READ, ReadMemory_XPROG_Params.Length);
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
-  uint8_t ReadBuffer[256];
+  uint8_t* ReadBuffer = BufferArena_Alloc (ReadMemory_XPROG_Params.Length);
 
-  if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
+  if (!(ReadBuffer))
+    {
+      ReturnStatus = XPROG_ERR_FAILED;
+    }
+  else if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
     {
       /* Read the PDI target's memory, indicate timeout if occurred */
       if (!(XMEGANVM_ReadMemory (ReadMemory_XPROG_Params.Address, ReadBuffer,
@@ -390,14 +414,14 @@ XPROGProtocol_ReadMemory (void)
         ReturnStatus = XPROG_ERR_TIMEOUT;
     }
 
-  Endpoint_Write_8 (CMD_XPROG);
-  Endpoint_Write_8 (XPROG_CMD_READ_MEM);
-  Endpoint_Write_8 (ReturnStatus);
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_READ_MEM);
+  V2Protocol_Write_8 (ReturnStatus);
 
   if (ReturnStatus == XPROG_ERR_OK)
-    Endpoint_Write_Stream_LE (ReadBuffer, ReadMemory_XPROG_Params.Length, NULL);
+    V2Protocol_WriteStream (ReadBuffer, ReadMemory_XPROG_Params.Length);
 
-  Endpoint_ClearIN ();
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the XPROG CRC command to read a specific memory space's CRC value for comparison between the
@@ -413,12 +437,9 @@ XPROGProtocol_ReadCRC (void)
     uint8_t CRCType;
   } ReadCRC_XPROG_Params;
 
-  Endpoint_Read_Stream_LE (&ReadCRC_XPROG_Params, sizeof(ReadCRC_XPROG_Params),
-                           NULL);
+  V2Protocol_ReadParams (&ReadCRC_XPROG_Params, sizeof(ReadCRC_XPROG_Params));
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
   uint32_t MemoryCRC;
 
@@ -450,17 +471,88 @@ XPROGProtocol_ReadCRC (void)
       ReturnStatus = XPROG_ERR_FAILED;
     }
 
-  Endpoint_Write_8 (CMD_XPROG);
-  Endpoint_Write_8 (XPROG_CMD_CRC);
-  Endpoint_Write_8 (ReturnStatus);
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_CRC);
+  V2Protocol_Write_8 (ReturnStatus);
 
   if (ReturnStatus == XPROG_ERR_OK)
     {
-      Endpoint_Write_8 (MemoryCRC >> 16);
-      Endpoint_Write_16_LE (MemoryCRC & 0xFFFF);
+      V2Protocol_Write_8 (MemoryCRC >> 16);
+      V2Protocol_Write_8 (MemoryCRC & 0xFF);
+      V2Protocol_Write_8 ((MemoryCRC >> 8) & 0xFF);
     }
 
-  Endpoint_ClearIN ();
+  V2Protocol_EndResponse ();
+}
+
+/** Handler for the vendor XPROG READ_MEM_CRC command, to read the CRC-32 (see \ref MemoryCRC_Update) of an address
+ *  range within the attached device. Unlike the CRC command this works for TPI devices, which have no CRC hardware
+ *  of their own, and for any range of a PDI device's memory.
+ */
+static void
+XPROGProtocol_ReadMemoryCRC (void)
+{
+  uint8_t ReturnStatus = XPROG_ERR_OK;
+
+  struct
+  {
+    uint8_t MemoryType;
+    uint32_t Address;
+    uint32_t Length;
+  } ReadMemoryCRC_XPROG_Params;
+
+  V2Protocol_ReadParams (&ReadMemoryCRC_XPROG_Params,
+                         sizeof(ReadMemoryCRC_XPROG_Params));
+  ReadMemoryCRC_XPROG_Params.Address = SwapEndian_32 (
+      ReadMemoryCRC_XPROG_Params.Address);
+  ReadMemoryCRC_XPROG_Params.Length = SwapEndian_32 (
+      ReadMemoryCRC_XPROG_Params.Length);
+  Trace_SetRange (ReadMemoryCRC_XPROG_Params.Address,
+                  MIN(ReadMemoryCRC_XPROG_Params.Length, UINT16_MAX));
+  Health_Count (HEALTH_BYTES_READ, ReadMemoryCRC_XPROG_Params.Length);
+
+  V2Protocol_BeginResponse ();
+
+  /* The range is read in chunks of all of the arena left */
+  uint16_t ReadBufferSize = BufferArena_Available ();
+  uint8_t* ReadBuffer = BufferArena_Alloc (ReadBufferSize);
+  uint32_t MemoryCRC = MEMORY_CRC_INITIAL;
+
+  while (ReadMemoryCRC_XPROG_Params.Length)
+    {
+      uint16_t ChunkLength = MIN(ReadMemoryCRC_XPROG_Params.Length, ReadBufferSize);
+      bool ReadOK;
+
+      if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
+        ReadOK = XMEGANVM_ReadMemory (ReadMemoryCRC_XPROG_Params.Address, ReadBuffer, ChunkLength);
+      else
+        ReadOK = TINYNVM_ReadMemory (ReadMemoryCRC_XPROG_Params.Address, ReadBuffer, ChunkLength);
+
+      /* Indicate timeout if occurred */
+      if (!(ReadOK))
+        {
+          ReturnStatus = XPROG_ERR_TIMEOUT;
+          break;
+        }
+
+      for (uint16_t CurrentByte = 0; CurrentByte < ChunkLength; CurrentByte++)
+        MemoryCRC = MemoryCRC_Update (MemoryCRC, ReadBuffer[CurrentByte]);
+
+      ReadMemoryCRC_XPROG_Params.Address += ChunkLength;
+      ReadMemoryCRC_XPROG_Params.Length -= ChunkLength;
+
+      /* Each chunk is read within its own command timeout, so that a range of any size may be checked */
+      TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+    }
+
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_READ_MEM_CRC);
+  V2Protocol_Write_8 (ReturnStatus);
+
+  if (ReturnStatus == XPROG_ERR_OK)
+    V2Protocol_Write_32_BE (MemoryCRC ^ MEMORY_CRC_FINAL_XOR);
+
+  V2Protocol_EndResponse ();
 }
 
 /** Handler for the XPROG SET_PARAM command to set a XPROG parameter for use when communicating with the
@@ -471,42 +563,40 @@ XPROGProtocol_SetParam (void)
 {
   uint8_t ReturnStatus = XPROG_ERR_OK;
 
-  uint8_t XPROGParam = Endpoint_Read_8 ();
+  uint8_t XPROGParam = V2Protocol_Read_8 ();
 
   /* Determine which parameter is being set, store the new parameter value */
   switch (XPROGParam)
     {
     case XPROG_PARAM_NVMBASE:
-      XPROG_Param_NVMBase = Endpoint_Read_32_BE ();
+      XPROG_Param_NVMBase = V2Protocol_Read_32_BE ();
       break;
     case XPROG_PARAM_EEPPAGESIZE:
-      XPROG_Param_EEPageSize = Endpoint_Read_16_BE ();
+      XPROG_Param_EEPageSize = V2Protocol_Read_16_BE ();
       break;
     case XPROG_PARAM_NVMCMD_REG:
-      XPROG_Param_NVMCMDRegAddr = Endpoint_Read_8 ();
+      XPROG_Param_NVMCMDRegAddr = V2Protocol_Read_8 ();
       break;
     case XPROG_PARAM_NVMCSR_REG:
-      XPROG_Param_NVMCSRRegAddr = Endpoint_Read_8 ();
+      XPROG_Param_NVMCSRRegAddr = V2Protocol_Read_8 ();
       break;
     case XPROG_PARAM_UNKNOWN_1:
       /* TODO: Undocumented parameter added in AVRStudio 5.1, purpose unknown. Must ACK and discard or
        the communication with AVRStudio 5.1 will fail.
        */
-      Endpoint_Discard_16 ();
+      V2Protocol_Read_16_BE ();
       break;
     default:
       ReturnStatus = XPROG_ERR_FAILED;
       break;
     }
 
-  Endpoint_ClearOUT ();
-  Endpoint_SelectEndpoint (AVRISP_DATA_IN_EPADDR);
-  Endpoint_SetEndpointDirection (ENDPOINT_DIR_IN);
+  V2Protocol_BeginResponse ();
 
-  Endpoint_Write_8 (CMD_XPROG);
-  Endpoint_Write_8 (XPROG_CMD_SET_PARAM);
-  Endpoint_Write_8 (ReturnStatus);
-  Endpoint_ClearIN ();
+  V2Protocol_Write_8 (CMD_XPROG);
+  V2Protocol_Write_8 (XPROG_CMD_SET_PARAM);
+  V2Protocol_Write_8 (ReturnStatus);
+  V2Protocol_EndResponse ();
 }
 
 #endif
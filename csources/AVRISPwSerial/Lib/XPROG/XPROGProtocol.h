@@ -44,6 +44,7 @@
 #include <LUFA/Drivers/USB/USB.h>
 
 #include "../V2Protocol.h"
+#include "../MemoryCRC.h"
 #include "XMEGANVM.h"
 #include "TINYNVM.h"
 #include "Config/AppConfig.h"
@@ -70,6 +71,9 @@
 #define XPROG_CMD_CRC                        0x06
 #define XPROG_CMD_SET_PARAM                  0x07
 
+/* Vendor extension commands, not part of the Atmel protocol: */
+#define XPROG_CMD_READ_MEM_CRC               0x0F
+
 #define XPROG_MEM_TYPE_APPL                  1
 #define XPROG_MEM_TYPE_BOOT                  2
 #define XPROG_MEM_TYPE_EEPROM                3
@@ -132,6 +136,7 @@ static void XPROGProtocol_Erase(void);
 static void XPROGProtocol_WriteMemory(void);
 static void XPROGProtocol_ReadMemory(void);
 static void XPROGProtocol_ReadCRC(void);
+static void XPROGProtocol_ReadMemoryCRC(void);
 #endif
 
 #endif
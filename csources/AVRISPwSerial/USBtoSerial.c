@@ -34,6 +34,7 @@
  *  the project and is responsible for the initial application hardware configuration.
  */
 
+#define  INCLUDE_FROM_USBTOSERIAL_C
 #include "USBtoSerial.h"
 
 /** Circular buffer to hold data from the host before it is sent to the device via the serial port. */
@@ -48,10 +49,22 @@ static RingBuffer_t USARTtoUSB_Buffer;
 /** Underlying data buffer for \ref USARTtoUSB_Buffer, where the stored bytes are located. */
 static uint8_t USARTtoUSB_Buffer_Data[128];
 
-/* Pulse generation counters to keep track of the time remaining for each pulse type */
+/* Pulse generation deadlines to keep track of the time remaining for each pulse type */
 #define TX_RX_LED_PULSE_PERIOD 100
-uint16_t TxLEDPulse = 0; // time remaining for Tx LED pulse
-uint16_t RxLEDPulse = 0; // time remaining for Rx LED pulse
+static bool TxLEDPulse = false; // Tx LED pulse in progress
+static bool RxLEDPulse = false; // Rx LED pulse in progress
+static Timebase_Time_t TxLEDPulseEnd; // end of the Tx LED pulse
+static Timebase_Time_t RxLEDPulseEnd; // end of the Rx LED pulse
+
+/** Flag to indicate that the serial bridge is serviced from the USB Start of Frame event, because the main loop is
+ *  blocked in a long running programmer command.
+ */
+static volatile bool SerialBackgroundTask;
+
+/** Flag to indicate that a programming session took over the USART or the target /RESET line, so the bridge must
+ *  restore them once the session has ended.
+ */
+static bool SerialHeldByProgrammer;
 
 /** LUFA CDC Class driver interface configuration and state information. This structure is
  *  passed to all CDC Class driver functions, so that multiple instances of the same class
@@ -71,18 +84,8 @@ void
 SetupSerialHardware (void)
 {
 
-  /* Initialize TIMER3 to handle LED tasks.
-   * With 16 MHz clock and 1/64 prescaler, timer 1 is clocked at 250 kHz
-   * Our chosen compare match generates an interrupt every 1 ms.
-   */
-  OCR3AH = 0;
-  OCR3AL = 250;
-  TIMSK3 = (1 << OCIE3A);     // enable timer 1 output compare A match interrupt
-  TCCR3B = ((1 << CS31) | (1 << CS30)); // 1/64 prescaler on timer 1 input
-  TCCR3A = 0;
-
-  /* Pull target /RESET line high */
-  AUX_LINE_DDR |= AUX_LINE_MASK;
+  /* Leave the target /RESET line tristated until the host opens the serial port and sets DTR */
+  AUX_LINE_DDR &= ~AUX_LINE_MASK;
   AUX_LINE_PORT &= ~AUX_LINE_MASK;
 
   RingBuffer_InitBuffer (&USBtoUSART_Buffer, USBtoUSART_Buffer_Data, sizeof(USBtoUSART_Buffer_Data));
@@ -90,9 +93,36 @@ SetupSerialHardware (void)
 
 }
 
+/** Restores the USART configuration and the target /RESET line state requested by the host, after a programming
+ *  session has released them.
+ */
+static void
+Serial_ResumeBridge (void)
+{
+  /* Leave the target running if the host never opened the serial port */
+  if (!(VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS))
+    return;
+
+  EVENT_CDC_Device_LineEncodingChanged (&VirtualSerial_CDC_Interface);
+  EVENT_CDC_Device_ControLineStateChanged (&VirtualSerial_CDC_Interface);
+}
+
+/** Moves data between the CDC interface and the USART. The bytes from the host are held in the ring buffer
+ *  while a programming session owns the target, as the USART may be in use as the PDI/TPI bus.
+ */
 void
 Serial_Task (void)
 {
+  if (TargetInProgMode)
+    {
+      SerialHeldByProgrammer = true;
+    }
+  else if (SerialHeldByProgrammer)
+    {
+      SerialHeldByProgrammer = false;
+      Serial_ResumeBridge ();
+    }
+
   /* Only try to read in bytes from the CDC interface if the transmit buffer is not full */
   if (!(RingBuffer_IsFull (&USBtoUSART_Buffer)))
     {
@@ -102,7 +132,8 @@ Serial_Task (void)
       if (!(ReceivedByte < 0))
         {
           LEDs_TurnOnLEDs(LEDMASK_TX);
-          TxLEDPulse = TX_RX_LED_PULSE_PERIOD;
+          TxLEDPulse = true;
+          TxLEDPulseEnd = Timebase_Deadline (TIMEBASE_MS(TX_RX_LED_PULSE_PERIOD));
           RingBuffer_Insert (&USBtoUSART_Buffer, ReceivedByte);
         }
     }
@@ -111,7 +142,8 @@ Serial_Task (void)
   if (BufferCount)
     {
       LEDs_TurnOnLEDs(LEDMASK_RX);
-      RxLEDPulse = TX_RX_LED_PULSE_PERIOD;
+      RxLEDPulse = true;
+      RxLEDPulseEnd = Timebase_Deadline (TIMEBASE_MS(TX_RX_LED_PULSE_PERIOD));
 
       Endpoint_SelectEndpoint (VirtualSerial_CDC_Interface.Config.DataINEndpoint.Address);
 
@@ -139,20 +171,63 @@ Serial_Task (void)
     }
 
   /* Load the next byte from the USART transmit buffer into the USART if transmit buffer space is available */
-  if (Serial_IsSendReady () && !(RingBuffer_IsEmpty (&USBtoUSART_Buffer)))
+  if (!(SerialHeldByProgrammer) && Serial_IsSendReady () && !(RingBuffer_IsEmpty (&USBtoUSART_Buffer)))
     Serial_SendByte (RingBuffer_Remove (&USBtoUSART_Buffer));
 
+  /* Check whether the TX or RX LED one-shot period has elapsed.  if so, turn off the LED */
+  if (TxLEDPulse && Timebase_HasExpired (TxLEDPulseEnd))
+    {
+      TxLEDPulse = false;
+      LEDs_TurnOffLEDs(LEDMASK_TX);
+    }
+
+  if (RxLEDPulse && Timebase_HasExpired (RxLEDPulseEnd))
+    {
+      RxLEDPulse = false;
+      LEDs_TurnOffLEDs(LEDMASK_RX);
+    }
+
   CDC_Device_USBTask (&VirtualSerial_CDC_Interface);
 }
 
 
+/** Selects whether the serial bridge is serviced from the USB Start of Frame event. The AVRISP task enables it
+ *  around each programmer command, so the target console keeps flowing while the main loop is blocked.
+ *
+ *  \param[in] Enable  Boolean true to service the bridge once per USB frame, false to leave it to the main loop
+ */
+void
+Serial_SetBackgroundTask (const bool Enable)
+{
+  SerialBackgroundTask = Enable;
+}
+
 /** Event handler for the library USB Configuration Changed event. */
 bool
 EVENT_Serial_Device_ConfigurationChanged (void)
 {
+  USB_Device_EnableSOFEvents ();
+
   return CDC_Device_ConfigureEndpoints (&VirtualSerial_CDC_Interface);
 }
 
+/** Event handler for the library USB Start of Frame event, raised every millisecond from the USB interrupt. While
+ *  a programmer command is running the serial bridge is serviced from here; the programmer's selected endpoint is
+ *  restored afterwards, as the interrupted command is in the middle of an endpoint transfer.
+ */
+void
+EVENT_USB_Device_StartOfFrame (void)
+{
+  if (!(SerialBackgroundTask))
+    return;
+
+  uint8_t PrevSelectedEndpoint = Endpoint_GetCurrentEndpoint ();
+
+  Serial_Task ();
+
+  Endpoint_SelectEndpoint (PrevSelectedEndpoint);
+}
+
 /** Event handler for the library USB Control Request reception event. */
 void
 EVENT_USB_Device_ControlRequest (void)
@@ -180,6 +255,10 @@ EVENT_CDC_Device_LineEncodingChanged (USB_ClassInfo_CDC_Device_t* const CDCInter
 {
   uint8_t ConfigMask = 0;
 
+  /* The new encoding is applied by Serial_ResumeBridge() once the programming session has ended */
+  if (TargetInProgMode)
+    return;
+
   switch (CDCInterfaceInfo->State.LineEncoding.ParityType)
     {
     case CDC_PARITY_Odd:
@@ -234,6 +313,12 @@ void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const C
 {
  bool CurrentDTRState = (CDCInterfaceInfo->State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_DTR);
 
+ /* The programmer drives the target /RESET line during a session, the DTR state is applied when it ends */
+ if (TargetInProgMode)
+   return;
+
+ AUX_LINE_DDR |= AUX_LINE_MASK;
+
  if (CurrentDTRState)
    {
      AUX_LINE_PORT |= AUX_LINE_MASK;
@@ -244,17 +329,3 @@ void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const C
    }
 }
 
-//uint16_t ctr = 0;
-ISR(TIMER3_COMPA_vect, ISR_BLOCK)
-{
-  /* Reset counter */
-  TCNT3H = 0;
-  TCNT3L = 0;
-
-  /* Check whether the TX or RX LED one-shot period has elapsed.  if so, turn off the LED */
-  if (TxLEDPulse && !(--TxLEDPulse))
-    LEDs_TurnOffLEDs(LEDMASK_TX);
-  if (RxLEDPulse && !(--RxLEDPulse))
-    LEDs_TurnOffLEDs(LEDMASK_RX);
-}
-
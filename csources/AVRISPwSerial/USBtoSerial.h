@@ -43,6 +43,8 @@
 #include <avr/power.h>
 
 #include "Descriptors.h"
+#include "Lib/Timebase.h"
+#include "Lib/V2Protocol.h"
 
 #include <LUFA/Drivers/Board/LEDs.h>
 #include <LUFA/Drivers/Peripheral/Serial.h>
@@ -56,14 +58,25 @@ SetupSerialHardware (void);
 
 void
 Serial_Task (void);
+void
+Serial_SetBackgroundTask (const bool Enable);
 
 bool
 EVENT_Serial_Device_ConfigurationChanged (void);
 void
 EVENT_USB_Device_ControlRequest (void);
 
+void
+EVENT_USB_Device_StartOfFrame (void);
+
 void
 EVENT_CDC_Device_LineEncodingChanged (USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+void
+EVENT_CDC_Device_ControLineStateChanged (USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+
+#if defined(INCLUDE_FROM_USBTOSERIAL_C)
+static void Serial_ResumeBridge(void);
+#endif
 
 #endif
 
@@ -38,12 +38,6 @@
 #include "USBtoSerial.h"
 
 
-uint8_t activeConfig __attribute__ ((section (".noinit")));
-
-void
-SelectConfiguration(void);
-
-
 //#if (BOARD != BOARD_NONE)
 ///* Some board hardware definitions (e.g. the Arduino Micro) have their LEDs defined on the same pins
 // as the ISP, PDI or TPI interfaces (see the accompanying project documentation). If a board other
@@ -62,25 +56,29 @@ main (void)
 {
   SetupHardware ();
 
+#if defined(ENABLE_STANDALONE_MODE)
+  Standalone_Init ();
+#endif
+
 #ifdef SERIAL_ENABLE
-  if (activeConfig)
-    SetupSerialHardware();
-  else
+  SetupSerialHardware ();
 #endif
-    V2Protocol_Init ();
+  V2Protocol_Init ();
 
   LEDs_SetAllLEDs (LEDMASK_USB_NOTREADY);
   GlobalInterruptEnable ();
 
   for (;;)
     {
+      AVRISP_Task ();
 
 #ifdef SERIAL_ENABLE
-  if (activeConfig)
-    Serial_Task();
-  else
+      Serial_Task ();
+#endif
+
+#if defined(ENABLE_STANDALONE_MODE)
+      Standalone_Task ();
 #endif
-    AVRISP_Task ();
 
       USB_USBTask ();
     }
@@ -99,10 +97,9 @@ SetupHardware (void)
   clock_prescale_set (clock_div_1);
 #endif
 
-  SelectConfiguration();
-
   /* Hardware Initialization */
   LEDs_Init ();
+  Timebase_Init ();
 
   /* USB Stack Initialization */
   USB_Init ();
@@ -128,48 +125,13 @@ EVENT_USB_Device_ConfigurationChanged (void)
 {
   bool ConfigSuccess = true;
 
+  /* Endpoints are configured in ascending order, the AVRISP data endpoint first */
+  ConfigSuccess &= EVENT_AVRISP_Device_ConfigurationChanged();
+
 #ifdef SERIAL_ENABLE
-  if (activeConfig)
-    ConfigSuccess &= EVENT_Serial_Device_ConfigurationChanged();
-  else
+  ConfigSuccess &= EVENT_Serial_Device_ConfigurationChanged();
 #endif
 
-  /* Setup AVRISP Data OUT endpoint */
-    ConfigSuccess &= EVENT_AVRISP_Device_ConfigurationChanged();
-
   /* Indicate endpoint configuration success or failure */
   LEDs_SetAllLEDs (ConfigSuccess ? LEDMASK_USB_READY : LEDMASK_USB_ERROR);
 }
-
-void
-SelectConfiguration(void)
-{
-  activeConfig = (activeConfig + 1) & 1;
-}
-
-/** This function is called by the library when in device mode, and must be overridden (see library "USB Descriptors"
- *  documentation) by the application code so that the address and size of a requested descriptor can be given
- *  to the USB library. When the device receives a Get Descriptor request on the control endpoint, this function
- *  is called so that the descriptor details can be passed back and the appropriate descriptor sent back to the
- *  USB host.
- *
- *  \param[in]  wValue                 Descriptor type and index to retrieve
- *  \param[in]  wIndex                 Sub-index to retrieve (such as a localized string language)
- *  \param[out] DescriptorAddress      Address of the retrieved descriptor
- *
- *  \return Length of the retrieved descriptor in bytes, or NO_DESCRIPTOR if the descriptor was not found
- */
-uint16_t
-CALLBACK_USB_GetDescriptor (const uint16_t wValue, const uint16_t wIndex,
-                            const void** const DescriptorAddress)
-{
-
-#ifdef SERIAL_ENABLE
-  if (activeConfig)
-    return Serial_GetDescriptor(wValue, wIndex, DescriptorAddress);
-  else
-#endif
-
-  return AVRISP_GetDescriptor (wValue, wIndex, DescriptorAddress);
-}
-